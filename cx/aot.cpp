@@ -0,0 +1,615 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <cmath>
+#include <codecvt>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <locale>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+#include "aot.h"
+#include "error.h"
+#include "optimizer.h"
+
+namespace cx {
+	namespace aot_settings {
+		bool emit_source = false;
+		bool compile = false;
+		std::wstring output_name;
+	}
+
+#if defined _WIN32
+	static const std::wstring &file_path(const std::wstring &file_name) { return file_name; }
+	static int run_command(const std::wstring &command) { return _wsystem(command.c_str()); }
+#else
+	static std::string file_path(const std::wstring &file_name) {
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		return converter.to_bytes(file_name);
+	}
+
+	static int run_command(const std::wstring &command) { return std::system(file_path(command).c_str()); }
+#endif
+
+	static bool file_exists(const std::wstring &file_name) {
+		return std::ifstream(file_path(file_name)).good();
+	}
+
+	/** quote           A file name as one argument of a shell command.
+	 *
+	 * @param file_name : file name.
+	 * @param quoted    : set to the argument.
+	 * @return false if cmd can't be given the name safely.
+	 */
+	static bool quote(const std::wstring &file_name, std::wstring &quoted) {
+		// a leading '-' would read as an option
+		const std::wstring name = ((file_name.size() > 0) && (file_name[0] == L'-')) ? L"./" + file_name : file_name;
+
+#if defined _WIN32
+		// cmd expands %VAR% even inside quotes, and a name can't hold '"'
+		if (name.find_first_of(L"\"%") != std::wstring::npos) return false;
+		quoted = L"\"" + name + L"\"";
+#else
+		quoted = L"'";
+		for (wchar_t c : name) {
+			if (c == L'\'') quoted += L"'\\''";
+			else quoted += c;
+		}
+		quoted += L"'";
+#endif
+		return true;
+	}
+
+	namespace aot {
+		/* What every generated file starts with, after the cx_real
+		 * typedef: the value union the VM uses and the array helpers.
+		 * An array is a raw buffer with its highest index in the 16
+		 * bytes in front, where a checked access finds it. */
+		static const char *prelude =
+			"typedef long long cx_int;\n"
+			"typedef bool cx_bool;\n"
+			"typedef wchar_t cx_char;\n"
+			"typedef uint8_t cx_byte;\n"
+			"\n"
+			"union cx_value {\n"
+			"\tcx_bool z;\n"
+			"\tcx_byte b;\n"
+			"\tcx_char c;\n"
+			"\tcx_int i;\n"
+			"\tcx_real d;\n"
+			"\tvoid *a;\n"
+			"\n"
+			"\tcx_value() { std::memset(this, 0, sizeof(*this)); }\n"
+			"};\n"
+			"\n"
+			"static void *cx_new_array(size_t size, cx_int max_index) {\n"
+			"\tcx_int *p_block = static_cast<cx_int *>(std::malloc(2 * sizeof(cx_int) + size));\n"
+			"\tif (p_block == nullptr) throw std::runtime_error(\"[ malloc ] out of memory\");\n"
+			"\n"
+			"\tp_block[0] = max_index;\n"
+			"\treturn p_block + 2;\n"
+			"}\n"
+			"\n"
+			"static void cx_delete(void *mem) {\n"
+			"\tif (mem != nullptr) std::free(static_cast<cx_int *>(mem) - 2);\n"
+			"}\n"
+			"\n"
+			"static void *cx_check(void *mem, cx_int index, const char *name) {\n"
+			"\tif ((mem == nullptr) || (index > static_cast<cx_int *>(mem)[-2]) || (index < 0)) {\n"
+			"\t\tthrow std::runtime_error(std::string(\"index out of bounds: \") + name + \"[\" + std::to_string(index) + \"]\");\n"
+			"\t}\n"
+			"\n"
+			"\treturn mem;\n"
+			"}\n"
+			"\n";
+
+		// Thrown on code with no C++ translation
+		struct untranslatable {
+			std::wstring why;
+		};
+
+		/** identifier      A Cx name as a C++ identifier: hidden
+		 *                  locals have a '$' in theirs.
+		 */
+		static std::string identifier(const std::wstring &name) {
+			std::string id;
+
+			for (wchar_t c : name) {
+				if (((c >= L'a') && (c <= L'z')) || ((c >= L'A') && (c <= L'Z')) ||
+					((c >= L'0') && (c <= L'9')) || (c == L'_')) id += static_cast<char>(c);
+				else id += '_';
+			}
+
+			return id;
+		}
+
+		static std::string int_literal(cx_int v) {
+			if (v == std::numeric_limits<cx_int>::min()) return "(-9223372036854775807LL - 1)";
+			return std::to_string(v) + "LL";
+		}
+
+		static std::string real_literal(cx_real v) {
+			if (std::isnan(v)) return "std::numeric_limits<cx_real>::quiet_NaN()";
+			if (std::isinf(v)) return v < 0 ? "-std::numeric_limits<cx_real>::infinity()" : "std::numeric_limits<cx_real>::infinity()";
+
+			std::ostringstream literal;
+			literal << std::setprecision(std::numeric_limits<cx_real>::max_digits10) << v;
+
+			std::string text = literal.str();
+			if (text.find_first_of(".e") == std::string::npos) text += ".0";
+			if (sizeof(cx_real) != sizeof(double)) text += "L";
+
+			return text;
+		}
+
+		/** stack_depths    Operand stack depth before each instruction.
+		 *
+		 * @param code      : function's program.
+		 * @param depth     : set to the depth, -1 where unreachable.
+		 * @param max_depth : set to the deepest stack.
+		 * @return false if an instruction's stack effect is unknown or
+		 *          the depth at some instruction differs by path.
+		 */
+		static bool stack_depths(const program &code, std::vector<int> &depth, int &max_depth) {
+			const int count = static_cast<int>(code.size());
+			depth.assign(count, -1);
+			max_depth = 0;
+
+			std::vector<int> work;
+			if (count > 0) {
+				depth[0] = 0;
+				work.push_back(0);
+			}
+
+			auto reach = [&](int index, int d) {
+				if (index == count) return true;
+				if ((index < 0) || (index > count)) return false;
+				if (depth[index] == -1) {
+					depth[index] = d;
+					work.push_back(index);
+					return true;
+				}
+				return depth[index] == d;
+			};
+
+			while (!work.empty()) {
+				const int index = work.back();
+				work.pop_back();
+
+				const inst &instruction = code[index];
+				int pops = 0, pushes = 0;
+
+				if (instruction.op == CALL) {
+					const symbol_table_node *p_callee = static_cast<const symbol_table_node *>(instruction.arg0.a_);
+					pops = static_cast<int>(p_callee->defined.routine.p_parameter_ids.size());
+					pushes = (p_callee->p_type->typecode == T_VOID) ? 0 : 1;
+				}
+				else if (!optimizer::stack_effect(instruction, pops, pushes)) {
+					return false;
+				}
+
+				if (depth[index] < pops) return false;
+
+				const int next = depth[index] - pops + pushes;
+				max_depth = std::max(max_depth, std::max(next, depth[index]));
+
+				if (optimizer::is_jump(instruction.op) &&
+					!reach(optimizer::jump_target(instruction), next)) return false;
+
+				if ((instruction.op != GOTO) && (instruction.op != RETURN) &&
+					!reach(index + 1, next)) return false;
+			}
+
+			return true;
+		}
+
+		/** cpp_translator  Writes the functions a program reaches,
+		 *                  then the program itself as cx_main.
+		 */
+		class cpp_translator {
+			std::ostream &out;
+			std::set<std::string> used_names;
+			std::map<const symbol_table_node *, std::string> globals;
+			std::map<const symbol_table_node *, std::string> function_names;
+			std::map<const symbol_table_node *, std::string> parameter_names;
+			std::vector<symbol_table_node *> functions;
+
+			// names of what the function being written can see
+			std::map<const symbol_table_node *, std::string> scope;
+			const symbol_table_node *p_current;
+
+			std::string unique_name(const std::string &prefix, const std::wstring &name) {
+				std::string id = prefix + identifier(name);
+				for (int n = 2; used_names.count(id) != 0; ++n) id = prefix + identifier(name) + "_" + std::to_string(n);
+
+				used_names.insert(id);
+				return id;
+			}
+
+			// every function the code reaches, compiling lazy bodies
+			void collect(symbol_table_node *p_function_id) {
+				if (function_names.count(p_function_id) != 0) return;
+
+				if (p_function_id->defined.routine.p_lazy_body != nullptr) compile_function_body(p_function_id);
+
+				function_names[p_function_id] = unique_name("f_", p_function_id->node_name);
+				functions.push_back(p_function_id);
+
+				for (auto &instruction : p_function_id->defined.routine.program_code) {
+					if (instruction.op == CALL) collect(static_cast<symbol_table_node *>(instruction.arg0.a_));
+				}
+			}
+
+			std::string variable(const inst &instruction) {
+				const symbol_table_node *p_node = static_cast<const symbol_table_node *>(instruction.arg0.a_);
+
+				auto name = scope.find(p_node);
+				if (name == scope.end()) {
+					throw untranslatable{ p_current->node_name + L": uses " + p_node->node_name + L" of an enclosing function" };
+				}
+
+				return name->second;
+			}
+
+			// the Cx name of an array, for bounds errors
+			static std::string array_name(const inst &instruction) {
+				return "\"" + identifier(static_cast<const symbol_table_node *>(instruction.arg0.a_)->node_name) + "\"";
+			}
+
+			static std::string s(int slot) { return "s" + std::to_string(slot); }
+
+			void line(const std::string &text) { out << "\t" << text << ";\n"; }
+
+			void signature(const symbol_table_node *p_function_id) {
+				out << "static cx_value " << function_names[p_function_id] << "(";
+
+				const auto &parameters = p_function_id->defined.routine.p_parameter_ids;
+				for (size_t i = 0; i < parameters.size(); ++i) {
+					if (i > 0) out << ", ";
+					out << "cx_value " << parameter_names[parameters[i].get()];
+				}
+
+				if (parameters.empty()) out << "void";
+				out << ")";
+			}
+
+			void array_load(const inst &instruction, int d, const char *member, const char *type) {
+				line(s(d - 2) + "." + member + " = static_cast<" + type + " *>(cx_check(" + s(d - 2) + ".a, " +
+					s(d - 1) + ".i, " + array_name(instruction) + "))[" + s(d - 1) + ".i]");
+			}
+
+			void array_store(const inst &instruction, int d, const char *member, const char *type) {
+				line("static_cast<" + std::string(type) + " *>(cx_check(" + variable(instruction) + ".a, " + s(d - 2) +
+					".i, " + array_name(instruction) + "))[" + s(d - 2) + ".i] = " + s(d - 1) + "." + member);
+			}
+
+			void binary(int d, const char *member, const char *op) {
+				line(s(d - 2) + "." + member + " = " + s(d - 2) + "." + member + " " + op + " " + s(d - 1) + "." + member);
+			}
+
+			// relational operators leave a cx_int, as _REL_OP does
+			void relation(int d, const char *member, const char *op) {
+				line(s(d - 2) + ".i = " + s(d - 2) + "." + member + " " + op + " " + s(d - 1) + "." + member);
+			}
+
+			void instruction(const inst &instruction, int d) {
+				switch (instruction.op) {
+				case AALOAD: case ALOAD: case PLOAD: line(s(d) + ".a = " + variable(instruction) + ".a"); break;
+				case AASTORE: case ASTORE: line(variable(instruction) + ".a = " + s(d - 1) + ".a"); break;
+				case ACONST_NULL: line(s(d) + ".a = nullptr"); break;
+				case AINC:
+					line(variable(instruction) + ".a = static_cast<char *>(" + variable(instruction) + ".a) + " + int_literal(instruction.arg1.i_));
+					break;
+				case APTR:
+					line(variable(instruction) + ".a = static_cast<char *>(" + s(d - 1) + ".a) + " + int_literal(instruction.arg1.i_));
+					break;
+				case VM_THROW: line("throw std::runtime_error(static_cast<const char *>(" + s(d - 1) + ".a))"); break;
+
+				case B2I: line(s(d - 1) + ".i = static_cast<cx_int>(" + s(d - 1) + ".b)"); break;
+				case C2I: line(s(d - 1) + ".i = static_cast<cx_int>(" + s(d - 1) + ".c)"); break;
+				case D2I: line(s(d - 1) + ".i = static_cast<cx_int>(" + s(d - 1) + ".d)"); break;
+				case I2B: line(s(d - 1) + ".b = static_cast<cx_byte>(" + s(d - 1) + ".i)"); break;
+				case I2C: line(s(d - 1) + ".c = static_cast<cx_char>(" + s(d - 1) + ".i)"); break;
+				case I2D: line(s(d - 1) + ".d = static_cast<cx_real>(" + s(d - 1) + ".i)"); break;
+
+				case BALOAD: array_load(instruction, d, "b", "cx_byte"); break;
+				case CALOAD: array_load(instruction, d, "c", "cx_char"); break;
+				case DALOAD: array_load(instruction, d, "d", "cx_real"); break;
+				case IALOAD: array_load(instruction, d, "i", "cx_int"); break;
+				case BASTORE: array_store(instruction, d, "b", "cx_byte"); break;
+				case CASTORE: array_store(instruction, d, "c", "cx_char"); break;
+				case DASTORE: array_store(instruction, d, "d", "cx_real"); break;
+				case IASTORE: array_store(instruction, d, "i", "cx_int"); break;
+				case BALOAD_U: line(s(d - 2) + ".b = static_cast<cx_byte *>(" + s(d - 2) + ".a)[" + s(d - 1) + ".i]"); break;
+				case CALOAD_U: line(s(d - 2) + ".c = static_cast<cx_char *>(" + s(d - 2) + ".a)[" + s(d - 1) + ".i]"); break;
+				case DALOAD_U: line(s(d - 2) + ".d = static_cast<cx_real *>(" + s(d - 2) + ".a)[" + s(d - 1) + ".i]"); break;
+				case IALOAD_U: line(s(d - 2) + ".i = static_cast<cx_int *>(" + s(d - 2) + ".a)[" + s(d - 1) + ".i]"); break;
+				case BASTORE_U: line("static_cast<cx_byte *>(" + variable(instruction) + ".a)[" + s(d - 2) + ".i] = " + s(d - 1) + ".b"); break;
+				case CASTORE_U: line("static_cast<cx_char *>(" + variable(instruction) + ".a)[" + s(d - 2) + ".i] = " + s(d - 1) + ".c"); break;
+				case DASTORE_U: line("static_cast<cx_real *>(" + variable(instruction) + ".a)[" + s(d - 2) + ".i] = " + s(d - 1) + ".d"); break;
+				case IASTORE_U: line("static_cast<cx_int *>(" + variable(instruction) + ".a)[" + s(d - 2) + ".i] = " + s(d - 1) + ".i"); break;
+				case BALOAD_P: line(s(d) + ".b = *static_cast<cx_byte *>(" + variable(instruction) + ".a)"); break;
+				case CALOAD_P: line(s(d) + ".c = *static_cast<cx_char *>(" + variable(instruction) + ".a)"); break;
+				case DALOAD_P: line(s(d) + ".d = *static_cast<cx_real *>(" + variable(instruction) + ".a)"); break;
+				case IALOAD_P: line(s(d) + ".i = *static_cast<cx_int *>(" + variable(instruction) + ".a)"); break;
+				case BASTORE_P: line("*static_cast<cx_byte *>(" + variable(instruction) + ".a) = " + s(d - 1) + ".b"); break;
+				case CASTORE_P: line("*static_cast<cx_char *>(" + variable(instruction) + ".a) = " + s(d - 1) + ".c"); break;
+				case DASTORE_P: line("*static_cast<cx_real *>(" + variable(instruction) + ".a) = " + s(d - 1) + ".d"); break;
+				case IASTORE_P: line("*static_cast<cx_int *>(" + variable(instruction) + ".a) = " + s(d - 1) + ".i"); break;
+
+				case CALL: {
+					const symbol_table_node *p_callee = static_cast<const symbol_table_node *>(instruction.arg0.a_);
+					const int count = static_cast<int>(p_callee->defined.routine.p_parameter_ids.size());
+
+					std::string call = function_names[p_callee] + "(";
+					for (int i = 0; i < count; ++i) call += (i > 0 ? ", " : "") + s(d - count + i);
+					call += ")";
+
+					if (p_callee->p_type->typecode == T_VOID) line(call);
+					else line(s(d - count) + " = " + call);
+				} break;
+
+				case DADD: binary(d, "d", "+"); break;
+				case DSUB: binary(d, "d", "-"); break;
+				case DMUL: binary(d, "d", "*"); break;
+				case DDIV: binary(d, "d", "/"); break;
+				case DREM: line(s(d - 2) + ".d = std::fmod(" + s(d - 2) + ".d, " + s(d - 1) + ".d)"); break;
+				case DEQ: relation(d, "d", "=="); break;
+				case DNOT_EQ: relation(d, "d", "!="); break;
+				case DLT: relation(d, "d", "<"); break;
+				case DLT_EQ: relation(d, "d", "<="); break;
+				case DGT: relation(d, "d", ">"); break;
+				case DGT_EQ: relation(d, "d", ">="); break;
+				case DNEG: line(s(d - 1) + ".d = -std::abs(" + s(d - 1) + ".d)"); break;
+				case DPOS: line(s(d - 1) + ".d = std::abs(" + s(d - 1) + ".d)"); break;
+				case DCONST: line(s(d) + ".d = " + real_literal(instruction.arg0.d_)); break;
+				case DINC: line(variable(instruction) + ".d += " + real_literal(instruction.arg1.d_)); break;
+				case DLOAD: line(s(d) + ".d = " + variable(instruction) + ".d"); break;
+				case DSTORE: line(variable(instruction) + ".d = " + s(d - 1) + ".d"); break;
+				case DEL: line("cx_delete(" + variable(instruction) + ".a)"); break;
+
+				case IADD: binary(d, "i", "+"); break;
+				case ISUB: binary(d, "i", "-"); break;
+				case IMUL: binary(d, "i", "*"); break;
+				case IDIV: binary(d, "i", "/"); break;
+				case IREM: binary(d, "i", "%"); break;
+				case IAND: binary(d, "i", "&"); break;
+				case IOR: binary(d, "i", "|"); break;
+				case IXOR: binary(d, "i", "^"); break;
+				case ISHL: binary(d, "i", "<<"); break;
+				case ISHR: binary(d, "i", ">>"); break;
+				case IEQ: relation(d, "i", "=="); break;
+				case INOT_EQ: relation(d, "i", "!="); break;
+				case ILT: relation(d, "i", "<"); break;
+				case ILT_EQ: relation(d, "i", "<="); break;
+				case IGT: relation(d, "i", ">"); break;
+				case IGT_EQ: relation(d, "i", ">="); break;
+				case BEQ: relation(d, "b", "=="); break;
+				case ZEQ: relation(d, "z", "=="); break;
+				case INEG: line(s(d - 1) + ".i = -std::abs(" + s(d - 1) + ".i)"); break;
+				case IPOS: line(s(d - 1) + ".i = std::abs(" + s(d - 1) + ".i)"); break;
+				case INOT: line(s(d - 1) + ".i = ~" + s(d - 1) + ".i"); break;
+				case ICONST: line(s(d) + ".i = " + int_literal(instruction.arg0.i_)); break;
+				case IINC: line(variable(instruction) + ".i += " + int_literal(instruction.arg1.i_)); break;
+				case ILOAD: line(s(d) + ".i = " + variable(instruction) + ".i"); break;
+				case ISTORE: line(variable(instruction) + ".i = " + s(d - 1) + ".i"); break;
+
+				case LOGIC_AND: binary(d, "z", "&&"); break;
+				case LOGIC_OR: binary(d, "z", "||"); break;
+				case LOGIC_NOT: line(s(d - 1) + ".z = !" + s(d - 1) + ".i"); break;
+
+				case GOTO: line("goto L" + std::to_string(optimizer::jump_target(instruction))); break;
+				case IF_FALSE:
+					line("if (!" + s(d - 1) + ".z) goto L" + std::to_string(optimizer::jump_target(instruction)));
+					break;
+				case RETURN: line("return result"); break;
+
+				case NEWARRAY: {
+					const cx_type *p_type = static_cast<const cx_type *>(instruction.arg0.a_);
+					line(s(d - 1) + ".a = cx_new_array(" + std::to_string(p_type->size) + ", " +
+						int_literal(p_type->array.max_index) + ")");
+				} break;
+
+				case CHECKCAST: case NOP: case POP: case POP2: case VLOOP:
+					break;
+				default:
+					throw untranslatable{ p_current->node_name + L": no C++ for " + opcode_string[instruction.op] };
+				}
+			}
+
+			void function(const symbol_table_node *p_function_id, bool is_program) {
+				const auto &routine = p_function_id->defined.routine;
+				const program &code = routine.program_code;
+
+				p_current = p_function_id;
+				scope = globals;
+				scope[p_function_id] = "result";
+				for (auto &p_parameter : routine.p_parameter_ids) scope[p_parameter.get()] = parameter_names[p_parameter.get()];
+				if (!is_program) {
+					for (auto &p_local : routine.p_variable_ids) scope[p_local.get()] = unique_name("l_", p_local->node_name);
+				}
+
+				std::vector<int> depth;
+				int max_depth = 0;
+				if (!stack_depths(code, depth, max_depth)) {
+					throw untranslatable{ p_function_id->node_name + L": operand stack differs between paths" };
+				}
+
+				std::vector<bool> is_target(code.size() + 1, false);
+				for (size_t pc = 0; pc < code.size(); ++pc) {
+					if ((depth[pc] >= 0) && optimizer::is_jump(code[pc].op)) is_target[optimizer::jump_target(code[pc])] = true;
+				}
+
+				if (is_program) out << "static cx_value cx_main(void)";
+				else signature(p_function_id);
+				out << " {\n\tcx_value result;\n";
+
+				if (!is_program) {
+					for (auto &p_local : routine.p_variable_ids) out << "\tcx_value " << scope[p_local.get()] << ";\n";
+				}
+
+				for (int slot = 0; slot < max_depth; ++slot) out << "\tcx_value " << s(slot) << ";\n";
+				out << "\n";
+
+				for (size_t pc = 0; pc < code.size(); ++pc) {
+					if (is_target[pc]) out << "L" << pc << ":\n";
+					if (depth[pc] >= 0) instruction(code[pc], depth[pc]);
+				}
+
+				if (is_target[code.size()]) out << "L" << code.size() << ":\n";
+				out << "\treturn result;\n}\n\n";
+			}
+
+		public:
+			cpp_translator(std::ostream &out_) : out(out_), p_current(nullptr) {}
+
+			void translate(const symbol_table_node_ptr &p_program_id) {
+				for (auto &p_global : p_program_id->defined.routine.p_variable_ids) {
+					globals[p_global.get()] = unique_name("g_", p_global->node_name);
+				}
+
+				for (auto &instruction : p_program_id->defined.routine.program_code) {
+					if (instruction.op == CALL) collect(static_cast<symbol_table_node *>(instruction.arg0.a_));
+				}
+
+				out << "// " << identifier(p_program_id->node_name) << ", translated from Cx bytecode\n"
+					<< "#include <cmath>\n#include <cstdint>\n#include <cstdlib>\n#include <cstring>\n"
+					<< "#include <iostream>\n#include <limits>\n#include <stdexcept>\n#include <string>\n\n"
+					<< "typedef " << (sizeof(cx_real) == sizeof(double) ? "double" : "long double") << " cx_real;\n"
+					<< prelude;
+
+				for (auto &global : globals) out << "static cx_value " << global.second << ";\n";
+				out << "\n";
+
+				for (symbol_table_node *p_function_id : functions) {
+					for (auto &p_parameter : p_function_id->defined.routine.p_parameter_ids) {
+						parameter_names[p_parameter.get()] = unique_name("p_", p_parameter->node_name);
+					}
+
+					signature(p_function_id);
+					out << ";\n";
+				}
+				out << "\n";
+
+				for (symbol_table_node *p_function_id : functions) function(p_function_id, false);
+				function(p_program_id.get(), true);
+
+				out << "int main(void) {\n"
+					<< "\ttry {\n"
+					<< "\t\tcx_value value = cx_main();\n"
+					<< "\t\tstd::wcout << L\"" << identifier(p_program_id->node_name) << " returned \" << value.i << std::endl;\n"
+					<< "\t\treturn static_cast<int>(value.i);\n"
+					<< "\t}\n"
+					<< "\tcatch (std::exception &ex) {\n"
+					<< "\t\tstd::cerr << \"\\nFatal: \" << ex.what() << std::endl;\n"
+					<< "\t}\n"
+					<< "\n"
+					<< "\treturn " << static_cast<int>(ABORT_RUNTIME_ERROR) << ";\n"
+					<< "}\n";
+			}
+		};
+
+		bool transpile(const symbol_table_node_ptr &p_program_id, std::ostream &out, std::wstring &why) {
+			try {
+				cpp_translator translator(out);
+				translator.translate(p_program_id);
+			}
+			catch (untranslatable &error) {
+				why = error.why;
+				return false;
+			}
+
+			return true;
+		}
+
+		int build(const symbol_table_node_ptr &p_program_id, const std::wstring &source_file_name) {
+			// script.cx -> script.cpp, script(.exe)
+			std::wstring base_name = aot_settings::output_name;
+			if (base_name.empty()) {
+				base_name = source_file_name;
+				if ((base_name.size() > 3) && (base_name.compare(base_name.size() - 3, 3, L".cx") == 0)) {
+					base_name.erase(base_name.size() - 3);
+				}
+			}
+
+			const std::wstring cpp_file_name = base_name + L".cpp";
+#if defined _WIN32
+			const std::wstring exe_file_name = base_name + L".exe";
+#else
+			const std::wstring &exe_file_name = base_name;
+#endif
+
+			// only replace what -o named
+			if (aot_settings::output_name.empty()) {
+				const std::wstring *p_existing = file_exists(cpp_file_name) ? &cpp_file_name :
+					(aot_settings::compile && file_exists(exe_file_name)) ? &exe_file_name : nullptr;
+
+				if (p_existing != nullptr) {
+					std::wcerr << L"aot: " << *p_existing << L" exists, use -o=<name> to replace it" << std::endl;
+					return EXIT_FAILURE;
+				}
+			}
+
+			std::wstring cpp_argument, exe_argument;
+			if (aot_settings::compile && (!quote(cpp_file_name, cpp_argument) || !quote(exe_file_name, exe_argument))) {
+				std::wcerr << L"aot: can't pass " << base_name << L" to the compiler" << std::endl;
+				return EXIT_FAILURE;
+			}
+
+			std::ostringstream source;
+			std::wstring why;
+			if (!transpile(p_program_id, source, why)) {
+				std::wcerr << L"aot: " << why << std::endl;
+				return EXIT_FAILURE;
+			}
+
+			std::ofstream output(file_path(cpp_file_name), std::ios::binary | std::ios::trunc);
+			output << source.str();
+			output.close();
+
+			if (!output) {
+				std::wcerr << L"aot: can't write " << cpp_file_name << std::endl;
+				return EXIT_FAILURE;
+			}
+
+			if (!aot_settings::compile) return 0;
+
+#if defined _WIN32
+			const std::wstring command = L"cl /nologo /EHsc /O2 " + cpp_argument + L" /Fe" + exe_argument;
+#else
+			// $CXX is a command line of its own, it may carry flags
+			const char *compiler = std::getenv("CXX");
+			const std::wstring command = std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(compiler != nullptr ? compiler : "c++") +
+				L" -O2 -o " + exe_argument + L" " + cpp_argument;
+#endif
+
+			return (run_command(command) == 0) ? 0 : EXIT_FAILURE;
+		}
+	}
+}
@@ -0,0 +1,66 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef AOT_H
+#define AOT_H
+
+#include <ostream>
+#include <string>
+#include "symtab.h"
+
+namespace cx {
+	namespace aot_settings {
+		extern bool emit_source;	// -cpp: write the program as C++
+		extern bool compile;		// -aot: and build it with the system compiler
+		extern std::wstring output_name;	// -o=<name>: write <name>.cpp and <name>, replacing them
+	}
+
+	namespace aot {
+		/** transpile       Write a program as one C++ translation
+		 *                  unit: a C++ function per Cx function, the
+		 *                  operand stack as locals, arrays as raw
+		 *                  buffers with their highest index in front.
+		 *
+		 * @param p_program_id : ptr to the __main__ program node.
+		 * @param out          : where the source goes.
+		 * @param why          : set to what could not be translated.
+		 * @return false if some code can't be translated.
+		 */
+		bool transpile(const symbol_table_node_ptr &p_program_id, std::ostream &out, std::wstring &why);
+
+		/** build           Transpile a program next to its source
+		 *                  file and, with -aot, compile it into an
+		 *                  executable ($CXX, or cl on Windows).  Files
+		 *                  that are already there are left alone
+		 *                  unless -o names them.
+		 *
+		 * @param p_program_id     : ptr to the __main__ program node.
+		 * @param source_file_name : the program's source file.
+		 * @return exit status, nonzero if either step failed.
+		 */
+		int build(const symbol_table_node_ptr &p_program_id, const std::wstring &source_file_name);
+	}
+}
+
+#endif
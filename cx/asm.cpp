@@ -265,7 +265,7 @@ namespace cx {
 			case opcode::IINC: get_token(); break;
 			case opcode::ILOAD: get_token(); {
 				if (token != TC_IDENTIFIER) cx_error(ERR_MISSING_IDENTIFIER);
-				symbol_table_node_ptr p_node = search_all(p_token->string);
+				symbol_table_node_ptr p_node = search_all(p_token->atom());
 				if (p_node == nullptr) cx_error(ERR_UNDEFINED_IDENTIFIER);
 				this->emit(p_function_id, opcode::ILOAD, p_node.get());
 			}
@@ -289,7 +289,7 @@ namespace cx {
 			case opcode::ISHR: get_token(); break;
 			case opcode::ISTORE: get_token(); {
 				if (token != TC_IDENTIFIER) cx_error(ERR_MISSING_IDENTIFIER);
-				symbol_table_node_ptr p_node = search_all(p_token->string);
+				symbol_table_node_ptr p_node = search_all(p_token->atom());
 				if (p_node == nullptr) cx_error(ERR_UNDEFINED_IDENTIFIER);
 				this->emit(p_function_id, opcode::ISTORE, p_node.get());
 			}
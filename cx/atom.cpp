@@ -0,0 +1,89 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "atom.h"
+
+namespace cx {
+
+	// Filled by word_token::get and whoever enters a symbol.
+	atom_table cx_atoms;
+
+	size_t hash_chars(const wchar_t *p_string, size_t length) {
+		uint64_t h = 14695981039346656037ULL;
+
+		for (size_t i = 0; i < length; ++i) {
+			h ^= static_cast<uint64_t>(p_string[i]);
+			h *= 1099511628211ULL;
+		}
+
+		return static_cast<size_t>(h);
+	}
+
+	/** intern      Find the id of a name, adding the name if it is
+	 *              new.
+	 *
+	 * @param p_string : first character of the name.
+	 * @param length   : number of characters.
+	 * @return the name's atom.
+	 */
+	atom_id atom_table::intern(const wchar_t *p_string, size_t length) {
+		std::lock_guard<std::mutex> guard(lock);
+
+		// Keep the index at most half full.
+		if ((names.size() + 1) * 2 > slots.size()) grow();
+
+		const size_t name_hash = hash_chars(p_string, length);
+		const size_t mask = slots.size() - 1;
+
+		for (size_t i = name_hash & mask;; i = (i + 1) & mask) {
+			const atom_id atom = slots[i];
+
+			if (atom == NO_ATOM) {
+				slots[i] = static_cast<atom_id>(names.size());
+				names.emplace_back(p_string, length);
+				hashes.push_back(name_hash);
+				return slots[i];
+			}
+
+			if ((hashes[atom] == name_hash) && (names[atom].size() == length) &&
+				(wmemcmp(names[atom].data(), p_string, length) == 0)) {
+				return atom;
+			}
+		}
+	}
+
+	/** grow        Double the index and reinsert every atom.
+	 */
+	void atom_table::grow(void) {
+		slots.assign(slots.empty() ? 256 : slots.size() * 2, NO_ATOM);
+
+		const size_t mask = slots.size() - 1;
+
+		for (atom_id atom = 0; atom < names.size(); ++atom) {
+			size_t i = hashes[atom] & mask;
+			while (slots[i] != NO_ATOM) i = (i + 1) & mask;
+			slots[i] = atom;
+		}
+	}
+}
@@ -0,0 +1,90 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef ATOM_H
+#define ATOM_H
+
+#include <cstdint>
+#include <cwchar>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cx {
+
+	// Id of an interned identifier. Equal names have equal ids.
+	typedef uint32_t atom_id;
+
+	const atom_id NO_ATOM = UINT32_MAX;
+
+	/** atom_table      Interned identifiers.
+	 *
+	 *                  Every distinct name is stored once and given the
+	 *                  next id, so the compiler can compare and hash
+	 *                  names as integers. Names are never removed and
+	 *                  keep their address for the life of the table.
+	 *                  Modules are compiled on several threads, so
+	 *                  every access takes the table's lock.
+	 */
+	class atom_table {
+	public:
+		atom_table() {}
+
+		atom_id intern(const wchar_t *p_string, size_t length);
+
+		atom_id intern(const wchar_t *p_string) {
+			return intern(p_string, wcslen(p_string));
+		}
+
+		atom_id intern(const std::wstring &name) {
+			return intern(name.c_str(), name.size());
+		}
+
+		const std::wstring &name(atom_id atom) const {
+			std::lock_guard<std::mutex> guard(lock);
+			return names[atom];
+		}
+
+		size_t size(void) const {
+			std::lock_guard<std::mutex> guard(lock);
+			return names.size();
+		}
+
+	private:
+		std::deque<std::wstring> names;	// deque: references stay valid
+		std::vector<size_t> hashes;
+		std::vector<atom_id> slots;		// NO_ATOM if empty
+		mutable std::mutex lock;
+
+		void grow(void);
+	};
+
+	// Hash of a run of characters (FNV-1a).
+	size_t hash_chars(const wchar_t *p_string, size_t length);
+
+	extern atom_table cx_atoms;
+}
+
+#endif
@@ -0,0 +1,325 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#if defined _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <codecvt>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <string>
+#include "bench.h"
+#include "buffer.h"
+#include "error.h"
+#include "parser.h"
+#include "scanner.h"
+#include "symtab.h"
+
+namespace cx {
+	namespace bench_settings {
+		bool run = false;
+		unsigned size = 2000;
+	}
+
+	double *p_optimize_seconds = nullptr;
+
+	// Runs of each source, the fastest is reported.
+	const int bench_runs = 3;
+
+#if defined _WIN32
+	static const std::wstring &file_path(const std::wstring &file_name) { return file_name; }
+	static int remove_file(const std::wstring &file_name) { return _wremove(file_name.c_str()); }
+
+	/** new_temp_file   Make an empty file that has a name of its own
+	 *                  in the temporary directory.
+	 *
+	 * @param file_name : set to its full path.
+	 * @return false if it could not be made.
+	 */
+	static bool new_temp_file(std::wstring &file_name) {
+		wchar_t directory[MAX_PATH + 1], name[MAX_PATH + 1];
+		if ((GetTempPathW(MAX_PATH + 1, directory) == 0) || (GetTempFileNameW(directory, L"cxb", 0, name) == 0)) return false;
+
+		file_name = name;
+		return true;
+	}
+#else
+	static std::string file_path(const std::wstring &file_name) {
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		return converter.to_bytes(file_name);
+	}
+
+	static int remove_file(const std::wstring &file_name) { return std::remove(file_path(file_name).c_str()); }
+
+	static bool new_temp_file(std::wstring &file_name) {
+		const char *p_directory = getenv("TMPDIR");
+		std::string name = std::string((p_directory != nullptr) ? p_directory : "/tmp") + "/cx_bench_XXXXXX";
+
+		const int file = mkstemp(&name[0]);
+		if (file < 0) return false;
+		close(file);
+
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		file_name = converter.from_bytes(name);
+		return true;
+	}
+#endif
+
+	/** bench_shape     Writes a source of one shape, made of about
+	 *                  size units.
+	 */
+	struct bench_shape {
+		const char *name;
+		void(*generate)(std::ostream &source, unsigned size);
+	};
+
+	// size globals, each initialized from the one before
+	static void generate_globals(std::ostream &source, unsigned size) {
+		source << "int g0 = 1;\n";
+
+		for (unsigned i = 1; i < size; ++i) {
+			source << "int g" << i << " = g" << i - 1 << " + " << i % 10 << ";\n";
+		}
+
+		source << "return g" << size - 1 << " % 100;\n";
+	}
+
+	// functions made of if blocks nested 16 deep
+	static void generate_nesting(std::ostream &source, unsigned size) {
+		const unsigned depth = 16;
+		const unsigned functions = std::max(size / depth, 1u);
+
+		for (unsigned f = 0; f < functions; ++f) {
+			source << "int nest" << f << "(int x) {\n\tint s = 0;\n";
+
+			for (unsigned level = 0; level < depth; ++level) {
+				source << std::string(level + 1, '\t') << "if (x > " << level << ") {\n"
+					<< std::string(level + 2, '\t') << "s = s + " << level << ";\n";
+			}
+
+			for (unsigned level = depth; level > 0; --level) {
+				source << std::string(level, '\t') << "}\n";
+			}
+
+			source << "\treturn s;\n}\n";
+		}
+
+		source << "return nest0(" << depth << ");\n";
+	}
+
+	// one function of size statements
+	static void generate_long_function(std::ostream &source, unsigned size) {
+		source << "int long_function(int x) {\n\tint s = 0;\n";
+
+		for (unsigned i = 0; i < size; ++i) {
+			source << "\ts = s + x * " << i % 10 << ";\n";
+		}
+
+		source << "\treturn s % 100;\n}\nreturn long_function(1);\n";
+	}
+
+	/* functions of 1 to 8 parameters, each called once; the parser
+	 * has no user overloads yet, so every arity gets its own name */
+	static void generate_calls(std::ostream &source, unsigned size) {
+		const unsigned arities = 8;
+		const unsigned names = std::max(size / arities, 1u);
+
+		for (unsigned name = 0; name < names; ++name) {
+			for (unsigned params = 1; params <= arities; ++params) {
+				source << "int call" << name << "_" << params << "(";
+				for (unsigned p = 0; p < params; ++p) source << (p > 0 ? ", " : "") << "int p" << p;
+				source << ") {\n\treturn p" << params - 1 << ";\n}\n";
+			}
+		}
+
+		source << "int r = 0;\n";
+
+		for (unsigned name = 0; name < names; ++name) {
+			for (unsigned params = 1; params <= arities; ++params) {
+				source << "r = r + call" << name << "_" << params << "(";
+				for (unsigned p = 0; p < params; ++p) source << (p > 0 ? ", " : "") << p;
+				source << ");\n";
+			}
+		}
+
+		source << "return r % 100;\n";
+	}
+
+	const bench_shape bench_shapes[] = {
+		{ "globals", generate_globals },
+		{ "nesting", generate_nesting },
+		{ "long", generate_long_function },
+		{ "calls", generate_calls },
+	};
+
+	static size_t peak_memory_kb(void) {
+#if defined _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return counters.PeakWorkingSetSize / 1024;
+#else
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+		return static_cast<size_t>(usage.ru_maxrss);
+#endif
+	}
+
+	static double seconds_since(std::chrono::steady_clock::time_point start) {
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+	/** lex_file        Run the scanner alone over a file.
+	 *
+	 * @param file_name : file to scan.
+	 * @param tokens    : set to the number of tokens.
+	 * @return seconds taken.
+	 */
+	static double lex_file(const std::wstring &file_name, size_t &tokens) {
+		auto start = std::chrono::steady_clock::now();
+		text_scanner scanner(new source_buffer(file_name));
+
+		for (tokens = 0; scanner.get()->code() != TC_END_OF_FILE; ++tokens);
+
+		return seconds_since(start);
+	}
+
+	/** parse_file      Parse a file into a fresh global table.
+	 *
+	 * @param file_name        : file to parse.
+	 * @param optimize_seconds : set to the time spent in the
+	 *                           function passes.
+	 * @return seconds taken in all, -1 on a syntax error.
+	 */
+	static double parse_file(const std::wstring &file_name, double &optimize_seconds) {
+		p_global_symbol_table = new_symtab();
+		optimize_seconds = 0;
+		p_optimize_seconds = &optimize_seconds;
+
+		auto start = std::chrono::steady_clock::now();
+		double seconds = -1;
+
+		try {
+			parser bench_parser(new source_buffer(file_name));
+			bench_parser.parse();
+			if (bench_parser.error_count() == 0) seconds = seconds_since(start);
+		}
+		catch (translation_stopped) {}
+
+		p_optimize_seconds = nullptr;
+
+		return seconds;
+	}
+
+	int run_benchmark(void) {
+		// the sources go to a file of their own, never one of the user's
+		std::wstring file_name;
+		if (!new_temp_file(file_name)) {
+			std::cerr << "cx: could not make a file for the benchmark's sources" << std::endl;
+			return ABORT_SOURCE_FILE_OPEN_FAILED;
+		}
+
+		int return_value = 0;
+
+		// a broken source is reported, not fatal
+		error::throw_on_abort = true;
+
+		std::cout << "front end benchmark, size " << bench_settings::size
+			<< ", best of " << bench_runs << " runs\n\n"
+			<< std::left << std::setw(11) << "shape" << std::right
+			<< std::setw(9) << "lines" << std::setw(10) << "tokens"
+			<< std::setw(10) << "lex ms" << std::setw(10) << "parse ms"
+			<< std::setw(10) << "opt ms" << std::setw(14) << "tokens/sec"
+			<< std::setw(12) << "peak +KB" << std::endl;
+
+		for (const bench_shape &shape : bench_shapes) {
+			std::ostringstream source;
+			shape.generate(source, std::max(bench_settings::size, 1u));
+
+			const std::string text = source.str();
+			{
+				std::ofstream output(file_path(file_name), std::ios::binary);
+				output << text;
+			}
+
+			double lex_seconds = 0, parse_seconds = 0, optimize_seconds = 0;
+			size_t tokens = 0;
+
+			// the peak only grows, so a shape smaller than one before it adds nothing
+			const size_t peak_before = peak_memory_kb();
+
+			for (int run = 0; run < bench_runs; ++run) {
+				double lex = lex_file(file_name, tokens);
+				double optimize = 0;
+				double parse = parse_file(file_name, optimize);
+
+				if (parse < 0) {
+					parse_seconds = -1;
+					break;
+				}
+
+				// parse time is the whole front end, take out the lexing and the passes
+				parse = std::max(parse - lex - optimize, 0.0);
+
+				if ((run == 0) || (lex < lex_seconds)) lex_seconds = lex;
+				if ((run == 0) || (parse < parse_seconds)) parse_seconds = parse;
+				if ((run == 0) || (optimize < optimize_seconds)) optimize_seconds = optimize;
+			}
+
+			std::cout << std::left << std::setw(11) << shape.name << std::right
+				<< std::setw(9) << std::count(text.begin(), text.end(), '\n')
+				<< std::setw(10) << tokens;
+
+			if (parse_seconds < 0) {
+				std::cout << "  syntax error in the generated source" << std::endl;
+				return_value = ABORT_TOO_MANY_SYNTAX_ERRORS;
+				continue;
+			}
+
+			std::cout << std::fixed << std::setprecision(2)
+				<< std::setw(10) << lex_seconds * 1000
+				<< std::setw(10) << parse_seconds * 1000
+				<< std::setw(10) << optimize_seconds * 1000
+				<< std::setprecision(0)
+				<< std::setw(14) << (lex_seconds > 0 ? tokens / lex_seconds : 0)
+				<< std::setw(12) << peak_memory_kb() - peak_before << std::endl;
+		}
+
+		remove_file(file_name);
+
+		return return_value;
+	}
+}
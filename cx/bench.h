@@ -0,0 +1,70 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+
+namespace cx {
+	namespace bench_settings {
+		extern bool run;			// -bench: time the front end and exit
+		extern unsigned size;		// -bench<n>: units per generated source
+	}
+
+	/** phase_timer     Adds the time until it goes out of scope to a
+	 *                  phase total, or does nothing without one.
+	 */
+	class phase_timer {
+		double *p_seconds;
+		std::chrono::steady_clock::time_point start;
+	public:
+		phase_timer(double *p_seconds_) : p_seconds(p_seconds_) {
+			if (p_seconds != nullptr) start = std::chrono::steady_clock::now();
+		}
+
+		~phase_timer() {
+			if (p_seconds == nullptr) return;
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			*p_seconds += elapsed.count();
+		}
+	};
+
+	// Seconds spent in the function passes while a benchmark runs.
+	extern double *p_optimize_seconds;
+
+	/** run_benchmark   Generate Cx sources of each shape (many
+	 *                  globals, deep nesting, long functions, calls
+	 *                  with many arguments) and report how long lexing,
+	 *                  parsing with emission, and the function passes
+	 *                  take, tokens per second, and how much each shape
+	 *                  raises the process's peak memory.
+	 *
+	 * @return exit status, nonzero if a generated source failed.
+	 */
+	int run_benchmark(void);
+}
+
+#endif
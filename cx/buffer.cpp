@@ -26,72 +26,232 @@ THE SOFTWARE.
 #include <cstdio>
 #include <cstring>
 #include <cerrno>
+#include <cstdint>
 #include <codecvt>
-#include <fstream>
+#include <locale>
 #include <ctime>
 #endif
 
+#if defined _WIN32
+#include <windows.h>
+#elif defined __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <iostream>
 #include <string>
 #include "buffer.h"
+#include "charscan.h"
 #include "symtab.h"
 
 namespace cx{
 	namespace buffer {
 		// special end-of-file character
 		const char EOF_CHAR = 0x7F;
-		int current_line_number = 0;
-
-		/* "virtual" position of the current char
-		 *  In the input buffer (with tabs expanded) */
-		int input_position = 0;
 		const int max_printline_length = 80;
 		bool list_flag = false;
-		list_buffer list; // the list file buffer
+
+		/* source being scanned on this thread: cx_error is called
+		 * from anywhere in the front end and finds the listing and
+		 * error count it adds to through it.  A source that starts
+		 * while another is being read puts it back when it ends. */
+		thread_local text_in_buffer *p_active_source = nullptr;
 	}
-	
-	/** Constructor     Construct a input text buffer by opening the
+
+	// returned by map_file when the file cannot be mapped
+	static const char *const MAP_FAILED_ptr = reinterpret_cast<const char *>(-1);
+
+	/** map_file        Map a whole file read-only into memory.
+	 *
+	 * @param file_name : name of the file to map.
+	 * @param size      : set to the file size in bytes.
+	 * @return ptr to the mapped bytes, nullptr if the file is empty,
+	 *          or MAP_FAILED_ptr if it could not be opened.
+	 */
+	static const char *map_file(const std::wstring &file_name, size_t &size) {
+		size = 0;
+#if defined _WIN32
+		HANDLE file = CreateFileW(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			errno = ENOENT;
+			return MAP_FAILED_ptr;
+		}
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size)) {
+			CloseHandle(file);
+			return MAP_FAILED_ptr;
+		}
+
+		size = static_cast<size_t>(file_size.QuadPart);
+		if (size == 0) {
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		// the view keeps the mapping alive once the handles are closed
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		const char *p_view = mapping ?
+			static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+
+		return p_view ? p_view : MAP_FAILED_ptr;
+#else
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		int fd = open(converter.to_bytes(file_name).c_str(), O_RDONLY);
+		if (fd < 0) return MAP_FAILED_ptr;
+
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) < 0) {
+			close(fd);
+			return MAP_FAILED_ptr;
+		}
+
+		size = static_cast<size_t>(file_stat.st_size);
+		if (size == 0) {
+			close(fd);
+			return nullptr;
+		}
+
+		// the mapping outlives the descriptor
+		void *p_map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+
+		return (p_map == MAP_FAILED) ? MAP_FAILED_ptr : static_cast<const char *>(p_map);
+#endif
+	}
+
+	/** Constructor     Construct a input text buffer by mapping the
 	 *                  input file.
 	 *
 	 * @param p_input_file_name : ptr to the name of the input file
 	 * @param ac             : abort code to use if open failed
 	 */
 	text_in_buffer::text_in_buffer(std::wstring input_file_name,
-		abort_code ac) : file_name_(input_file_name) {
+		abort_code ac) : p_previous_source(buffer::p_active_source),
+		file_name_(input_file_name), position(0), next_position(0),
+		line_start(0), line_number_(0), ch_(L'\0'),
+		error_count(0), p_scopes(nullptr) {
 
-		// Open the input file.  Abort if failed.
-		file.open(file_name_.c_str(), std::ios::in);
-		file.imbue(std::locale(file.getloc(), new std::codecvt_utf8<wchar_t, 0x10ffff, std::little_endian>));
+		// Map the input file.  Abort if failed.
+		p_mapping = map_file(file_name_, source_size);
 
-		if (!file.good()) {
+		if (p_mapping == MAP_FAILED_ptr) {
 			std::wcout << file_name_ << ": " << std::strerror(errno) << std::endl;
+			p_mapping = nullptr;
 			abort_translation(ac);
 		}
+
+		p_source = p_mapping;
+
+		// skip a UTF-8 byte order mark
+		if ((source_size >= 3) && !memcmp(p_source, "\xEF\xBB\xBF", 3)) {
+			p_source += 3;
+			source_size -= 3;
+		}
+
+		/* a final newline ends the last line, otherwise the end of
+		 * the file does and reads as one more L'\0' */
+		eof_position = ((source_size > 0) && (p_source[source_size - 1] == '\n')) ?
+			source_size : source_size + 1;
+
+		buffer::p_active_source = this;
+		decode();
+	}
+
+	/** Destructor      Unmap the input file.
+	 */
+	text_in_buffer::~text_in_buffer(void) {
+		if (p_mapping != nullptr) {
+#if defined _WIN32
+			UnmapViewOfFile(p_mapping);
+#else
+			munmap(const_cast<char *>(p_mapping), source_size + (p_source - p_mapping));
+#endif
+		}
+
+		buffer::p_active_source = p_previous_source;
+	}
+
+	/** decode          Decode the UTF-8 character at position into
+	 *                 ch_ and set next_position past it.  A newline
+	 *                 and the end of the last line decode as L'\0',
+	 *                 anything past that as the end-of-file
+	 *                 character.  Malformed bytes decode as U+FFFD.
+	 *
+	 * @return the decoded character.
+	 */
+	wchar_t text_in_buffer::decode(void) {
+		const wchar_t replacement_char = 0xFFFD;
+
+		if (position >= source_size) {
+			next_position = position + 1;
+			ch_ = (position < eof_position) ? L'\0' : buffer::EOF_CHAR;
+			return ch_;
+		}
+
+		const unsigned char *p_byte = reinterpret_cast<const unsigned char *>(p_source) + position;
+		unsigned char lead = *p_byte;
+
+		// 7-bit ASCII, by far the common case
+		if (lead < 0x80) {
+			next_position = position + 1;
+			ch_ = (lead == '\n') ? L'\0' : static_cast<wchar_t>(lead);
+			return ch_;
+		}
+
+		size_t length;
+		uint32_t code_point;
+
+		if ((lead & 0xE0) == 0xC0) { length = 2; code_point = lead & 0x1F; }
+		else if ((lead & 0xF0) == 0xE0) { length = 3; code_point = lead & 0x0F; }
+		else if ((lead & 0xF8) == 0xF0) { length = 4; code_point = lead & 0x07; }
+		else {
+			next_position = position + 1;
+			return ch_ = replacement_char;
+		}
+
+		for (size_t i = 1; i < length; ++i) {
+			if ((position + i >= source_size) || ((p_byte[i] & 0xC0) != 0x80)) {
+				next_position = position + i;
+				return ch_ = replacement_char;
+			}
+			code_point = (code_point << 6) | (p_byte[i] & 0x3F);
+		}
+
+		next_position = position + length;
+
+		if ((code_point > 0x10FFFF) || (code_point > WCHAR_MAX)) return ch_ = replacement_char;
+
+		return ch_ = static_cast<wchar_t>(code_point);
 	}
 
 	/** get_char        Fetch and return the next__ character from the
-	 *                 text buffer.  If at the end of the buffer,
-	 *                 read the next__ source line.  If at the end of
+	 *                 text buffer.  Stepping past the end of a line
+	 *                 starts the next__ one.  If at the end of
 	 *                 the file, return the end-of-file character.
 	 *
 	 * @return next__ character from the source file
 	 *          or the end-of-file character.
 	 */
 	wchar_t text_in_buffer::get_char(void) {
-		const int tab_size = 8; // size of tabs
-		wchar_t ch; // character to return
+		if (ch_ == buffer::EOF_CHAR) return buffer::EOF_CHAR; // end of file
 
-		if (*p_char == buffer::EOF_CHAR) return buffer::EOF_CHAR; // end of file
-		else if (*p_char == L'\0') ch = get_line(); // null
-		else { // next__ char
-			++p_char;
-			++buffer::input_position;
-			ch = *p_char;
-		}
+		bool end_of_line = (position < source_size) && (p_source[position] == '\n');
 
-		// If tab character, increment input_position to the next__
-		// multiple of tab_size.
-		if (ch == L'\t') buffer::input_position += tab_size - buffer::input_position % tab_size;
+		position = next_position;
+		wchar_t ch = decode();
+
+		if (end_of_line && (ch != buffer::EOF_CHAR)) {
+			line_start = position;
+			++line_number_;
+			start_line();
+		}
 
 		return ch;
 	}
@@ -104,66 +264,249 @@ namespace cx{
 	 * @return the previous character
 	 */
 	wchar_t text_in_buffer::put_back_char(void) {
-		--p_char;
-		--buffer::input_position;
+		if (position == 0) return ch_;
 
-		return *p_char;
+		// step back over UTF-8 continuation bytes to the lead byte
+		size_t back = position - 1;
+		while ((back > 0) && (back < source_size)
+			&& ((static_cast<unsigned char>(p_source[back]) & 0xC0) == 0x80)) --back;
+
+		if (position == line_start) {
+			--line_number_;
+			line_start = back;
+			while ((line_start > 0) && (p_source[line_start - 1] != '\n')) --line_start;
+		}
+
+		position = back;
+
+		return decode();
 	}
 
-	/** Constructor     Construct a source buffer by opening the
-	 *                  source file.  Initialize the list file, and
-	 *                  read the first line from the source file.
+	/** advance_to      Move forward to a later offset, counting the
+	 *                 lines passed on the way.  When listing, go a
+	 *                 character at a time so every line is listed.
 	 *
-	 * @param p_source_file_name : ptr to name of source file
+	 * @param target : offset to move to, at most eof_position.
+	 * @return the character at the new position.
 	 */
-	source_buffer::source_buffer(const std::wstring source_file_name)
-		: text_in_buffer(source_file_name, ABORT_SOURCE_FILE_OPEN_FAILED) {
-		// Initialize the list file and read the first source line.
-		if (buffer::list_flag) buffer::list.initialize(source_file_name);
-		get_line();
+	wchar_t text_in_buffer::advance_to(size_t target) {
+		if (buffer::list_flag) {
+			while ((position < target) && (ch_ != buffer::EOF_CHAR)) get_char();
+			return ch_;
+		}
+
+		// a final newline leads to end of file, not to a new line
+		size_t counted_end = (target < source_size) ? target : eof_position - 1;
+		size_t lines = (counted_end > position) ?
+			count_newlines(p_source + position, p_source + counted_end) : 0;
+
+		if (lines > 0) {
+			line_number_ += static_cast<int>(lines);
+			line_start = counted_end;
+			while (p_source[line_start - 1] != '\n') --line_start;
+		}
+
+		position = target;
+		return decode();
 	}
 
-	/** get_line         Read the next__ line from the source file, and
-	 *                  print it to the list file preceded by the
-	 *                  line number and the current nesting level.
+	/** skip_white_space   Skip the current character and every
+	 *                    blank or newline after it.
 	 *
-	 * @return first character of the source line, or the
-	 *          end-of-file character if at the end of the file
+	 * @return the first character that is not skipped.
 	 */
-	wchar_t source_buffer::get_line(void) {
-		if (file.eof()) {
-			p_char = (wchar_t *)&buffer::EOF_CHAR;
-			file.close();
-		}
+	wchar_t text_in_buffer::skip_white_space(void) {
+		wchar_t ch = get_char();
+		if ((position >= source_size) || (ch == buffer::EOF_CHAR)) return ch;
 
-		// Else read the next__ source line and print it to the list file.
-		else {
-			memset(text, L'\0', sizeof(text));
+		size_t end = skip_blank_bytes(p_source + position, p_source + source_size) - p_source;
+		return (end > position) ? advance_to(end) : ch;
+	}
+
+	/** skip_to_end_of_line    Skip the rest of a line comment.
+	 *
+	 * @return L'\0' for the end of the line, or the end-of-file
+	 *          character.
+	 */
+	wchar_t text_in_buffer::skip_to_end_of_line(void) {
+		if (position >= source_size) return ch_;
+
+		const char *p_newline = static_cast<const char *>(
+			memchr(p_source + position, '\n', source_size - position));
 
-			while (!wcscmp(text, L"\0")) {
-				file.getline(text, MAX_INPUT_BUFFER_SIZE);
+		position = p_newline ? (p_newline - p_source) : source_size;
+		return decode();
+	}
+
+	/** skip_block_comment     Skip a block comment whose opening '*'
+	 *                        is the current character, and the
+	 *                        closing '/'.
+	 *
+	 * @return the character after the comment, or the end-of-file
+	 *          character if it is never closed.
+	 */
+	wchar_t text_in_buffer::skip_block_comment(void) {
+		if (position >= source_size) return ch_;
 
-				if (file.eof()) break;
+		const char *p_end = find_comment_end(p_source + position + 1, p_source + source_size);
 
-				++buffer::current_line_number;
+		return advance_to((p_end < p_source + source_size) ?
+			(p_end - p_source) + 2 : eof_position);
+	}
+
+	/** skip_block      Skip the rest of a { } block whose opening
+	 *                 bracket was just read, without scanning its
+	 *                 tokens.  Strings, characters and comments are
+	 *                 stepped over, so brackets in them don't count.
+	 *
+	 * @return the character after the closing bracket, or the
+	 *          end-of-file character if it is never closed.
+	 */
+	wchar_t text_in_buffer::skip_block(void) {
+		const char *p_end = p_source + source_size;
+		const char *p = p_source + position;
+		int depth = 1;
+
+		while (p < p_end) {
+			const char c = *p++;
+
+			switch (c) {
+			case '{': ++depth; break;
+			case '}':
+				if (--depth == 0) return advance_to(p - p_source);
+				break;
+			case '\"':
+			case '\'':
+				while ((p < p_end) && (*p != c)) {
+					if (*p == '\\') ++p;
+					++p;
+				}
+				++p;
+				break;
+			case '/':
+				if ((p < p_end) && (*p == '/')) {
+					p = static_cast<const char *>(memchr(p, '\n', p_end - p));
+					if (p == nullptr) p = p_end;
+				}
+				else if ((p < p_end) && (*p == '*')) {
+					p = find_comment_end(p + 1, p_end);
+					p = (p < p_end) ? p + 2 : p_end;
+				}
+				break;
+			default:
+				break;
 			}
+		}
+
+		return advance_to(eof_position);
+	}
+
+	/** seek            Go back to a point recorded with offset() and
+	 *                 line_number(), to scan from there again.
+	 *
+	 * @param offset      : offset of the character to scan next.
+	 * @param line_number : number of its line.
+	 */
+	void text_in_buffer::seek(size_t offset, int line_number) {
+		position = (offset < eof_position) ? offset : eof_position;
+		line_number_ = line_number;
+
+		line_start = position;
+		while ((line_start > 0) && (line_start <= source_size) &&
+			(p_source[line_start - 1] != '\n')) --line_start;
 
-			p_char = text; // point to first source line char
+		decode();
+	}
+
+	/** input_position     Column of the current character, with tabs
+	 *                    expanded, for the error arrow.
+	 *
+	 * @return "virtual" position of the current char in its line.
+	 */
+	int text_in_buffer::input_position(void) {
+		const int tab_size = 8; // size of tabs
+		int column = 0;
 
-			//std::wcout << text << std::endl;
+		size_t saved_position = position;
+		size_t saved_next_position = next_position;
+		wchar_t saved_ch = ch_;
 
-			// just buffer current line, we can display on error
-			buffer::list.wbuffer(
-				text,
-				buffer::current_line_number,
-				scoping::current_nesting_level
-				);
+		for (position = line_start; position <= saved_position; position = next_position) {
+			if (position > line_start) ++column;
 
-			if (buffer::list_flag) buffer::list.put_line();
+			// If tab character, increment column to the next__
+			// multiple of tab_size.
+			if (decode() == L'\t') column += tab_size - column % tab_size;
 		}
 
-		buffer::input_position = 0;
-		return *p_char;
+		position = saved_position;
+		next_position = saved_next_position;
+		ch_ = saved_ch;
+
+		return column;
+	}
+
+	/** current_line    Decode the line being scanned, for listings
+	 *                 and error messages.
+	 *
+	 * @return the current line without its line terminator.
+	 */
+	std::wstring text_in_buffer::current_line(void) {
+		std::wstring line;
+		size_t saved_position = position;
+		size_t saved_next_position = next_position;
+		wchar_t saved_ch = ch_;
+
+		for (position = line_start; (decode() != L'\0') && (ch_ != buffer::EOF_CHAR);
+			position = next_position) {
+			line += ch_;
+		}
+
+		if (!line.empty() && (line.back() == L'\r')) line.pop_back();
+
+		position = saved_position;
+		next_position = saved_next_position;
+		ch_ = saved_ch;
+
+		return line;
+	}
+
+	/** list_current_line  Put the current line, preceded by the line
+	 *                    number and the current nesting level, into
+	 *                    the list buffer.
+	 */
+	void text_in_buffer::list_current_line(void) {
+		list.wbuffer(
+			current_line().c_str(),
+			line_number_,
+			(p_scopes != nullptr) ? p_scopes->nesting_level() : 0
+			);
+	}
+
+	/** Constructor     Construct a source buffer by mapping the
+	 *                  source file.  Initialize the list file, and
+	 *                  list the first line of the source file.
+	 *
+	 * @param p_source_file_name : ptr to name of source file
+	 */
+	source_buffer::source_buffer(const std::wstring source_file_name)
+		: text_in_buffer(source_file_name, ABORT_SOURCE_FILE_OPEN_FAILED) {
+		++line_number_;
+
+		// Initialize the list file and list the first source line.
+		if (buffer::list_flag) list.initialize(source_file_name);
+		start_line();
+	}
+
+	/** start_line       Print a newly started source line to the
+	 *                  list file, when listing.  Otherwise nothing
+	 *                  is formatted until an error needs the line.
+	 */
+	void source_buffer::start_line(void) {
+		if (buffer::list_flag) {
+			list_current_line();
+			list.put_line();
+		}
 	}
 
 
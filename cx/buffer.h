@@ -25,10 +25,11 @@ THE SOFTWARE.
 #ifndef BUFFER_H
 #define BUFFER_H
 
-#include <fstream>
 #include <cstdio>
 #include <cstring>
+#include <cwchar>
 #include <memory>
+#include <string>
 #include <wchar.h>
 #include "error.h"
 
@@ -36,45 +37,17 @@ namespace cx{
 
 #define MAX_INPUT_BUFFER_SIZE 1024
 
-	class list_buffer;
+	class text_in_buffer;
+	class symbol_table_stack;
 
 	namespace buffer {
 		extern const char EOF_CHAR;
-		extern int input_position;
 		extern bool list_flag;
 		extern int level;
-		extern list_buffer list;
-		extern int current_line_number;
 		extern const int max_printline_length;
+		extern thread_local text_in_buffer *p_active_source;
 	}
 
-	///  text_in_buffer       Abstract text input buffer class.
-
-	class text_in_buffer {
-	protected:
-		std::wifstream file;					// Input text file
-		std::wstring file_name_;				// File name
-		wchar_t text[MAX_INPUT_BUFFER_SIZE];	// Input text buffer
-		wchar_t *p_char;						// Pointer to the current char position
-		virtual wchar_t get_line(void) = 0;
-	public:
-		text_in_buffer(std::wstring input_file_name, abort_code ac);
-		virtual ~text_in_buffer(void) {	file.close();}
-		const wchar_t *file_name(void) { return file_name_.c_str(); }
-		wchar_t current_char(void) {return *p_char;}
-		wchar_t get_char(void);
-		wchar_t put_back_char(void);
-	};
-
-	///  cx_source_buffer       Source buffer subclass of cx_text_in_buffer.
-
-	class source_buffer : public text_in_buffer {
-		virtual wchar_t get_line(void);
-
-	public:
-		source_buffer(std::wstring source_file_name);
-	};
-
 	///  cx_text_out_buffer      Abstract text output buffer class.
 
 	class text_out_buffer {
@@ -96,6 +69,10 @@ namespace cx{
 		int line_count; // count of lines in the current page
 	public:
 
+		list_buffer(void) : line_count(0) {
+			memset(text, 0, sizeof(text));
+		}
+
 		virtual ~list_buffer(void) {}
 
 		void initialize(const std::wstring file_name);
@@ -106,11 +83,66 @@ namespace cx{
 		}
 
 		void wbuffer(const wchar_t *p_text, int line_number, int nesting_level) {
-			//swprintf(text, L"%4d %d: %s", line_number, nesting_level, p_text);
-			_swprintf(text, L"%4d %d: %s", line_number, nesting_level, p_text);
+			std::swprintf(text, sizeof(text) / sizeof(text[0]), L"%4d %d: %.*ls",
+				line_number, nesting_level, MAX_INPUT_BUFFER_SIZE, p_text);
 		}
 	};
 
+	///  text_in_buffer       Abstract text input buffer class.  The
+	///                       whole file is mapped into memory and its
+	///                       UTF-8 bytes are decoded one character at a
+	///                       time; the end of every line reads as L'\0'.
+
+	class text_in_buffer {
+		text_in_buffer *p_previous_source;		// Source active before this one
+	protected:
+		std::wstring file_name_;				// File name
+		const char *p_mapping;					// Mapped file
+		const char *p_source;					// Source text within the mapping
+		size_t source_size;						// Size of the source text in bytes
+		size_t eof_position;					// Offset that reads as end of file
+		size_t position;						// Offset of the current char
+		size_t next_position;					// Offset of the char after it
+		size_t line_start;						// Offset of the current line
+		int line_number_;						// Number of the current line
+		wchar_t ch_;							// Current char, decoded
+		wchar_t decode(void);
+		wchar_t advance_to(size_t target);
+		virtual void start_line(void) = 0;
+	public:
+		list_buffer list;						// Listing of this source and its errors
+		int error_count;						// Syntax errors found in it
+		const symbol_table_stack *p_scopes;		// Scopes of the parser reading it
+
+		text_in_buffer(std::wstring input_file_name, abort_code ac);
+		virtual ~text_in_buffer(void);
+		const wchar_t *file_name(void) { return file_name_.c_str(); }
+		const char *bytes(void) const { return p_source; }
+		size_t byte_count(void) const { return source_size; }
+		int line_number(void) const { return line_number_; }
+		size_t offset(void) const { return position; }
+		wchar_t current_char(void) {return ch_;}
+		wchar_t get_char(void);
+		wchar_t put_back_char(void);
+		wchar_t skip_white_space(void);
+		wchar_t skip_to_end_of_line(void);
+		wchar_t skip_block_comment(void);
+		wchar_t skip_block(void);
+		void seek(size_t offset, int line_number);
+		int input_position(void);
+		std::wstring current_line(void);
+		void list_current_line(void);
+	};
+
+	///  cx_source_buffer       Source buffer subclass of cx_text_in_buffer.
+
+	class source_buffer : public text_in_buffer {
+		virtual void start_line(void);
+
+	public:
+		source_buffer(std::wstring source_file_name);
+	};
+
 	typedef std::shared_ptr<text_in_buffer> text_in_buffer_ptr;
 }
 
@@ -0,0 +1,512 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <codecvt>
+#include <fstream>
+#include <locale>
+#include <unordered_map>
+#include <vector>
+#include "cache.h"
+#include "charscan.h"
+#include "cxvm.h"
+#include "optimizer.h"
+#include "simd.h"
+#include "tier.h"
+#include "verify.h"
+
+namespace cx {
+	namespace cache_settings {
+		bool use_cache = true;
+	}
+
+	using optimizer::operand_kind;
+	using optimizer::arg0_kind;
+	using optimizer::OPERAND_VALUE;
+	using optimizer::OPERAND_NODE;
+	using optimizer::OPERAND_TYPE;
+
+	// bump when the layout below changes
+	const uint32_t cache_format_version = 7;
+	const char cache_magic[4] = { 'C', 'X', 'C', '\0' };
+
+	/** opcode_table_hash   Hash of the opcode names in opcode order,
+	 *                      so a cache written before opcodes were
+	 *                      added, removed or reordered is not loaded
+	 *                      even if bytecode_version was not bumped.
+	 */
+	static uint64_t opcode_table_hash(void) {
+		std::wstring names;
+		for (unsigned op = 0; op <= ZEQ; ++op) names += std::wstring(opcode_string[op]) + L" ";
+
+		return hash_bytes(reinterpret_cast<const char *>(names.data()), names.size() * sizeof(wchar_t));
+	}
+
+	static bool is_routine(const symbol_table_node *p_node) {
+		return (p_node->defined.defined_how == DC_FUNCTION)
+			|| (p_node->defined.defined_how == DC_PROGRAM);
+	}
+
+#if defined _WIN32
+	static const std::wstring &file_path(const std::wstring &file_name) { return file_name; }
+	static int remove_file(const std::wstring &file_name) { return _wremove(file_name.c_str()); }
+
+	static int rename_file(const std::wstring &from, const std::wstring &to) {
+		return _wrename(from.c_str(), to.c_str());
+	}
+#else
+	static std::string file_path(const std::wstring &file_name) {
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		return converter.to_bytes(file_name);
+	}
+
+	static int remove_file(const std::wstring &file_name) { return std::remove(file_path(file_name).c_str()); }
+
+	static int rename_file(const std::wstring &from, const std::wstring &to) {
+		return std::rename(file_path(from).c_str(), file_path(to).c_str());
+	}
+#endif
+
+	/******************
+	 *                *
+	 *  Cache Writer  *
+	 *                *
+	 ******************/
+
+	class cache_writer {
+	public:
+		std::string bytes;
+
+		template <typename T> void put(const T &v) {
+			bytes.append(reinterpret_cast<const char *>(&v), sizeof(T));
+		}
+
+		void put_string(const std::wstring &s) {
+			put(static_cast<uint32_t>(s.size()));
+			bytes.append(reinterpret_cast<const char *>(s.data()), s.size() * sizeof(wchar_t));
+		}
+
+		/** index_node      Number a node the first time it is seen
+		 *                  and queue it to be written.
+		 */
+		int32_t index_node(symbol_table_node *p_node) {
+			if (p_node == nullptr) return -1;
+
+			auto it = node_index.find(p_node);
+			if (it != node_index.end()) return it->second;
+
+			int32_t index = static_cast<int32_t>(nodes.size());
+			node_index[p_node] = index;
+			nodes.push_back(p_node);
+			return index;
+		}
+
+		/** index_type      Number a type, and the element and index
+		 *                  types of an array, the first time it is seen.
+		 */
+		int32_t index_type(cx_type *p_type) {
+			if (p_type == nullptr) return -1;
+
+			auto it = type_index.find(p_type);
+			if (it != type_index.end()) return it->second;
+
+			int32_t index = static_cast<int32_t>(types.size());
+			type_index[p_type] = index;
+			types.push_back(p_type);
+
+			index_type(p_type->array.p_element_type.get());
+			index_type(p_type->array.p_index_type.get());
+			return index;
+		}
+
+		std::vector<symbol_table_node *> nodes;
+		std::vector<cx_type *> types;
+
+	private:
+		std::unordered_map<symbol_table_node *, int32_t> node_index;
+		std::unordered_map<cx_type *, int32_t> type_index;
+	};
+
+	/******************
+	 *                *
+	 *  Cache Reader  *
+	 *                *
+	 ******************/
+
+	class cache_reader {
+	public:
+		cache_reader(const char *p_begin, const char *p_end)
+			: p(p_begin), p_end(p_end), good(true) {}
+
+		template <typename T> T get(void) {
+			T v = T();
+			if (static_cast<size_t>(p_end - p) < sizeof(T)) {
+				good = false;
+				return v;
+			}
+			memcpy(&v, p, sizeof(T));
+			p += sizeof(T);
+			return v;
+		}
+
+		std::wstring get_string(void) {
+			uint32_t length = get<uint32_t>();
+			if (!good || (static_cast<size_t>(p_end - p) / sizeof(wchar_t) < length)) {
+				good = false;
+				return std::wstring();
+			}
+			std::wstring s(reinterpret_cast<const wchar_t *>(p), length);
+			p += length * sizeof(wchar_t);
+			return s;
+		}
+
+		void skip(size_t count) {
+			if (static_cast<size_t>(p_end - p) < count) good = false;
+			else p += count;
+		}
+
+		// count of a following table, rejecting impossible sizes
+		uint32_t get_count(void) {
+			uint32_t count = get<uint32_t>();
+			if (count > static_cast<size_t>(p_end - p)) good = false;
+			return good ? count : 0;
+		}
+
+		const char *p;
+		const char *p_end;
+		bool good;
+	};
+
+	/** Constructor     Key the cache on the source being compiled.
+	 *
+	 * @param source_file_name : name of the source file.
+	 * @param source           : its mapped text.
+	 */
+	bytecode_cache::bytecode_cache(const std::wstring &source_file_name, const text_in_buffer &source)
+		: source_hash(hash_bytes(source.bytes(), source.byte_count())),
+		source_size(source.byte_count()) {
+
+		// script.cx -> script.cxc
+		cache_file_name = source_file_name;
+		if ((cache_file_name.size() > 3)
+			&& (cache_file_name.compare(cache_file_name.size() - 3, 3, L".cx") == 0)) {
+			cache_file_name += L"c";
+		}
+		else cache_file_name += L".cxc";
+	}
+
+	/** store           Write the program and everything it reaches
+	 *                  to the cache file.  Failing to write is not an
+	 *                  error; the next run just compiles again.  Code
+	 *                  the verifier rejects is not written, load
+	 *                  would refuse it and it would be rewritten on
+	 *                  every run.
+	 *
+	 * @param p_program_id : ptr to the __main__ program node.
+	 */
+	void bytecode_cache::store(const symbol_table_node_ptr &p_program_id) {
+		std::string reason;
+		if (!verifier::verify_program(p_program_id.get(), reason)) return;
+
+		cache_writer writer;
+
+		// number every node and type reachable from __main__
+		writer.index_node(p_program_id.get());
+
+		for (size_t i = 0; i < writer.nodes.size(); ++i) {
+			symbol_table_node *p_node = writer.nodes[i];
+			writer.index_type(p_node->p_type.get());
+
+			if (!is_routine(p_node)) continue;
+
+			for (auto &p_param : p_node->defined.routine.p_parameter_ids) writer.index_node(p_param.get());
+			for (auto &p_local : p_node->defined.routine.p_variable_ids) writer.index_node(p_local.get());
+
+			for (auto &code : p_node->defined.routine.program_code) {
+				switch (arg0_kind(code.op)) {
+				case OPERAND_NODE: writer.index_node(static_cast<symbol_table_node *>(code.arg0.a_)); break;
+				case OPERAND_TYPE: writer.index_type(static_cast<cx_type *>(code.arg0.a_)); break;
+				default: break;
+				}
+			}
+		}
+
+		// header
+		writer.bytes.append(cache_magic, sizeof(cache_magic));
+		writer.put(cache_format_version);
+		writer.put(bytecode_version);
+		writer.put(opcode_table_hash());
+		writer.put(static_cast<uint8_t>(sizeof(void *)));
+		writer.put(static_cast<uint8_t>(sizeof(wchar_t)));
+		writer.put(static_cast<uint8_t>(sizeof(value)));
+		writer.put(static_cast<uint8_t>(sizeof(cx_real)));
+		writer.put(static_cast<uint8_t>(vm_settings::unchecked_flag));
+		writer.put(static_cast<uint8_t>(tier_settings::tiered));
+		writer.put(static_cast<uint8_t>(simd_settings::vectorize));
+		writer.put(static_cast<uint8_t>(optimizer_settings::level));
+		writer.put(source_hash);
+		writer.put(source_size);
+
+		// hash of everything after it, filled in once it is written
+		const size_t payload_hash_at = writer.bytes.size();
+		writer.put(static_cast<uint64_t>(0));
+
+		// types
+		writer.put(static_cast<uint32_t>(writer.types.size()));
+		for (cx_type *p_type : writer.types) {
+			writer.put(static_cast<uint8_t>(p_type->typeform));
+			writer.put(static_cast<uint8_t>(p_type->typecode));
+			writer.put(static_cast<uint64_t>(p_type->size));
+			writer.put(static_cast<uint64_t>(p_type->array.min_index));
+			writer.put(static_cast<uint64_t>(p_type->array.max_index));
+			writer.put(static_cast<uint64_t>(p_type->array.element_count));
+			writer.put(writer.index_type(p_type->array.p_element_type.get()));
+			writer.put(writer.index_type(p_type->array.p_index_type.get()));
+		}
+
+		// nodes; routines carry their parameters, locals and code
+		writer.put(static_cast<uint32_t>(writer.nodes.size()));
+		for (symbol_table_node *p_node : writer.nodes) {
+			writer.put_string(p_node->node_name);
+			writer.put(static_cast<uint8_t>(p_node->defined.defined_how));
+			writer.put(writer.index_type(p_node->p_type.get()));
+
+			if (!is_routine(p_node)) continue;
+
+			writer.put(static_cast<uint8_t>(p_node->defined.routine.function_type));
+			writer.put_string(p_node->defined.routine.qualified_name);
+
+			writer.put(static_cast<uint32_t>(p_node->defined.routine.p_parameter_ids.size()));
+			for (auto &p_param : p_node->defined.routine.p_parameter_ids) writer.put(writer.index_node(p_param.get()));
+
+			writer.put(static_cast<uint32_t>(p_node->defined.routine.p_variable_ids.size()));
+			for (auto &p_local : p_node->defined.routine.p_variable_ids) writer.put(writer.index_node(p_local.get()));
+
+			writer.put(static_cast<uint32_t>(p_node->defined.routine.program_code.size()));
+			for (auto &code : p_node->defined.routine.program_code) {
+				operand_kind kind = (code.arg0.a_ == nullptr) ? OPERAND_VALUE : arg0_kind(code.op);
+
+				writer.put(static_cast<uint32_t>(code.op));
+				writer.put(kind);
+
+				switch (kind) {
+				case OPERAND_NODE: writer.put(writer.index_node(static_cast<symbol_table_node *>(code.arg0.a_))); break;
+				case OPERAND_TYPE: writer.put(writer.index_type(static_cast<cx_type *>(code.arg0.a_))); break;
+				default: writer.put(code.arg0); break;
+				}
+
+				writer.put(code.arg1);
+			}
+		}
+
+		const size_t payload_at = payload_hash_at + sizeof(uint64_t);
+		const uint64_t payload_hash = hash_bytes(writer.bytes.data() + payload_at, writer.bytes.size() - payload_at);
+		writer.bytes.replace(payload_hash_at, sizeof(payload_hash), reinterpret_cast<const char *>(&payload_hash), sizeof(payload_hash));
+
+		// write beside the real file, then swap it in
+		std::wstring temp_file_name = cache_file_name + L".tmp";
+		{
+			std::ofstream output(file_path(temp_file_name), std::ios::binary | std::ios::trunc);
+			if (!output.good()) return;
+
+			output.write(writer.bytes.data(), writer.bytes.size());
+			if (!output.good()) {
+				output.close();
+				remove_file(temp_file_name);
+				return;
+			}
+		}
+
+		remove_file(cache_file_name);
+		if (rename_file(temp_file_name, cache_file_name) != 0) {
+			remove_file(temp_file_name);
+		}
+	}
+
+	/** load            Read the program back from the cache file.
+	 *
+	 * @return ptr to the __main__ program node, or nullptr if there
+	 *          is no cache or it is stale or damaged.
+	 */
+	symbol_table_node_ptr bytecode_cache::load(void) {
+		std::ifstream input(file_path(cache_file_name), std::ios::binary);
+		if (!input.good()) return nullptr;
+
+		std::vector<char> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+		cache_reader reader(bytes.data(), bytes.data() + bytes.size());
+
+		// header: anything but an exact match is a miss
+		if ((bytes.size() < sizeof(cache_magic)) || memcmp(bytes.data(), cache_magic, sizeof(cache_magic))) return nullptr;
+		reader.p += sizeof(cache_magic);
+
+		if (reader.get<uint32_t>() != cache_format_version) return nullptr;
+		if (reader.get<uint32_t>() != bytecode_version) return nullptr;
+		if (reader.get<uint64_t>() != opcode_table_hash()) return nullptr;
+		if (reader.get<uint8_t>() != sizeof(void *)) return nullptr;
+		if (reader.get<uint8_t>() != sizeof(wchar_t)) return nullptr;
+		if (reader.get<uint8_t>() != sizeof(value)) return nullptr;
+		if (reader.get<uint8_t>() != sizeof(cx_real)) return nullptr;
+		if (reader.get<uint8_t>() != static_cast<uint8_t>(vm_settings::unchecked_flag)) return nullptr;
+		if (reader.get<uint8_t>() != static_cast<uint8_t>(tier_settings::tiered)) return nullptr;
+		if (reader.get<uint8_t>() != static_cast<uint8_t>(simd_settings::vectorize)) return nullptr;
+		if (reader.get<uint8_t>() != static_cast<uint8_t>(optimizer_settings::level)) return nullptr;
+		if (reader.get<uint64_t>() != source_hash) return nullptr;
+		if (reader.get<uint64_t>() != source_size) return nullptr;
+
+		/* the verifier checks the shape of the code, not constants,
+		 * sizes or bounds, so a damaged body must not get that far */
+		const uint64_t payload_hash = reader.get<uint64_t>();
+		if (!reader.good || (hash_bytes(reader.p, reader.p_end - reader.p) != payload_hash)) return nullptr;
+
+		// enum values are checked before they are cast
+		auto in_range = [&](uint32_t v, uint32_t last) {
+			if (v > last) reader.good = false;
+			return v;
+		};
+
+		// types, then their element/index links
+		struct type_links { int32_t element; int32_t index; };
+		std::vector<type_ptr> types(reader.get_count());
+		std::vector<type_links> links(types.size());
+
+		for (size_t i = 0; i < types.size(); ++i) {
+			type_form form = static_cast<type_form>(in_range(reader.get<uint8_t>(), F_NONE));
+			type_code code = static_cast<type_code>(in_range(reader.get<uint8_t>(), T_DUMMY));
+			if ((code > T_REFERENCE) && (code != T_VOID) && (code != T_DUMMY)) reader.good = false;
+			types[i] = std::make_shared<cx_type>(form, code);
+			types[i]->size = static_cast<size_t>(reader.get<uint64_t>());
+			types[i]->array.min_index = static_cast<size_t>(reader.get<uint64_t>());
+			types[i]->array.max_index = static_cast<size_t>(reader.get<uint64_t>());
+			types[i]->array.element_count = static_cast<size_t>(reader.get<uint64_t>());
+			links[i].element = reader.get<int32_t>();
+			links[i].index = reader.get<int32_t>();
+		}
+
+		auto type_at = [&](int32_t index) -> type_ptr {
+			if ((index < -1) || (index >= static_cast<int32_t>(types.size()))) reader.good = false;
+			return ((index < 0) || !reader.good) ? nullptr : types[index];
+		};
+
+		for (size_t i = 0; i < types.size(); ++i) {
+			types[i]->array.p_element_type = type_at(links[i].element);
+			types[i]->array.p_index_type = type_at(links[i].index);
+		}
+
+		/* nodes are created up front, since code refers to nodes
+		 * later in the table (callees, globals) */
+		std::vector<symbol_table_node_ptr> nodes(reader.get_count());
+		if (!reader.good || nodes.empty()) return nullptr;
+
+		const char *p_node_records = reader.p;
+		for (size_t i = 0; (i < nodes.size()) && reader.good; ++i) {
+			atom_id name = cx_atoms.intern(reader.get_string());
+			define_code dc = static_cast<define_code>(in_range(reader.get<uint8_t>(), DC_NAMESPACE));
+			nodes[i] = std::make_shared<symbol_table_node>(name, dc);
+			reader.get<int32_t>();
+
+			if (!is_routine(nodes[i].get())) continue;
+
+			reader.get<uint8_t>();
+			reader.get_string();
+			uint32_t count = reader.get_count();
+			reader.skip(count * sizeof(int32_t));
+			count = reader.get_count();
+			reader.skip(count * sizeof(int32_t));
+
+			count = reader.get_count();
+			for (uint32_t c = 0; (c < count) && reader.good; ++c) {
+				in_range(reader.get<uint32_t>(), ZEQ);
+				operand_kind kind = static_cast<operand_kind>(in_range(reader.get<uint8_t>(), OPERAND_TYPE));
+				reader.skip((kind == OPERAND_VALUE) ? sizeof(value) : sizeof(int32_t));
+				reader.skip(sizeof(value));
+			}
+		}
+		if (!reader.good) return nullptr;
+
+		auto node_at = [&](int32_t index) -> symbol_table_node_ptr {
+			if ((index < -1) || (index >= static_cast<int32_t>(nodes.size()))) reader.good = false;
+			return ((index < 0) || !reader.good) ? nullptr : nodes[index];
+		};
+
+		// second pass: fill in types, parameters, locals and code
+		reader.p = p_node_records;
+		for (size_t i = 0; (i < nodes.size()) && reader.good; ++i) {
+			symbol_table_node_ptr &p_node = nodes[i];
+
+			reader.get_string();
+			reader.get<uint8_t>();
+			p_node->p_type = type_at(reader.get<int32_t>());
+
+			if (!is_routine(p_node.get())) continue;
+
+			auto &routine = p_node->defined.routine;
+			routine.function_type = static_cast<function_code>(in_range(reader.get<uint8_t>(), FUNC_ITERATOR));
+			routine.qualified_name = reader.get_string();
+
+			uint32_t count = reader.get_count();
+			for (uint32_t c = 0; (c < count) && reader.good; ++c) routine.p_parameter_ids.push_back(node_at(reader.get<int32_t>()));
+
+			count = reader.get_count();
+			for (uint32_t c = 0; (c < count) && reader.good; ++c) routine.p_variable_ids.push_back(node_at(reader.get<int32_t>()));
+
+			count = reader.get_count();
+			routine.program_code.reserve(count);
+			for (uint32_t c = 0; (c < count) && reader.good; ++c) {
+				opcode op = static_cast<opcode>(in_range(reader.get<uint32_t>(), ZEQ));
+				operand_kind kind = static_cast<operand_kind>(in_range(reader.get<uint8_t>(), OPERAND_TYPE));
+				value arg0;
+
+				switch (kind) {
+				case OPERAND_NODE: arg0.a_ = node_at(reader.get<int32_t>()).get(); break;
+				case OPERAND_TYPE: arg0.a_ = type_at(reader.get<int32_t>()).get(); break;
+				default: arg0 = reader.get<value>(); break;
+				}
+
+				routine.program_code.push_back({ op, arg0, reader.get<value>() });
+			}
+		}
+
+		if (!reader.good || !is_routine(nodes[0].get())) return nullptr;
+
+		// code read from disk is only run if it verifies
+		std::string reason;
+		if (!verifier::verify_program(nodes[0].get(), reason)) return nullptr;
+
+		/* the program's symbol table owns every loaded node and,
+		 * through unnamed type nodes, every type; code only holds
+		 * raw pointers to them */
+		symbol_table_ptr p_symtab = std::make_shared<symbol_table>();
+		for (auto &p_node : nodes) p_symtab->enter(p_node);
+
+		for (auto &p_type : types) {
+			symbol_table_node_ptr p_type_node = std::make_shared<symbol_table_node>(cx_atoms.intern(L""), DC_TYPE);
+			p_type_node->p_type = p_type;
+			p_symtab->enter(p_type_node);
+		}
+		nodes[0]->defined.routine.p_symtab = p_symtab;
+
+		return nodes[0];
+	}
+}
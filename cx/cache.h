@@ -0,0 +1,62 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <string>
+#include "buffer.h"
+#include "symtab.h"
+
+namespace cx {
+	namespace cache_settings {
+		extern bool use_cache;
+	}
+
+	/** bytecode_cache      Compiled program cache (.cxc) kept next to
+	 *                      the source file.
+	 *
+	 *                      The cache holds every function reachable
+	 *                      from __main__ with its parameters, locals,
+	 *                      types and bytecode.  It is keyed by a hash
+	 *                      of the source text and by the compiler
+	 *                      build, so any edit to the source or any
+	 *                      rebuild of cx makes it stale.
+	 */
+	class bytecode_cache {
+	public:
+		bytecode_cache(const std::wstring &source_file_name, const text_in_buffer &source);
+
+		symbol_table_node_ptr load(void);
+		void store(const symbol_table_node_ptr &p_program_id);
+
+	private:
+		std::wstring cache_file_name;
+		uint64_t source_hash;
+		uint64_t source_size;
+	};
+}
+
+#endif
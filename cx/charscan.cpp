@@ -0,0 +1,259 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <cstdint>
+#include "charscan.h"
+
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define CX_CHARSCAN_SIMD
+#include <immintrin.h>
+#if defined _MSC_VER
+#include <intrin.h>
+#define CX_TARGET_AVX2
+#else
+#define CX_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace cx {
+
+	static inline bool is_blank_byte(char c) {
+		return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') || (c == '\f');
+	}
+
+	static const char *skip_blank_bytes_scalar(const char *p, const char *p_end) {
+		while ((p < p_end) && is_blank_byte(*p)) ++p;
+		return p;
+	}
+
+	static size_t count_newlines_scalar(const char *p, const char *p_end) {
+		size_t count = 0;
+		for (; p < p_end; ++p) count += (*p == '\n');
+		return count;
+	}
+
+	static const char *find_comment_end_scalar(const char *p, const char *p_end) {
+		for (; p + 1 < p_end; ++p) {
+			if ((p[0] == '*') && (p[1] == '/')) return p;
+		}
+		return p_end;
+	}
+
+#ifdef CX_CHARSCAN_SIMD
+
+	// index of the lowest set bit of a non-zero mask
+	static inline unsigned first_bit(uint32_t mask) {
+#if defined _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	static bool cpu_has_avx2(void) {
+#if defined _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+
+		// the OS must save ymm registers too
+		__cpuid(info, 1);
+		if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return false;
+		if ((_xgetbv(0) & 6) != 6) return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+
+	static const bool use_avx2 = cpu_has_avx2();
+
+	/*****************
+	 *               *
+	 *  SSE2 (16 B)  *
+	 *               *
+	 *****************/
+
+	static inline __m128i blank_mask_sse2(__m128i bytes) {
+		__m128i blank = _mm_or_si128(
+			_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+			_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')));
+		blank = _mm_or_si128(blank, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')));
+		blank = _mm_or_si128(blank, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+		return _mm_or_si128(blank, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\f')));
+	}
+
+	static const char *skip_blank_bytes_sse2(const char *p, const char *p_end) {
+		for (; p_end - p >= 16; p += 16) {
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+			uint32_t other = ~static_cast<uint32_t>(_mm_movemask_epi8(blank_mask_sse2(bytes))) & 0xFFFF;
+			if (other) return p + first_bit(other);
+		}
+
+		return skip_blank_bytes_scalar(p, p_end);
+	}
+
+	static size_t count_newlines_sse2(const char *p, const char *p_end) {
+		const __m128i newline = _mm_set1_epi8('\n');
+		size_t count = 0;
+
+		while (p_end - p >= 16) {
+			__m128i counts = _mm_setzero_si128();
+
+			// each byte lane counts at most 255 matches
+			for (int i = 0; (i < 255) && (p_end - p >= 16); ++i, p += 16) {
+				__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+				counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(bytes, newline));
+			}
+
+			__m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+			count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+		}
+
+		return count + count_newlines_scalar(p, p_end);
+	}
+
+	static const char *find_comment_end_sse2(const char *p, const char *p_end) {
+		const __m128i star = _mm_set1_epi8('*');
+		const __m128i slash = _mm_set1_epi8('/');
+
+		for (; p_end - p >= 17; p += 16) {
+			__m128i stars = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), star);
+			__m128i slashes = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1)), slash);
+			uint32_t hits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(stars, slashes)));
+			if (hits) return p + first_bit(hits);
+		}
+
+		return find_comment_end_scalar(p, p_end);
+	}
+
+	/*****************
+	 *               *
+	 *  AVX2 (32 B)  *
+	 *               *
+	 *****************/
+
+	CX_TARGET_AVX2
+	static inline __m256i blank_mask_avx2(__m256i bytes) {
+		__m256i blank = _mm256_or_si256(
+			_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+			_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')));
+		blank = _mm256_or_si256(blank, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')));
+		blank = _mm256_or_si256(blank, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+		return _mm256_or_si256(blank, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\f')));
+	}
+
+	CX_TARGET_AVX2
+	static const char *skip_blank_bytes_avx2(const char *p, const char *p_end) {
+		for (; p_end - p >= 32; p += 32) {
+			__m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+			uint32_t other = ~static_cast<uint32_t>(_mm256_movemask_epi8(blank_mask_avx2(bytes)));
+			if (other) return p + first_bit(other);
+		}
+
+		return skip_blank_bytes_sse2(p, p_end);
+	}
+
+	CX_TARGET_AVX2
+	static size_t count_newlines_avx2(const char *p, const char *p_end) {
+		const __m256i newline = _mm256_set1_epi8('\n');
+		size_t count = 0;
+
+		while (p_end - p >= 32) {
+			__m256i counts = _mm256_setzero_si256();
+
+			// each byte lane counts at most 255 matches
+			for (int i = 0; (i < 255) && (p_end - p >= 32); ++i, p += 32) {
+				__m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+				counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(bytes, newline));
+			}
+
+			uint64_t sums[4];
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(sums),
+				_mm256_sad_epu8(counts, _mm256_setzero_si256()));
+			count += static_cast<size_t>(sums[0] + sums[1] + sums[2] + sums[3]);
+		}
+
+		return count + count_newlines_sse2(p, p_end);
+	}
+
+	CX_TARGET_AVX2
+	static const char *find_comment_end_avx2(const char *p, const char *p_end) {
+		const __m256i star = _mm256_set1_epi8('*');
+		const __m256i slash = _mm256_set1_epi8('/');
+
+		for (; p_end - p >= 33; p += 32) {
+			__m256i stars = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), star);
+			__m256i slashes = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1)), slash);
+			uint32_t hits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(stars, slashes)));
+			if (hits) return p + first_bit(hits);
+		}
+
+		return find_comment_end_sse2(p, p_end);
+	}
+
+#endif
+
+	const char *skip_blank_bytes(const char *p_begin, const char *p_end) {
+#ifdef CX_CHARSCAN_SIMD
+		if (use_avx2) return skip_blank_bytes_avx2(p_begin, p_end);
+		return skip_blank_bytes_sse2(p_begin, p_end);
+#else
+		return skip_blank_bytes_scalar(p_begin, p_end);
+#endif
+	}
+
+	size_t count_newlines(const char *p_begin, const char *p_end) {
+#ifdef CX_CHARSCAN_SIMD
+		if (use_avx2) return count_newlines_avx2(p_begin, p_end);
+		return count_newlines_sse2(p_begin, p_end);
+#else
+		return count_newlines_scalar(p_begin, p_end);
+#endif
+	}
+
+	const char *find_comment_end(const char *p_begin, const char *p_end) {
+#ifdef CX_CHARSCAN_SIMD
+		if (use_avx2) return find_comment_end_avx2(p_begin, p_end);
+		return find_comment_end_sse2(p_begin, p_end);
+#else
+		return find_comment_end_scalar(p_begin, p_end);
+#endif
+	}
+
+	uint64_t hash_bytes(const char *p_bytes, size_t count) {
+		uint64_t h = 14695981039346656037ull;
+
+		for (size_t i = 0; i < count; ++i) {
+			h ^= static_cast<unsigned char>(p_bytes[i]);
+			h *= 1099511628211ull;
+		}
+
+		return h;
+	}
+}
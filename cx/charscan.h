@@ -0,0 +1,70 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef CHARSCAN_H
+#define CHARSCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cx {
+
+	/** skip_blank_bytes    Skip a run of source whitespace bytes:
+	 *                      space, tab, carriage return, form feed
+	 *                      and newline.  Uses AVX2 or SSE2 when the
+	 *                      CPU has them.
+	 *
+	 * @param p_begin : first byte to look at.
+	 * @param p_end   : end of the bytes.
+	 * @return first byte that is not whitespace, or p_end.
+	 */
+	const char *skip_blank_bytes(const char *p_begin, const char *p_end);
+
+	/** count_newlines      Count the newline bytes in a range.
+	 *
+	 * @param p_begin : first byte to count.
+	 * @param p_end   : end of the bytes.
+	 * @return number of '\n' bytes.
+	 */
+	size_t count_newlines(const char *p_begin, const char *p_end);
+
+	/** find_comment_end    Find the "*" "/" pair that closes a block
+	 *                      comment.
+	 *
+	 * @param p_begin : first byte inside the comment.
+	 * @param p_end   : end of the bytes.
+	 * @return ptr to the closing '*', or p_end if there is none.
+	 */
+	const char *find_comment_end(const char *p_begin, const char *p_end);
+
+	/** hash_bytes          FNV-1a hash of a run of bytes.
+	 *
+	 * @param p_bytes : first byte.
+	 * @param count   : number of bytes.
+	 * @return the hash.
+	 */
+	uint64_t hash_bytes(const char *p_bytes, size_t count);
+}
+
+#endif
@@ -32,13 +32,13 @@ namespace cx {
 
 		symbol_table_node_ptr p_new_id = nullptr;
 
-		p_new_id = search_local(p_token->string);
+		p_new_id = search_local(p_token->atom());
 
 		if (p_new_id != nullptr) {
 			cx_error(error_code::ERR_REDEFINED_IDENTIFIER);
 		}
 
-		p_new_id = std::make_shared<symbol_table_node>(p_token->string, define_code::DC_TYPE);
+		p_new_id = std::make_shared<symbol_table_node>(p_token->atom(), define_code::DC_TYPE);
 		p_new_id->p_type = std::make_shared<cx_type>(F_REFERENCE, T_REFERENCE, 0, p_new_id, p_std_type_members);
 
 		get_token();
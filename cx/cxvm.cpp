@@ -27,6 +27,13 @@ THE SOFTWARE.
 #include "cxvm.h"
 #include "symtab.h"
 #include "error.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "profile.h"
+#include "simd.h"
+#include "tier.h"
+#include "trace.h"
+#include "verify.h"
 
 namespace cx{
 	namespace vm_settings {
@@ -35,33 +42,51 @@ namespace cx{
 		bool dev_debug_flag = false;
 		// Verbose garbage collection
 		bool verbose_gc = false;
+		// Trusted code: emit array access without bounds checks
+		bool unchecked_flag = false;
+		// Run functions as x86-64 machine code where the JIT can
+		bool jit_flag = false;
 	}
 
 	const wchar_t *opcode_string[] = {
 		L"aaload"            ,
 		L"aastore"           ,
 		L"aconst_null"       ,
+		L"ainc"              ,
 		L"aload"             ,
 		L"anewarray"         ,
+		L"aptr"              ,
 		L"arraylength"       ,
 		L"astore"            ,
 		L"vm_throw"            ,
 		L"b2i"               ,
 		L"baload"            ,
+		L"baload_u"          ,
+		L"baload_p"          ,
 		L"bastore"           ,
+		L"bastore_u"         ,
+		L"bastore_p"         ,
 		L"beq"               ,
 		L"bipush"            ,
 		L"c2i"               ,
 		L"call"              ,
 		L"caload"            ,
+		L"caload_u"          ,
+		L"caload_p"          ,
 		L"castore"           ,
+		L"castore_u"         ,
+		L"castore_p"         ,
 		L"checkcast"         ,
 		L"d2f"               ,
 		L"d2i"               ,
 		L"d2l"               ,
 		L"dadd"              ,
 		L"daload"            ,
+		L"daload_u"          ,
+		L"daload_p"          ,
 		L"dastore"           ,
+		L"dastore_u"         ,
+		L"dastore_p"         ,
 		L"dcmp"              ,
 		L"dconst"            ,
 		L"ddiv"              ,
@@ -94,8 +119,12 @@ namespace cx{
 		L"i2d"               ,
 		L"iadd"              ,
 		L"iaload"            ,
+		L"iaload_u"          ,
+		L"iaload_p"          ,
 		L"iand"              ,
 		L"iastore"           ,
+		L"iastore_u"         ,
+		L"iastore_p"         ,
 		L"icmp"              ,
 		L"iconst"            ,
 		L"idiv"              ,
@@ -166,6 +195,7 @@ namespace cx{
 		L"ret"              ,
 		L"swap"             ,
 		L"tableswitch"      ,
+		L"vloop"            ,
 		L"zeq"              ,
 		L"break_marker"
 	};
@@ -195,6 +225,10 @@ namespace cx{
 	// Top of stack
 #define _TOS vpu.stack_ptr[-1]
 
+	// -profile-out count of the current instruction
+#define _COUNT(taken) \
+	profile::count(p_my_function_id, static_cast<int>(vpu.inst_ptr - vpu.code_ptr->begin()), taken)
+
 	// Memory address to uintptr_t
 #define _ADDRTOINT(addr) (uintptr_t)*&addr	
 
@@ -224,6 +258,30 @@ namespace cx{
 	_BOUNDS_CHECK(index) \
 	*((type *)((char *)mem + (index * sizeof(type)))) = v_;\
 }
+
+	/* Unchecked load/store, emitted only when the index is proven
+	 * to be in bounds or when running with -unchecked. */
+#define _ALOAD_U(t_, type) {      \
+		cx_int index = _POPS->i_; \
+		void *mem = _POPS->a_; \
+		_PUSHS->t_ = ((type *)mem)[index];\
+}
+
+#define _ASTORE_U(t_, type) {     \
+	type v_ = _POPS->t_;\
+	cx_int index = _POPS->i_;\
+	((type *)_VALUE->a_)[index] = v_;\
+}
+
+	/* Load/store through an element pointer kept in a hidden local
+	 * by the strength reduction pass (see APTR/AINC). */
+#define _ALOAD_P(t_, type) {      \
+		_PUSHS->t_ = *((type *)_VALUE->a_);\
+}
+
+#define _ASTORE_P(t_, type) {     \
+	*((type *)_VALUE->a_) = _POPS->t_;\
+}
 	// Binary Operators
 #define _BIN_OP(t_, type, op)  { \
 	type b = _POPS->t_; \
@@ -242,8 +300,28 @@ namespace cx{
 	_PUSHS->i_ = (a op b); \
 }
 
+	/** unchecked_array_op   Map an array load/store to the variant
+	 *                      that skips _BOUNDS_CHECK.
+	 *
+	 * @param op : checked array opcode.
+	 * @return unchecked opcode, or op if there is none.
+	 */
+	opcode unchecked_array_op(opcode op) {
+		switch (op) {
+		case BALOAD: return BALOAD_U;
+		case BASTORE: return BASTORE_U;
+		case CALOAD: return CALOAD_U;
+		case CASTORE: return CASTORE_U;
+		case DALOAD: return DALOAD_U;
+		case DASTORE: return DASTORE_U;
+		case IALOAD: return IALOAD_U;
+		case IASTORE: return IASTORE_U;
+		default: return op;
+		}
+	}
+
 	// Pointer to the runtime stack
-	cxvm::cxvm() { this->vpu.stack_ptr = this->stack; }
+	cxvm::cxvm() { this->vpu.stack_ptr = this->p_operand_base = this->stack; }
 	cxvm::~cxvm(void){}
 	value *cxvm::push(void) { return _PUSHS; }
 	value *cxvm::pop(void) { return _POPS; }
@@ -269,6 +347,7 @@ namespace cx{
 
 		this->vpu.code_ptr = &this->p_my_function_id->defined.routine.program_code;
 		this->vpu.inst_ptr = this->vpu.code_ptr->begin();
+		if (profile_settings::record) profile::enter(p_function_id);
 
 		// load variables
 		if (!p_my_function_id->defined.routine.p_variable_ids.empty()){
@@ -276,6 +355,8 @@ namespace cx{
 				local->runstack_item = _PUSHS;
 			}
 		}
+
+		this->p_operand_base = this->vpu.stack_ptr;
 	}
 
 	void cxvm::nano_sleep(int nano_secs = 5) {
@@ -284,366 +365,583 @@ namespace cx{
 			);
 	}
 
-	void cxvm::go(void) {
+	/** call        Call a function: pop its arguments, run it on a
+	 *              VM of its own and push what it returns.
+	 *
+	 * @param p_function_id : function to call.
+	 */
+	void cxvm::call(symbol_table_node *p_function_id) {
+		invoke(p_function_id);
+		if (vm_settings::dev_debug_flag) show_return(p_function_id);
+	}
+
+	/** show_return     -dev: print what a call returned.
+	 *
+	 * @param p_function_id : function called.
+	 */
+	void cxvm::show_return(const symbol_table_node *p_function_id) {
+		const value &result = *p_function_id->runstack_item;
+
+		switch (p_function_id->p_type->typecode) {
+		case type_code::T_BOOLEAN: std::wcout << p_function_id->node_name << L" returned " << result.z_ << std::endl; break;
+		case type_code::T_BYTE: std::wcout << p_function_id->node_name << L" returned " << result.b_ << std::endl; break;
+		case type_code::T_CHAR: std::wcout << p_function_id->node_name << L" returned " << result.c_ << std::endl; break;
+		case type_code::T_DOUBLE: std::wcout << p_function_id->node_name << L" returned " << result.d_ << std::endl; break;
+		case type_code::T_INT: std::wcout << p_function_id->node_name << L" returned " << result.i_ << std::endl; break;
+		default: break;
+		}
+	}
+
+	/** invoke      call without the -dev output, the interpreter
+	 *              loop leaves that to its policy.
+	 *
+	 * @param p_function_id : function to call.
+	 */
+	void cxvm::invoke(symbol_table_node *p_function_id) {
+		// a lazy body is compiled on the first call
+		if (p_function_id->defined.routine.p_lazy_body != nullptr) compile_function_body(p_function_id);
+		if (tier_settings::tiered) tier::enter(p_function_id);
+
+		std::shared_ptr<cxvm> cx = std::make_shared<cxvm>();
+		p_function_id->runstack_item = cx->push();
+		p_function_id->runstack_item->a_ = nullptr;
+
+		// Load parameters from the stack
+		std::vector<std::shared_ptr<symbol_table_node>>::reverse_iterator parameter = p_function_id->defined.routine.p_parameter_ids.rbegin();
+		for (; parameter != p_function_id->defined.routine.p_parameter_ids.rend(); ++parameter) {
+			value *p_param = _POPS;
+			parameter->get()->runstack_item = cx->push();
+
+			switch (parameter->get()->p_type->typecode) {
+			case type_code::T_BOOLEAN:
+				parameter->get()->runstack_item->z_ = p_param->z_;
+				break;
+			case type_code::T_BYTE:
+				parameter->get()->runstack_item->b_ = p_param->b_;
+				break;
+			case type_code::T_CHAR:
+				parameter->get()->runstack_item->c_ = p_param->c_;
+				break;
+			case type_code::T_DOUBLE:
+				parameter->get()->runstack_item->d_ = p_param->d_;
+				break;
+			case type_code::T_INT:
+				parameter->get()->runstack_item->i_ = p_param->i_;
+				break;
+				// Reference needs to be copied into the callee heap
+			case type_code::T_REFERENCE: {
+				parameter->get()->runstack_item->a_ = p_param->a_;
+				uintptr_t reference = _ADDRTOINT(p_param->a_);
+				heap::mem_mapping mem_map = this->heap_.at(reference);
+				cx->copy_reference(reference, mem_map);
+				parameter->get()->p_type = mem_map.p_type;
+			}break;
+			}
+		}
+
+		// Enter function info
+		cx->enter_function(p_function_id);
+		// Run function
+		tier::active_call running(p_function_id);
+		cx->go();
+
+		// Push functions return value
+		switch (p_function_id->p_type->typecode) {
+		case type_code::T_BOOLEAN:
+			_PUSHS->z_ = p_function_id->runstack_item->z_;
+			break;
+		case type_code::T_BYTE:
+			_PUSHS->b_ = p_function_id->runstack_item->b_;
+			break;
+		case type_code::T_CHAR:
+			_PUSHS->c_ = p_function_id->runstack_item->c_;
+			break;
+		case type_code::T_DOUBLE:
+			_PUSHS->d_ = p_function_id->runstack_item->d_;
+			break;
+		case type_code::T_INT:
+			_PUSHS->i_ = p_function_id->runstack_item->i_;
+			break;
+			// Need to copy returned reference into caller heap
+		case type_code::T_REFERENCE: {
+			uintptr_t reference = _ADDRTOINT(p_function_id->runstack_item->a_);
+			auto mem_mapping = this->heap_.insert(std::make_pair(reference, cx->get_managed_reference(reference)));
+			p_function_id->p_type = mem_mapping.first->second.p_type;// ->heap_.at(reference).p_type;
+			_PUSHS->a_ = p_function_id->runstack_item->a_;
+		}break;
+		case type_code::T_VOID: break;
+		}
+	}
+
+	/** new_array   Allocate an array on this VM's heap.
+	 *
+	 * @param p_type        : array type, its size is allocated.
+	 * @param element_count : requested elements.
+	 * @return the memory.
+	 */
+	void *cxvm::new_array(const cx_type *p_type, size_t element_count) {
 		using namespace heap;
 
-		try {
-			for (vpu.inst_ptr = vpu.code_ptr->begin();
-			vpu.inst_ptr < vpu.code_ptr->end();
-				vpu.inst_ptr++) {
-
-				switch (vpu.inst_ptr->op) {
-				case opcode::AALOAD: _PUSHS->a_ = _VALUE->a_; continue;
-				case opcode::AASTORE: _VALUE->a_ = _POPS->a_; continue;
-				case opcode::ACONST_NULL: _PUSHS->a_ = nullptr; continue;
-				case opcode::ALOAD: _PUSHS->a_ = _VALUE->a_;  continue;
-/*				case opcode::ANEWARRAY: {
-					size_t size = (size_t)_POPS->i_ * sizeof(void *);
+		const size_t size = p_type->size;
 
-					void **mem = (void **)malloc(size);
-					assert(mem != nullptr);
+		void *mem = malloc(size);
 
-					mem_mapping *mem_map = &heap_[_ADDRTOINT(mem)]; // point to, only 1 hash calculation
+		if (mem == nullptr) {
+			std::string msg = "[ malloc ] ";
+			msg += std::strerror(errno);
 
-					/* Compile with -D INSTRUCTION_TEST if testing.
-					* If undefined, RAM gets released and tests allocating RAM
-					* will fail.   */
+			msg += "\ntype: " + std::to_string(p_type->typecode);
+			//msg += "\nelement type: " + std::to_string(p_type->array.p_element_type->typecode);
+		//	msg += "\nelement size: " + type_size[p_type->typecode];
+			msg += "\nelement count: " + std::to_string(element_count);
+			msg += "\nsize: " + std::to_string(size);
 
-					// assign mem to smart pointer, release using free()
-/*					mem_map->shared_ref = heap::managedmem((uintptr_t *)mem, free);
-					mem_map->size = size; // size
-					mem_map->typecode = T_REFERENCE; // type
-					mem_map->typeform = F_ARRAY;
-					_PUSHS->a_ = (void *)mem;
-				} continue;
-				case opcode::ARRAYLENGTH: {
-					void *mem = _POPS->a_;
-					assert(mem != nullptr);
-					_PUSHS->i_ = heap_[_ADDRTOINT(mem)].count();
-				} continue;*/
-				case opcode::ASTORE: {
-					_VALUE->a_ = _POPS->a_;
-					uintptr_t reference = _ADDRTOINT(_VALUE->a_);
-					// Do a look up on the heap and increment reference count.
-					symbol_table_node *p_node = _NODE;
-					p_node->p_type = this->heap_.at(reference).p_type;
-				}continue;
-				case opcode::VM_THROW: { // Throws a string message
-					char *message = (char *)_POPS->a_;
-					assert(message != nullptr);
-					throw std::exception(message);
-				} continue;
-				case opcode::B2I:		_PUSHS->i_ = static_cast<cx_int> (_POPS->b_); continue;
-				case opcode::BALOAD:	_ALOAD(b_, cx_byte); continue;
-				case opcode::BASTORE:	_ASTORE(b_, cx_byte); continue;
-				case opcode::BEQ:		_REL_OP(b_, cx_byte, == ); continue;
-				case opcode::C2I:		_PUSHS->i_ = static_cast<cx_int> (_POPS->c_); continue;
-				case opcode::CALL: {
-					symbol_table_node *p_function_id = (symbol_table_node *)vpu.inst_ptr->arg0.a_;
-
-					std::shared_ptr<cxvm> cx = std::make_shared<cxvm>();
-					p_function_id->runstack_item = cx->push();
-					p_function_id->runstack_item->a_ = nullptr;
-
-					// Load parameters from the stack
-					std::vector<std::shared_ptr<symbol_table_node>>::reverse_iterator parameter = p_function_id->defined.routine.p_parameter_ids.rbegin();
-					for (; parameter != p_function_id->defined.routine.p_parameter_ids.rend(); ++parameter) {
-						value *p_param = _POPS;
-						parameter->get()->runstack_item = cx->push();
-
-						switch (parameter->get()->p_type->typecode) {
-						case type_code::T_BOOLEAN:
-							parameter->get()->runstack_item->z_ = p_param->z_;
-							break;
-						case type_code::T_BYTE:
-							parameter->get()->runstack_item->b_ = p_param->b_;
-							break;
-						case type_code::T_CHAR:
-							parameter->get()->runstack_item->c_ = p_param->c_;
-							break;
-						case type_code::T_DOUBLE:
-							parameter->get()->runstack_item->d_ = p_param->d_;
-							break;
-						case type_code::T_INT:
-							parameter->get()->runstack_item->i_ = p_param->i_;
-							break;
-							// Reference needs to be copied into the callee heap
-						case type_code::T_REFERENCE: {
-							parameter->get()->runstack_item->a_ = p_param->a_;
-							uintptr_t reference = _ADDRTOINT(p_param->a_);
-							heap::mem_mapping mem_map = this->heap_.at(reference);
-							cx->copy_reference(reference, mem_map);
-							parameter->get()->p_type = mem_map.p_type;
-						}break;
-						}
-					}
+			throw std::exception(msg.c_str());
+		}
 
-					// Enter function info
-					cx->enter_function(p_function_id);
-					// Run function
-					cx->go();
+		uintptr_t reference = _ADDRTOINT(mem);
+		auto mem_map = this->heap_.insert(std::make_pair(reference, mem_mapping()));
+		mem_map.first->second.shared_ref = std::shared_ptr<uintptr_t>((uintptr_t *)mem, free);
+		mem_map.first->second.p_type = std::make_shared<cx_type>(*p_type);
 
-					// Push functions return value
-					switch (p_function_id->p_type->typecode) {
-					case type_code::T_BOOLEAN:
-						_PUSHS->z_ = p_function_id->runstack_item->z_;
+		return mem;
+	}
 
-						if (vm_settings::dev_debug_flag) {
-							std::wcout << p_function_id->node_name << L" returned " << p_function_id->runstack_item->z_ << std::endl;
-						}
-						break;
-					case type_code::T_BYTE:
-						_PUSHS->b_ = p_function_id->runstack_item->b_;
+	/** resume      Go on running a function left by a trace at
+	 *              a side exit.  Its result, parameters and
+	 *              variables are bound already, the operands it
+	 *              had are on this VM's stack.
+	 *
+	 * @param p_function_id : function to run.
+	 * @param location      : instruction to go on at.
+	 */
+	void cxvm::resume(symbol_table_node *p_function_id, int location) {
+		this->p_my_function_id = p_function_id;
 
-						if (vm_settings::dev_debug_flag) {
-							std::wcout << p_function_id->node_name << L" returned " << p_function_id->runstack_item->b_ << std::endl;
-						}
-						break;
-					case type_code::T_CHAR:
-						_PUSHS->c_ = p_function_id->runstack_item->c_;
+		this->vpu.code_ptr = &p_function_id->defined.routine.program_code;
+		this->vpu.inst_ptr = this->vpu.code_ptr->begin() + location;
+		// its slots are on the VM it left, only operands are here
+		this->p_operand_base = this->stack;
 
-						if (vm_settings::dev_debug_flag) {
-							std::wcout << p_function_id->node_name << L" returned " << p_function_id->runstack_item->c_ << std::endl;
-						}
-						break;
-					case type_code::T_DOUBLE:
-						_PUSHS->d_ = p_function_id->runstack_item->d_;
+		tier::active_call running(p_function_id);
+		go();
+	}
 
-						if (vm_settings::dev_debug_flag) {
-							std::wcout << p_function_id->node_name << L" returned " << p_function_id->runstack_item->d_ << std::endl;
-						}
-						break;
-					case type_code::T_INT:
-						_PUSHS->i_ = p_function_id->runstack_item->i_;
+	/** guarded_push/guarded_pop/guarded_node/guard_jump
+	 *
+	 *              What a guarded loop does for code the verifier
+	 *              turned down: operands stay between the function's
+	 *              slots and the top of the stack, nodes must be
+	 *              bound to a slot and jumps must land in the code.
+	 */
+	inline value *cxvm::guarded_push(void) {
+		if (vpu.stack_ptr >= this->stack + _STACK_SIZE) throw std::exception("stack overflow");
+		return vpu.stack_ptr++;
+	}
 
-						if (vm_settings::dev_debug_flag) {
-							std::wcout << p_function_id->node_name << L" returned " << p_function_id->runstack_item->i_ << std::endl;
-						}
-						break;
-						// Need to copy returned reference into caller heap
-					case type_code::T_REFERENCE: {
-						uintptr_t reference = _ADDRTOINT(p_function_id->runstack_item->a_);
-						auto mem_mapping = this->heap_.insert(std::make_pair(reference, cx->get_managed_reference(reference)));
-						p_function_id->p_type = mem_mapping.first->second.p_type;// ->heap_.at(reference).p_type;
-						_PUSHS->a_ = p_function_id->runstack_item->a_;
-					}break;
-					case type_code::T_VOID: break;
-					}
-				} continue;
-				case opcode::CALOAD: _ALOAD(c_, cx_char); continue;
-				case opcode::CASTORE: _ASTORE(c_, cx_char); continue;
-				case opcode::CHECKCAST: continue;
-
-					/** Duplicate the top operand stack value
-					 * Duplicate the top value on the operand stack and push
-					 * the duplicated value onto the operand stack. */
+	inline value *cxvm::guarded_pop(void) {
+		if (vpu.stack_ptr <= this->p_operand_base) throw std::exception("stack underflow");
+		return --vpu.stack_ptr;
+	}
+
+	inline symbol_table_node *cxvm::guarded_node(void) const {
+		symbol_table_node *p_node = (symbol_table_node *)vpu.inst_ptr->arg0.a_;
+		if ((p_node == nullptr) || (p_node->runstack_item == nullptr)) throw std::exception("operand not bound to a slot");
+		return p_node;
+	}
+
+	inline void cxvm::guard_jump(cx_int location) const {
+		if ((location < 1) || (location > static_cast<cx_int>(vpu.code_ptr->size()))) throw std::exception("jump outside the code");
+	}
+
+	// a guarded loop checks every push, pop and operand
+#undef _POPS
+#undef _PUSHS
+#undef _NODE
+#undef _VALUE
+#define _POPS (policy::guarded ? guarded_pop() : --vpu.stack_ptr)
+#define _PUSHS (policy::guarded ? guarded_push() : vpu.stack_ptr++)
+#define _NODE (policy::guarded ? guarded_node() : (symbol_table_node *)this->vpu.inst_ptr->arg0.a_)
+#define _VALUE _NODE->runstack_item
+
+	/* Interpreter loop policies.  Each fixes at compile time which
+	 * hooks run<> is built with, a hook left out costs nothing; one
+	 * built in still tests its setting, as several share a policy. */
+
+	// No hooks
+	struct plain_loop {
+		static const bool guarded = false;		// guard the stack, operands and jumps
+		static const bool debug = false;		// -dev output
+		static const bool back_edges = false;	// -tier/-trace take loops over
+		static const bool counting = false;		// -profile-out counts
+	};
+
+	// -tier or -trace: a loop's back edge may leave for machine code or a trace
+	struct trace_loop : plain_loop {
+		static const bool back_edges = true;
+	};
+
+	// -profile-out: count calls, branches, loop trips and returns
+	struct profile_loop : plain_loop {
+		static const bool counting = true;
+	};
+
+	// -dev, or hooks of more than one policy: every hook, all code guarded
+	struct debug_loop {
+		static const bool guarded = true;
+		static const bool debug = true;
+		static const bool back_edges = true;
+		static const bool counting = true;
+	};
+
+	// A policy for code the verifier turned down
+	template <class policy> struct guarded_loop : policy {
+		static const bool guarded = true;
+	};
+
+	void (cxvm::*cxvm::p_trusted_loop)(void) = &cxvm::run<plain_loop>;
+	void (cxvm::*cxvm::p_guarded_loop)(void) = &cxvm::run<guarded_loop<plain_loop>>;
+
+	/** choose_loops    Pick the interpreter loops for the settings,
+	 *                  once they are read.
+	 */
+	void cxvm::choose_loops(void) {
+		const bool back_edges = tier_settings::tiered || trace_settings::tracing;
+
+		if (vm_settings::dev_debug_flag || (back_edges && profile_settings::record)) {
+			p_trusted_loop = p_guarded_loop = &cxvm::run<debug_loop>;
+		}
+		else if (profile_settings::record) {
+			p_trusted_loop = &cxvm::run<profile_loop>;
+			p_guarded_loop = &cxvm::run<guarded_loop<profile_loop>>;
+		}
+		else if (back_edges) {
+			p_trusted_loop = &cxvm::run<trace_loop>;
+			p_guarded_loop = &cxvm::run<guarded_loop<trace_loop>>;
+		}
+		else {
+			p_trusted_loop = &cxvm::run<plain_loop>;
+			p_guarded_loop = &cxvm::run<guarded_loop<plain_loop>>;
+		}
+	}
+
+	template <class policy> void cxvm::run(void) {
+		using namespace heap;
+
+		for (;
+		vpu.inst_ptr < vpu.code_ptr->end();
+			vpu.inst_ptr++) {
+
+			switch (vpu.inst_ptr->op) {
+			case opcode::AALOAD: _PUSHS->a_ = _VALUE->a_; continue;
+			case opcode::AASTORE: _VALUE->a_ = _POPS->a_; continue;
+			case opcode::ACONST_NULL: _PUSHS->a_ = nullptr; continue;
+			case opcode::AINC: _VALUE->a_ = (char *)_VALUE->a_ + vpu.inst_ptr->arg1.i_; continue;
+			case opcode::ALOAD: _PUSHS->a_ = _VALUE->a_;  continue;
+			case opcode::APTR: _VALUE->a_ = (char *)_POPS->a_ + vpu.inst_ptr->arg1.i_; continue;
+/*				case opcode::ANEWARRAY: {
+				size_t size = (size_t)_POPS->i_ * sizeof(void *);
+
+				void **mem = (void **)malloc(size);
+				assert(mem != nullptr);
+
+				mem_mapping *mem_map = &heap_[_ADDRTOINT(mem)]; // point to, only 1 hash calculation
+
+				/* Compile with -D INSTRUCTION_TEST if testing.
+				* If undefined, RAM gets released and tests allocating RAM
+				* will fail.   */
+
+				// assign mem to smart pointer, release using free()
+/*					mem_map->shared_ref = heap::managedmem((uintptr_t *)mem, free);
+				mem_map->size = size; // size
+				mem_map->typecode = T_REFERENCE; // type
+				mem_map->typeform = F_ARRAY;
+				_PUSHS->a_ = (void *)mem;
+			} continue;
+			case opcode::ARRAYLENGTH: {
+				void *mem = _POPS->a_;
+				assert(mem != nullptr);
+				_PUSHS->i_ = heap_[_ADDRTOINT(mem)].count();
+			} continue;*/
+			case opcode::ASTORE: {
+				_VALUE->a_ = _POPS->a_;
+				uintptr_t reference = _ADDRTOINT(_VALUE->a_);
+				// Do a look up on the heap and increment reference count.
+				symbol_table_node *p_node = _NODE;
+				p_node->p_type = this->heap_.at(reference).p_type;
+			}continue;
+			case opcode::VM_THROW: { // Throws a string message
+				char *message = (char *)_POPS->a_;
+				assert(message != nullptr);
+				throw std::exception(message);
+			} continue;
+			case opcode::B2I:		_PUSHS->i_ = static_cast<cx_int> (_POPS->b_); continue;
+			case opcode::BALOAD:	_ALOAD(b_, cx_byte); continue;
+			case opcode::BALOAD_U:	_ALOAD_U(b_, cx_byte); continue;
+			case opcode::BALOAD_P:	_ALOAD_P(b_, cx_byte); continue;
+			case opcode::BASTORE:	_ASTORE(b_, cx_byte); continue;
+			case opcode::BASTORE_U:	_ASTORE_U(b_, cx_byte); continue;
+			case opcode::BASTORE_P:	_ASTORE_P(b_, cx_byte); continue;
+			case opcode::BEQ:		_REL_OP(b_, cx_byte, == ); continue;
+			case opcode::C2I:		_PUSHS->i_ = static_cast<cx_int> (_POPS->c_); continue;
+			case opcode::CALL:
+				if (policy::counting && profile_settings::record) _COUNT(false);
+				invoke((symbol_table_node *)vpu.inst_ptr->arg0.a_);
+				if (policy::debug && vm_settings::dev_debug_flag) show_return((symbol_table_node *)vpu.inst_ptr->arg0.a_);
+				continue;
+			case opcode::CALOAD: _ALOAD(c_, cx_char); continue;
+			case opcode::CALOAD_U: _ALOAD_U(c_, cx_char); continue;
+			case opcode::CALOAD_P: _ALOAD_P(c_, cx_char); continue;
+			case opcode::CASTORE: _ASTORE(c_, cx_char); continue;
+			case opcode::CASTORE_U: _ASTORE_U(c_, cx_char); continue;
+			case opcode::CASTORE_P: _ASTORE_P(c_, cx_char); continue;
+			case opcode::CHECKCAST: continue;
+
+				/** Duplicate the top operand stack value
+				 * Duplicate the top value on the operand stack and push
+				 * the duplicated value onto the operand stack. */
 /*				case opcode::DUP: {
-					value *val = (value *)(vpu.stack_ptr - 1);
-					assert(val != nullptr);
+				value *val = (value *)(vpu.stack_ptr - 1);
+				assert(val != nullptr);
 
-					// Allow the compiler to build copy CTOR
-					value *new_value_copy = new value(*val);
+				// Allow the compiler to build copy CTOR
+				value *new_value_copy = new value(*val);
 
-					assert(new_value_copy != nullptr);
-					assert(new_value_copy->a_ == val->a_);
+				assert(new_value_copy != nullptr);
+				assert(new_value_copy->a_ == val->a_);
 
-					heap::mem_mapping *mem_map = &heap_[_ADDRTOINT(new_value_copy)]; // point to, only 1 hash calculation
+				heap::mem_mapping *mem_map = &heap_[_ADDRTOINT(new_value_copy)]; // point to, only 1 hash calculation
 
-					/* Compile with -D INSTRUCTION_TEST if testing.
-					* If undefined, RAM gets released and tests that allocate RAM
-					* will fail.   */
+				/* Compile with -D INSTRUCTION_TEST if testing.
+				* If undefined, RAM gets released and tests that allocate RAM
+				* will fail.   */
 
-					// Assign mem to smart pointer, release using delete
+				// Assign mem to smart pointer, release using delete
 /*					mem_map->shared_ref = std::move(heap::managedmem((uintptr_t *)new_value_copy));
-					mem_map->size = sizeof(value); // size
-					mem_map->typecode = T_REFERENCE; // type
-					mem_map->typeform = F_SCALAR;
-
-					// Push new copy
-					_PUSHS->a_ = (void *)new_value_copy;
-
-				} continue;*/
-				case opcode::DUP2:		continue;
-				case opcode::DUP2_X1:	continue;
-				case opcode::DUP2_X2:	continue;
-				case opcode::DUP_X1:	continue;
-				case opcode::DUP_X2:	continue;
-				case opcode::D2I:		_PUSHS->i_ = static_cast<cx_int> (_POPS->d_); continue;
-				case opcode::DADD:		_BIN_OP(d_, cx_real, +); continue;
-				case opcode::DALOAD:	_ALOAD(d_, cx_real); continue;
-				case opcode::DASTORE:	_ASTORE(d_, cx_real); continue;
-				case opcode::DCONST:	_PUSHS->d_ = vpu.inst_ptr->arg0.d_; continue;
-				case opcode::DDIV:		_BIN_OP(d_, cx_real, / ); continue;
-				case opcode::DEL: {
-					uintptr_t reference = _ADDRTOINT(_VALUE->a_);
-					if (this->heap_.erase(reference) == 0) {
-						std::string node_name = std::string(_NODE->node_name.begin(), _NODE->node_name.end());
-						std::string msg = "Double delete on reference or [ " + node_name + " ] not allocated on heap.";
-						throw std::exception(msg.c_str());
-					}
-				}continue;
-				case opcode::DEQ:		_REL_OP(d_, cx_real, == ); continue;
-				case opcode::DGT:		_REL_OP(d_, cx_real, > ); continue;
-				case opcode::DGT_EQ:	_REL_OP(d_, cx_real, >= ); continue;
-				case opcode::DINC:		_VALUE->d_ += vpu.inst_ptr->arg1.d_; continue;
-				case opcode::DLOAD:		_PUSHS->d_ = _VALUE->d_; continue;
-				case opcode::DLT:		_REL_OP(d_, cx_real, < ); continue;
-				case opcode::DLT_EQ:	_REL_OP(d_, cx_real, <= ); continue;
-				case opcode::DMUL:		_BIN_OP(d_, cx_real, * ); continue;
-				case opcode::DNEG:		_PUSHS->d_ = -abs(_POPS->d_); continue;
-				case opcode::DNOT_EQ:	_REL_OP(d_, cx_real, != ); continue;
-				case opcode::DPOS:		_PUSHS->d_ = abs(_POPS->d_); continue;
-				case opcode::DREM: {
-					cx_real b = _POPS->d_;
-					cx_real a = _POPS->d_;
-					_PUSHS->d_ = fmod(a, b);
-				}continue;
-				case opcode::DSTORE:	_VALUE->d_ = _POPS->d_; continue;
-				case opcode::DSUB:		_BIN_OP(d_, cx_real, - ); continue;
-				case opcode::GETFIELD: continue;
-				case opcode::GETSTATIC: continue;
-				case opcode::GOTO: {
-					cx_int location = vpu.inst_ptr->arg0.i_;
-					if (location <= 0) {
-						vpu.inst_ptr = vpu.code_ptr->begin();
-					}
-					else {
-						vpu.inst_ptr = vpu.code_ptr->begin() + (int)(location - 1);
+				mem_map->size = sizeof(value); // size
+				mem_map->typecode = T_REFERENCE; // type
+				mem_map->typeform = F_SCALAR;
+
+				// Push new copy
+				_PUSHS->a_ = (void *)new_value_copy;
+
+			} continue;*/
+			case opcode::DUP2:		continue;
+			case opcode::DUP2_X1:	continue;
+			case opcode::DUP2_X2:	continue;
+			case opcode::DUP_X1:	continue;
+			case opcode::DUP_X2:	continue;
+			case opcode::D2I:		_PUSHS->i_ = static_cast<cx_int> (_POPS->d_); continue;
+			case opcode::DADD:		_BIN_OP(d_, cx_real, +); continue;
+			case opcode::DALOAD:	_ALOAD(d_, cx_real); continue;
+			case opcode::DALOAD_U:	_ALOAD_U(d_, cx_real); continue;
+			case opcode::DALOAD_P:	_ALOAD_P(d_, cx_real); continue;
+			case opcode::DASTORE:	_ASTORE(d_, cx_real); continue;
+			case opcode::DASTORE_U:	_ASTORE_U(d_, cx_real); continue;
+			case opcode::DASTORE_P:	_ASTORE_P(d_, cx_real); continue;
+			case opcode::DCONST:	_PUSHS->d_ = vpu.inst_ptr->arg0.d_; continue;
+			case opcode::DDIV:		_BIN_OP(d_, cx_real, / ); continue;
+			case opcode::DEL: {
+				uintptr_t reference = _ADDRTOINT(_VALUE->a_);
+				if (this->heap_.erase(reference) == 0) {
+					std::string node_name = std::string(_NODE->node_name.begin(), _NODE->node_name.end());
+					std::string msg = "Double delete on reference or [ " + node_name + " ] not allocated on heap.";
+					throw std::exception(msg.c_str());
+				}
+			}continue;
+			case opcode::DEQ:		_REL_OP(d_, cx_real, == ); continue;
+			case opcode::DGT:		_REL_OP(d_, cx_real, > ); continue;
+			case opcode::DGT_EQ:	_REL_OP(d_, cx_real, >= ); continue;
+			case opcode::DINC:		_VALUE->d_ += vpu.inst_ptr->arg1.d_; continue;
+			case opcode::DLOAD:		_PUSHS->d_ = _VALUE->d_; continue;
+			case opcode::DLT:		_REL_OP(d_, cx_real, < ); continue;
+			case opcode::DLT_EQ:	_REL_OP(d_, cx_real, <= ); continue;
+			case opcode::DMUL:		_BIN_OP(d_, cx_real, * ); continue;
+			case opcode::DNEG:		_PUSHS->d_ = -abs(_POPS->d_); continue;
+			case opcode::DNOT_EQ:	_REL_OP(d_, cx_real, != ); continue;
+			case opcode::DPOS:		_PUSHS->d_ = abs(_POPS->d_); continue;
+			case opcode::DREM: {
+				cx_real b = _POPS->d_;
+				cx_real a = _POPS->d_;
+				_PUSHS->d_ = fmod(a, b);
+			}continue;
+			case opcode::DSTORE:	_VALUE->d_ = _POPS->d_; continue;
+			case opcode::DSUB:		_BIN_OP(d_, cx_real, - ); continue;
+			case opcode::GETFIELD: continue;
+			case opcode::GETSTATIC: continue;
+			case opcode::GOTO: {
+				cx_int location = vpu.inst_ptr->arg0.i_;
+				if (policy::counting && profile_settings::record) _COUNT(false);
+
+				if (policy::back_edges && tier_settings::tiered) {
+					const int head = optimizer::jump_target(*vpu.inst_ptr);
+
+					// a hot loop goes on in machine code once it's translated
+					if (head <= vpu.inst_ptr - vpu.code_ptr->begin()) {
+						const native_code *p_native = tier::back_edge(p_my_function_id);
+						if ((p_native != nullptr) && jit::run_loop(this, *p_native, head)) return;
 					}
-				} continue;
-				case opcode::I2B:		_PUSHS->b_ = static_cast<cx_byte> (_POPS->i_); continue;
-				case opcode::I2C:		_PUSHS->c_ = static_cast<cx_char> (_POPS->i_); continue;
-				case opcode::I2D:		_PUSHS->d_ = static_cast<cx_real> (_POPS->i_); continue;
-				case opcode::IADD:		_BIN_OP(i_, cx_int, + ); continue;
-				case opcode::IALOAD:	_ALOAD(i_, cx_int); continue;
-				case opcode::ILT:		_REL_OP(i_, cx_int, < ); continue;
-					// Bitwise AND
-				case opcode::IAND:		_BIN_OP(i_, cx_int, & ); continue;
-				case opcode::IASTORE:	_ASTORE(i_, cx_int); continue;
-				case opcode::ICMP:
-					continue;
-				case opcode::ICONST:	_PUSHS->i_ = vpu.inst_ptr->arg0.i_; continue;
-				case opcode::IDIV:		_BIN_OP(i_, cx_int, / ); continue;
-				case opcode::IEQ:		_REL_OP(i_, cx_int, == ); continue;
-				case opcode::IF_FALSE:
-				{
-					if (!_POPS->z_) {
-						cx_int location = vpu.inst_ptr->arg0.i_;
-						vpu.inst_ptr = vpu.code_ptr->begin() + (int)(location - 1);
+				}
+
+				if (policy::back_edges && trace_settings::tracing) {
+					const int head = optimizer::jump_target(*vpu.inst_ptr);
+
+					// a hot loop runs as its trace until a guard fails
+					if (head <= vpu.inst_ptr - vpu.code_ptr->begin()) {
+						const int exit = trace::back_edge(this, p_my_function_id, head);
+						if (exit >= 0) {
+							vpu.inst_ptr = vpu.code_ptr->begin() + (exit - 1);
+							continue;
+						}
 					}
-				}continue;
-				/*case opcode::IFNE: _IF(!= ); continue;
-				case opcode::IFLT: _IF(< ); continue;
-				case opcode::IFGE: _IF(>= ); continue;
-				case opcode::IFGT: _IF(> ); continue;
-				case opcode::IFLE: _IF(<= ); continue;*/
+				}
+
+				if (location <= 0) {
+					vpu.inst_ptr = vpu.code_ptr->begin();
+				}
+				else {
+					if (policy::guarded) guard_jump(location);
+					vpu.inst_ptr = vpu.code_ptr->begin() + (int)(location - 1);
+				}
+			} continue;
+			case opcode::I2B:		_PUSHS->b_ = static_cast<cx_byte> (_POPS->i_); continue;
+			case opcode::I2C:		_PUSHS->c_ = static_cast<cx_char> (_POPS->i_); continue;
+			case opcode::I2D:		_PUSHS->d_ = static_cast<cx_real> (_POPS->i_); continue;
+			case opcode::IADD:		_BIN_OP(i_, cx_int, + ); continue;
+			case opcode::IALOAD:	_ALOAD(i_, cx_int); continue;
+			case opcode::IALOAD_U:	_ALOAD_U(i_, cx_int); continue;
+			case opcode::IALOAD_P:	_ALOAD_P(i_, cx_int); continue;
+			case opcode::ILT:		_REL_OP(i_, cx_int, < ); continue;
+				// Bitwise AND
+			case opcode::IAND:		_BIN_OP(i_, cx_int, & ); continue;
+			case opcode::IASTORE:	_ASTORE(i_, cx_int); continue;
+			case opcode::IASTORE_U:	_ASTORE_U(i_, cx_int); continue;
+			case opcode::IASTORE_P:	_ASTORE_P(i_, cx_int); continue;
+			case opcode::ICMP:
+				continue;
+			case opcode::ICONST:	_PUSHS->i_ = vpu.inst_ptr->arg0.i_; continue;
+			case opcode::IDIV:		_BIN_OP(i_, cx_int, / ); continue;
+			case opcode::IEQ:		_REL_OP(i_, cx_int, == ); continue;
+			case opcode::IF_FALSE:
+			{
+				const bool taken = !_POPS->z_;
+				if (policy::counting && profile_settings::record) _COUNT(taken);
+
+				if (taken) {
+					cx_int location = vpu.inst_ptr->arg0.i_;
+					if (policy::guarded) guard_jump(location);
+					vpu.inst_ptr = vpu.code_ptr->begin() + (int)(location - 1);
+				}
+			}continue;
+			/*case opcode::IFNE: _IF(!= ); continue;
+			case opcode::IFLT: _IF(< ); continue;
+			case opcode::IFGE: _IF(>= ); continue;
+			case opcode::IFGT: _IF(> ); continue;
+			case opcode::IFLE: _IF(<= ); continue;*/
 
 /*				case opcode::IF_ACMPEQ: {
-					void *value2 = _POPS->a_;
-					void *value1 = _POPS->a_;
+				void *value2 = _POPS->a_;
+				void *value1 = _POPS->a_;
 
-					if (!memcmp(value1, value2, heap_[_ADDRTOINT(value1)].size)) _JMP(i_);
-				} continue;
+				if (!memcmp(value1, value2, heap_[_ADDRTOINT(value1)].size)) _JMP(i_);
+			} continue;
 
-				case opcode::IF_ACMPNE: {
-					void *value2 = _POPS->a_;
-					void *value1 = _POPS->a_;
+			case opcode::IF_ACMPNE: {
+				void *value2 = _POPS->a_;
+				void *value1 = _POPS->a_;
 
-					if (memcmp(value1, value2, heap_[_ADDRTOINT(value1)].size)) _JMP(i_);
-				} continue;
+				if (memcmp(value1, value2, heap_[_ADDRTOINT(value1)].size)) _JMP(i_);
+			} continue;
 */
-				/*case opcode::IF_ICMPEQ: _IFICMP(== ); continue;
-				case opcode::IF_ICMPNE: _IFICMP(!= ); continue;
-				case opcode::IF_ICMPLT: _IFICMP(< ); continue;
-				case opcode::IF_ICMPGE: _IFICMP(>= ); continue;
-				case opcode::IF_ICMPGT: _IFICMP(> ); continue;
-				case opcode::IF_ICMPLE: _IFICMP(<= ); continue;
-				case opcode::IFNONNULL: if (_POPS->a_ != nullptr) _JMP(i_); continue;
-				case opcode::IFNULL: if (_POPS->a_ == nullptr) _JMP(i_); continue;*/
-				case opcode::IGT:		_REL_OP(i_, cx_int, > ); continue;
-				case opcode::IGT_EQ:	_REL_OP(i_, cx_int, >= ); continue;
-				case opcode::IINC:		_VALUE->i_ += vpu.inst_ptr->arg1.i_; continue;
-				case opcode::ILOAD:		_PUSHS->i_ = _VALUE->i_; continue;
-				case opcode::ILT_EQ:	_REL_OP(i_, cx_int, <= ); continue;
-				case opcode::IMUL:		_BIN_OP(i_, cx_int, * ); continue;
-				case opcode::INEG:		_PUSHS->i_ = -abs(_POPS->i_); continue;
-					// Unary complement (bit inversion)
-				case opcode::INOT: 		_UNA_OP(i_, cx_int, ~ ); continue;
-				case opcode::INOT_EQ:	_REL_OP(i_, cx_int, != ); continue;
-				case opcode::INSTANCEOF: continue;
-				case opcode::INVOKEDYNAMIC: continue;
-				case opcode::INVOKEFUNCT: continue;
-				case opcode::INVOKEINTERFACE: continue;
-				case opcode::INVOKESPECIAL: continue;
-				case opcode::INVOKESTATIC: continue;
-				case opcode::INVOKEVIRTUAL: continue;
-					// Bitwise inclusive OR
-				case opcode::IOR:		_BIN_OP(i_, cx_int, | ); continue;
-				case opcode::IPOS: 		_PUSHS->i_ = abs(_POPS->i_); continue;
-				case opcode::IREM: 		_BIN_OP(i_, cx_int, % ); continue;
-				case opcode::ISHL: 		_BIN_OP(i_, cx_int, << ); continue;
-				case opcode::ISHR: 		_BIN_OP(i_, cx_int, >> ); continue;
-				case opcode::ISTORE:	_VALUE->i_ = _POPS->i_; continue;
-				case opcode::ISUB:		_BIN_OP(i_, cx_int, - ); continue;
-					// Bitwise exclusive OR
-				case opcode::IXOR: 		_BIN_OP(i_, cx_int, ^ ); continue;
-				case opcode::JSR:
-				case opcode::JSR_W: continue;
-				case opcode::LDC:
-				case opcode::LDC2_W:
-				case opcode::LDC_W: continue;
-				case opcode::LOOKUPSWITCH: continue;
-				case opcode::LOGIC_OR:	_BIN_OP(z_, cx_bool, || ); continue;
-				case opcode::LOGIC_AND:	_BIN_OP(z_, cx_bool, && ); continue;
-				case opcode::LOGIC_NOT: _PUSHS->z_ = !_POPS->i_; continue;
-				case opcode::MONITORENTER:
-				case opcode::MONITOREXIT: continue;
-				case opcode::MULTIANEWARRAY: continue;
-				case opcode::NEW: continue;
-
-					/** newarray: allocate new array
-					 * @param: vpu.stack_ptr[-1].l_ - number of elements
-					 * @param: vpu.inst_ptr->arg0.a_ - type pointer
-					 * @return: new array allocation managed by GC */
-				case opcode::NEWARRAY: {
-					const size_t element_count = static_cast<size_t>(_POPS->i_);
-					const cx_type *p_type = (const cx_type *)vpu.inst_ptr->arg0.a_;
-					const size_t size = p_type->size;
-
-					void *mem = malloc(size);
-
-					if (mem == nullptr) {
-						std::string msg = "[ malloc ] ";
-						msg += std::strerror(errno);
-
-						msg += "\ntype: " + std::to_string(p_type->typecode);
-						//msg += "\nelement type: " + std::to_string(p_type->array.p_element_type->typecode);
-					//	msg += "\nelement size: " + type_size[p_type->typecode];
-						msg += "\nelement count: " + std::to_string(element_count);
-						msg += "\nsize: " + std::to_string(size);
-
-						throw std::exception(msg.c_str());
-					}
+			/*case opcode::IF_ICMPEQ: _IFICMP(== ); continue;
+			case opcode::IF_ICMPNE: _IFICMP(!= ); continue;
+			case opcode::IF_ICMPLT: _IFICMP(< ); continue;
+			case opcode::IF_ICMPGE: _IFICMP(>= ); continue;
+			case opcode::IF_ICMPGT: _IFICMP(> ); continue;
+			case opcode::IF_ICMPLE: _IFICMP(<= ); continue;
+			case opcode::IFNONNULL: if (_POPS->a_ != nullptr) _JMP(i_); continue;
+			case opcode::IFNULL: if (_POPS->a_ == nullptr) _JMP(i_); continue;*/
+			case opcode::IGT:		_REL_OP(i_, cx_int, > ); continue;
+			case opcode::IGT_EQ:	_REL_OP(i_, cx_int, >= ); continue;
+			case opcode::IINC:		_VALUE->i_ += vpu.inst_ptr->arg1.i_; continue;
+			case opcode::ILOAD:		_PUSHS->i_ = _VALUE->i_; continue;
+			case opcode::ILT_EQ:	_REL_OP(i_, cx_int, <= ); continue;
+			case opcode::IMUL:		_BIN_OP(i_, cx_int, * ); continue;
+			case opcode::INEG:		_PUSHS->i_ = -abs(_POPS->i_); continue;
+				// Unary complement (bit inversion)
+			case opcode::INOT: 		_UNA_OP(i_, cx_int, ~ ); continue;
+			case opcode::INOT_EQ:	_REL_OP(i_, cx_int, != ); continue;
+			case opcode::INSTANCEOF: continue;
+			case opcode::INVOKEDYNAMIC: continue;
+			case opcode::INVOKEFUNCT: continue;
+			case opcode::INVOKEINTERFACE: continue;
+			case opcode::INVOKESPECIAL: continue;
+			case opcode::INVOKESTATIC: continue;
+			case opcode::INVOKEVIRTUAL: continue;
+				// Bitwise inclusive OR
+			case opcode::IOR:		_BIN_OP(i_, cx_int, | ); continue;
+			case opcode::IPOS: 		_PUSHS->i_ = abs(_POPS->i_); continue;
+			case opcode::IREM: 		_BIN_OP(i_, cx_int, % ); continue;
+			case opcode::ISHL: 		_BIN_OP(i_, cx_int, << ); continue;
+			case opcode::ISHR: 		_BIN_OP(i_, cx_int, >> ); continue;
+			case opcode::ISTORE:	_VALUE->i_ = _POPS->i_; continue;
+			case opcode::ISUB:		_BIN_OP(i_, cx_int, - ); continue;
+				// Bitwise exclusive OR
+			case opcode::IXOR: 		_BIN_OP(i_, cx_int, ^ ); continue;
+			case opcode::JSR:
+			case opcode::JSR_W: continue;
+			case opcode::LDC:
+			case opcode::LDC2_W:
+			case opcode::LDC_W: continue;
+			case opcode::LOOKUPSWITCH: continue;
+			case opcode::LOGIC_OR:	_BIN_OP(z_, cx_bool, || ); continue;
+			case opcode::LOGIC_AND:	_BIN_OP(z_, cx_bool, && ); continue;
+			case opcode::LOGIC_NOT: _PUSHS->z_ = !_POPS->i_; continue;
+			case opcode::MONITORENTER:
+			case opcode::MONITOREXIT: continue;
+			case opcode::MULTIANEWARRAY: continue;
+			case opcode::NEW: continue;
+
+				/** newarray: allocate new array
+				 * @param: vpu.stack_ptr[-1].l_ - number of elements
+				 * @param: vpu.inst_ptr->arg0.a_ - type pointer
+				 * @return: new array allocation managed by GC */
+			case opcode::NEWARRAY: {
+				const size_t element_count = static_cast<size_t>(_POPS->i_);
+				_PUSHS->a_ = new_array((const cx_type *)vpu.inst_ptr->arg0.a_, element_count);
+			} continue;
+			case opcode::NOP: continue;
+			case opcode::PLOAD: _PUSHS->a_ = _VALUE->a_; continue;
+			case opcode::POP: _POPS; continue;
+			case opcode::POP2: _POPS; _POPS; continue;
+			case opcode::PUTFIELD: continue;
+			case opcode::PUTSTATIC: continue;
+			case opcode::RETURN:
+				if (policy::counting && profile_settings::record) _COUNT(false);
+				return;
+			case opcode::SWAP: continue;
+			case opcode::TABLESWITCH: continue;
+			case opcode::VLOOP: {
+				// the loop after it runs as a vector kernel when it can
+				const int exit = simd::run(p_my_function_id, static_cast<int>(vpu.inst_ptr - vpu.code_ptr->begin()) + 1);
+				if (exit >= 0) {
+					if (policy::guarded) guard_jump(exit);
+					vpu.inst_ptr = vpu.code_ptr->begin() + (exit - 1);
+				}
+			} continue;
+			case opcode::ZEQ: _REL_OP(z_, cx_bool, == ); continue;
+			} //switch
+		} // for
+	}
+
+	void cxvm::go(void) {
+		try {
+			// enter_function starts at the first instruction, resume may not
+			if (vm_settings::jit_flag && (vpu.inst_ptr == vpu.code_ptr->begin()) &&
+				jit::run(this, p_my_function_id)) return;
 
-					uintptr_t reference = _ADDRTOINT(mem);
-					auto mem_map = this->heap_.insert(std::make_pair(reference, mem_mapping()));
-					mem_map.first->second.shared_ref = std::shared_ptr<uintptr_t>((uintptr_t *)mem, free);
-					mem_map.first->second.p_type = std::make_shared<cx_type>(*p_type);
-
-					_PUSHS->a_ = mem;
-				} continue;
-				case opcode::NOP: continue;
-				case opcode::PLOAD: _PUSHS->a_ = _VALUE->a_; continue;
-				case opcode::POP: _POPS; continue;
-				case opcode::POP2: _POPS; _POPS; continue;
-				case opcode::PUTFIELD: continue;
-				case opcode::PUTSTATIC: continue;
-				case opcode::RETURN: return; break;
-				case opcode::SWAP: continue;
-				case opcode::TABLESWITCH: continue;
-				case opcode::ZEQ: _REL_OP(z_, cx_bool, == ); continue;
-				} //switch
-			} // for
+			// code the verifier passed runs without the guards
+			(this->*(verifier::trusted(p_my_function_id) ? p_trusted_loop : p_guarded_loop))();
 		}
 
 		catch (std::exception ex) {
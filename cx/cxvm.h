@@ -49,6 +49,8 @@ namespace cx {
 	namespace vm_settings {
 		extern bool dev_debug_flag;
 		extern bool verbose_gc;
+		extern bool unchecked_flag;
+		extern bool jit_flag;
 	}
 
 	namespace heap {
@@ -86,32 +88,52 @@ namespace cx {
 
 	extern const wchar_t* opcode_string[];
 
+	/* What compiled code means: bump it with any change to the
+	 * emitter, the optimizing passes or the VM that changes the code
+	 * built for a program or how that code runs.  Bytecode caches of
+	 * another version are not loaded. */
+	const uint32_t bytecode_version = 1;
+
 	// Op codes
 	enum opcode {
 		AALOAD,
 		AASTORE,
 		ACONST_NULL,
+		AINC,
 		ALOAD,
 		ANEWARRAY,
+		APTR,
 		ARRAYLENGTH,
 		ASTORE,
 		VM_THROW,
 		B2I,
 		BALOAD,
+		BALOAD_U,
+		BALOAD_P,
 		BASTORE,
+		BASTORE_U,
+		BASTORE_P,
 		BEQ,
 		BIPUSH,
 		C2I,
 		CALL,
 		CALOAD,
+		CALOAD_U,
+		CALOAD_P,
 		CASTORE,
+		CASTORE_U,
+		CASTORE_P,
 		CHECKCAST,
 		D2F,
 		D2I,
 		D2L,
 		DADD,
 		DALOAD,
+		DALOAD_U,
+		DALOAD_P,
 		DASTORE,
+		DASTORE_U,
+		DASTORE_P,
 		DCMP,
 		DCONST,
 		DDIV,
@@ -144,8 +166,12 @@ namespace cx {
 		I2D,
 		IADD,
 		IALOAD,
+		IALOAD_U,
+		IALOAD_P,
 		IAND,
 		IASTORE,
+		IASTORE_U,
+		IASTORE_P,
 		ICMP,
 		ICONST,
 		IDIV,
@@ -216,6 +242,7 @@ namespace cx {
 		RETURN,
 		SWAP,
 		TABLESWITCH,
+		VLOOP,
 		ZEQ,
 		BREAK_MARKER = 0xFFFF
 	};
@@ -234,6 +261,8 @@ namespace cx {
 
 	// Program instructions
 	typedef std::vector<inst> program;
+	// Unchecked counterpart of an array load/store opcode
+	opcode unchecked_array_op(opcode op);
 	// Instruction pointer
 	typedef std::vector<inst>::const_iterator instr_ptr;
 
@@ -259,9 +288,24 @@ namespace cx {
 		// Copies a reference into the callees heap
 		void copy_reference(const uintptr_t &reference, const heap::mem_mapping &mem_map);
 		// The current function ID node
-		const symbol_table_node *p_my_function_id;
+		symbol_table_node *p_my_function_id;
+		// Bottom of the operand stack, below are the function's slots
+		value *p_operand_base;
 		// TODO: Nano sleep for multithreading
 		void nano_sleep(int nano_secs);	// Thread sleep while waiting for VM lock
+		// The interpreter loop, built with the hooks of a policy
+		template <class policy> void run(void);
+		// Loops chosen at startup, for verified code and for the rest
+		static void (cxvm::*p_trusted_loop)(void);
+		static void (cxvm::*p_guarded_loop)(void);
+		// A guarded loop's stack, operand and jump
+		value *guarded_push(void);
+		value *guarded_pop(void);
+		symbol_table_node *guarded_node(void) const;
+		void guard_jump(cx_int location) const;
+		// call, leaving -dev output to the loop's policy
+		void invoke(symbol_table_node *p_function_id);
+		void show_return(const symbol_table_node *p_function_id);
 
 	public:
 		
@@ -271,6 +315,14 @@ namespace cx {
 		// Enter functions 
 		void enter_function(symbol_table_node *p_function_id);
 		void go(void);
+		// Go on running a function, its variables already bound, at location
+		void resume(symbol_table_node *p_function_id, int location);
+		// Call a function with the arguments on top of the stack
+		void call(symbol_table_node *p_function_id);
+		// Choose the interpreter loops for the settings
+		static void choose_loops(void);
+		// Allocate an array on this VM's heap
+		void *new_array(const cx_type *p_type, size_t element_count);
 		cxvm();
 		~cxvm(void);
 	};
@@ -29,6 +29,8 @@ namespace cx {
 	void parser::emit_const(symbol_table_node_ptr &p_function_id, symbol_table_node_ptr &p_id) {
 		opcode op;
 
+		add_dependency(p_function_id.get(), p_id.get());
+
 		switch (p_id->p_type->typecode)
 		{
 		case T_BOOLEAN:
@@ -431,6 +433,8 @@ namespace cx {
 			break;
 		}
 
+		if (vm_settings::unchecked_flag) op = unchecked_array_op(op);
+
 		p_function_id->defined.routine.program_code.push_back({ op, p_id.get(), p_type.get() });
 	}
 
@@ -459,6 +463,8 @@ namespace cx {
 			break;
 		}
 
+		if (vm_settings::unchecked_flag) op = unchecked_array_op(op);
+
 		p_function_id->defined.routine.program_code.push_back({ op, p_id.get() });
 	}
 
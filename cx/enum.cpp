@@ -33,7 +33,7 @@ namespace cx {
 
 		if (p_function_id == nullptr) {}
 
-		symbol_table_node_ptr p_enum_id = this->enter_new_local(p_token->string, DC_TYPE);
+		symbol_table_node_ptr p_enum_id = this->enter_new_local(p_token->atom(), DC_TYPE);
 		get_token();
 
 		type_ptr p_result_type = p_integer_type;
@@ -46,7 +46,7 @@ namespace cx {
 			get_token();
 			if (token != TC_IDENTIFIER) cx_error(error_code::ERR_NOT_A_TYPE_IDENTIFIER);
 		case TC_IDENTIFIER: {
-			p_node = search_all(p_token->string);
+			p_node = search_all(p_token->atom());
 			if (p_node->defined.defined_how != DC_TYPE) cx_error(error_code::ERR_INVALID_TYPE);
 
 			if (p_node->p_type->typecode != T_BYTE && p_node->p_type->typecode != T_INT)
@@ -67,7 +67,7 @@ namespace cx {
 
 				if (token != TC_IDENTIFIER) cx_error(error_code::ERR_MISSING_IDENTIFIER);
 
-				p_id = p_enum_id->p_type->p_enum_ids->enter(p_token->string, DC_CONSTANT);
+				p_id = p_enum_id->p_type->p_enum_ids->enter(p_token->atom(), DC_CONSTANT);
 				p_id->p_type = p_result_type;
 				get_token();
 
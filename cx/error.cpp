@@ -34,8 +34,8 @@ namespace cx{
 		bool error_arrow_flag = true; // true if print arrows under syntax
 		//   errors, false if not
 		const int error_arrow_offset = 8; // offset for printing the error arrow
-		int error_count = 0; // count of syntax errors
 		int max_syntax_errors = 0;
+		bool throw_on_abort = false;
 	}
 
 	///  Abort messages      Keyed to enumeration type cx_abort_code.
@@ -61,6 +61,7 @@ namespace cx{
 	 */
 	void abort_translation(abort_code ac) {
 		std::cerr << "*** fatal translator error: " << abort_message[-ac] << std::endl;
+		if (error::throw_on_abort) throw translation_stopped{ ac };
 		std::cin.get();
 		exit(ac);
 	}
@@ -133,28 +134,44 @@ namespace cx{
 		L"Invalid escape character",
 		L"Could not load library",
 		L"No cx_lib_init in library",
-		L"Invalid VM opcode"
+		L"Invalid VM opcode",
+		L"Could not find module",
+		L"Module includes itself"
 	};
 
 	/** cx_error       print an arrow under the error and then
-	 *              print the error message.
+	 *              print the error message.  The error counts
+	 *              against the source being read on this thread.
 	 *
 	 * @param ec : error code
 	 */
 	void cx_error(error_code ec) {
-		int error_position = error::error_arrow_offset + buffer::input_position - 1;
+		text_in_buffer *p_source = buffer::p_active_source;
+
+		// no source to point into, or to stop
+		if (p_source == nullptr) {
+			std::wcout << L"*** error: " << error_messages[ec] << std::endl;
+			return;
+		}
+
+		list_buffer &list = p_source->list;
 
 		// print the arrow pointing to the token just scanned.
-		buffer::list.put_line(); // print current line info
-		_swprintf(buffer::list.text, L"%*s^", error_position, L" ");
-		buffer::list.put_line();
+		int input_position = p_source->input_position();
+		p_source->list_current_line();
+
+		int error_position = error::error_arrow_offset + input_position - 1;
+		list.put_line(); // print current line info
+		_swprintf(list.text, L"%*s^", error_position, L" ");
+		list.put_line();
 
 		// print the error message.
-		_swprintf(buffer::list.text, L"*** error: %s", error_messages[ec]);
-		buffer::list.put_line();
+		_swprintf(list.text, L"*** error: %s", error_messages[ec]);
+		list.put_line();
 
-		if (++error::error_count > error::max_syntax_errors) {
-			buffer::list.put_line(L"Too many syntax errors.  Translation aborted.");
+		if (++p_source->error_count > error::max_syntax_errors) {
+			list.put_line(L"Too many syntax errors.  Translation aborted.");
+			if (error::throw_on_abort) throw translation_stopped{ ec };
 			std::cin.get();
 			exit(ec);
 			//abort_translation(abort_too_many_syntax_errors);
@@ -171,12 +188,15 @@ namespace cx{
 		"Invalid standard function argument",
 		"Invalid user input",
 		"Unimplemented runtime feature",
-		"Array index out of bounds"
+		"Array index out of bounds",
+		"Source file changed since it was compiled",
+		"Syntax errors in a function body"
 	};
 
 	void cx_runtime_error(runtime_error_code ec) {
 		std::cout << runtime_error_messages[ec] << std::endl;
 
+		if (error::throw_on_abort) throw translation_stopped{ ABORT_RUNTIME_ERROR };
 		exit(ABORT_RUNTIME_ERROR);
 	}
 }
\ No newline at end of file
@@ -29,9 +29,18 @@ namespace cx {
 	namespace error {
 		extern bool error_arrow_flag; // true if print arrows under syntax
 		extern const int error_arrow_offset; // offset for printing the error arrow
-		extern int error_count; // count of syntax errors
 		extern int max_syntax_errors;
+		extern bool throw_on_abort; // throw translation_stopped, don't exit
 	}
+
+	/** translation_stopped     Thrown in place of exiting the process
+	 *                          when error::throw_on_abort is set, so
+	 *                          the compile server outlives a bad file.
+	 */
+	struct translation_stopped {
+		int exit_code;
+	};
+
 	///  Abort codes for fatal translator errors.
 
 	enum abort_code {
@@ -116,7 +125,9 @@ namespace cx {
 		ERR_INVALID_ESCAPE_CHAR,
 		ERR_LOADING_LIBRARY,
 		ERR_LIBRARY_NO_INIT,
-		ERR_INVALID_OPCODE
+		ERR_INVALID_OPCODE,
+		ERR_MODULE_NOT_FOUND,
+		ERR_CIRCULAR_INCLUDE
 	};
 
 	void cx_error(error_code ec);
@@ -130,7 +141,9 @@ namespace cx {
 		RTE_INVALID_FUNCTION_ARGUMENT,
 		RTE_INVALID_USER_INPUT,
 		RTE_UNIMPLEMENTED_RUNTIME_FEATURE,
-		RTE_ARRAY_INDEX_OUT_OF_BOUNDS
+		RTE_ARRAY_INDEX_OUT_OF_BOUNDS,
+		RTE_SOURCE_CHANGED,
+		RTE_FUNCTION_BODY_ERRORS
 	};
 
 	void cx_runtime_error(runtime_error_code ec);
@@ -240,7 +240,7 @@ namespace cx {
 		switch (this->token) {
 		case TC_IDENTIFIER:
 		{
-			symbol_table_node_ptr p_node = search_all(p_token->string);
+			symbol_table_node_ptr p_node = search_all(p_token->atom());
 
 			if (p_node == nullptr) {
 				cx_error(ERR_UNDEFINED_IDENTIFIER);
@@ -253,7 +253,7 @@ namespace cx {
 				get_token();
 
 				// Find all functions that share this name.
-				auto function_list = this->find_functions(p_node->node_name);
+				auto function_list = this->find_functions(p_node->name);
 				p_node = parse_subroutine_call(p_function_id, function_list);
 				p_result_type = p_node->p_type;
 
@@ -290,7 +290,7 @@ namespace cx {
 				case TC_PLUS_PLUS:
 					switch (p_result_type->typecode) {
 					case T_DOUBLE:
-						this->emit(p_function_id, opcode::DINC, p_node.get(), 1.0L);
+						this->emit(p_function_id, opcode::DINC, p_node.get(), static_cast<cx_real>(1.0));
 						break;
 					default:
 						this->emit(p_function_id, opcode::IINC, p_node.get(), 1);
@@ -300,7 +300,7 @@ namespace cx {
 				case TC_MINUS_MINUS:
 					switch (p_result_type->typecode) {
 					case T_DOUBLE:
-						this->emit(p_function_id, opcode::DINC, p_node.get(), -1.0L);
+						this->emit(p_function_id, opcode::DINC, p_node.get(), static_cast<cx_real>(-1.0));
 						break;
 					default:
 						this->emit(p_function_id, opcode::IINC, p_node.get(), -1);
@@ -322,10 +322,12 @@ namespace cx {
 		}
 		break;
 		case TC_NUMBER: {
-			symbol_table_node_ptr p_node = search_all(p_token->string);
+			// Literals are entered under their spelling.
+			const atom_id literal = cx_atoms.intern(p_token->string);
+			symbol_table_node_ptr p_node = search_all(literal);
 
 			if (p_node == nullptr) {
-				p_node = enter_local(p_token->string, DC_CONSTANT);
+				p_node = enter_local(literal, DC_CONSTANT);
 			}
 
 			switch (p_token->type()) {
@@ -348,10 +350,11 @@ namespace cx {
 		}break;
 		case TC_CHAR:
 		{
-			symbol_table_node_ptr p_id = search_all(p_token->string);
+			const atom_id literal = cx_atoms.intern(p_token->string);
+			symbol_table_node_ptr p_id = search_all(literal);
 
 			if (p_id == nullptr) {
-				p_id = enter_local(p_token->string);
+				p_id = enter_local(literal);
 				p_id->p_type = p_char_type;
 				p_id->defined.constant_value.c_ = p_token->string[1];
 			}
@@ -364,10 +367,11 @@ namespace cx {
 		case TC_STRING:
 		{
 			// TODO fix string constants
-			symbol_table_node_ptr p_id = search_all(p_token->string);
+			const atom_id literal = cx_atoms.intern(p_token->string);
+			symbol_table_node_ptr p_id = search_all(literal);
 
 			if (p_id == nullptr) {
-				p_id = enter_local(p_token->string);
+				p_id = enter_local(literal);
 			}
 
 			if (p_token->type() == T_CHAR) {
@@ -422,7 +426,7 @@ namespace cx {
 				cx_error(error_code::ERR_MISSING_IDENTIFIER);
 			}
 
-			symbol_table_node_ptr p_node = search_all(p_token->string);
+			symbol_table_node_ptr p_node = search_all(p_token->atom());
 			if (p_node->defined.defined_how != DC_TYPE) {
 				cx_error(error_code::ERR_NOT_A_TYPE_IDENTIFIER);
 			}
@@ -439,7 +443,7 @@ namespace cx {
 					if ((token != TC_IDENTIFIER) && (token != TC_NUMBER) && (token != TC_CHAR)) {
 						cx_error(error_code::ERR_INVALID_INDEX_TYPE);
 					}
-					std::wstring index_id = p_token->string;	// Save node name to lookup later
+					const atom_id index_id = cx_atoms.intern(p_token->string);	// Save node name to lookup later
 					type_ptr p_expr_type = parse_expression(p_function_id);
 					symbol_table_node_ptr p_const_node = search_all(index_id);
 
@@ -534,7 +538,7 @@ namespace cx {
 			case TC_COLON_COLON:
 				if (p_id->p_type->typeform == F_ENUM) {
 					get_token();
-					symbol_table_node_ptr p_enum_id = p_id->p_type->p_enum_ids->search(p_token->string);
+					symbol_table_node_ptr p_enum_id = p_id->p_type->p_enum_ids->search(p_token->atom());
 					if (p_enum_id == nullptr) cx_error(error_code::ERR_UNDEFINED_IDENTIFIER);
 
 					this->emit_const(p_function_id, p_enum_id);
@@ -552,7 +556,7 @@ namespace cx {
 				this->get_token();
 				switch (p_result_type->typecode) {
 				case T_DOUBLE:
-					this->emit(p_function_id, opcode::DINC, p_id.get(), 1.0L);
+					this->emit(p_function_id, opcode::DINC, p_id.get(), static_cast<cx_real>(1.0));
 					break;
 				default:
 					this->emit(p_function_id, opcode::IINC, p_id.get(), 1);
@@ -563,7 +567,7 @@ namespace cx {
 				this->get_token();
 				switch (p_result_type->typecode) {
 				case T_DOUBLE:
-					this->emit(p_function_id, opcode::DINC, p_id.get(), -1.0L);
+					this->emit(p_function_id, opcode::DINC, p_id.get(), static_cast<cx_real>(-1.0));
 					break;
 				default:
 					this->emit(p_function_id, opcode::IINC, p_id.get(), -1);
@@ -22,9 +22,17 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
+#include "bench.h"
+#include "charscan.h"
 #include "parser.h"
+#include "optimizer.h"
+#include "tier.h"
 
 namespace cx {
+	namespace parse_settings {
+		bool lazy_functions = false; // leave bodies for their first call
+	}
+
 	/** parse_block      parse a function's block:
 	*
 	*                      {
@@ -59,7 +67,7 @@ namespace cx {
 			bool is_array = false;
 
 			// find param type
-			p_node = find(p_token->string);
+			p_node = find(p_token->atom());
 
 			if (p_node->defined.defined_how != DC_TYPE) {
 				cx_error(ERR_INVALID_TYPE);
@@ -77,7 +85,7 @@ namespace cx {
 			symbol_table_node_ptr p_param = nullptr;
 
 
-			p_param = enter_new_local(p_token->string, DC_VARIABLE);
+			p_param = enter_new_local(p_token->atom(), DC_VARIABLE);
 
 			if (is_array) {
 				p_param->p_type = std::make_shared<cx_type>(F_ARRAY, T_REFERENCE);
@@ -129,7 +137,7 @@ namespace cx {
 	*/
 	symbol_table_node_ptr parser::parse_subroutine_call(
 		symbol_table_node_ptr &p_function_id,
-		std::pair<local::iterator, local::iterator> p_node_ids) {
+		local::range p_node_ids) {
 		symbol_table_node_ptr p_result_node = parse_declared_subroutine_call(p_function_id, p_node_ids);
 		p_function_id->defined.routine.program_code.push_back({ CALL, p_result_node.get() });
 		return p_result_node;
@@ -144,7 +152,7 @@ namespace cx {
 	*/
 	symbol_table_node_ptr parser::parse_declared_subroutine_call(
 		symbol_table_node_ptr &p_function_id,
-		std::pair<local::iterator, local::iterator> p_node_ids) {
+		local::range p_node_ids) {
 
 		symbol_table_node_ptr p_result_node;
 		if (token == TC_LEFT_PAREN) {
@@ -173,7 +181,7 @@ namespace cx {
 	*/
 	symbol_table_node_ptr parser::parse_actual_parm_list(
 		symbol_table_node_ptr &p_function_id,
-		std::pair<local::iterator, local::iterator> p_node_ids) {
+		local::range p_node_ids) {
 
 		/* If there are no actual parameters, there better not be
 		* any formal parameters either. */
@@ -250,6 +258,46 @@ namespace cx {
 		return p_result_node;
 	}
 
+	/** qualified_name    A routine's name with where it is declared:
+	*                  the source file's name, the functions it is
+	*                  nested in, and the parameter types that tell
+	*                  its overloads apart, e.g. "lib.cx:outer(int).f(double*)".
+	*
+	* @param p_scope_id    : ptr to the routine it is declared in,
+	*                        nullptr for the program or module itself.
+	* @param p_function_id : ptr to the routine's symbol table node.
+	* @return its qualified name.
+	*/
+	std::wstring parser::qualified_name(const symbol_table_node_ptr &p_scope_id, const symbol_table_node_ptr &p_function_id) const {
+		const size_t slash = file_name.find_last_of(L"/\\");
+		const std::wstring source = (slash == std::wstring::npos) ? file_name : file_name.substr(slash + 1);
+
+		if (p_scope_id == nullptr) return source;
+
+		std::wstring name;
+		if ((p_scope_id->defined.defined_how == DC_PROGRAM) || p_scope_id->defined.routine.qualified_name.empty()) {
+			name = source + L":";
+		}
+		else {
+			name = p_scope_id->defined.routine.qualified_name + L".";
+		}
+
+		name += p_function_id->node_name;
+		name += L"(";
+
+		for (auto &p_param : p_function_id->defined.routine.p_parameter_ids) {
+			if (&p_param != &p_function_id->defined.routine.p_parameter_ids.front()) name += L",";
+
+			const bool is_array = (p_param->p_type != nullptr) && (p_param->p_type->typeform == F_ARRAY);
+			const type_ptr &p_type = is_array ? p_param->p_type->array.p_element_type : p_param->p_type;
+
+			name += ((p_type != nullptr) && (p_type->p_type_id != nullptr)) ? p_type->p_type_id->node_name : L"?";
+			if (is_array) name += L"*";
+		}
+
+		return name + L")";
+	}
+
 	/** parse_function_header         parse a function header:
 	*
 	*                              <type-id> <id> (<parm-list>);
@@ -262,10 +310,11 @@ namespace cx {
 	*      If scope == 0 and p_program_ptr_id->found_global_end == false;
 	*      Set main's location in icode only when function body is found.
 	*
+	* @param p_scope_id    : ptr to the routine it is declared in.
 	* @param p_function_id : ptr to the function id's symbol table node.
 	* @return ptr to function id's symbol table node.
 	*/
-	symbol_table_node_ptr parser::parse_function_header(symbol_table_node_ptr &p_function_id) {
+	symbol_table_node_ptr parser::parse_function_header(symbol_table_node_ptr &p_scope_id, symbol_table_node_ptr &p_function_id) {
 		// enter the next__ nesting level and open a new scope
 		// for the function.
 		symtab_stack.enter_scope();
@@ -274,6 +323,7 @@ namespace cx {
 
 		parse_formal_parm_list(p_function_id);
 		p_function_id->defined.defined_how = DC_FUNCTION;
+		p_function_id->defined.routine.qualified_name = qualified_name(p_scope_id, p_function_id);
 
 		// For recursive calls.
 		//symtab_stack.enter_new_function(p_function_id);
@@ -287,10 +337,117 @@ namespace cx {
 		}
 		else {
 			p_function_id->defined.routine.function_type = FUNC_DECLARED;
-			parse_statement(p_function_id);
-			p_function_id->defined.routine.p_symtab = symtab_stack.exit_scope();
+
+			/* Only global functions are left for later: their body
+			 * sees nothing but its parameters and the globals. A
+			 * listing needs every line, so it parses them all. */
+			if (parse_settings::lazy_functions && !buffer::list_flag &&
+				(symtab_stack.nesting_level() == 1) && (token == TC_LEFT_BRACKET)) {
+				defer_function_body(p_function_id);
+			}
+			else {
+				parse_function_body(p_function_id);
+			}
 		}
 
 		return p_function_id;
 	}
+
+	/** parse_function_body       parse a function's body, close the
+	*                          function's scope and optimize its code.
+	*
+	* @param p_function_id : ptr to the function id's symbol table node.
+	*/
+	void parser::parse_function_body(symbol_table_node_ptr &p_function_id) {
+		// A break can't leave the function body.
+		std::vector<label *> outer_break_labels;
+		outer_break_labels.swap(break_labels);
+		parse_statement(p_function_id);
+		break_labels.swap(outer_break_labels);
+		p_function_id->defined.routine.p_symtab = symtab_stack.exit_scope();
+
+		// with -tier the tier thread optimizes it once it's hot
+		if (tier_settings::tiered) return;
+
+		phase_timer timer(p_optimize_seconds);
+		optimizer::optimize_function(p_function_id.get());
+	}
+
+	/** defer_function_body       Record where a function's body starts
+	*                          and skip over it without parsing it.
+	*                          The opening bracket has just been read.
+	*
+	* @param p_function_id : ptr to the function id's symbol table node.
+	*/
+	void parser::defer_function_body(symbol_table_node_ptr &p_function_id) {
+		text_in_buffer *p_source = p_scanner->source();
+
+		std::shared_ptr<lazy_body> p_body = std::make_shared<lazy_body>();
+		p_body->file_name = file_name;
+		p_body->offset = p_source->offset() - 1;
+		p_body->line_number = p_source->line_number();
+		p_body->p_global_scope = p_global_scope;
+		p_body->p_function_id = p_function_id;
+
+		// the scope holds the parameters until the body is parsed
+		p_function_id->defined.routine.p_symtab = symtab_stack.exit_scope();
+		p_function_id->defined.routine.p_lazy_body = p_body;
+
+		p_source->skip_block();
+		p_body->length = p_source->offset() - p_body->offset;
+		p_body->body_hash = hash_bytes(p_source->bytes() + p_body->offset, p_body->length);
+		get_token();
+	}
+
+	/** parse_lazy_body           parse a body left by defer_function_body,
+	*                          back in the function's scope.
+	*
+	* @param p_function_id : ptr to the function id's symbol table node.
+	*/
+	void parser::parse_lazy_body(symbol_table_node_ptr &p_function_id) {
+		symtab_stack.set_scope(1);
+		symtab_stack.set_current_symtab(p_function_id->defined.routine.p_symtab.get());
+
+		get_token();
+		parse_function_body(p_function_id);
+	}
+
+	/** compile_function_body     Parse and emit the body of a function
+	*                          on its first call.  The file is read
+	*                          again, so a body that changed since it
+	*                          was skipped, or that has syntax errors,
+	*                          is a runtime error; the function keeps
+	*                          its lazy body and never runs.
+	*
+	* @param p_function_id : ptr to the function id's symbol table node.
+	*/
+	void compile_function_body(symbol_table_node *p_function_id) {
+		auto &routine = p_function_id->defined.routine;
+		std::shared_ptr<lazy_body> p_body;
+		p_body.swap(routine.p_lazy_body);
+
+		symbol_table_node_ptr p_function = p_body->p_function_id.lock();
+		if (p_function == nullptr) return;
+
+		source_buffer *p_source = new source_buffer(p_body->file_name);
+
+		if ((p_body->offset + p_body->length > p_source->byte_count()) ||
+			(hash_bytes(p_source->bytes() + p_body->offset, p_body->length) != p_body->body_hash)) {
+			delete p_source;
+			routine.p_lazy_body = p_body;
+			cx_runtime_error(RTE_SOURCE_CHANGED);
+			return;
+		}
+
+		p_source->seek(p_body->offset, p_body->line_number);
+
+		parser body_parser(p_source, p_body->p_global_scope);
+		body_parser.parse_lazy_body(p_function);
+
+		if (body_parser.error_count() > 0) {
+			routine.program_code.clear();
+			routine.p_lazy_body = p_body;
+			cx_runtime_error(RTE_FUNCTION_BODY_ERRORS);
+		}
+	}
 }
\ No newline at end of file
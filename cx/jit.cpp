@@ -0,0 +1,932 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#if defined _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <type_traits>
+#include <vector>
+#include "cxvm.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "simd.h"
+#include "tier.h"
+
+#if defined _M_X64 || defined __x86_64__
+#define __CX_JIT_X64__
+#endif
+
+namespace cx {
+	native_code::entry_point native_code::loop_entry(int head) const {
+		for (auto &loop : loop_entries) {
+			if (loop.first == head) return loop.second;
+		}
+
+		return nullptr;
+	}
+
+	native_code::~native_code() {
+		if (p_memory == nullptr) return;
+#if defined _WIN32
+		VirtualFree(p_memory, 0, MEM_RELEASE);
+#else
+		munmap(p_memory, size);
+#endif
+	}
+
+	namespace jit {
+		// Exception a runtime call stopped on, thrown again by run.
+		static thread_local std::exception_ptr pending_exception;
+
+#ifdef __CX_JIT_X64__
+		enum x64_register {
+			RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+			R8, R9, R10, R11, R12, R13, R14, R15
+		};
+
+#if defined _WIN32
+		const x64_register argument_registers[] = { RCX, RDX, R8 };
+#else
+		const x64_register argument_registers[] = { RDI, RSI, RDX };
+#endif
+
+		/* The operand stack is kept in callee saved registers by
+		 * depth, deeper values in the frame.  Every stack value is
+		 * the 64 bits of a value union an opcode reads or writes. */
+		const x64_register slot_registers[] = { RBX, R12, R13, R14, R15 };
+		const int register_slots = 5;
+
+		// Frame below rbp: saved registers, the VM, spills, call arguments.
+		const int saved_registers_size = 40;
+		const int vm_offset = -48;
+
+		/* Reals are translated only where cx_real is a 64 bit double
+		 * (MSVC, or __CX_REAL_DOUBLE__), the width of a stack slot. */
+		const bool real_is_double = sizeof(cx_real) == sizeof(double);
+
+		const bool char_is_32_bits = sizeof(cx_char) == 4;
+		const bool char_is_signed = std::is_signed<cx_char>::value;
+
+		/** x64_assembler   Byte level x86-64 encoder, just the forms
+		 *                  the templates use.
+		 */
+		class x64_assembler {
+		public:
+			std::vector<uint8_t> bytes;
+
+			size_t position(void) const { return bytes.size(); }
+
+			void emit(std::initializer_list<uint8_t> code) {
+				bytes.insert(bytes.end(), code.begin(), code.end());
+			}
+
+			void emit32(int32_t v) {
+				for (int i = 0; i < 4; ++i) bytes.push_back(static_cast<uint8_t>(v >> (i * 8)));
+			}
+
+			void emit64(uint64_t v) {
+				for (int i = 0; i < 8; ++i) bytes.push_back(static_cast<uint8_t>(v >> (i * 8)));
+			}
+
+			void patch32(size_t at, int32_t v) {
+				for (int i = 0; i < 4; ++i) bytes[at + i] = static_cast<uint8_t>(v >> (i * 8));
+			}
+
+			void rex_w(int reg, int rm) {
+				bytes.push_back(static_cast<uint8_t>(0x48 | ((reg >> 3) << 2) | (rm >> 3)));
+			}
+
+			void modrm(int mod, int reg, int rm) {
+				bytes.push_back(static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+			}
+
+			// [base + disp32]
+			void memory(int reg, int base, int32_t disp) {
+				modrm(2, reg, base);
+				if ((base & 7) == RSP) bytes.push_back(0x24);
+				emit32(disp);
+			}
+
+			// mov dst, src
+			void mov(x64_register dst, x64_register src) {
+				if (dst == src) return;
+				rex_w(dst, src);
+				bytes.push_back(0x8B);
+				modrm(3, dst, src);
+			}
+
+			// mov dst, imm
+			void mov(x64_register dst, int64_t imm) {
+				rex_w(0, dst);
+
+				if ((imm >= INT32_MIN) && (imm <= INT32_MAX)) {
+					bytes.push_back(0xC7);
+					modrm(3, 0, dst);
+					emit32(static_cast<int32_t>(imm));
+				}
+				else {
+					bytes.back() = static_cast<uint8_t>(0x48 | (dst >> 3));
+					bytes.push_back(static_cast<uint8_t>(0xB8 + (dst & 7)));
+					emit64(static_cast<uint64_t>(imm));
+				}
+			}
+
+			// mov dst, [base + disp]
+			void load(x64_register dst, x64_register base, int32_t disp) {
+				rex_w(dst, base);
+				bytes.push_back(0x8B);
+				memory(dst, base, disp);
+			}
+
+			// mov [base + disp], src
+			void store(x64_register base, int32_t disp, x64_register src) {
+				rex_w(src, base);
+				bytes.push_back(0x89);
+				memory(src, base, disp);
+			}
+
+			// lea dst, [base + disp]
+			void lea(x64_register dst, x64_register base, int32_t disp) {
+				rex_w(dst, base);
+				bytes.push_back(0x8D);
+				memory(dst, base, disp);
+			}
+
+			// mov rax, [address]
+			void load_rax_absolute(const void *address) {
+				emit({ 0x48, 0xA1 });
+				emit64(reinterpret_cast<uintptr_t>(address));
+			}
+
+			void push(x64_register r) {
+				if (r >= R8) bytes.push_back(0x41);
+				bytes.push_back(static_cast<uint8_t>(0x50 + (r & 7)));
+			}
+
+			void pop(x64_register r) {
+				if (r >= R8) bytes.push_back(0x41);
+				bytes.push_back(static_cast<uint8_t>(0x58 + (r & 7)));
+			}
+
+			// jmp/jcc rel32, returns where the displacement goes
+			size_t jump(std::initializer_list<uint8_t> code) {
+				emit(code);
+				emit32(0);
+				return position() - 4;
+			}
+		};
+
+		/** call_pushes     Values a CALL leaves on the operand stack,
+		 *                  as cxvm::call pushes them.
+		 */
+		static int call_pushes(const symbol_table_node *p_function_id) {
+			switch (p_function_id->p_type->typecode) {
+			case T_BOOLEAN:
+			case T_BYTE:
+			case T_CHAR:
+			case T_DOUBLE:
+			case T_INT:
+			case T_REFERENCE:
+				return 1;
+			default:
+				return 0;
+			}
+		}
+
+		static bool real_opcode(opcode op) {
+			switch (op) {
+			case D2I: case DADD: case DALOAD_U: case DALOAD_P: case DASTORE_U: case DASTORE_P: case DCONST:
+			case DDIV: case DEQ: case DGT: case DGT_EQ: case DINC: case DLOAD: case DLT: case DLT_EQ:
+			case DMUL: case DNOT_EQ: case DSTORE: case DSUB: case I2D:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// True if a call passes or returns a real.
+		static bool real_call(const symbol_table_node *p_function_id) {
+			if (p_function_id->p_type->typecode == T_DOUBLE) return true;
+
+			for (auto &p_parameter : p_function_id->defined.routine.p_parameter_ids) {
+				if (p_parameter->p_type->typecode == T_DOUBLE) return true;
+			}
+
+			return false;
+		}
+
+		/** translatable    True for the opcodes with a template.
+		 */
+		static bool translatable(const inst &instruction) {
+			if (!real_is_double && (real_opcode(instruction.op) ||
+				((instruction.op == CALL) && real_call(static_cast<const symbol_table_node *>(instruction.arg0.a_))))) {
+				return false;
+			}
+
+			switch (instruction.op) {
+			case AALOAD: case AASTORE: case ACONST_NULL: case AINC: case ALOAD: case APTR:
+			case B2I: case BALOAD_U: case BALOAD_P: case BASTORE_U: case BASTORE_P: case BEQ:
+			case C2I: case CALL: case CALOAD_U: case CALOAD_P: case CASTORE_U: case CASTORE_P: case CHECKCAST:
+			case D2I: case DADD: case DALOAD_U: case DALOAD_P: case DASTORE_U: case DASTORE_P: case DCONST:
+			case DDIV: case DEQ: case DGT: case DGT_EQ: case DINC: case DLOAD: case DLT: case DLT_EQ:
+			case DMUL: case DNOT_EQ: case DSTORE: case DSUB:
+			case GOTO: case I2B: case I2C: case I2D: case IADD: case IALOAD_U: case IALOAD_P: case IAND:
+			case IASTORE_U: case IASTORE_P: case ICONST: case IDIV: case IEQ: case IF_FALSE: case IGT:
+			case IGT_EQ: case IINC: case ILOAD: case ILT: case ILT_EQ: case IMUL: case INOT: case INOT_EQ:
+			case IOR: case IREM: case ISHL: case ISHR: case ISTORE: case ISUB: case IXOR:
+			case LOGIC_OR: case LOGIC_AND: case LOGIC_NOT: case NEWARRAY: case NOP: case PLOAD:
+			case POP: case POP2: case RETURN: case VLOOP: case ZEQ:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/** find_depths     Operand stack depth before each instruction.
+		 *
+		 * @param code      : function's program.
+		 * @param depth     : set to the depth, -1 where unreachable.
+		 * @param max_depth : set to the deepest stack.
+		 * @param max_args  : set to the most arguments of a CALL.
+		 * @return false if an opcode has no template or the depth at
+		 *          some instruction is not the same on every path.
+		 */
+		static bool find_depths(const program &code, std::vector<int> &depth, int &max_depth, int &max_args) {
+			const int count = static_cast<int>(code.size());
+
+			depth.assign(count, -1);
+			max_depth = 0;
+			max_args = 0;
+
+			std::vector<int> work;
+			if (count > 0) {
+				depth[0] = 0;
+				work.push_back(0);
+			}
+
+			auto reach = [&](int index, int d) {
+				if (index == count) return true;
+				if ((index < 0) || (index > count)) return false;
+				if (depth[index] == -1) {
+					depth[index] = d;
+					work.push_back(index);
+					return true;
+				}
+				return depth[index] == d;
+			};
+
+			while (!work.empty()) {
+				const int index = work.back();
+				work.pop_back();
+
+				const inst &instruction = code[index];
+				if (!translatable(instruction)) return false;
+
+				int pops = 0, pushes = 0;
+
+				if (instruction.op == CALL) {
+					const symbol_table_node *p_function_id = static_cast<const symbol_table_node *>(instruction.arg0.a_);
+					pops = static_cast<int>(p_function_id->defined.routine.p_parameter_ids.size());
+					pushes = call_pushes(p_function_id);
+					max_args = std::max(max_args, pops);
+				}
+				else if (!optimizer::stack_effect(instruction, pops, pushes)) {
+					return false;
+				}
+
+				if (depth[index] < pops) return false;
+
+				const int next = depth[index] - pops + pushes;
+				max_depth = std::max(max_depth, std::max(next, depth[index]));
+
+				if (optimizer::is_jump(instruction.op) &&
+					!reach(optimizer::jump_target(instruction), next)) return false;
+
+				if ((instruction.op != GOTO) && (instruction.op != RETURN) &&
+					!reach(index + 1, next)) return false;
+			}
+
+			return true;
+		}
+
+		// Runtime calls, they never let an exception into native code.
+
+		static int call_function(cxvm *vm, symbol_table_node *p_function_id, cx_int *p_slots) {
+			try {
+				const size_t count = p_function_id->defined.routine.p_parameter_ids.size();
+				for (size_t i = 0; i < count; ++i) vm->push()->i_ = p_slots[i];
+
+				vm->call(p_function_id);
+
+				if (call_pushes(p_function_id) > 0) p_slots[0] = vm->pop()->i_;
+				return 0;
+			}
+			catch (...) {
+				pending_exception = std::current_exception();
+				return 1;
+			}
+		}
+
+		static int new_array(cxvm *vm, const cx_type *p_type, cx_int *p_slots) {
+			try {
+				void *mem = vm->new_array(p_type, static_cast<size_t>(p_slots[0]));
+				p_slots[0] = static_cast<cx_int>(reinterpret_cast<uintptr_t>(mem));
+				return 0;
+			}
+			catch (...) {
+				pending_exception = std::current_exception();
+				return 1;
+			}
+		}
+
+		// leaves the location the kernel went on at, -1 to run the loop
+		static int vector_loop(cxvm *, const vector_kernel *p_kernel, cx_int *p_slots) {
+			try {
+				p_slots[0] = simd::run(*p_kernel);
+				return 0;
+			}
+			catch (...) {
+				pending_exception = std::current_exception();
+				return 1;
+			}
+		}
+
+		/** x64_translator  Stitches the template of each instruction
+		 *                  into one function.
+		 */
+		class x64_translator {
+			x64_assembler a;
+			const program &code;
+			std::vector<int> depth;
+			int spill_slots, argument_slots;
+			int arguments_offset;
+
+			std::vector<size_t> instruction_offsets;
+			std::vector<std::pair<size_t, int>> jumps;		// displacement, instruction
+			std::vector<size_t> failed_jumps;
+			std::vector<std::pair<int, size_t>> loop_entries;	// loop header, offset
+			std::vector<std::shared_ptr<vector_kernel>> kernels;
+			int32_t frame_size;
+
+			int32_t spill_offset(int slot) const {
+				return vm_offset - 8 * (slot - register_slots + 1);
+			}
+
+			// load a stack value into a scratch register
+			void get(x64_register r, int slot) {
+				if (slot < register_slots) a.mov(r, slot_registers[slot]);
+				else a.load(r, RBP, spill_offset(slot));
+			}
+
+			void put(int slot, x64_register r) {
+				if (slot < register_slots) a.mov(slot_registers[slot], r);
+				else a.store(RBP, spill_offset(slot), r);
+			}
+
+			// rax = address of the node's runstack value
+			void node_value(const inst &instruction) {
+				const symbol_table_node *p_node = static_cast<const symbol_table_node *>(instruction.arg0.a_);
+				a.load_rax_absolute(&p_node->runstack_item);
+			}
+
+			// rax = the pointer held in the node's runstack value
+			void node_pointer(const inst &instruction) {
+				node_value(instruction);
+				a.load(RAX, RAX, 0);
+			}
+
+			// movzx eax, al
+			void zero_extend_al(void) { a.emit({ 0x0F, 0xB6, 0xC0 }); }
+
+			// rax = cx_char in eax/ax, extended as cx_char converts to cx_int
+			void extend_char(void) {
+				if (!char_is_32_bits) a.emit({ 0x0F, 0xB7, 0xC0 });
+				else if (char_is_signed) a.emit({ 0x48, 0x63, 0xC0 });
+				else a.emit({ 0x89, 0xC0 });
+			}
+
+			void binary_int(const inst &instruction, int d) {
+				get(RAX, d - 2);
+				get(RCX, d - 1);
+
+				switch (instruction.op) {
+				case IADD: a.emit({ 0x48, 0x03, 0xC1 }); break;
+				case ISUB: a.emit({ 0x48, 0x2B, 0xC1 }); break;
+				case IAND: a.emit({ 0x48, 0x23, 0xC1 }); break;
+				case IOR:  a.emit({ 0x48, 0x0B, 0xC1 }); break;
+				case IXOR: a.emit({ 0x48, 0x33, 0xC1 }); break;
+				case IMUL: a.emit({ 0x48, 0x0F, 0xAF, 0xC1 }); break;
+				case IDIV: a.emit({ 0x48, 0x99, 0x48, 0xF7, 0xF9 }); break;
+				case IREM: a.emit({ 0x48, 0x99, 0x48, 0xF7, 0xF9, 0x48, 0x89, 0xD0 }); break;
+				case ISHL: a.emit({ 0x48, 0xD3, 0xE0 }); break;
+				case ISHR: a.emit({ 0x48, 0xD3, 0xF8 }); break;
+				default: break;
+				}
+
+				put(d - 2, RAX);
+			}
+
+			void compare_int(uint8_t setcc, int d) {
+				get(RAX, d - 2);
+				get(RCX, d - 1);
+				a.emit({ 0x48, 0x3B, 0xC1, 0x0F, setcc, 0xC0 });
+				zero_extend_al();
+				put(d - 2, RAX);
+			}
+
+			// xmm0 = second from top, xmm1 = top
+			void double_operands(int d) {
+				get(RAX, d - 2);
+				get(RCX, d - 1);
+				a.emit({ 0x66, 0x48, 0x0F, 0x6E, 0xC0, 0x66, 0x48, 0x0F, 0x6E, 0xC9 });
+			}
+
+			void binary_double(uint8_t operation, int d) {
+				double_operands(d);
+				a.emit({ 0xF2, 0x0F, operation, 0xC1, 0x66, 0x48, 0x0F, 0x7E, 0xC0 });
+				put(d - 2, RAX);
+			}
+
+			void compare_double(const inst &instruction, int d) {
+				double_operands(d);
+
+				switch (instruction.op) {
+				case DLT:     a.emit({ 0x66, 0x0F, 0x2E, 0xC8, 0x0F, 0x97, 0xC0 }); break;
+				case DLT_EQ:  a.emit({ 0x66, 0x0F, 0x2E, 0xC8, 0x0F, 0x93, 0xC0 }); break;
+				case DGT:     a.emit({ 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x97, 0xC0 }); break;
+				case DGT_EQ:  a.emit({ 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x93, 0xC0 }); break;
+				case DEQ:     a.emit({ 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8 }); break;
+				case DNOT_EQ: a.emit({ 0x66, 0x0F, 0x2E, 0xC1, 0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8 }); break;
+				default: break;
+				}
+
+				zero_extend_al();
+				put(d - 2, RAX);
+			}
+
+			// rax = element at rax[rcx]
+			void load_element(opcode op) {
+				switch (op) {
+				case BALOAD_U: a.emit({ 0x0F, 0xB6, 0x04, 0x08 }); break;
+				case CALOAD_U:
+					if (!char_is_32_bits) a.emit({ 0x0F, 0xB7, 0x04, 0x48 });
+					else if (char_is_signed) a.emit({ 0x48, 0x63, 0x04, 0x88 });
+					else a.emit({ 0x8B, 0x04, 0x88 });
+					break;
+				default: a.emit({ 0x48, 0x8B, 0x04, 0xC8 }); break;
+				}
+			}
+
+			// rax[rcx] = rdx
+			void store_element(opcode op) {
+				switch (op) {
+				case BASTORE_U: a.emit({ 0x88, 0x14, 0x08 }); break;
+				case CASTORE_U:
+					if (char_is_32_bits) a.emit({ 0x89, 0x14, 0x88 });
+					else a.emit({ 0x66, 0x89, 0x14, 0x48 });
+					break;
+				default: a.emit({ 0x48, 0x89, 0x14, 0xC8 }); break;
+				}
+			}
+
+			// rax = *rax
+			void load_pointed(opcode op) {
+				switch (op) {
+				case BALOAD_P: a.emit({ 0x0F, 0xB6, 0x00 }); break;
+				case CALOAD_P:
+					if (!char_is_32_bits) a.emit({ 0x0F, 0xB7, 0x00 });
+					else if (char_is_signed) a.emit({ 0x48, 0x63, 0x00 });
+					else a.emit({ 0x8B, 0x00 });
+					break;
+				default: a.emit({ 0x48, 0x8B, 0x00 }); break;
+				}
+			}
+
+			// *rax = rdx
+			void store_pointed(opcode op) {
+				switch (op) {
+				case BASTORE_P: a.emit({ 0x88, 0x10 }); break;
+				case CASTORE_P:
+					if (char_is_32_bits) a.emit({ 0x89, 0x10 });
+					else a.emit({ 0x66, 0x89, 0x10 });
+					break;
+				default: a.emit({ 0x48, 0x89, 0x10 }); break;
+				}
+			}
+
+			// helper(vm, p_operand, arguments), leaving for failed on nonzero
+			void runtime_call(const void *p_helper, const void *p_operand) {
+				a.load(argument_registers[0], RBP, vm_offset);
+				a.mov(argument_registers[1], static_cast<int64_t>(reinterpret_cast<uintptr_t>(p_operand)));
+				a.lea(argument_registers[2], RBP, arguments_offset);
+				a.mov(RAX, static_cast<int64_t>(reinterpret_cast<uintptr_t>(p_helper)));
+				a.emit({ 0xFF, 0xD0, 0x85, 0xC0 });
+				failed_jumps.push_back(a.jump({ 0x0F, 0x85 }));
+			}
+
+			void translate_instruction(const inst &instruction, int d) {
+				switch (instruction.op) {
+				case ICONST:
+				case ACONST_NULL:
+					if (d < register_slots) a.mov(slot_registers[d], instruction.arg0.i_);
+					else {
+						a.mov(RAX, instruction.arg0.i_);
+						put(d, RAX);
+					}
+					break;
+				case DCONST: {
+					int64_t bits;
+					std::memcpy(&bits, &instruction.arg0.d_, sizeof(bits));
+					a.mov(RAX, bits);
+					put(d, RAX);
+				} break;
+				case AALOAD:
+				case ALOAD:
+				case DLOAD:
+				case ILOAD:
+				case PLOAD:
+					node_pointer(instruction);
+					put(d, RAX);
+					break;
+				case AASTORE:
+				case DSTORE:
+				case ISTORE:
+					get(RCX, d - 1);
+					node_value(instruction);
+					a.store(RAX, 0, RCX);
+					break;
+				case AINC:
+				case IINC:
+					node_value(instruction);
+					a.mov(RCX, instruction.arg1.i_);
+					a.emit({ 0x48, 0x01, 0x08 });
+					break;
+				case DINC: {
+					int64_t bits;
+					std::memcpy(&bits, &instruction.arg1.d_, sizeof(bits));
+					node_value(instruction);
+					a.load(RDX, RAX, 0);
+					a.mov(RCX, bits);
+					a.emit({ 0x66, 0x48, 0x0F, 0x6E, 0xC2, 0x66, 0x48, 0x0F, 0x6E, 0xC9,
+						0xF2, 0x0F, 0x58, 0xC1, 0x66, 0x48, 0x0F, 0x7E, 0xC2 });
+					a.store(RAX, 0, RDX);
+				} break;
+				case APTR:
+					get(RCX, d - 1);
+					a.mov(RDX, instruction.arg1.i_);
+					a.emit({ 0x48, 0x03, 0xCA });
+					node_value(instruction);
+					a.store(RAX, 0, RCX);
+					break;
+				case IADD: case ISUB: case IAND: case IOR: case IXOR:
+				case IMUL: case IDIV: case IREM: case ISHL: case ISHR:
+					binary_int(instruction, d);
+					break;
+				case ILT:     compare_int(0x9C, d); break;
+				case ILT_EQ:  compare_int(0x9E, d); break;
+				case IGT:     compare_int(0x9F, d); break;
+				case IGT_EQ:  compare_int(0x9D, d); break;
+				case IEQ:     compare_int(0x94, d); break;
+				case INOT_EQ: compare_int(0x95, d); break;
+				case BEQ:
+				case ZEQ:
+					get(RAX, d - 2);
+					get(RCX, d - 1);
+					a.emit({ 0x38, 0xC8, 0x0F, 0x94, 0xC0 });
+					zero_extend_al();
+					put(d - 2, RAX);
+					break;
+				case LOGIC_AND:
+				case LOGIC_OR:
+					get(RAX, d - 2);
+					get(RCX, d - 1);
+					a.emit({ 0x84, 0xC0, 0x0F, 0x95, 0xC0, 0x84, 0xC9, 0x0F, 0x95, 0xC1,
+						static_cast<uint8_t>(instruction.op == LOGIC_AND ? 0x20 : 0x08), 0xC8 });
+					zero_extend_al();
+					put(d - 2, RAX);
+					break;
+				case LOGIC_NOT:
+					get(RAX, d - 1);
+					a.emit({ 0x48, 0x85, 0xC0, 0x0F, 0x94, 0xC0 });
+					zero_extend_al();
+					put(d - 1, RAX);
+					break;
+				case INOT:
+					get(RAX, d - 1);
+					a.emit({ 0x48, 0xF7, 0xD0 });
+					put(d - 1, RAX);
+					break;
+				case B2I:
+				case I2B:
+					get(RAX, d - 1);
+					zero_extend_al();
+					put(d - 1, RAX);
+					break;
+				case C2I:
+				case I2C:
+					get(RAX, d - 1);
+					extend_char();
+					put(d - 1, RAX);
+					break;
+				case I2D:
+					get(RAX, d - 1);
+					a.emit({ 0xF2, 0x48, 0x0F, 0x2A, 0xC0, 0x66, 0x48, 0x0F, 0x7E, 0xC0 });
+					put(d - 1, RAX);
+					break;
+				case D2I:
+					get(RAX, d - 1);
+					a.emit({ 0x66, 0x48, 0x0F, 0x6E, 0xC0, 0xF2, 0x48, 0x0F, 0x2C, 0xC0 });
+					put(d - 1, RAX);
+					break;
+				case DADD: binary_double(0x58, d); break;
+				case DSUB: binary_double(0x5C, d); break;
+				case DMUL: binary_double(0x59, d); break;
+				case DDIV: binary_double(0x5E, d); break;
+				case DLT: case DLT_EQ: case DGT: case DGT_EQ: case DEQ: case DNOT_EQ:
+					compare_double(instruction, d);
+					break;
+				case BALOAD_U: case CALOAD_U: case DALOAD_U: case IALOAD_U:
+					get(RAX, d - 2);
+					get(RCX, d - 1);
+					load_element(instruction.op);
+					put(d - 2, RAX);
+					break;
+				case BASTORE_U: case CASTORE_U: case DASTORE_U: case IASTORE_U:
+					get(RDX, d - 1);
+					get(RCX, d - 2);
+					node_pointer(instruction);
+					store_element(instruction.op);
+					break;
+				case BALOAD_P: case CALOAD_P: case DALOAD_P: case IALOAD_P:
+					node_pointer(instruction);
+					load_pointed(instruction.op);
+					put(d, RAX);
+					break;
+				case BASTORE_P: case CASTORE_P: case DASTORE_P: case IASTORE_P:
+					get(RDX, d - 1);
+					node_pointer(instruction);
+					store_pointed(instruction.op);
+					break;
+				case IF_FALSE:
+					get(RAX, d - 1);
+					a.emit({ 0x84, 0xC0 });
+					jumps.push_back(std::make_pair(a.jump({ 0x0F, 0x84 }), optimizer::jump_target(instruction)));
+					break;
+				case GOTO:
+					jumps.push_back(std::make_pair(a.jump({ 0xE9 }), optimizer::jump_target(instruction)));
+					break;
+				case RETURN:
+					jumps.push_back(std::make_pair(a.jump({ 0xE9 }), static_cast<int>(code.size())));
+					break;
+				case VLOOP: {
+					// the kernel leaves through the header's if_false when it runs the loop
+					const int header = static_cast<int>(&instruction - code.data()) + 1;
+					std::shared_ptr<vector_kernel> p_kernel = simd::compile(code, header);
+					if (p_kernel == nullptr) break;
+
+					kernels.push_back(p_kernel);
+					runtime_call(reinterpret_cast<const void *>(&vector_loop), p_kernel.get());
+					a.load(RAX, RBP, arguments_offset);
+					a.emit({ 0x48, 0x85, 0xC0 });
+					jumps.push_back(std::make_pair(a.jump({ 0x0F, 0x89 }), optimizer::jump_target(code[header + 3])));
+				} break;
+				case NEWARRAY:
+					get(RAX, d - 1);
+					a.store(RBP, arguments_offset, RAX);
+					runtime_call(reinterpret_cast<const void *>(&new_array), instruction.arg0.a_);
+					a.load(RAX, RBP, arguments_offset);
+					put(d - 1, RAX);
+					break;
+				case CALL: {
+					const symbol_table_node *p_function_id = static_cast<const symbol_table_node *>(instruction.arg0.a_);
+					const int count = static_cast<int>(p_function_id->defined.routine.p_parameter_ids.size());
+
+					for (int i = 0; i < count; ++i) {
+						get(RAX, d - count + i);
+						a.store(RBP, arguments_offset + 8 * i, RAX);
+					}
+
+					runtime_call(reinterpret_cast<const void *>(&call_function), p_function_id);
+
+					if (call_pushes(p_function_id) > 0) {
+						a.load(RAX, RBP, arguments_offset);
+						put(d - count, RAX);
+					}
+				} break;
+				default:	// POP, POP2, NOP, CHECKCAST, VLOOP
+					break;
+				}
+			}
+
+		public:
+			// save the registers, make the frame and keep the VM pointer
+			void prologue(void) {
+				a.push(RBP);
+				a.mov(RBP, RSP);
+				for (x64_register r : slot_registers) a.push(r);
+				a.emit({ 0x48, 0x81, 0xEC });
+				a.emit32(frame_size);
+				a.store(RBP, vm_offset, argument_registers[0]);
+			}
+
+			/* A second way in at the head of each loop, for on stack
+			 * replacement.  Only heads with nothing on the operand
+			 * stack: the interpreter's locals are already where the
+			 * code reads them. */
+			void loop_entry_points(void) {
+				std::vector<bool> is_head(code.size(), false);
+
+				for (size_t index = 0; index < code.size(); ++index) {
+					if ((code[index].op != GOTO) || (depth[index] < 0)) continue;
+
+					const int target = optimizer::jump_target(code[index]);
+					if ((target <= static_cast<int>(index)) && (depth[target] == 0)) is_head[target] = true;
+				}
+
+				for (size_t index = 0; index < code.size(); ++index) {
+					if (!is_head[index]) continue;
+
+					loop_entries.push_back(std::make_pair(static_cast<int>(index), a.position()));
+					prologue();
+					jumps.push_back(std::make_pair(a.jump({ 0xE9 }), static_cast<int>(index)));
+				}
+			}
+
+		public:
+			x64_translator(const program &code_) : code(code_) {}
+
+			bool translate(void) {
+				int max_depth = 0, max_args = 0;
+				if (!find_depths(code, depth, max_depth, max_args)) return false;
+
+				spill_slots = std::max(max_depth - register_slots, 0);
+				argument_slots = std::max(max_args, 1);
+				arguments_offset = vm_offset - 8 * (spill_slots + argument_slots);
+
+				// keep rsp 16 byte aligned at calls, with 32 bytes of home space
+				frame_size = 8 + 8 * (spill_slots + argument_slots) + 32;
+				if ((frame_size % 16) == 0) frame_size += 8;
+
+				prologue();
+
+				instruction_offsets.resize(code.size() + 1);
+
+				for (size_t index = 0; index < code.size(); ++index) {
+					instruction_offsets[index] = a.position();
+					if (depth[index] >= 0) translate_instruction(code[index], depth[index]);
+				}
+
+				// done: status 0
+				instruction_offsets[code.size()] = a.position();
+				a.emit({ 0x31, 0xC0 });
+
+				const size_t exit = a.position();
+				a.lea(RSP, RBP, -saved_registers_size);
+				for (int r = register_slots - 1; r >= 0; --r) a.pop(slot_registers[r]);
+				a.pop(RBP);
+				a.emit({ 0xC3 });
+
+				// failed: status 1
+				const size_t failed = a.position();
+				a.emit({ 0xB8 });
+				a.emit32(1);
+				const size_t to_exit = a.jump({ 0xE9 });
+				a.patch32(to_exit, static_cast<int32_t>(exit - (to_exit + 4)));
+
+				loop_entry_points();
+
+				for (auto &jump : jumps) {
+					a.patch32(jump.first, static_cast<int32_t>(instruction_offsets[jump.second] - (jump.first + 4)));
+				}
+
+				for (size_t at : failed_jumps) {
+					a.patch32(at, static_cast<int32_t>(failed - (at + 4)));
+				}
+
+				return true;
+			}
+
+			const std::vector<uint8_t> &bytes(void) const { return a.bytes; }
+			const std::vector<std::pair<int, size_t>> &loops(void) const { return loop_entries; }
+			const std::vector<std::shared_ptr<vector_kernel>> &vector_kernels(void) const { return kernels; }
+		};
+
+		/** make_executable     Copy machine code to memory it can
+		 *                      run from.
+		 */
+		static bool make_executable(const x64_translator &translator, native_code &native) {
+			const std::vector<uint8_t> &bytes = translator.bytes();
+
+
+#if defined _WIN32
+			native.size = bytes.size();
+			native.p_memory = VirtualAlloc(nullptr, native.size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (native.p_memory == nullptr) return false;
+
+			std::memcpy(native.p_memory, bytes.data(), bytes.size());
+
+			DWORD old_protection;
+			if (!VirtualProtect(native.p_memory, native.size, PAGE_EXECUTE_READ, &old_protection)) return false;
+			FlushInstructionCache(GetCurrentProcess(), native.p_memory, native.size);
+#else
+			const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			native.size = (bytes.size() + page - 1) / page * page;
+
+			void *p_memory = mmap(nullptr, native.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p_memory == MAP_FAILED) return false;
+			native.p_memory = p_memory;
+
+			std::memcpy(native.p_memory, bytes.data(), bytes.size());
+			if (mprotect(native.p_memory, native.size, PROT_READ | PROT_EXEC) != 0) return false;
+#endif
+			native.entry = reinterpret_cast<native_code::entry_point>(native.p_memory);
+			native.kernels = translator.vector_kernels();
+
+			for (auto &loop : translator.loops()) {
+				native.loop_entries.push_back(std::make_pair(loop.first,
+					reinterpret_cast<native_code::entry_point>(static_cast<uint8_t *>(native.p_memory) + loop.second)));
+			}
+
+			return true;
+		}
+#endif
+
+		/** enter       Run native code on vm, throwing again what it
+		 *              stopped on.
+		 *
+		 * @param entry : where to start.
+		 * @param vm    : VM of the function's activation.
+		 */
+		static void enter(native_code::entry_point entry, cxvm *vm) {
+			if (entry(vm) != 0) {
+				std::exception_ptr p_exception;
+				std::swap(p_exception, pending_exception);
+				std::rethrow_exception(p_exception);
+			}
+		}
+
+		std::shared_ptr<native_code> translate(const symbol_table_node *p_function_id) {
+			std::shared_ptr<native_code> p_native = std::make_shared<native_code>();
+
+#ifdef __CX_JIT_X64__
+			x64_translator translator(p_function_id->defined.routine.program_code);
+			if (translator.translate() && !make_executable(translator, *p_native)) {
+				p_native->entry = nullptr;
+			}
+#endif
+
+			return p_native;
+		}
+
+		bool run(cxvm *vm, const symbol_table_node *p_function_id) {
+			std::shared_ptr<native_code> &p_native = p_function_id->defined.routine.p_native_code;
+			if (p_native == nullptr) {
+				// with -tier the tier thread translates it once it's hot
+				if (tier_settings::tiered) return false;
+				p_native = translate(p_function_id);
+			}
+			if (p_native->entry == nullptr) return false;
+
+			enter(p_native->entry, vm);
+			return true;
+		}
+
+		bool run_loop(cxvm *vm, const native_code &native, int head) {
+			native_code::entry_point entry = native.loop_entry(head);
+			if (entry == nullptr) return false;
+
+			enter(entry, vm);
+			return true;
+		}
+	}
+}
@@ -0,0 +1,72 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "symtab.h"
+
+namespace cx {
+	class cxvm;
+	struct vector_kernel;
+
+	/** native_code     x86-64 translation of a function's program.
+	 *
+	 *                  The entry point returns nonzero when the code
+	 *                  stopped on an exception, which jit::run then
+	 *                  throws again.  A null entry point means the
+	 *                  function uses something the JIT does not
+	 *                  translate, and runs on the interpreter.
+	 */
+	struct native_code {
+		typedef int(*entry_point)(cxvm *);
+
+		entry_point entry;
+		std::vector<std::pair<int, entry_point>> loop_entries;	// by loop head
+		std::vector<std::shared_ptr<vector_kernel>> kernels;	// run by its VLOOPs
+		void *p_memory;
+		size_t size;
+
+		native_code() : entry(nullptr), p_memory(nullptr), size(0) {}
+		~native_code();
+
+		// Entry point at the head of a loop, null if the code has none
+		entry_point loop_entry(int head) const;
+	};
+
+	namespace jit {
+		// Translate a function's program, the entry is null if it can't be
+		std::shared_ptr<native_code> translate(const symbol_table_node *p_function_id);
+		// Run a function entered on vm as machine code, false to interpret it
+		bool run(cxvm *vm, const symbol_table_node *p_function_id);
+		// Continue an activation at the head of a loop, false if the code can't
+		bool run_loop(cxvm *vm, const native_code &native, int head);
+	}
+}
+
+#endif
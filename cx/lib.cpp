@@ -22,6 +22,7 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
+#include <iostream>
 #include "parser.h"
 
 #if defined _WIN32
@@ -35,8 +36,6 @@ std::vector<void *> linux_libs;
 #endif
 
 namespace cx{
-	// env variable that holds the path to stdlib
-#define __CX_STDLIB__   L"CX_STDLIB"
 
 	void load_lib(const wchar_t *lib, symbol_table *p_symtab) {
 
@@ -116,90 +115,96 @@ namespace cx{
 		}
 	}
 
-	/** parse_execute_directive      Opens an external script module
-	*                      for parsing.
+	/** parse_execute_directive      Parse a run of directives.
 	*
-	*      #include <identifier>
+	*      #include "<module>"
+	*      #warn "<message>"
+	*      #import <library>
+	*
+	*      The modules of a run of #include lines are all queued
+	*      before waiting for the first, so they compile at the
+	*      same time, and are then merged in the order written.
 	*
 	* @param p_function_id : ptr to the routine owning this directive call.
 	*/
-	//	void parser::parse_execute_directive(symbol_table_node_ptr &p_function_id) {
-	//
-	//		//	extern symbol_table_node_ptr p_program_ptr_id;
-	//
-	//		switch (token) {
-	//		case TC_INCLUDE:
-	//		{
-	//			std::wstring lib_path;
-	//			wchar_t *env_path = _wgetenv(__CX_STDLIB__);
-	//
-	//			if (env_path != nullptr) {
-	//				lib_path = env_path;
-	//#ifdef _WIN32
-	//				lib_path += L"\\";
-	//#else
-	//				lib_path += L"/";
-	//#endif
-	//			}
-	//
-	//			get_token();
-	//
-	//			lib_path += p_token->string;
-	//			p_program_ptr_id->found_global_end = true;
-	//
-	//			// save current line number
-	//			int old_line_num = current_line_number;
-	//			current_line_number = 0;
-	//
-	//			/* true : stdlib module
-	//			* returns nullptr */
-	//			{
-	//				std::unique_ptr<parser> p_parser;// = nullptr;
-	//
-	//				try {
-	//					p_parser = std::make_unique<parser>(new source_buffer(lib_path.c_str()), true);
-	//
-	//					p_parser->parse();
-	//				}
-	//				catch (...) {
-	//
-	//				}
-	//			}
-	//
-	//			current_line_number = old_line_num;
-	//			p_program_ptr_id->found_global_end = false;
-	//			get_token();
-	//		}
-	//		break;
-	//		case TC_WARN:
-	//		{
-	//			get_token();
-	//
-	//			if (token != TC_STRING) {
-	//				cx_error(ERR_UNEXPECTED_TOKEN);
-	//			}
-	//
-	//			{
-	//				std::wstring msg = p_token->string;
-	//				msg[0] = ' ';
-	//				msg[msg.length() - 1] = L'\0';
-	//				std::wcerr << "warning:" << msg << std::endl;
-	//			}
-	//
-	//			get_token();
-	//		}
-	//		break;
-	//		case TC_IMPORT:
-	//		{
-	//			get_token();
-	//
-	//			load_lib(p_token->string, symtab_stack.get_current_symtab());
-	//
-	//			get_token();
-	//		}
-	//		break;
-	//		default:
-	//			break;
-	//		}
-	//	}
+	void parser::parse_execute_directive(symbol_table_node_ptr &p_function_id) {
+		std::vector<module_ptr> includes;
+
+		while (token == TC_POUND) {
+			get_token();
+
+			switch (token) {
+			case TC_INCLUDE:
+			{
+				get_token();
+
+				if (token != TC_STRING) {
+					cx_error(ERR_UNEXPECTED_TOKEN);
+					break;
+				}
+
+				wchar_t module_name[MAX_INPUT_BUFFER_SIZE];
+				copy_quoted_string(module_name, p_token->string);
+
+				std::wstring module_file_name = find_module(module_name, file_name);
+				if (module_file_name.empty()) cx_error(ERR_MODULE_NOT_FOUND);
+				else includes.push_back(schedule_module(module_file_name));
+
+				get_token();
+			}
+			break;
+			case TC_WARN:
+			{
+				get_token();
+
+				if (token != TC_STRING) {
+					cx_error(ERR_UNEXPECTED_TOKEN);
+					break;
+				}
+
+				{
+					wchar_t msg[MAX_INPUT_BUFFER_SIZE];
+					copy_quoted_string(msg, p_token->string);
+					std::wcerr << "warning: " << msg << std::endl;
+				}
+
+				get_token();
+			}
+			break;
+			case TC_IMPORT:
+			{
+				get_token();
+
+				load_lib(p_token->string, symtab_stack.get_current_symtab());
+
+				get_token();
+			}
+			break;
+			default:
+				cx_error(ERR_UNEXPECTED_TOKEN);
+				break;
+			}
+		}
+
+		if (includes.empty()) return;
+
+		// modules are merged into the global scope only
+		if (symtab_stack.nesting_level() != 0) {
+			cx_error(ERR_UNEXPECTED_TOKEN);
+			return;
+		}
+
+		for (auto &p_include : includes) {
+			if (!wait_for_module(p_include, p_module)) {
+				cx_error(ERR_CIRCULAR_INCLUDE);
+				continue;
+			}
+
+			merge_module(p_include, p_global_scope.get());
+
+			// the program links in the code of every module, once
+			if (is_module) p_module->includes.push_back(p_include);
+			else link_module(p_include, p_function_id.get(), linked_modules, p_scanner->source()->error_count);
+		}
+	}
 }
\ No newline at end of file
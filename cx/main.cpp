@@ -26,15 +26,29 @@ THE SOFTWARE.
 #include <chrono>
 #endif
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 #include <memory>
 #include <locale>
 #include <codecvt>
+#include <vector>
 #include "error.h"
+#include "aot.h"
+#include "bench.h"
 #include "buffer.h"
+#include "cache.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "profile.h"
+#include "server.h"
+#include "simd.h"
 #include "symtab.h"
+#include "tier.h"
+#include "trace.h"
+#include "verify.h"
 #include "cxvm.h"
 
 void set_options(int argc, char **argv);
@@ -51,6 +65,11 @@ int main(int argc, char *argv[]) {
 
 	try {
 		set_options(argc, argv);
+		// the interpreter loop is built per set of hooks, pick it once
+		cxvm::choose_loops();
+
+		if (server_settings::serve) return serve();
+		if (bench_settings::run) return run_benchmark();
 
 		// Check the command line arguments.
 		if (argc < 2) {
@@ -60,17 +79,44 @@ int main(int argc, char *argv[]) {
 
 		std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
 		std::string args = argv[1];
+		std::wstring source_file_name = converter.from_bytes(args);
+
+		if (server_settings::remote) return run_on_server(source_file_name);
 
 		// Create the parser for the source file,
 		// and then parse the file.
-		std::shared_ptr<cx::parser> parser = std::make_shared<cx::parser>(new source_buffer(converter.from_bytes(args)));
+		source_buffer *p_source = new source_buffer(source_file_name);
+		std::shared_ptr<cx::parser> parser = std::make_shared<cx::parser>(p_source);
 
 #ifdef __CX_PROFILE_EXECUTION__
 		using namespace std::chrono;
 		high_resolution_clock::time_point t1 = high_resolution_clock::now();
 #endif
 
-		symbol_table_node_ptr p_program_id = parser->parse();
+		/* A listing, a -dev dump, pass dumps and pass times need the
+		 * front end to run, so the cache is only used without them. */
+		bool use_cache = cache_settings::use_cache && !buffer::list_flag && !vm_settings::dev_debug_flag &&
+			optimizer_settings::print_after.empty() && !optimizer_settings::time_passes;
+		bytecode_cache cache(source_file_name, *p_source);
+
+		symbol_table_node_ptr p_program_id = use_cache ? cache.load() : nullptr;
+
+		if (p_program_id == nullptr) {
+			p_program_id = parser->parse();
+			/* the cache is keyed on this file alone, not its modules,
+			 * and lazy bodies are not compiled yet */
+			if (use_cache && (parser->error_count() == 0) && !parser->uses_modules() &&
+				!parse_settings::lazy_functions) cache.store(p_program_id);
+		}
+
+		// -profile-in tunes the code before it is shown or run
+		if (!profile_settings::input_file.empty() && (parser->error_count() == 0)) profile::apply(p_program_id.get());
+
+		// code that passes the verifier runs without the VM's guards
+		std::string reason;
+		if ((parser->error_count() == 0) && !verifier::verify_program(p_program_id.get(), reason) && vm_settings::dev_debug_flag) {
+			std::cerr << "[ verifier  ]--> " << reason << std::endl;
+		}
 
 		if (vm_settings::dev_debug_flag) {
 			std::wstring asm_file = parser->code_filename() + L".i";
@@ -100,13 +146,16 @@ int main(int argc, char *argv[]) {
 			output.close();
 		}
 
+		// -cpp and -aot build the program instead of running it
+		if (aot_settings::emit_source && (parser->error_count() == 0)) return aot::build(p_program_id, source_file_name);
+
 #ifdef __CX_PROFILE_EXECUTION__
 		high_resolution_clock::time_point t2 = high_resolution_clock::now();
 		duration<double> time_span = duration_cast <duration<double >> (t2 - t1);
 		std::cout << "finished parsing in: " << time_span.count() << "(secs)" << std::endl;
 #endif
 
-		if (error::error_count == 0) {
+		if (parser->error_count() == 0) {
 			std::shared_ptr<cxvm> cx = std::make_shared<cxvm>();
 
 #ifdef __CX_PROFILE_EXECUTION__
@@ -116,6 +165,8 @@ int main(int argc, char *argv[]) {
 			cx->enter_function(p_program_id.get());
 			cx->go();
 
+			if (profile_settings::record) profile::save(p_program_id.get());
+
 			std::wcout << p_program_id->node_name << " returned " << p_program_id->runstack_item->i_ << std::endl;
 
 #ifdef __CX_PROFILE_EXECUTION__
@@ -133,9 +184,29 @@ int main(int argc, char *argv[]) {
 		std::cerr << "\nFatal: " << ex.what() << std::endl;
 	}
 
+	if (tier_settings::tiered) tier::shutdown();
+	if (optimizer_settings::time_passes) optimizer::report_pass_times(std::wcerr);
+
 	return return_value;
 }
 
+/** option_error    Reject a -O level or -print-after pass that
+ *                  doesn't exist, listing the ones that do.
+ *
+ * @param program : name cx was run as.
+ * @param option  : the bad option.
+ */
+static void option_error(const char *program, const char *option) {
+	using namespace cx;
+
+	std::cerr << "cx: bad option " << option << std::endl
+		<< "usage: " << program << " <source file> [-O0|-O1|-O2|-O3] [-print-after=all";
+	for (auto name : optimizer::pass_names()) std::cerr << '|' << name;
+	std::cerr << ']' << std::endl;
+
+	abort_translation(ABORT_INVALID_COMMANDLINE_ARGS);
+}
+
 void set_options(int argc, char **argv) {
 	using namespace cx;
 
@@ -146,5 +217,84 @@ void set_options(int argc, char **argv) {
 		if (!strcmp("-vgc", argv[i])) vm_settings::verbose_gc = true;
 		else // Source listing
 		if (!strcmp("-list", argv[i])) buffer::list_flag = true;
+		else // Trusted code, no array bounds checks
+		if (!strcmp("-unchecked", argv[i])) vm_settings::unchecked_flag = true;
+		else // Run functions as x86-64 machine code
+		if (!strcmp("-jit", argv[i])) vm_settings::jit_flag = true;
+		else // Interpret functions until they are hot, then optimize them
+		if (!strcmp("-tier", argv[i])) tier_settings::tiered = true;
+		else // -tier with the calls that make a function hot
+		if (!strncmp("-tiercalls", argv[i], 10)) {
+			tier_settings::tiered = true;
+			tier_settings::call_threshold = atoi(argv[i] + 10);
+		}
+		else // -tier with the loop iterations that make a function hot
+		if (!strncmp("-tierloops", argv[i], 10)) {
+			tier_settings::tiered = true;
+			tier_settings::loop_threshold = atoi(argv[i] + 10);
+		}
+		else // Record hot loop paths and run them as traces
+		if (!strcmp("-trace", argv[i])) trace_settings::tracing = true;
+		else // -trace with the iterations that make a loop hot
+		if (!strncmp("-tracehot", argv[i], 9)) {
+			trace_settings::tracing = true;
+			trace_settings::threshold = atoi(argv[i] + 9);
+		}
+		else // Count branches, calls and loop trips into a profile
+		if (!strncmp("-profile-out=", argv[i], 13)) {
+			std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+			profile_settings::record = true;
+			profile_settings::output_file = converter.from_bytes(argv[i] + 13);
+		}
+		else // Inline and lay out code by the counts of an earlier run
+		if (!strncmp("-profile-in=", argv[i], 12)) {
+			std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+			profile_settings::input_file = converter.from_bytes(argv[i] + 12);
+		}
+		else // Write the program as C++ next to the source
+		if (!strcmp("-cpp", argv[i])) aot_settings::emit_source = true;
+		else // Compile the program to a native executable with the system compiler
+		if (!strcmp("-aot", argv[i])) aot_settings::emit_source = aot_settings::compile = true;
+		else // Name of the C++ file and executable, replacing them if they exist
+		if (!strncmp("-o=", argv[i], 3)) {
+			std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+			aot_settings::output_name = converter.from_bytes(argv[i] + 3);
+		}
+		else // Leave loops to the interpreter rather than vector kernels
+		if (!strcmp("-novector", argv[i])) simd_settings::vectorize = false;
+		else // Optimization level, -O0 runs the code as the parser emitted it
+		if (!strncmp("-O", argv[i], 2)) {
+			const char *p_level = argv[i] + 2;
+			if ((p_level[0] < '0') || (p_level[0] > '3') || (p_level[1] != '\0')) option_error(argv[0], argv[i]);
+
+			optimizer_settings::level = p_level[0] - '0';
+		}
+		else // Report the time spent in each optimizing pass
+		if (!strcmp("-time-passes", argv[i])) optimizer_settings::time_passes = true;
+		else // Dump each function after a pass, or after every pass with "all"
+		if (!strncmp("-print-after=", argv[i], 13)) {
+			optimizer_settings::print_after = argv[i] + 13;
+
+			std::vector<const char *> names = optimizer::pass_names();
+			names.push_back("all");
+			if (std::find(names.begin(), names.end(), optimizer_settings::print_after) == names.end()) option_error(argv[0], argv[i]);
+		}
+		else // Always compile, never read or write the .cxc cache
+		if (!strcmp("-nocache", argv[i])) cache_settings::use_cache = false;
+		else // Compile function bodies on their first call
+		if (!strcmp("-lazy", argv[i])) parse_settings::lazy_functions = true;
+		else // Module compiler threads, -j1 compiles modules one by one
+		if (!strncmp("-j", argv[i], 2)) module_settings::thread_count = atoi(argv[i] + 2);
+		else // Stay up and compile for -remote
+		if (!strcmp("-serve", argv[i])) server_settings::serve = true;
+		else // Run on the compile server
+		if (!strcmp("-remote", argv[i])) server_settings::remote = true;
+		else // Compile server number, when a user runs more than one
+		if (!strncmp("-port", argv[i], 5)) server_settings::port = static_cast<unsigned short>(atoi(argv[i] + 5));
+		else // Front end benchmark, -bench<n> sets the size of its sources
+		if (!strncmp("-bench", argv[i], 6)) {
+			bench_settings::run = true;
+			if (argv[i][6] != '\0') bench_settings::size = atoi(argv[i] + 6);
+		}
     }
 }
\ No newline at end of file
@@ -0,0 +1,395 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#if defined _WIN32
+#include <io.h>
+#endif
+
+#include <algorithm>
+#include <codecvt>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <locale>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "buffer.h"
+#include "charscan.h"
+#include "error.h"
+#include "module.h"
+#include "optimizer.h"
+#include "parser.h"
+
+namespace cx {
+	namespace module_settings {
+		unsigned thread_count = 0;	// module threads, 0 for one per core
+	}
+
+	/** module_scheduler    Modules by full path and the queue of
+	 *                      those not yet started.  The lock guards
+	 *                      both and the state of every module.
+	 */
+	struct module_scheduler {
+		std::mutex lock;
+		std::condition_variable queued;
+		std::condition_variable finished;
+		std::map<std::wstring, module_ptr> modules;
+		std::deque<module_ptr> queue;
+		unsigned worker_count = 0;
+	};
+
+	/** scheduler       The one scheduler.  It is never destroyed:
+	 *                  idle module threads are still waiting on it
+	 *                  when the process exits.
+	 */
+	static module_scheduler &scheduler(void) {
+		static module_scheduler *p_scheduler = new module_scheduler();
+		return *p_scheduler;
+	}
+
+	/** run_compile     Compile a queued module on this thread and
+	 *                  wake whoever waits for it.
+	 *
+	 * @param p_module : module claimed by the caller.
+	 * @param guard    : the held scheduler lock.
+	 */
+	static void run_compile(module *p_module, std::unique_lock<std::mutex> &guard) {
+		p_module->state = module::RUNNING;
+		guard.unlock();
+
+		p_module->compile();
+
+		guard.lock();
+		p_module->state = module::DONE;
+		scheduler().finished.notify_all();
+	}
+
+	/** module_thread   Body of a module thread: compile queued
+	 *                  modules until the process exits.
+	 */
+	static void module_thread(void) {
+		module_scheduler &s = scheduler();
+		std::unique_lock<std::mutex> guard(s.lock);
+
+		for (;;) {
+			s.queued.wait(guard, [&s] { return !s.queue.empty(); });
+
+			module_ptr p_module = s.queue.front();
+			s.queue.pop_front();
+
+			// an includer may have compiled it already
+			if (p_module->state == module::QUEUED) run_compile(p_module.get(), guard);
+		}
+	}
+
+	/** compile     Parse the module's file.  This runs on a module
+	 *              thread, or on the includer's thread when it got
+	 *              there first; the module's parser keeps its own
+	 *              error count and scopes either way.
+	 */
+	void module::compile(void) {
+		hash_file(file_name, source_hash);
+
+		try {
+			parser module_parser(new source_buffer(file_name), this);
+			p_module_id = module_parser.parse();
+			error_count = module_parser.error_count();
+		}
+		catch (translation_stopped) {
+			// the compile server keeps going; the includer reports it
+			if (error_count == 0) error_count = 1;
+			p_module_id = std::make_shared<symbol_table_node>(cx_atoms.intern(L"__module__"), DC_PROGRAM);
+			if (p_symtab == nullptr) p_symtab = new_symtab();
+		}
+	}
+
+	/** existing_full_path  Full path of a file, used to know a
+	 *                      module however it is named.
+	 *
+	 * @param file_name : name of the file.
+	 * @return full path, empty if there is no such file.
+	 */
+	std::wstring existing_full_path(const std::wstring &file_name) {
+#if defined _WIN32
+		wchar_t full_path[_MAX_PATH];
+
+		if ((_waccess(file_name.c_str(), 0) != 0) ||
+			(_wfullpath(full_path, file_name.c_str(), _MAX_PATH) == nullptr)) return std::wstring();
+
+		return full_path;
+#else
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		char *p_full_path = realpath(converter.to_bytes(file_name).c_str(), nullptr);
+		if (p_full_path == nullptr) return std::wstring();
+
+		std::wstring full_path = converter.from_bytes(p_full_path);
+		free(p_full_path);
+
+		return full_path;
+#endif
+	}
+
+	/** hash_file       Hash the bytes of a file, to tell when it
+	 *                  changes.
+	 *
+	 * @param file_name : name of the file.
+	 * @param hash      : set to the hash.
+	 * @return false if the file could not be read.
+	 */
+	bool hash_file(const std::wstring &file_name, uint64_t &hash) {
+#if defined _WIN32
+		std::ifstream input(file_name, std::ios::binary);
+#else
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		std::ifstream input(converter.to_bytes(file_name), std::ios::binary);
+#endif
+		if (!input.good()) return false;
+
+		std::string bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+		hash = hash_bytes(bytes.data(), bytes.size());
+
+		return true;
+	}
+
+	/** find_module     Find the file of an included module: next to
+	 *                  the including file, else in the stdlib
+	 *                  directory.  ".cx" is added to a name without
+	 *                  an extension.
+	 *
+	 * @param name               : name as written in the #include.
+	 * @param includer_file_name : file doing the including.
+	 * @return full path of the module, empty if there is none.
+	 */
+	std::wstring find_module(const std::wstring &name, const std::wstring &includer_file_name) {
+		std::wstring module_name = name;
+
+		size_t base_name = module_name.find_last_of(L"/\\");
+		base_name = (base_name == std::wstring::npos) ? 0 : base_name + 1;
+		if (module_name.find(L'.', base_name) == std::wstring::npos) module_name += L".cx";
+
+		size_t directory_end = includer_file_name.find_last_of(L"/\\");
+		std::wstring directory = (directory_end == std::wstring::npos) ?
+			std::wstring() : includer_file_name.substr(0, directory_end + 1);
+
+		std::wstring full_path = existing_full_path(directory + module_name);
+		if (!full_path.empty()) return full_path;
+
+		wchar_t *env_path = _wgetenv(__CX_STDLIB__);
+		if (env_path == nullptr) return std::wstring();
+
+#ifdef _WIN32
+		return existing_full_path(std::wstring(env_path) + L"\\" + module_name);
+#else
+		return existing_full_path(std::wstring(env_path) + L"/" + module_name);
+#endif
+	}
+
+	/** schedule_module     Queue a module for compiling, unless it
+	 *                      already is.  The first time a module is
+	 *                      queued a module thread is started, up to
+	 *                      one per core.  A listing must come out in
+	 *                      source order, so then nothing is queued
+	 *                      and each includer compiles its modules
+	 *                      itself, one by one.
+	 *
+	 * @param file_name : full path of the module.
+	 * @return the module.
+	 */
+	module_ptr schedule_module(const std::wstring &file_name) {
+		module_scheduler &s = scheduler();
+		std::lock_guard<std::mutex> guard(s.lock);
+
+		module_ptr &p_module = s.modules[file_name];
+		if (p_module != nullptr) return p_module;
+
+		p_module = std::make_shared<module>(file_name);
+
+		unsigned max_threads = module_settings::thread_count;
+		if (max_threads == 0) max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+		if (!buffer::list_flag && (max_threads > 1)) {
+			s.queue.push_back(p_module);
+
+			if (s.worker_count < max_threads) {
+				++s.worker_count;
+				std::thread(module_thread).detach();
+			}
+
+			s.queued.notify_one();
+		}
+
+		return p_module;
+	}
+
+	/** wait_for_module     Wait until a module is compiled.  If no
+	 *                      module thread has started it, compile it
+	 *                      here instead of waiting.
+	 *
+	 * @param p_module   : module to wait for.
+	 * @param p_includer : module doing the waiting, nullptr for the
+	 *                     program.
+	 * @return false if the module is, through its own includes,
+	 *         waiting for the includer; it would never finish.
+	 */
+	bool wait_for_module(const module_ptr &p_module, module *p_includer) {
+		module_scheduler &s = scheduler();
+		std::unique_lock<std::mutex> guard(s.lock);
+
+		for (module *p_waiter = p_module.get(); p_waiter != nullptr; p_waiter = p_waiter->p_waiting_on) {
+			if (p_waiter == p_includer) return false;
+		}
+
+		if (p_includer != nullptr) p_includer->p_waiting_on = p_module.get();
+
+		if (p_module->state == module::QUEUED) run_compile(p_module.get(), guard);
+		else s.finished.wait(guard, [&p_module] { return p_module->state == module::DONE; });
+
+		if (p_includer != nullptr) p_includer->p_waiting_on = nullptr;
+
+		return true;
+	}
+
+	/** merge_module    Enter a compiled module's symbols into an
+	 *                  includer's global table, in the order the
+	 *                  module declared them.  Symbols the table
+	 *                  already has through another include are
+	 *                  skipped; functions may add overloads, any
+	 *                  other clash is a redefinition.
+	 *
+	 * @param p_module : compiled module.
+	 * @param p_symtab : includer's global table.
+	 */
+	void merge_module(const module_ptr &p_module, symbol_table *p_symtab) {
+		local &exports = p_module->p_symtab->symbols;
+
+		for (auto entry = exports.begin() + p_module->first_export; entry != exports.end(); ++entry) {
+			symbol_table_node_ptr &p_node = entry->second;
+			bool is_new = true;
+			bool clashes = false;
+
+			local::range existing = p_symtab->find_functions(entry->first);
+			for (auto p_other = existing.first; p_other != existing.second; ++p_other) {
+				if (p_other->second == p_node) is_new = false;
+				else if ((p_other->second->defined.defined_how != DC_FUNCTION) ||
+					(p_node->defined.defined_how != DC_FUNCTION)) clashes = true;
+			}
+
+			if (!is_new) continue;
+
+			if (clashes) cx_error(ERR_REDEFINED_IDENTIFIER);
+			else p_symtab->enter(p_node);
+		}
+	}
+
+	/** link_module     Append a module's top level code to the
+	 *                  program, after that of the modules it
+	 *                  includes, and give the program its variables.
+	 *                  A module is linked once, where it is first
+	 *                  included.
+	 *
+	 * @param p_module       : compiled module.
+	 * @param p_program_id   : the program.
+	 * @param linked_modules : modules already linked.
+	 * @param error_count    : the includer's syntax errors, the
+	 *                         module's are added to them.
+	 */
+	void link_module(const module_ptr &p_module, symbol_table_node *p_program_id,
+		std::vector<module *> &linked_modules, int &error_count) {
+
+		if (std::find(linked_modules.begin(), linked_modules.end(), p_module.get()) != linked_modules.end()) return;
+		linked_modules.push_back(p_module.get());
+
+		for (auto &p_include : p_module->includes) link_module(p_include, p_program_id, linked_modules, error_count);
+
+		auto &routine = p_program_id->defined.routine;
+		const auto &module_routine = p_module->p_module_id->defined.routine;
+
+		routine.p_variable_ids.insert(routine.p_variable_ids.end(),
+			module_routine.p_variable_ids.begin(), module_routine.p_variable_ids.end());
+
+		// jumps are to code indexes, so move them past the program's code
+		const int offset = static_cast<int>(routine.program_code.size());
+
+		for (inst instruction : module_routine.program_code) {
+			if (optimizer::is_jump(instruction.op)) instruction.arg0.i_ += offset;
+			routine.program_code.push_back(instruction);
+		}
+
+		error_count += p_module->error_count;
+	}
+
+	/** forget_changed_modules  Drop the modules whose file changed
+	 *                          since it was compiled, and every module
+	 *                          including one of them, so the next
+	 *                          include compiles them again.  Used by
+	 *                          the compile server between runs.
+	 *
+	 * @return true if any module was dropped.
+	 */
+	bool forget_changed_modules(void) {
+		module_scheduler &s = scheduler();
+		std::lock_guard<std::mutex> guard(s.lock);
+
+		std::vector<const module *> changed;
+
+		for (auto &entry : s.modules) {
+			uint64_t hash = 0;
+			if (!hash_file(entry.first, hash) || (hash != entry.second->source_hash)) {
+				changed.push_back(entry.second.get());
+			}
+		}
+
+		// then whatever includes a changed module, until none is left
+		for (bool grew = !changed.empty(); grew;) {
+			grew = false;
+
+			for (auto &entry : s.modules) {
+				const module *p_module = entry.second.get();
+				if (std::find(changed.begin(), changed.end(), p_module) != changed.end()) continue;
+
+				for (auto &p_include : p_module->includes) {
+					if (std::find(changed.begin(), changed.end(), p_include.get()) != changed.end()) {
+						changed.push_back(p_module);
+						grew = true;
+						break;
+					}
+				}
+			}
+		}
+
+		for (auto entry = s.modules.begin(); entry != s.modules.end();) {
+			if (std::find(changed.begin(), changed.end(), entry->second.get()) != changed.end()) {
+				entry = s.modules.erase(entry);
+			}
+			else {
+				++entry;
+			}
+		}
+
+		return !changed.empty();
+	}
+}
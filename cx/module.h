@@ -0,0 +1,89 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "symtab.h"
+
+// env variable that holds the path to stdlib
+#define __CX_STDLIB__   L"CX_STDLIB"
+
+namespace cx {
+	namespace module_settings {
+		extern unsigned thread_count;
+	}
+
+	class module;
+	typedef std::shared_ptr<module> module_ptr;
+
+	/** module      A Cx source file pulled in with #include.
+	 *
+	 *              Every module is compiled once, by itself, into
+	 *              its own global table, however many files include
+	 *              it.  Modules are compiled on a pool of module
+	 *              threads, so independent modules are compiled at
+	 *              the same time; the includer waits for them and
+	 *              merges their tables in the order they were
+	 *              included, so the result does not depend on which
+	 *              thread finished first.
+	 */
+	class module {
+	public:
+		enum compile_state { QUEUED, RUNNING, DONE };
+
+		const std::wstring file_name;
+		symbol_table_ptr p_symtab;			// the module's global table
+		symbol_table_node_ptr p_module_id;	// top level code and variables
+		size_t first_export;				// entries before it are builtins
+		std::vector<module_ptr> includes;	// modules it includes, in order
+		int error_count;					// syntax errors in the file itself
+		uint64_t source_hash;				// of the file as compiled
+
+		compile_state state;				// guarded by the scheduler lock
+		module *p_waiting_on;				// module this one waits for
+
+		module(const std::wstring &file_name_)
+			: file_name(file_name_), first_export(0), error_count(0),
+			source_hash(0), state(QUEUED), p_waiting_on(nullptr) {}
+
+		void compile(void);
+	};
+
+	std::wstring existing_full_path(const std::wstring &file_name);
+	bool hash_file(const std::wstring &file_name, uint64_t &hash);
+	std::wstring find_module(const std::wstring &name, const std::wstring &includer_file_name);
+	module_ptr schedule_module(const std::wstring &file_name);
+	bool wait_for_module(const module_ptr &p_module, module *p_includer);
+	void merge_module(const module_ptr &p_module, symbol_table *p_symtab);
+	void link_module(const module_ptr &p_module, symbol_table_node *p_program_id,
+		std::vector<module *> &linked_modules, int &error_count);
+	bool forget_changed_modules(void);
+}
+
+#endif
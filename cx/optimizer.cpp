@@ -0,0 +1,1164 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "optimizer.h"
+#include "simd.h"
+#include "ssa.h"
+
+namespace cx {
+	namespace optimizer_settings {
+		int level = 2;
+		bool time_passes = false;
+		std::string print_after;
+	}
+
+	// callees -O3 inlines without a profile, and the caller size it stops at
+	const size_t static_inline_max_callee = 16;
+	const size_t static_inline_max_caller = 1000;
+
+	namespace optimizer {
+
+		/** arg0_kind       What arg0 of an instruction refers to.
+		 *
+		 * @param op : opcode.
+		 * @return OPERAND_NODE for a symbol table node, OPERAND_TYPE for a
+		 *          type, OPERAND_VALUE for an immediate.
+		 */
+		operand_kind arg0_kind(opcode op) {
+			switch (op) {
+			case AALOAD: case AASTORE: case AINC: case ALOAD: case APTR: case ASTORE:
+			case BALOAD: case BALOAD_U: case BALOAD_P: case BASTORE: case BASTORE_U: case BASTORE_P:
+			case CALOAD: case CALOAD_U: case CALOAD_P: case CASTORE: case CASTORE_U: case CASTORE_P:
+			case DALOAD: case DALOAD_U: case DALOAD_P: case DASTORE: case DASTORE_U: case DASTORE_P:
+			case IALOAD: case IALOAD_U: case IALOAD_P: case IASTORE: case IASTORE_U: case IASTORE_P:
+			case CALL: case DEL: case DINC: case DLOAD: case DSTORE:
+			case IINC: case ILOAD: case ISTORE: case PLOAD:
+				return OPERAND_NODE;
+			case NEWARRAY:
+				return OPERAND_TYPE;
+			default:
+				return OPERAND_VALUE;
+			}
+		}
+
+		/** stack_effect     Number of operand stack values an instruction
+		 *                  consumes and produces.
+		 *
+		 * @param instruction : instruction to inspect.
+		 * @param pops        : values popped.
+		 * @param pushes      : values pushed.
+		 * @return false if the effect is not statically known (CALL).
+		 */
+		bool stack_effect(const inst &instruction, int &pops, int &pushes) {
+			pops = 0;
+			pushes = 0;
+
+			switch (instruction.op) {
+			case AALOAD:
+			case ACONST_NULL:
+			case ALOAD:
+			case DCONST:
+			case DLOAD:
+			case ICONST:
+			case ILOAD:
+			case PLOAD:
+			case BALOAD_P:
+			case CALOAD_P:
+			case DALOAD_P:
+			case IALOAD_P:
+				pushes = 1;
+				return true;
+			case AASTORE:
+			case APTR:
+			case ASTORE:
+			case DSTORE:
+			case ISTORE:
+			case IF_FALSE:
+			case POP:
+			case BASTORE_P:
+			case CASTORE_P:
+			case DASTORE_P:
+			case IASTORE_P:
+				pops = 1;
+				return true;
+			case POP2:
+			case BASTORE:
+			case BASTORE_U:
+			case CASTORE:
+			case CASTORE_U:
+			case DASTORE:
+			case DASTORE_U:
+			case IASTORE:
+			case IASTORE_U:
+				pops = 2;
+				return true;
+			case B2I:
+			case C2I:
+			case D2I:
+			case I2B:
+			case I2C:
+			case I2D:
+			case DNEG:
+			case DPOS:
+			case INEG:
+			case IPOS:
+			case INOT:
+			case LOGIC_NOT:
+			case NEWARRAY:
+				pops = 1;
+				pushes = 1;
+				return true;
+			case BALOAD:
+			case BALOAD_U:
+			case CALOAD:
+			case CALOAD_U:
+			case DALOAD:
+			case DALOAD_U:
+			case IALOAD:
+			case IALOAD_U:
+			case BEQ:
+			case DADD:
+			case DDIV:
+			case DEQ:
+			case DGT:
+			case DGT_EQ:
+			case DLT:
+			case DLT_EQ:
+			case DMUL:
+			case DNOT_EQ:
+			case DREM:
+			case DSUB:
+			case IADD:
+			case IAND:
+			case IDIV:
+			case IEQ:
+			case IGT:
+			case IGT_EQ:
+			case ILT:
+			case ILT_EQ:
+			case IMUL:
+			case INOT_EQ:
+			case IOR:
+			case IREM:
+			case ISHL:
+			case ISHR:
+			case ISUB:
+			case IXOR:
+			case LOGIC_OR:
+			case LOGIC_AND:
+			case ZEQ:
+				pops = 2;
+				pushes = 1;
+				return true;
+			case AINC:
+			case CHECKCAST:
+			case DEL:
+			case DINC:
+			case GOTO:
+			case IINC:
+			case NOP:
+			case RETURN:
+			case VLOOP:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		bool is_jump(opcode op) {
+			return (op == GOTO) || (op == IF_FALSE);
+		}
+
+		/** jump_target      Resolve a jump location to the index of the
+		 *                  next executed instruction. cxvm::go lands on
+		 *                  location - 1 and then steps, except that
+		 *                  locations <= 0 rewind to begin() first.
+		 *
+		 * @param instruction : GOTO or IF_FALSE.
+		 * @return instruction index.
+		 */
+		int jump_target(const inst &instruction) {
+			const int location = static_cast<int>(instruction.arg0.i_);
+			return location <= 0 ? 1 : location;
+		}
+
+		/** splice           Replace erase_count instructions at an index
+		 *                  with new ones and move every jump location
+		 *                  past the edit by the size difference.
+		 *
+		 * NOTE:
+		 *      A jump that landed on the start of the edit keeps
+		 *      landing there, so inserted code is skipped by it.
+		 *
+		 * @param code        : code to edit.
+		 * @param at          : first instruction replaced.
+		 * @param erase_count : number of instructions removed.
+		 * @param insts       : instructions inserted in their place.
+		 * @return size difference.
+		 */
+		static int splice(program &code, int at, int erase_count, const std::vector<inst> &insts) {
+			const int delta = static_cast<int>(insts.size()) - erase_count;
+
+			for (auto &instruction : code) {
+				if (!is_jump(instruction.op)) continue;
+
+				cx_int &location = instruction.arg0.i_;
+				if (location >= at + erase_count) location += delta;
+				else if (location > at) location = at;
+			}
+
+			code.erase(code.begin() + at, code.begin() + at + erase_count);
+			code.insert(code.begin() + at, insts.begin(), insts.end());
+
+			return delta;
+		}
+
+		/** jump_targets     Mark every instruction some jump lands on.
+		 *
+		 * @param code : code to scan.
+		 * @return one flag per instruction (plus the end).
+		 */
+		static std::vector<bool> jump_targets(const program &code) {
+			std::vector<bool> is_target(code.size() + 2, false);
+
+			for (auto &instruction : code) {
+				if (!is_jump(instruction.op)) continue;
+
+				const int target = jump_target(instruction);
+				if (target < static_cast<int>(is_target.size())) is_target[target] = true;
+			}
+
+			return is_target;
+		}
+
+		// Counted for loop recognized by match_counted_loop.
+		struct counted_loop {
+			int top;			// header ILOAD i
+			int back;			// back edge GOTO
+			int body_start;
+			const void *p_index;	// loop variable node
+			cx_int first;		// initial value of i
+			cx_int step;		// header increment
+			cx_int low;			// range of i inside the body
+			cx_int high;
+			std::vector<bool> is_target;
+		};
+
+		/** match_counted_loop   Recognize a counted loop of the shape
+		 *                      emitted by parse_FOR:
+		 *
+		 *          top - 2:  iconst <first>
+		 *          top - 1:  istore i
+		 *          top    :  iload i
+		 *                    iconst <n>
+		 *                    ilt | ilt_eq
+		 *                    if_false <exit>
+		 *                    iinc i <step>
+		 *                    <body>
+		 *          back   :  goto top
+		 *
+		 *                      The loop must only be entered through its
+		 *                      initializer and i must only change through
+		 *                      the header increment. Calls are rejected
+		 *                      since a callee can rebind or modify any node.
+		 *                      i only grows, so inside <body> it lies in
+		 *                      [first + step, n - 1 + step] (n + step for <=).
+		 *
+		 * @param code : function code.
+		 * @param top  : loop header index.
+		 * @param back : index of the back edge GOTO.
+		 * @param loop : filled in on success.
+		 * @return true if the loop has that shape.
+		 */
+		static bool match_counted_loop(const program &code, int top, int back, counted_loop &loop) {
+			const int body_start = top + 5;
+
+			if ((top < 2) || (body_start > back)) return false;
+
+			const void *p_index = code[top].arg0.a_;
+
+			if ((code[top].op != ILOAD) ||
+				(code[top + 1].op != ICONST) ||
+				((code[top + 2].op != ILT) && (code[top + 2].op != ILT_EQ)) ||
+				(code[top + 3].op != IF_FALSE) ||
+				(jump_target(code[top + 3]) <= back) ||
+				(code[top + 4].op != IINC) || (code[top + 4].arg0.a_ != p_index) ||
+				(code[top - 1].op != ISTORE) || (code[top - 1].arg0.a_ != p_index) ||
+				(code[top - 2].op != ICONST)) return false;
+
+			const cx_int first = code[top - 2].arg0.i_;
+			const cx_int limit = code[top + 1].arg0.i_;
+			const cx_int step = code[top + 4].arg1.i_;
+
+			if ((step <= 0) || (step > INT32_MAX) ||
+				(first < INT32_MIN) || (first > INT32_MAX) || (limit > INT32_MAX)) return false;
+
+			for (int pc = 0; pc < static_cast<int>(code.size()); ++pc) {
+				const inst &instruction = code[pc];
+
+				if (is_jump(instruction.op)) {
+					const int target = jump_target(instruction);
+					const bool inside = (pc >= top) && (pc <= back);
+
+					if (inside) {
+						if ((target > top) && (target < body_start)) return false;
+					}
+					else if ((target >= top - 1) && (target <= back)) {
+						return false;
+					}
+				}
+
+				if ((pc < top) || (pc > back)) continue;
+
+				switch (instruction.op) {
+				case CALL:
+					return false;
+				case ISTORE:
+				case DSTORE:
+				case ASTORE:
+				case DINC:
+					if (instruction.arg0.a_ == p_index) return false;
+					break;
+				case IINC:
+					if ((instruction.arg0.a_ == p_index) && (pc != top + 4)) return false;
+					break;
+				default:
+					break;
+				}
+			}
+
+			loop.top = top;
+			loop.back = back;
+			loop.body_start = body_start;
+			loop.p_index = p_index;
+			loop.first = first;
+			loop.step = step;
+			loop.low = first + step;
+			loop.high = (code[top + 2].op == ILT ? limit - 1 : limit) + step;
+			loop.is_target = jump_targets(code);
+
+			return true;
+		}
+
+		/** fixed_array_bound    Find the max index an array local is
+		 *                      guaranteed to have for the whole function.
+		 *                      Holds when the only store to the local is
+		 *                      a single NEWARRAY of constant size, made
+		 *                      before any jump so that it runs ahead of
+		 *                      every loop.
+		 *
+		 * @param p_function_id : function owning the code.
+		 * @param p_array       : array variable node.
+		 * @param max_index     : proven max index.
+		 * @return true if proven.
+		 */
+		static bool fixed_array_bound(symbol_table_node *p_function_id,
+			const symbol_table_node *p_array, cx_int &max_index) {
+
+			bool is_local = false;
+			for (auto &p_local : p_function_id->defined.routine.p_variable_ids) {
+				if (p_local.get() == p_array) {
+					is_local = true;
+					break;
+				}
+			}
+
+			if (!is_local) return false;
+
+			const program &code = p_function_id->defined.routine.program_code;
+			const cx_type *p_array_type = nullptr;
+			bool seen_jump = false;
+			int store_count = 0;
+
+			for (size_t i = 0; i < code.size(); ++i) {
+				if (is_jump(code[i].op)) seen_jump = true;
+				if (code[i].arg0.a_ != p_array) continue;
+
+				switch (code[i].op) {
+				case ASTORE:
+					if (seen_jump || (i == 0) || (code[i - 1].op != NEWARRAY)) return false;
+					p_array_type = (const cx_type *)code[i - 1].arg0.a_;
+					++store_count;
+					break;
+				case AASTORE:
+				case ISTORE:
+				case DSTORE:
+					return false;
+				default:
+					break;
+				}
+			}
+
+			if ((store_count != 1) || (p_array_type == nullptr)) return false;
+			if (p_array_type->array.element_count == 0) return false;
+
+			max_index = static_cast<cx_int>(p_array_type->array.max_index);
+			return true;
+		}
+
+		// Array access indexed directly by the loop variable.
+		struct indexed_access {
+			int pc;			// load/store instruction
+			int index_pc;	// iload i feeding the index
+			int array_pc;	// aload feeding a load, -1 for stores
+		};
+
+		// Symbolic operand stack slot used by find_indexed_accesses.
+		struct slot {
+			enum { UNKNOWN, INDEX, ARRAY } kind;
+			const void *p_node;
+			int pc;
+		};
+
+		/** find_indexed_accesses    Simulate the operand stack over the
+		 *                          loop body and collect array accesses
+		 *                          whose index is i itself. The stack is
+		 *                          forgotten where control flow joins.
+		 *
+		 * @param code : function code.
+		 * @param loop : counted loop.
+		 * @return accesses in code order.
+		 */
+		static std::vector<indexed_access> find_indexed_accesses(const program &code, const counted_loop &loop) {
+			std::vector<indexed_access> accesses;
+			std::vector<slot> stack;
+			const slot unknown = { slot::UNKNOWN, nullptr, -1 };
+
+			auto pop = [&stack, &unknown]() -> slot {
+				if (stack.empty()) return unknown;
+				slot s = stack.back();
+				stack.pop_back();
+				return s;
+			};
+
+			for (int pc = loop.body_start; pc < loop.back; ++pc) {
+				const inst &instruction = code[pc];
+				int pops = 0;
+				int pushes = 0;
+
+				if (loop.is_target[pc]) stack.clear();
+
+				if (!stack_effect(instruction, pops, pushes)) {
+					stack.clear();
+					continue;
+				}
+
+				switch (instruction.op) {
+				case ILOAD:
+					stack.push_back({ instruction.arg0.a_ == loop.p_index ? slot::INDEX : slot::UNKNOWN,
+						instruction.arg0.a_, pc });
+					continue;
+				case ALOAD:
+					stack.push_back({ slot::ARRAY, instruction.arg0.a_, pc });
+					continue;
+				case BALOAD:
+				case BALOAD_U:
+				case CALOAD:
+				case CALOAD_U:
+				case DALOAD:
+				case DALOAD_U:
+				case IALOAD:
+				case IALOAD_U: {
+					slot index = pop();
+					slot array = pop();
+
+					if ((index.kind == slot::INDEX) &&
+						(array.kind == slot::ARRAY) && (array.p_node == instruction.arg0.a_)) {
+						accesses.push_back({ pc, index.pc, array.pc });
+					}
+
+					stack.push_back(unknown);
+				} continue;
+				case BASTORE:
+				case BASTORE_U:
+				case CASTORE:
+				case CASTORE_U:
+				case DASTORE:
+				case DASTORE_U:
+				case IASTORE:
+				case IASTORE_U: {
+					pop();
+					slot index = pop();
+
+					if (index.kind == slot::INDEX) {
+						accesses.push_back({ pc, index.pc, -1 });
+					}
+				} continue;
+				default:
+					break;
+				}
+
+				for (int i = 0; i < pops; ++i) pop();
+				for (int i = 0; i < pushes; ++i) stack.push_back(unknown);
+
+				if (is_jump(instruction.op)) stack.clear();
+			}
+
+			return accesses;
+		}
+
+		/** eliminate_bounds_checks  Run the loop range analysis over every
+		 *                          back edge of a finished function and
+		 *                          switch array accesses indexed by the
+		 *                          loop variable to their unchecked variant
+		 *                          when the whole range fits the array.
+		 *
+		 * NOTE:
+		 *      Only DC_FUNCTION bodies are analyzed. Globals owned by
+		 *      __main__ can be reassigned by any function.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 */
+		void eliminate_bounds_checks(symbol_table_node *p_function_id) {
+			if (p_function_id->defined.defined_how != DC_FUNCTION) return;
+			if (vm_settings::unchecked_flag) return;
+
+			program &code = p_function_id->defined.routine.program_code;
+
+			for (int pc = 0; pc < static_cast<int>(code.size()); ++pc) {
+				if (code[pc].op != GOTO) continue;
+
+				counted_loop loop;
+				const int top = jump_target(code[pc]);
+				if ((top >= pc) || !match_counted_loop(code, top, pc, loop)) continue;
+				if (loop.low < 0) continue;
+
+				for (auto &access : find_indexed_accesses(code, loop)) {
+					inst &instruction = code[access.pc];
+					cx_int max_index = 0;
+
+					if (fixed_array_bound(p_function_id, (const symbol_table_node *)instruction.arg0.a_, max_index) &&
+						(loop.high <= max_index)) {
+						instruction.op = unchecked_array_op(instruction.op);
+					}
+				}
+			}
+		}
+
+		/** power_of_two     Exponent k of a constant equal to 2^k.
+		 *
+		 * @param n : constant.
+		 * @return k, or -1 if n is not a positive power of two.
+		 */
+		static int power_of_two(cx_int n) {
+			if ((n <= 0) || ((n & (n - 1)) != 0)) return -1;
+
+			int k = 0;
+			while (n > 1) {
+				n >>= 1;
+				++k;
+			}
+
+			return k;
+		}
+
+		/** pointer_op       Element pointer variant of an unchecked
+		 *                  array load/store.
+		 *
+		 * @param op   : unchecked array opcode.
+		 * @param size : element size in bytes.
+		 * @return pointer opcode, or op if there is none.
+		 */
+		static opcode pointer_op(opcode op, cx_int &size) {
+			switch (op) {
+			case BALOAD_U: size = sizeof(cx_byte); return BALOAD_P;
+			case BASTORE_U: size = sizeof(cx_byte); return BASTORE_P;
+			case CALOAD_U: size = sizeof(cx_char); return CALOAD_P;
+			case CASTORE_U: size = sizeof(cx_char); return CASTORE_P;
+			case DALOAD_U: size = sizeof(cx_real); return DALOAD_P;
+			case DASTORE_U: size = sizeof(cx_real); return DASTORE_P;
+			case IALOAD_U: size = sizeof(cx_int); return IALOAD_P;
+			case IASTORE_U: size = sizeof(cx_int); return IASTORE_P;
+			default: size = 0; return op;
+			}
+		}
+
+		/** new_hidden_local     Add a compiler generated local to a
+		 *                      function. It gets its runstack slot in
+		 *                      cxvm::enter_function like any other local.
+		 *
+		 * @param p_function_id : function owning the local.
+		 * @param name          : node name, shown in listings.
+		 * @param p_type        : type of the local.
+		 * @return ptr to the new node.
+		 */
+		symbol_table_node *new_hidden_local(symbol_table_node *p_function_id,
+			const std::wstring &name, const type_ptr &p_type) {
+			symbol_table_node_ptr p_local = std::make_shared<symbol_table_node>(cx_atoms.intern(name), DC_VARIABLE);
+			p_local->p_type = p_type;
+
+			p_function_id->defined.routine.p_variable_ids.push_back(p_local);
+
+			return p_local.get();
+		}
+
+		/** reduce_loop      Strength reduction for one counted loop:
+		 *
+		 *                  i * c               ->  iload j, with j
+		 *                                          stepping by c * step
+		 *                  i / 2^k, i % 2^k    ->  ishr, iand when i >= 0
+		 *                  a[i] (unchecked)    ->  xaload_p/xastore_p p,
+		 *                                          with p stepping by
+		 *                                          step * sizeof element
+		 *
+		 *                  The derived variables are set up between the
+		 *                  initializer and the header and stepped next
+		 *                  to the header increment.
+		 *
+		 * @param p_function_id : function owning the code.
+		 * @param loop          : counted loop.
+		 * @return size difference of the code.
+		 */
+		static int reduce_loop(symbol_table_node *p_function_id, const counted_loop &loop) {
+			program &code = p_function_id->defined.routine.program_code;
+
+			struct rewrite {
+				int at;
+				int erase_count;
+				std::vector<inst> insts;
+			};
+
+			std::vector<rewrite> rewrites;
+			std::vector<inst> init;
+			std::vector<inst> steps;
+			std::map<cx_int, symbol_table_node *> scaled_ids;
+			std::map<const void *, symbol_table_node *> pointer_ids;
+
+			// a[i] through element pointers
+			for (auto &access : find_indexed_accesses(code, loop)) {
+				const inst &instruction = code[access.pc];
+				symbol_table_node *p_array = (symbol_table_node *)instruction.arg0.a_;
+				cx_int size = 0;
+				cx_int max_index = 0;
+				const opcode op = pointer_op(instruction.op, size);
+
+				if (size == 0) continue;
+				if (!fixed_array_bound(p_function_id, p_array, max_index)) continue;
+
+				if ((access.array_pc != -1) &&
+					((access.array_pc != access.pc - 2) || (access.index_pc != access.pc - 1) ||
+					loop.is_target[access.pc - 1] || loop.is_target[access.pc])) continue;
+
+				symbol_table_node *&p_pointer = pointer_ids[p_array];
+				if (p_pointer == nullptr) {
+					p_pointer = new_hidden_local(p_function_id, p_array->node_name + L"$ptr", p_array->p_type);
+					init.push_back({ ALOAD, p_array });
+					init.push_back({ APTR, p_pointer, loop.first * size });
+					steps.push_back({ AINC, p_pointer, loop.step * size });
+				}
+
+				if (access.array_pc != -1) {
+					rewrites.push_back({ access.array_pc, 3, { { op, p_pointer } } });
+				}
+				else {
+					rewrites.push_back({ access.pc, 1, { { op, p_pointer } } });
+					rewrites.push_back({ access.index_pc, 1, {} });
+				}
+			}
+
+			for (int pc = loop.body_start; pc + 2 < loop.back; ++pc) {
+				inst &first = code[pc];
+				inst &second = code[pc + 1];
+				inst &third = code[pc + 2];
+
+				if (loop.is_target[pc + 1] || loop.is_target[pc + 2]) continue;
+
+				const bool index_first = (first.op == ILOAD) && (first.arg0.a_ == loop.p_index) && (second.op == ICONST);
+				const bool index_second = (first.op == ICONST) && (second.op == ILOAD) && (second.arg0.a_ == loop.p_index);
+
+				// i * c -> j
+				if ((third.op == IMUL) && (index_first || index_second)) {
+					const cx_int factor = index_first ? second.arg0.i_ : first.arg0.i_;
+					if ((factor < INT32_MIN) || (factor > INT32_MAX)) continue;
+
+					symbol_table_node *&p_scaled = scaled_ids[factor];
+					if (p_scaled == nullptr) {
+						p_scaled = new_hidden_local(p_function_id,
+							((symbol_table_node *)loop.p_index)->node_name + L"$" + std::to_wstring(factor),
+							p_integer_type);
+						init.push_back({ ICONST, loop.first * factor });
+						init.push_back({ ISTORE, p_scaled });
+						steps.push_back({ IINC, p_scaled, loop.step * factor });
+					}
+
+					rewrites.push_back({ pc, 3, { { ILOAD, p_scaled } } });
+					pc += 2;
+					continue;
+				}
+
+				// i / 2^k, i % 2^k with i >= 0
+				if (index_first && (loop.low >= 0)) {
+					const int k = power_of_two(second.arg0.i_);
+					if (k < 1) continue;
+
+					if (third.op == IDIV) {
+						second.arg0.i_ = k;
+						third.op = ISHR;
+					}
+					else if (third.op == IREM) {
+						second.arg0.i_ = second.arg0.i_ - 1;
+						third.op = IAND;
+					}
+				}
+			}
+
+			if (rewrites.empty()) return 0;
+
+			std::sort(rewrites.begin(), rewrites.end(),
+				[](const rewrite &a, const rewrite &b) { return a.at > b.at; });
+
+			int delta = 0;
+			for (auto &edit : rewrites) {
+				delta += splice(code, edit.at, edit.erase_count, edit.insts);
+			}
+
+			delta += splice(code, loop.top + 4, 0, steps);
+			delta += splice(code, loop.top, 0, init);
+
+			return delta;
+		}
+
+		/** reduce_strength  Replace costly arithmetic in a finished
+		 *                  function. Counted loops get their induction
+		 *                  variable multiplies turned into additions and
+		 *                  their unchecked array accesses turned into
+		 *                  pointer increments; anywhere else a multiply
+		 *                  by 2^k becomes a shift.
+		 *
+		 * NOTE:
+		 *      Runs after eliminate_bounds_checks, which decides which
+		 *      accesses are safe to address through a pointer.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 */
+		void reduce_strength(symbol_table_node *p_function_id) {
+			if (p_function_id->defined.defined_how != DC_FUNCTION) return;
+
+			program &code = p_function_id->defined.routine.program_code;
+
+			/* Inner loops close before outer ones, so a forward scan
+			 * reduces them first. Edits stay inside [top, back]. */
+			for (int pc = 0; pc < static_cast<int>(code.size()); ++pc) {
+				if (code[pc].op != GOTO) continue;
+
+				counted_loop loop;
+				const int top = jump_target(code[pc]);
+				if ((top >= pc) || !match_counted_loop(code, top, pc, loop)) continue;
+
+				pc += reduce_loop(p_function_id, loop);
+			}
+
+			// x * 2^k -> x << k
+			const std::vector<bool> is_target = jump_targets(code);
+
+			for (size_t pc = 0; pc + 1 < code.size(); ++pc) {
+				if ((code[pc].op != ICONST) || (code[pc + 1].op != IMUL) || is_target[pc + 1]) continue;
+
+				const int k = power_of_two(code[pc].arg0.i_);
+				if (k < 1) continue;
+
+				code[pc].arg0.i_ = k;
+				code[pc + 1].op = ISHL;
+			}
+		}
+
+		/** passes_value     True for a parameter, local or result
+		 *                  cxvm::call copies by value.
+		 *
+		 * @param p_type : its type.
+		 * @return true if it is a scalar.
+		 */
+		static bool passes_value(const type_ptr &p_type) {
+			if ((p_type == nullptr) || !p_type->is_scalar_type()) return false;
+
+			switch (p_type->typecode) {
+			case T_BOOLEAN: case T_BYTE: case T_CHAR: case T_DOUBLE: case T_INT:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/** can_inline       True if a call can be replaced by the
+		 *                  callee's code: values in and out, no heap
+		 *                  of its own, and no way back into itself or
+		 *                  the caller.
+		 *
+		 * @param p_function_id : caller.
+		 * @param p_callee      : function called.
+		 * @return true if inline_call can take it.
+		 */
+		static bool can_inline(const symbol_table_node *p_function_id, const symbol_table_node *p_callee) {
+			auto &routine = p_callee->defined.routine;
+
+			if ((p_callee == p_function_id) || (p_callee->defined.defined_how != DC_FUNCTION)) return false;
+			if ((routine.p_lazy_body != nullptr) || routine.program_code.empty()) return false;
+			if ((p_callee->p_type->typecode != T_VOID) && !passes_value(p_callee->p_type)) return false;
+
+			for (auto &p_parameter : routine.p_parameter_ids) {
+				if (!passes_value(p_parameter->p_type)) return false;
+			}
+
+			for (auto &p_local : routine.p_variable_ids) {
+				if (!passes_value(p_local->p_type)) return false;
+			}
+
+			for (auto &instruction : routine.program_code) {
+				int pops, pushes;
+
+				switch (instruction.op) {
+				case ASTORE:
+				case DEL:
+				case NEWARRAY:
+					return false;
+				case CALL: {
+					const symbol_table_node *p_called = (const symbol_table_node *)instruction.arg0.a_;
+					if ((p_called == p_callee) || (p_called == p_function_id)) return false;
+					if ((p_called->p_type->typecode != T_VOID) && !passes_value(p_called->p_type)) return false;
+
+					for (auto &p_parameter : p_called->defined.routine.p_parameter_ids) {
+						if (!passes_value(p_parameter->p_type)) return false;
+					}
+				} break;
+				default:
+					if (!stack_effect(instruction, pops, pushes)) return false;
+				}
+			}
+
+			return true;
+		}
+
+		/** inline_call      Replace a CALL with a copy of the callee's
+		 *                  code.  Its parameters, variables and result
+		 *                  become hidden locals of the caller: the
+		 *                  arguments are stored into them, each RETURN
+		 *                  jumps past the copy and the result is loaded
+		 *                  there.
+		 *
+		 *                  [stores, last argument first]
+		 *                  [callee code, RETURN -> GOTO end]
+		 *            end:  [load of the result]
+		 *
+		 * @param p_function_id : caller.
+		 * @param at            : index of the CALL.
+		 * @return number of stores ahead of the copied code, or -1 if
+		 *         the call can't be inlined.
+		 */
+		int inline_call(symbol_table_node *p_function_id, int at) {
+			program &code = p_function_id->defined.routine.program_code;
+			symbol_table_node *p_callee = (symbol_table_node *)code[at].arg0.a_;
+			if ((code[at].op != CALL) || !can_inline(p_function_id, p_callee)) return -1;
+
+			auto &routine = p_callee->defined.routine;
+			std::map<const symbol_table_node *, symbol_table_node *> local_of;
+
+			auto hidden = [&](const symbol_table_node *p_node) {
+				symbol_table_node *p_local = new_hidden_local(p_function_id,
+					p_callee->node_name + L"$" + p_node->node_name, p_node->p_type);
+				local_of[p_node] = p_local;
+				return p_local;
+			};
+
+			auto store = [](const symbol_table_node *p_node) {
+				return (p_node->p_type->typecode == T_DOUBLE) ? DSTORE : ISTORE;
+			};
+
+			std::vector<inst> insts;
+			for (auto p_parameter = routine.p_parameter_ids.rbegin(); p_parameter != routine.p_parameter_ids.rend(); ++p_parameter) {
+				insts.push_back({ store(p_parameter->get()), hidden(p_parameter->get()) });
+			}
+
+			const int stores = static_cast<int>(insts.size());
+			const int base = at + stores;
+			const int end = base + static_cast<int>(routine.program_code.size());
+
+			for (auto &p_local : routine.p_variable_ids) hidden(p_local.get());
+			symbol_table_node *p_result = (p_callee->p_type->typecode != T_VOID) ? hidden(p_callee) : nullptr;
+
+			for (auto instruction : routine.program_code) {
+				if (instruction.op == RETURN) {
+					instruction = inst(GOTO, static_cast<cx_int>(end));
+				}
+				else if (is_jump(instruction.op)) {
+					instruction.arg0.i_ = base + jump_target(instruction);
+				}
+				else if (arg0_kind(instruction.op) == OPERAND_NODE) {
+					auto local = local_of.find((const symbol_table_node *)instruction.arg0.a_);
+					if (local != local_of.end()) instruction.arg0.a_ = local->second;
+				}
+
+				insts.push_back(instruction);
+			}
+
+			if (p_result != nullptr) {
+				insts.push_back({ (p_callee->p_type->typecode == T_DOUBLE) ? DLOAD : ILOAD, p_result });
+			}
+
+			splice(code, at, 1, insts);
+
+			add_dependency(p_function_id, p_callee);
+			for (auto p_node : routine.p_dependency_ids) add_dependency(p_function_id, p_node);
+
+			return stores;
+		}
+
+		/** vectorize_loops  Put a VLOOP ahead of the header of every loop
+		 *                  that can run as a vector kernel:
+		 *
+		 *                    istore i
+		 *                    vloop
+		 *          header:   iload i
+		 *
+		 *                  Jumps to the header skip it, so it only runs
+		 *                  when the loop is entered.  The loop is left
+		 *                  as it is for when the kernel can't run it,
+		 *                  and for -jit and -aot, which skip VLOOP.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 */
+		void vectorize_loops(symbol_table_node *p_function_id) {
+			if (!simd_settings::vectorize) return;
+
+			program &code = p_function_id->defined.routine.program_code;
+
+			for (int pc = 0; pc < static_cast<int>(code.size()); ++pc) {
+				if (code[pc].op != GOTO) continue;
+
+				const int top = jump_target(code[pc]);
+				if ((top < 1) || (top >= pc)) continue;
+
+				// entered by falling into the header
+				const opcode entry = code[top - 1].op;
+				if ((entry == GOTO) || (entry == RETURN) || (entry == VLOOP)) continue;
+
+				if (simd::compile(code, top) != nullptr) {
+					splice(code, top, 0, { inst(VLOOP) });
+					++pc;
+				}
+			}
+		}
+
+		/** inline_small_calls   Inline the calls to functions of a few
+		 *                      instructions, where the call costs more
+		 *                      than the body.  Without a profile there
+		 *                      is no telling which calls are hot, so
+		 *                      the callees are kept much smaller than
+		 *                      -profile-in allows.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 */
+		void inline_small_calls(symbol_table_node *p_function_id) {
+			program &code = p_function_id->defined.routine.program_code;
+
+			for (int at = 0; at < static_cast<int>(code.size()); ++at) {
+				if (code[at].op != CALL) continue;
+				if (code.size() > static_inline_max_caller) break;
+
+				const size_t callee_size = ((symbol_table_node *)code[at].arg0.a_)->defined.routine.program_code.size();
+				if (callee_size > static_inline_max_callee) continue;
+
+				const int stores = inline_call(p_function_id, at);
+				if (stores < 0) continue;
+
+				at += stores + static_cast<int>(callee_size);
+			}
+		}
+
+		/** pipeline_pass   A pass of optimize_function, the lowest -O
+		 *                  level that runs it, and whether it may run
+		 *                  on the tier thread: a pass that reads other
+		 *                  functions' code can't, since the interpreter
+		 *                  installs and compiles code meanwhile.
+		 */
+		struct pipeline_pass {
+			const char *name;
+			int level;
+			bool background;
+			void(*run)(symbol_table_node *p_function_id);
+		};
+
+		/* -O1 cleans up the SSA form, -O2 (the default) adds the loop
+		 * passes and -O3 inlines small calls first so the rest see
+		 * through them.  "ssa" covers building and lowering the SSA
+		 * form as well as its own passes. */
+		static const pipeline_pass pipeline[] = {
+			{ "inline", 3, false, inline_small_calls },
+			{ "ssa", 1, true, ssa::optimize },
+			{ "bounds-checks", 2, true, eliminate_bounds_checks },
+			{ "vectorize", 2, true, vectorize_loops },
+			{ "strength-reduction", 2, true, reduce_strength },
+		};
+
+		/** optimize_function    Run the passes of the -O level over a
+		 *                      finished function, in order.
+		 *
+		 * NOTE:
+		 *      A vectorized loop no longer has the shape reduce_strength
+		 *      looks for, so its array accesses stay indexed.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 * @param background    : true on the tier thread.
+		 */
+		void optimize_function(symbol_table_node *p_function_id, bool background) {
+			for (auto &pass : pipeline) {
+				if (pass.level > optimizer_settings::level) continue;
+				if (background && !pass.background) continue;
+
+				const auto start = std::chrono::steady_clock::now();
+				pass.run(p_function_id);
+				record_pass_time(pass.name, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+				if (print_after(pass.name)) {
+					std::wostringstream dump;
+					disassemble(dump, p_function_id);
+					write_dump(pass.name, dump.str());
+				}
+			}
+		}
+
+		/* Functions are optimized on the module threads and the tier
+		 * thread as well, so the report and the dumps take a lock. */
+		static std::mutex report_lock;
+
+		struct pass_time {
+			int runs = 0;
+			double seconds = 0;
+		};
+
+		// by pass, in the order they first ran
+		static std::vector<std::pair<std::string, pass_time>> pass_times;
+
+		/** record_pass_time     Add one run of a pass to the
+		 *                      -time-passes report.
+		 *
+		 * @param name    : pass name.
+		 * @param seconds : time the run took.
+		 */
+		void record_pass_time(const char *name, double seconds) {
+			if (!optimizer_settings::time_passes) return;
+
+			std::lock_guard<std::mutex> lock(report_lock);
+
+			auto entry = std::find_if(pass_times.begin(), pass_times.end(),
+				[name](const std::pair<std::string, pass_time> &time) { return time.first == name; });
+			if (entry == pass_times.end()) entry = pass_times.insert(pass_times.end(), std::make_pair(std::string(name), pass_time()));
+
+			++entry->second.runs;
+			entry->second.seconds += seconds;
+		}
+
+		/** pass_names       Names -print-after takes: the passes of the
+		 *                  pipeline, then the SSA passes "ssa" and
+		 *                  -profile-in run.
+		 *
+		 * @return names, in the order they run.
+		 */
+		std::vector<const char *> pass_names(void) {
+			std::vector<const char *> names;
+			for (auto &pass : pipeline) names.push_back(pass.name);
+
+			for (auto name : ssa::pass_names()) names.push_back(name);
+
+			return names;
+		}
+
+		/** print_after      True if -print-after names the pass.
+		 *
+		 * @param name : pass name.
+		 * @return true to dump the function after it.
+		 */
+		bool print_after(const char *name) {
+			return !optimizer_settings::print_after.empty() &&
+				((optimizer_settings::print_after == name) || (optimizer_settings::print_after == "all"));
+		}
+
+		/** write_dump       Write a -print-after dump to stderr in one
+		 *                  piece.
+		 *
+		 * @param name : pass that just ran.
+		 * @param text : the function, as bytecode or SSA form.
+		 */
+		void write_dump(const char *name, const std::wstring &text) {
+			std::lock_guard<std::mutex> lock(report_lock);
+			std::wcerr << L"*** after " << name << L" ***" << std::endl << text << std::endl;
+		}
+
+		/** disassemble      Write a function's bytecode, one instruction
+		 *                  per line with its location, jump targets and
+		 *                  the names of the nodes it refers to.
+		 *
+		 * @param out           : stream to write to.
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 */
+		void disassemble(std::wostream &out, const symbol_table_node *p_function_id) {
+			const program &code = p_function_id->defined.routine.program_code;
+			out << L"function: " << p_function_id->node_name << std::endl;
+
+			for (int pc = 0; pc < static_cast<int>(code.size()); ++pc) {
+				const inst &instruction = code[pc];
+				out << std::setw(5) << pc << L":\t" << opcode_string[instruction.op];
+
+				if (is_jump(instruction.op)) {
+					out << L" " << jump_target(instruction);
+				}
+				else if ((arg0_kind(instruction.op) == OPERAND_NODE) && (instruction.arg0.a_ != nullptr)) {
+					out << L" " << ((const symbol_table_node *)instruction.arg0.a_)->node_name;
+				}
+				else if (instruction.op == ICONST) {
+					out << L" " << instruction.arg0.i_;
+				}
+				else if (instruction.op == DCONST) {
+					out << L" " << instruction.arg0.d_;
+				}
+
+				out << std::endl;
+			}
+		}
+
+		/** report_pass_times    Write the -time-passes report: each pass,
+		 *                      how many functions it ran on and the
+		 *                      time it took in all.
+		 *
+		 * @param out : stream to write to.
+		 */
+		void report_pass_times(std::wostream &out) {
+			std::lock_guard<std::mutex> lock(report_lock);
+
+			out << L"pass                  runs        ms  (-O" << optimizer_settings::level << L")" << std::endl;
+			for (auto &time : pass_times) {
+				out << std::left << std::setw(20) << std::wstring(time.first.begin(), time.first.end()) << std::right
+					<< std::setw(6) << time.second.runs
+					<< std::setw(10) << std::fixed << std::setprecision(3) << time.second.seconds * 1000 << std::endl;
+			}
+		}
+	}
+}
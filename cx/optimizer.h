@@ -0,0 +1,86 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "cxvm.h"
+#include "symtab.h"
+
+namespace cx {
+	namespace optimizer_settings {
+		extern int level;				// -O0 .. -O3, which passes optimize_function runs
+		extern bool time_passes;		// -time-passes: report the time spent in each pass
+		extern std::string print_after;	// -print-after=<pass>: dump each function after the pass
+	}
+
+	namespace optimizer {
+		enum operand_kind : uint8_t {
+			OPERAND_VALUE, OPERAND_NODE, OPERAND_TYPE
+		};
+
+		// What arg0 of an instruction refers to
+		operand_kind arg0_kind(opcode op);
+		// Operand stack pops/pushes of an instruction, false if unknown
+		bool stack_effect(const inst &instruction, int &pops, int &pushes);
+		// True for instructions that transfer control
+		bool is_jump(opcode op);
+		// Index of the instruction a jump lands on
+		int jump_target(const inst &instruction);
+		// Add a compiler generated local to a function
+		symbol_table_node *new_hidden_local(symbol_table_node *p_function_id,
+			const std::wstring &name, const type_ptr &p_type);
+
+		// Replace proven in-bounds array accesses in for loops
+		void eliminate_bounds_checks(symbol_table_node *p_function_id);
+		// Turn multiplies/divides into additions, shifts and pointer steps
+		void reduce_strength(symbol_table_node *p_function_id);
+		// Mark loops that can run as vector kernels with VLOOP
+		void vectorize_loops(symbol_table_node *p_function_id);
+		// Replace a CALL with the callee's code, -1 if it can't be
+		int inline_call(symbol_table_node *p_function_id, int at);
+		// Inline calls to small functions (-O3)
+		void inline_small_calls(symbol_table_node *p_function_id);
+		// The passes of the -O level, in order, less inlining on the tier thread
+		void optimize_function(symbol_table_node *p_function_id, bool background = false);
+
+		// Add one run of a pass to the -time-passes report
+		void record_pass_time(const char *name, double seconds);
+		// Names -print-after takes: the pipeline's passes, then the SSA ones
+		std::vector<const char *> pass_names(void);
+		// True if -print-after names the pass, or is "all"
+		bool print_after(const char *name);
+		// Write a -print-after dump of a function
+		void write_dump(const char *name, const std::wstring &text);
+		// Write a function's bytecode, one instruction per line
+		void disassemble(std::wostream &out, const symbol_table_node *p_function_id);
+		// Write the -time-passes report
+		void report_pass_times(std::wostream &out);
+	}
+}
+
+#endif
@@ -40,30 +40,36 @@ namespace cx{
 	 * @return ptr to '__cx_global__' program Id.
 	 */
 	symbol_table_node_ptr parser::parse(void) {
-		symbol_table_node_ptr p_program_id = nullptr;
-
-		if (!is_module) {
-			p_program_id = std::make_shared<symbol_table_node>(L"__main__", DC_PROGRAM);
-			p_program_id->defined.routine.function_type = FUNC_DECLARED;
-			p_program_id->p_type = p_integer_type;
+		/* A module's top level code and variables are kept in a
+		 * routine of its own until linked into the program. */
+		symbol_table_node_ptr p_program_id = std::make_shared<symbol_table_node>(
+			cx_atoms.intern(is_module ? L"__module__" : L"__main__"), DC_PROGRAM);
+		p_program_id->defined.routine.function_type = FUNC_DECLARED;
+		p_program_id->p_type = p_integer_type;
+		p_program_id->defined.routine.p_symtab = p_global_scope;
+		p_program_id->defined.routine.qualified_name = qualified_name(nullptr, p_program_id);
+
+		if (is_module) {
+			p_module->p_symtab = p_global_scope;
+			p_module->first_export = p_global_scope->node_count();
 		}
 
-		scoping::current_nesting_level = 0;
+		symtab_stack.set_scope(0);
 		get_token();
 		parse_statement_list(p_program_id, TC_END_OF_FILE);
 		get_token();
 
 		if (!is_module) {
-			p_program_id->defined.routine.p_symtab = p_global_symbol_table;
 
 			resync(tokenlist_program_end);
 			conditional_get_token_append(TC_END_OF_FILE, ERR_MISSING_RIGHT_BRACKET);
 
 			if (vm_settings::dev_debug_flag) {
-				_swprintf(buffer::list.text, L"%20d source lines.", buffer::current_line_number);
-				buffer::list.put_line();
-				_swprintf(buffer::list.text, L"%20d syntax errors.", error::error_count);
-				buffer::list.put_line();
+				text_in_buffer *p_source = p_scanner->source();
+				_swprintf(p_source->list.text, L"%20d source lines.", p_source->line_number());
+				p_source->list.put_line();
+				_swprintf(p_source->list.text, L"%20d syntax errors.", p_source->error_count);
+				p_source->list.put_line();
 			}
 		}
 		return p_program_id;
@@ -138,7 +144,7 @@ namespace cx{
 		}
 
 		bool is_array = false;
-		symbol_table_node_ptr p_node = find(p_token->string);
+		symbol_table_node_ptr p_node = find(p_token->atom());
 		type_ptr assignment_expression_ptr = nullptr;
 		
 		if ((p_node->defined.defined_how == DC_TYPE) &&
@@ -157,7 +163,7 @@ namespace cx{
 
 				symbol_table_node_ptr p_new_id;
 
-				p_new_id = search_local(p_token->string);
+				p_new_id = search_local(p_token->atom());
 
 				// if not nullptr, it's already defined.
 				// check if forwarded
@@ -165,12 +171,12 @@ namespace cx{
 					if (p_new_id->defined.defined_how == DC_FUNCTION &&
 						p_new_id->defined.routine.function_type == FUNC_FORWARD) {
 						get_token();
-						parse_function_header(p_new_id);
+						parse_function_header(p_function_id, p_new_id);
 					}
 					else cx_error(ERR_REDEFINED_IDENTIFIER);
 				}
 				else {
-					p_new_id = std::make_shared<symbol_table_node>(p_token->string, DC_UNDEFINED);
+					p_new_id = std::make_shared<symbol_table_node>(p_token->atom(), DC_UNDEFINED);
 				}
 
 				// set type
@@ -187,7 +193,7 @@ namespace cx{
 				}
 				else if (token == TC_LEFT_PAREN) {
 					enter_new_function(p_new_id);
-					parse_function_header(p_new_id);
+					parse_function_header(p_function_id, p_new_id);
 				}
 				else if ((token != TC_COMMA) && (token != TC_END_OF_FILE)) {
 
@@ -218,7 +224,7 @@ namespace cx{
 		}
 		else if (p_node->defined.defined_how == DC_FUNCTION) {
 			get_token();
-			parse_subroutine_call(p_function_id, find_functions(p_node->node_name));
+			parse_subroutine_call(p_function_id, find_functions(p_node->name));
 		}
 		else {
 			get_token();
@@ -287,7 +293,7 @@ namespace cx{
 		get_token();
 
 		if (token == TC_IDENTIFIER) {
-			symbol_table_node_ptr p_field_id = p_type->complex.p_class_scope->search(p_token->string);
+			symbol_table_node_ptr p_field_id = p_type->complex.p_class_scope->search(p_token->atom());
 			if (p_field_id == nullptr) cx_error(ERR_INVALID_FIELD);
 
 			//icode.put(p_field_id);
@@ -329,7 +335,7 @@ namespace cx{
 		case TC_WHILE: parse_WHILE(p_function_id); break;
 		case TC_IF: parse_IF(p_function_id); break;
 		case TC_FOR: parse_FOR(p_function_id); break;
-		case TC_BREAK: get_token(); this->emit(p_function_id, opcode::BREAK_MARKER); break;
+		case TC_BREAK: parse_BREAK(p_function_id); break;
 		case TC_LEFT_BRACKET: parse_compound(p_function_id); break;
 		case TC_RETURN: parse_RETURN(p_function_id); break;
 			//case TC_NAMESPACE:{
@@ -359,10 +365,11 @@ namespace cx{
 			//}
 			//	break;ent_symtab(p_old_symtab);
 		case TC_ASM: parse_ASM(p_function_id); break;
+		case TC_POUND: parse_execute_directive(p_function_id); break;
 		case TC_DELETE: {
 			get_token();
 			if (token != TC_IDENTIFIER) cx_error(error_code::ERR_MISSING_IDENTIFIER);
-			symbol_table_node_ptr p_node = search_all(p_token->string);
+			symbol_table_node_ptr p_node = search_all(p_token->atom());
 			if (p_node->p_type->typecode != T_REFERENCE) cx_error(error_code::ERR_INVALID_REFERENCE);
 
 			this->emit(p_function_id, opcode::DEL, p_node.get());
@@ -461,7 +468,7 @@ namespace cx{
 
 		if (is_function) {
 			p_array_node->p_type = p_array_type;
-			parse_function_header(p_array_node);
+			parse_function_header(p_function_id, p_array_node);
 			return p_array_node->p_type;
 		}
 
@@ -26,17 +26,48 @@ THE SOFTWARE.
 #define PARSER_H
 #include <string>
 #include <cwchar>
+#include <vector>
 #include "buffer.h"
 #include "error.h"
 #include "token.h"
 #include "scanner.h"
 #include "types.h"
 #include "symtab.h"
+#include "module.h"
 
 namespace cx{
 
 	extern symbol_table_ptr p_global_symtab;
 
+	namespace parse_settings {
+		extern bool lazy_functions;
+	}
+
+	/** lazy_body    A function body left for the function's first
+	 *              call: where it starts, and the global scope it
+	 *              is parsed in.
+	 */
+	struct lazy_body {
+		std::wstring file_name;
+		size_t offset;								// offset of the opening bracket
+		int line_number;
+		size_t length;								// of the body in bytes
+		uint64_t body_hash;							// of the body's bytes
+		symbol_table_ptr p_global_scope;
+		std::weak_ptr<symbol_table_node> p_function_id;
+	};
+
+	/** label        Jump destination in a function's code. Jumps to a
+	 *              label that hasn't been placed yet are remembered and
+	 *              patched once it is, so emitted code never moves.
+	 */
+	struct label {
+		int location;				// -1 until placed
+		std::vector<int> fixups;	// jumps waiting for the location
+
+		label() : location(-1) {}
+	};
+
 	class parser {
 	public:
 		const std::wstring code_filename(void) const {
@@ -47,20 +78,28 @@ namespace cx{
 		text_scanner *const p_scanner; // ptr to the scanner
 		token *p_token; // ptr to the current token
 		token_code token; // code of current token
+		symbol_table_ptr p_global_scope; // program's global table, or the module's
 		symbol_table_stack symtab_stack;
 		type_ptr p_target_type;
+		module *const p_module; // module being compiled, nullptr for the program
 		bool is_module;
+		std::vector<module *> linked_modules; // modules whose code is in the program
 		std::wstring file_name;
+		std::vector<label *> break_labels; // exits of the enclosing loops
+
+		symbol_table_node_ptr parse_function_header(symbol_table_node_ptr &p_scope_id, symbol_table_node_ptr &p_function_id);
+		std::wstring qualified_name(const symbol_table_node_ptr &p_scope_id, const symbol_table_node_ptr &p_function_id) const;
 
-		symbol_table_node_ptr parse_function_header(symbol_table_node_ptr &p_function_id);
+		void parse_function_body(symbol_table_node_ptr &p_function_id);
+		void defer_function_body(symbol_table_node_ptr &p_function_id);
 
 		void parse_block(symbol_table_node_ptr &p_function_id);
 		void parse_formal_parm_list(symbol_table_node_ptr &p_function_id);
 
-		symbol_table_node_ptr parse_subroutine_call(symbol_table_node_ptr &p_function_id, std::pair<local::iterator, local::iterator> p_node_ids);
-		symbol_table_node_ptr parse_declared_subroutine_call(symbol_table_node_ptr &p_function_id, std::pair<local::iterator, local::iterator> p_node_ids);
+		symbol_table_node_ptr parse_subroutine_call(symbol_table_node_ptr &p_function_id, local::range p_node_ids);
+		symbol_table_node_ptr parse_declared_subroutine_call(symbol_table_node_ptr &p_function_id, local::range p_node_ids);
 
-		symbol_table_node_ptr parse_actual_parm_list(symbol_table_node_ptr &p_function_id, std::pair<local::iterator, local::iterator> p_node_ids);
+		symbol_table_node_ptr parse_actual_parm_list(symbol_table_node_ptr &p_function_id, local::range p_node_ids);
 		void parse_declarations_or_assignment(symbol_table_node_ptr &p_function_id);
 		type_ptr parse_array_type(symbol_table_node_ptr &p_function_id,
 			symbol_table_node_ptr &p_array_node);
@@ -90,37 +129,31 @@ namespace cx{
 		void parse_FOR(symbol_table_node_ptr &p_function_id);
 		void parse_compound(symbol_table_node_ptr &p_function_id);
 		void parse_RETURN(symbol_table_node_ptr &p_function_id);
+		void parse_BREAK(symbol_table_node_ptr &p_function_id);
 		void parse_ASM(symbol_table_node_ptr &p_function_id);
+		void parse_execute_directive(symbol_table_node_ptr &p_function_id);
 
 		void get_token(void) {
 			p_token = p_scanner->get();
 			token = p_token->code();
 		}
 
-		int put_location_marker(symbol_table_node_ptr &p_function_id) {
-			int location = std::distance(p_function_id->defined.routine.program_code.begin(),
-				p_function_id->defined.routine.program_code.end());
-			return location - 1;
-		}
-
-		void fixup_location_marker(symbol_table_node_ptr &p_function_id, int location) {
-			int jump_location = std::distance(p_function_id->defined.routine.program_code.begin(),
-				p_function_id->defined.routine.program_code.end());
+		void emit_jump(symbol_table_node_ptr &p_function_id, opcode op, label &target) {
+			if (target.location < 0) {
+				target.fixups.push_back(current_location(p_function_id));
+			}
 
-			p_function_id->defined.routine.program_code.at(location).arg0.i_ = jump_location;
+			this->emit(p_function_id, op, target.location < 0 ? 0 : target.location);
 		}
 
-		void set_break_jump(symbol_table_node_ptr &p_function_id, int start_marker) {
-			int break_point = current_location(p_function_id);
+		void place_label(symbol_table_node_ptr &p_function_id, label &target) {
+			target.location = current_location(p_function_id);
 
-			// Search for any emitted BREAK_MARKER
-			for (int i = start_marker; i < break_point; ++i) {
-				if (p_function_id->defined.routine.program_code[i].op == opcode::BREAK_MARKER) {
-					p_function_id->defined.routine.program_code[i].op = opcode::GOTO;
-					p_function_id->defined.routine.program_code[i].arg0.i_ = break_point;
-					break;
-				}
+			for (int at : target.fixups) {
+				p_function_id->defined.routine.program_code[at].arg0.i_ = target.location;
 			}
+
+			target.fixups.clear();
 		}
 
 		int current_location(symbol_table_node_ptr &p_function_id) {
@@ -128,15 +161,15 @@ namespace cx{
 				p_function_id->defined.routine.program_code.end());
 		}
 
-		symbol_table_node_ptr search_local(const std::wstring name) {
+		symbol_table_node_ptr search_local(atom_id name) {
 			return symtab_stack.search_local(name);
 		}
 
-		symbol_table_node_ptr search_all(const std::wstring name) {
+		symbol_table_node_ptr search_all(atom_id name) {
 			return symtab_stack.search_all(name);
 		}
 
-		symbol_table_node_ptr find(const std::wstring name) {
+		symbol_table_node_ptr find(atom_id name) {
 			symbol_table_node_ptr p_node = search_all(name);
 
 			if (p_node == nullptr){
@@ -146,7 +179,7 @@ namespace cx{
 			return p_node;
 		}
 
-		std::pair<local::iterator, local::iterator> find_functions(const std::wstring name) {
+		local::range find_functions(atom_id name) {
 			return symtab_stack.find_functions(name);
 		}
 
@@ -156,12 +189,12 @@ namespace cx{
 			p_string[length] = '\0';
 		}
 
-		symbol_table_node_ptr enter_local(const wchar_t *p_string,
+		symbol_table_node_ptr enter_local(atom_id name,
 			define_code dc = DC_UNDEFINED) {
-			return symtab_stack.enter_local(p_string, dc);
+			return symtab_stack.enter_local(name, dc);
 		}
 
-		symbol_table_node_ptr enter_new_local(std::wstring name,
+		symbol_table_node_ptr enter_new_local(atom_id name,
 			define_code dc = DC_UNDEFINED) {
 			return symtab_stack.enter_new_local(name, dc);
 		}
@@ -212,9 +245,20 @@ namespace cx{
 		void emit_store_no_load(symbol_table_node_ptr &p_function_id, symbol_table_node_ptr &p_id);
 	public:
 
-		parser(text_in_buffer *p_buffer, bool std_lib_module = false)
-			: p_scanner(new text_scanner(p_buffer)), is_module(std_lib_module) {
+		parser(text_in_buffer *p_buffer, module *p_module_ = nullptr)
+			: p_scanner(new text_scanner(p_buffer)),
+			p_global_scope(p_module_ != nullptr ? new_symtab() : p_global_symbol_table),
+			symtab_stack(p_global_scope), p_module(p_module_), is_module(p_module_ != nullptr) {
+			file_name = p_buffer->file_name();
+			p_buffer->p_scopes = &symtab_stack;
+		}
+
+		// Parser for a lazy function body, in the given global scope.
+		parser(text_in_buffer *p_buffer, const symbol_table_ptr &p_scope)
+			: p_scanner(new text_scanner(p_buffer)), p_global_scope(p_scope),
+			symtab_stack(p_global_scope), p_module(nullptr), is_module(false) {
 			file_name = p_buffer->file_name();
+			p_buffer->p_scopes = &symtab_stack;
 		}
 
 		~parser(void) {
@@ -222,6 +266,17 @@ namespace cx{
 		}
 
 		symbol_table_node_ptr parse(void);
+		void parse_lazy_body(symbol_table_node_ptr &p_function_id);
+
+		// True if the program pulled in any modules.
+		bool uses_modules(void) const {
+			return !linked_modules.empty();
+		}
+
+		// Syntax errors in the source, and in the modules linked into it.
+		int error_count(void) const {
+			return p_scanner->source()->error_count;
+		}
 	};
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,406 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cstring>
+#include <codecvt>
+#include <fstream>
+#include <iostream>
+#include <locale>
+#include <map>
+#include <set>
+#include "charscan.h"
+#include "cxvm.h"
+#include "optimizer.h"
+#include "profile.h"
+#include "ssa.h"
+
+namespace cx {
+	namespace profile_settings {
+		bool record = false;
+		std::wstring output_file;
+		std::wstring input_file;
+	}
+
+	// bump when the layout below changes
+	const uint32_t profile_format_version = 2;
+	const char profile_magic[4] = { 'C', 'X', 'P', '\0' };
+
+	// a call site this hot is inlined ...
+	const uint64_t inline_min_calls = 100;
+	// ... when the callee is this small
+	const size_t inline_max_callee = 64;
+	// and the caller stays this small
+	const size_t inline_max_caller = 2000;
+
+#if defined _WIN32
+	static const std::wstring &file_path(const std::wstring &file_name) { return file_name; }
+#else
+	static std::string file_path(const std::wstring &file_name) {
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		return converter.to_bytes(file_name);
+	}
+#endif
+
+	/** code_checksum   Hash of what a profile's locations depend on:
+	 *                  the opcodes and where the jumps go.
+	 *
+	 * @param code : code counted.
+	 * @return its checksum.
+	 */
+	static uint64_t code_checksum(const program &code) {
+		std::vector<int32_t> shape;
+		shape.reserve(code.size() + 1);
+		shape.push_back(static_cast<int32_t>(code.size()));
+
+		for (auto &instruction : code) {
+			shape.push_back(static_cast<int32_t>(instruction.op));
+			if (optimizer::is_jump(instruction.op)) shape.push_back(optimizer::jump_target(instruction));
+		}
+
+		return hash_bytes(reinterpret_cast<const char *>(shape.data()), shape.size() * sizeof(int32_t));
+	}
+
+	/** reachable_routines  The program and every function it can
+	 *                      call, in the order they are found.
+	 *
+	 * @param p_program_id : ptr to the __main__ program node.
+	 * @return routines.
+	 */
+	static std::vector<symbol_table_node *> reachable_routines(symbol_table_node *p_program_id) {
+		std::vector<symbol_table_node *> routines = { p_program_id };
+		std::set<symbol_table_node *> seen = { p_program_id };
+
+		for (size_t i = 0; i < routines.size(); ++i) {
+			for (auto &instruction : routines[i]->defined.routine.program_code) {
+				if (instruction.op != CALL) continue;
+
+				symbol_table_node *p_callee = (symbol_table_node *)instruction.arg0.a_;
+				if (seen.insert(p_callee).second) routines.push_back(p_callee);
+			}
+		}
+
+		return routines;
+	}
+
+	/** profile_key     What a routine's counts are filed under: its
+	 *                  qualified name, so same-named functions of
+	 *                  different modules, scopes or overloads keep
+	 *                  their own counts.
+	 *
+	 * @param p_routine : routine.
+	 * @return its key.
+	 */
+	static const std::wstring &profile_key(const symbol_table_node *p_routine) {
+		const std::wstring &qualified_name = p_routine->defined.routine.qualified_name;
+		return qualified_name.empty() ? p_routine->node_name : qualified_name;
+	}
+
+	/** counters_of     The counts of a function's running code,
+	 *                  started over when its code was replaced.
+	 *
+	 * @param p_function_id : function.
+	 * @return its profile.
+	 */
+	static code_profile &counters_of(symbol_table_node *p_function_id) {
+		const program &code = p_function_id->defined.routine.program_code;
+		std::shared_ptr<code_profile> &p_profile = p_function_id->defined.routine.p_profile;
+
+		if (p_profile == nullptr) p_profile = std::make_shared<code_profile>();
+
+		if (p_profile->p_code != code.data()) {
+			p_profile->checksum = code_checksum(code);
+			p_profile->entries = 0;
+			p_profile->counters.assign(code.size(), profile_counter());
+			p_profile->p_code = code.data();
+		}
+
+		return *p_profile;
+	}
+
+	namespace profile {
+		/** enter           Count an activation of a function.
+		 *
+		 * @param p_function_id : function entered.
+		 */
+		void enter(symbol_table_node *p_function_id) {
+			++counters_of(p_function_id).entries;
+		}
+
+		/** count           Count one run of an instruction.
+		 *
+		 * @param p_function_id : function running.
+		 * @param location      : index of the instruction.
+		 * @param taken         : an IF_FALSE jumped.
+		 */
+		void count(symbol_table_node *p_function_id, int location, bool taken) {
+			profile_counter &counter = counters_of(p_function_id).counters[location];
+
+			++counter.count;
+			if (taken) ++counter.taken;
+		}
+
+		/** save            Write the counts of this run to -profile-out.
+		 *                  Only instructions that ran are written.
+		 *
+		 * @param p_program_id : ptr to the __main__ program node.
+		 */
+		void save(symbol_table_node *p_program_id) {
+			std::string bytes(profile_magic, sizeof(profile_magic));
+
+			auto put = [&bytes](const void *p_value, size_t size) {
+				bytes.append(reinterpret_cast<const char *>(p_value), size);
+			};
+
+			put(&profile_format_version, sizeof(profile_format_version));
+			const uint8_t char_size = sizeof(wchar_t);
+			put(&char_size, sizeof(char_size));
+
+			std::vector<symbol_table_node *> profiled;
+			for (auto p_routine : reachable_routines(p_program_id)) {
+				const std::shared_ptr<code_profile> &p_profile = p_routine->defined.routine.p_profile;
+				if ((p_profile != nullptr) && (p_profile->p_code == p_routine->defined.routine.program_code.data())) {
+					profiled.push_back(p_routine);
+				}
+			}
+
+			const uint32_t routine_count = static_cast<uint32_t>(profiled.size());
+			put(&routine_count, sizeof(routine_count));
+
+			for (auto p_routine : profiled) {
+				const code_profile &profile = *p_routine->defined.routine.p_profile;
+				const std::wstring &name = profile_key(p_routine);
+
+				const uint32_t name_size = static_cast<uint32_t>(name.size());
+				put(&name_size, sizeof(name_size));
+				put(name.data(), name.size() * sizeof(wchar_t));
+
+				const uint32_t code_size = static_cast<uint32_t>(profile.counters.size());
+				put(&profile.checksum, sizeof(profile.checksum));
+				put(&profile.entries, sizeof(profile.entries));
+				put(&code_size, sizeof(code_size));
+
+				uint32_t counted = 0;
+				for (auto &counter : profile.counters) {
+					if (counter.count > 0) ++counted;
+				}
+				put(&counted, sizeof(counted));
+
+				for (uint32_t location = 0; location < code_size; ++location) {
+					const profile_counter &counter = profile.counters[location];
+					if (counter.count == 0) continue;
+
+					put(&location, sizeof(location));
+					put(&counter.count, sizeof(counter.count));
+					put(&counter.taken, sizeof(counter.taken));
+				}
+			}
+
+			std::ofstream output(file_path(profile_settings::output_file), std::ios::binary | std::ios::trunc);
+			output.write(bytes.data(), bytes.size());
+
+			if (!output.good()) {
+				std::wcerr << L"cx: can't write profile " << profile_settings::output_file << std::endl;
+			}
+		}
+
+		/** load            Read the profiles of -profile-in by qualified
+		 *                  routine name.
+		 *
+		 * @param profiles : set to the profiles read.
+		 * @return false if the file is missing or damaged.
+		 */
+		static bool load(std::map<std::wstring, code_profile> &profiles) {
+			std::ifstream input(file_path(profile_settings::input_file), std::ios::binary);
+			if (!input.good()) return false;
+
+			std::vector<char> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+			const char *p = bytes.data();
+			const char *p_end = p + bytes.size();
+			bool good = true;
+
+			auto get = [&](void *p_value, size_t size) {
+				if (!good || (static_cast<size_t>(p_end - p) < size)) {
+					good = false;
+					memset(p_value, 0, size);
+					return;
+				}
+				memcpy(p_value, p, size);
+				p += size;
+			};
+
+			char magic[sizeof(profile_magic)];
+			uint32_t version = 0;
+			uint8_t char_size = 0;
+			get(magic, sizeof(magic));
+			get(&version, sizeof(version));
+			get(&char_size, sizeof(char_size));
+
+			if (!good || memcmp(magic, profile_magic, sizeof(magic)) ||
+				(version != profile_format_version) || (char_size != sizeof(wchar_t))) return false;
+
+			uint32_t routine_count = 0;
+			get(&routine_count, sizeof(routine_count));
+
+			for (uint32_t r = 0; good && (r < routine_count); ++r) {
+				uint32_t name_size = 0;
+				get(&name_size, sizeof(name_size));
+				if (!good || (static_cast<size_t>(p_end - p) / sizeof(wchar_t) < name_size)) return false;
+
+				std::wstring name(name_size, L'\0');
+				get(&name[0], name_size * sizeof(wchar_t));
+
+				code_profile profile;
+				uint32_t code_size = 0;
+				uint32_t counted = 0;
+				get(&profile.checksum, sizeof(profile.checksum));
+				get(&profile.entries, sizeof(profile.entries));
+				get(&code_size, sizeof(code_size));
+				get(&counted, sizeof(counted));
+				if (!good || (counted > code_size) || (code_size > static_cast<size_t>(p_end - p))) return false;
+
+				profile.counters.resize(code_size);
+				for (uint32_t c = 0; good && (c < counted); ++c) {
+					uint32_t location = 0;
+					get(&location, sizeof(location));
+					if (location >= code_size) return false;
+
+					get(&profile.counters[location].count, sizeof(uint64_t));
+					get(&profile.counters[location].taken, sizeof(uint64_t));
+				}
+
+				profiles[name] = std::move(profile);
+			}
+
+			return good;
+		}
+
+		/** inline_hot_calls    Inline the calls a caller made often.
+		 *                      The caller's counts are spliced along
+		 *                      with its code: the copied body gets
+		 *                      the callee's counts, scaled to the
+		 *                      share of its calls made from the site.
+		 *
+		 * @param p_function_id : caller, with a profile.
+		 * @return number of calls inlined.
+		 */
+		static int inline_hot_calls(symbol_table_node *p_function_id) {
+			program &code = p_function_id->defined.routine.program_code;
+			std::vector<profile_counter> &counters = p_function_id->defined.routine.p_profile->counters;
+			int inlined = 0;
+
+			for (int at = 0; at < static_cast<int>(code.size()); ++at) {
+				if ((code[at].op != CALL) || (counters[at].count < inline_min_calls)) continue;
+				if (code.size() > inline_max_caller) break;
+
+				symbol_table_node *p_callee = (symbol_table_node *)code[at].arg0.a_;
+				const std::shared_ptr<code_profile> &p_callee_profile = p_callee->defined.routine.p_profile;
+				const program &callee_code = p_callee->defined.routine.program_code;
+
+				if ((p_callee_profile == nullptr) || (p_callee_profile->entries == 0)) continue;
+				if (callee_code.size() > inline_max_callee) continue;
+
+				const double share = static_cast<double>(counters[at].count) / p_callee_profile->entries;
+				std::vector<profile_counter> body;
+				for (auto &counter : p_callee_profile->counters) {
+					profile_counter scaled;
+					scaled.count = static_cast<uint64_t>(counter.count * share);
+					scaled.taken = static_cast<uint64_t>(counter.taken * share);
+					body.push_back(scaled);
+				}
+
+				const size_t old_size = code.size();
+				const int stores = optimizer::inline_call(p_function_id, at);
+				if (stores < 0) continue;
+
+				// stores, body, then the result load
+				std::vector<profile_counter> spliced(stores);
+				spliced.insert(spliced.end(), body.begin(), body.end());
+				spliced.resize(code.size() - old_size + 1);
+
+				counters.erase(counters.begin() + at);
+				counters.insert(counters.begin() + at, spliced.begin(), spliced.end());
+
+				++inlined;
+				at += stores + static_cast<int>(body.size());
+			}
+
+			return inlined;
+		}
+
+		/** apply           Tune the program with the -profile-in counts:
+		 *                  inline hot calls, then lay out each function's
+		 *                  blocks in the order they ran.  A routine whose
+		 *                  code changed since the profile was taken is
+		 *                  left as it is.
+		 *
+		 * @param p_program_id : ptr to the __main__ program node.
+		 */
+		void apply(symbol_table_node *p_program_id) {
+			std::map<std::wstring, code_profile> profiles;
+			if (!load(profiles)) {
+				std::wcerr << L"cx: can't read profile " << profile_settings::input_file << std::endl;
+				return;
+			}
+
+			std::vector<symbol_table_node *> routines = reachable_routines(p_program_id);
+			std::vector<symbol_table_node *> matched;
+
+			for (auto p_routine : routines) {
+				const program &code = p_routine->defined.routine.program_code;
+				auto profile = profiles.find(profile_key(p_routine));
+
+				if ((profile == profiles.end()) || (profile->second.counters.size() != code.size()) ||
+					(profile->second.checksum != code_checksum(code))) continue;
+
+				p_routine->defined.routine.p_profile = std::make_shared<code_profile>(profile->second);
+				matched.push_back(p_routine);
+			}
+
+			int inlined = 0;
+			int laid_out = 0;
+
+			for (auto p_routine : matched) inlined += inline_hot_calls(p_routine);
+
+			for (auto p_routine : matched) {
+				if (p_routine->defined.defined_how != DC_FUNCTION) continue;
+
+				ssa::pass_manager passes;
+				passes.add(new ssa::constant_folding);
+				passes.add(new ssa::dead_code_elimination);
+				passes.add(new ssa::block_layout(*p_routine->defined.routine.p_profile));
+				if (passes.run(p_routine)) ++laid_out;
+			}
+
+			// the counts were of the code before this
+			for (auto p_routine : matched) p_routine->defined.routine.p_profile.reset();
+
+			if (vm_settings::dev_debug_flag) {
+				std::wcerr << L"[ profile   ]--> " << matched.size() << L" of " << routines.size()
+					<< L" routines matched, " << inlined << L" calls inlined, "
+					<< laid_out << L" functions rebuilt" << std::endl;
+			}
+		}
+	}
+}
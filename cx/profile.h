@@ -0,0 +1,74 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "symtab.h"
+
+namespace cx {
+	namespace profile_settings {
+		extern bool record;				// -profile-out was given
+		extern std::wstring output_file;	// where the counts of this run go
+		extern std::wstring input_file;	// -profile-in: counts of an earlier run
+	}
+
+	/** profile_counter Counts of one instruction: how often it ran,
+	 *                  and for IF_FALSE how often it jumped.  A CALL
+	 *                  counts its call site, the GOTO closing a loop
+	 *                  its trips.
+	 */
+	struct profile_counter {
+		uint64_t count = 0;
+		uint64_t taken = 0;
+	};
+
+	/** code_profile    Counts of one function's code, by instruction.
+	 *                  The checksum is of the code they were counted
+	 *                  on, a profile only applies to the same code.
+	 */
+	struct code_profile {
+		uint64_t checksum = 0;
+		uint64_t entries = 0;		// activations
+		std::vector<profile_counter> counters;
+		const inst *p_code = nullptr;	// code being counted in this run
+	};
+
+	namespace profile {
+		// Count an activation of a function
+		void enter(symbol_table_node *p_function_id);
+		// Count a branch, call or back edge at location of the running code
+		void count(symbol_table_node *p_function_id, int location, bool taken);
+		// Write the counts of this run to -profile-out
+		void save(symbol_table_node *p_program_id);
+		// Inline hot calls and lay out hot blocks with the -profile-in counts
+		void apply(symbol_table_node *p_program_id);
+	}
+}
+
+#endif
@@ -27,89 +27,45 @@ THE SOFTWARE.
 
 namespace cx{
 
-	char_code_map char_map; // maps a character to its code
-
 	/** Constructor     Construct a scanner by constructing the
-	 *                  text input file buffer and initializing the
-	 *                  character code map.
+	 *                  text input file buffer.  Characters are
+	 *                  classified through ascii_char_codes, which
+	 *                  needs no initialization.
 	 *
 	 * @param p_buffer : ptr to text input buffer to scan.
 	 */
 	text_scanner::text_scanner(text_in_buffer *p_buffer)
 		: p_text_in_buffer(p_buffer) {
-		char i;
-
-		// Initialize the character code map.
-		for (i = L'a'; i <= L'z'; ++i) char_map[i] = CC_LETTER;
-		for (i = L'A'; i <= L'Z'; ++i) char_map[i] = CC_LETTER;
-		for (i = L'0'; i <= L'9'; ++i) char_map[i] = CC_DIGIT;
-
-		char_map[L'_'] = CC_LETTER;
-
-		char_map[L'+'] = char_map[L'-'] = CC_SPECIAL;
-		char_map[L'*'] = char_map[L'/'] = CC_SPECIAL;
-		char_map[L'='] = char_map[L'^'] = CC_SPECIAL;
-		char_map[L'.'] = char_map[L','] = CC_SPECIAL;
-		char_map[L'<'] = char_map[L'>'] = CC_SPECIAL;
-		char_map[L'('] = char_map[L')'] = CC_SPECIAL;
-		char_map[L'['] = char_map[L']'] = CC_SPECIAL;
-		char_map[L'{'] = char_map[L'}'] = CC_SPECIAL;
-		char_map[L':'] = char_map[L';'] = CC_SPECIAL;
-
-		char_map[L'#'] = char_map[L'?'] = CC_SPECIAL;
-		char_map[L'~'] = char_map[L'|'] = CC_SPECIAL;
-		char_map[L'&'] = char_map[L'!'] = CC_SPECIAL;
-		char_map[L'%'] = CC_SPECIAL;
-
-		char_map[L' '] = char_map[L'\t'] = CC_WHITE_SPACE;
-		char_map[L'\n'] = char_map[L'\0'] = CC_WHITE_SPACE;
-		char_map[L'\r'] = char_map[L'\f'] = CC_WHITE_SPACE;
-		char_map[L'\\'] = CC_WHITE_SPACE;
-
-		char_map[L'\''] = CC_QUOTE;
-		char_map[L'\"'] = CC_DOUBLE_QUOTE;
-
-		char_map[buffer::EOF_CHAR] = CC_END_OF_FILE;
-
-		char_map[L'`'] = char_map[L'@'] = CC_ERROR;
 	}
 
-	/** skip_whitespace      Repeatedly fetch characters from the
-	 *                      text input as long as they're
-	 *                      whitespace. Each comment is a whitespace
-	 *                      character.
+	/** skip_whitespace      Skip whitespace and comments in the
+	 *                      text input.  Runs of blanks and comment
+	 *                      bodies are skipped by the buffer a block
+	 *                      of bytes at a time rather than a
+	 *                      character at a time.
 	 *
 	 */
 	void text_scanner::skip_whitespace(void) {
 		wchar_t ch = p_text_in_buffer->current_char();
 
 		do {
-			if (char_map[ch] == CC_WHITE_SPACE) {
-				ch = p_text_in_buffer->get_char();
+			if (char_code_of(ch) == CC_WHITE_SPACE) {
+				ch = p_text_in_buffer->skip_white_space();
 			}
 			else if (ch == L'/') {
 				ch = p_text_in_buffer->get_char();
 				if (ch == L'/') {
-					while (ch != L'\0') ch = p_text_in_buffer->get_char();
+					ch = p_text_in_buffer->skip_to_end_of_line();
 				}
 				else if (ch == L'*') {
-					while (ch != buffer::EOF_CHAR) {
-						ch = p_text_in_buffer->get_char();
-						if (ch == L'*') {
-							ch = p_text_in_buffer->get_char();
-							if (ch == L'/') {
-								ch = p_text_in_buffer->get_char();
-								break;
-							}
-						}
-					}
+					ch = p_text_in_buffer->skip_block_comment();
 				}
 				else {
 					p_text_in_buffer->put_back_char();
 					break;
 				}
 			}
-		} while ((char_map[ch] == CC_WHITE_SPACE) || (ch == L'/'));
+		} while ((char_code_of(ch) == CC_WHITE_SPACE) || (ch == L'/'));
 	}
 
 	/** get         Extract the next__ token from the text input,
@@ -125,7 +81,7 @@ namespace cx{
 		char_code code;
 
 		wchar_t ch = p_text_in_buffer->current_char();
-		code = char_map[ch];
+		code = char_code_of(ch);
 
 		// Determine the token class, based on the current character.
 		switch (code) {
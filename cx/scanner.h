@@ -63,6 +63,10 @@ namespace cx{
 		}
 
 		virtual token *get(void);
+
+		text_in_buffer *source(void) const {
+			return p_text_in_buffer;
+		}
 	};
 }
 #endif
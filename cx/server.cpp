@@ -0,0 +1,620 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#if defined _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <codecvt>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <locale>
+#include <map>
+#include <set>
+#include <streambuf>
+#include "buffer.h"
+#include "cxvm.h"
+#include "error.h"
+#include "module.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "server.h"
+#include "symtab.h"
+#include "verify.h"
+
+namespace cx {
+	namespace server_settings {
+		bool serve = false;
+		bool remote = false;
+		unsigned short port = 7837;
+	}
+
+	using optimizer::arg0_kind;
+	using optimizer::OPERAND_NODE;
+	using optimizer::OPERAND_TYPE;
+
+#if defined _WIN32
+	typedef SOCKET socket_handle;
+
+	static bool start_sockets(void) {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}
+
+	static void close_socket(socket_handle s) { closesocket(s); }
+#else
+	typedef int socket_handle;
+	const socket_handle INVALID_SOCKET = -1;
+
+	static bool start_sockets(void) { return true; }
+	static void close_socket(socket_handle s) { close(s); }
+#endif
+
+	/** compiled_file   What the server keeps of a file between runs.
+	 */
+	struct compiled_file {
+		uint64_t source_hash;
+		symbol_table_ptr p_globals;
+		symbol_table_node_ptr p_program_id;
+		// body hash of every function that was left for its first call
+		std::map<const symbol_table_node *, uint64_t> body_hashes;
+
+		compiled_file() : source_hash(0) {}
+	};
+
+	/** output_capture  Sends what the program and the compiler print
+	 *                  to a string, in the order it is printed, while
+	 *                  the server runs a request.
+	 */
+	class output_capture {
+		class narrow_buffer : public std::streambuf {
+			std::string &output;
+		public:
+			narrow_buffer(std::string &output_) : output(output_) {}
+		protected:
+			int_type overflow(int_type c) {
+				if (!traits_type::eq_int_type(c, traits_type::eof())) output += traits_type::to_char_type(c);
+				return traits_type::not_eof(c);
+			}
+		};
+
+		class wide_buffer : public std::wstreambuf {
+			std::string &output;
+			std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		public:
+			wide_buffer(std::string &output_) : output(output_) {}
+		protected:
+			int_type overflow(int_type c) {
+				if (!traits_type::eq_int_type(c, traits_type::eof())) {
+					output += converter.to_bytes(traits_type::to_char_type(c));
+				}
+				return traits_type::not_eof(c);
+			}
+		};
+
+		narrow_buffer narrow;
+		wide_buffer wide;
+		std::streambuf *p_cout, *p_cerr;
+		std::wstreambuf *p_wcout, *p_wcerr;
+
+	public:
+		output_capture(std::string &output) : narrow(output), wide(output) {
+			p_cout = std::cout.rdbuf(&narrow);
+			p_cerr = std::cerr.rdbuf(&narrow);
+			p_wcout = std::wcout.rdbuf(&wide);
+			p_wcerr = std::wcerr.rdbuf(&wide);
+		}
+
+		~output_capture() {
+			std::cout.rdbuf(p_cout);
+			std::cerr.rdbuf(p_cerr);
+			std::wcout.rdbuf(p_wcout);
+			std::wcerr.rdbuf(p_wcerr);
+		}
+	};
+
+	/** plain_type      True for a builtin type, or an array of them,
+	 *                  which is the same in every compile.  Types the
+	 *                  program declares are made again by each compile.
+	 *
+	 * @param p_type : type to check, may be null.
+	 * @return true if code using the type can be kept.
+	 */
+	static bool plain_type(const cx_type *p_type) {
+		if (p_type == nullptr) return true;
+		if (p_type->typeform == F_ARRAY) return plain_type(p_type->array.p_element_type.get());
+
+		return (p_type == p_boolean_type.get()) || (p_type == p_char_type.get())
+			|| (p_type == p_byte_type.get()) || (p_type == p_integer_type.get())
+			|| (p_type == p_double_type.get()) || (p_type == p_void_type.get());
+	}
+
+	static bool same_type(const cx_type *p_type1, const cx_type *p_type2) {
+		if (p_type1 == p_type2) return true;
+		if ((p_type1 == nullptr) || (p_type2 == nullptr)) return false;
+
+		return (p_type1->typeform == F_ARRAY) && (p_type2->typeform == F_ARRAY)
+			&& (p_type1->array.element_count == p_type2->array.element_count)
+			&& same_type(p_type1->array.p_element_type.get(), p_type2->array.p_element_type.get());
+	}
+
+	/** same_signature  True if two functions take the same parameters,
+	 *                  by name, kind and type, and return the same type.
+	 */
+	static bool same_signature(const symbol_table_node *p_function1, const symbol_table_node *p_function2) {
+		auto &params1 = p_function1->defined.routine.p_parameter_ids;
+		auto &params2 = p_function2->defined.routine.p_parameter_ids;
+
+		if (!same_type(p_function1->p_type.get(), p_function2->p_type.get()) ||
+			(params1.size() != params2.size())) return false;
+
+		for (size_t i = 0; i < params1.size(); ++i) {
+			if ((params1[i]->name != params2[i]->name) ||
+				(params1[i]->defined.defined_how != params2[i]->defined.defined_how) ||
+				!same_type(params1[i]->p_type.get(), params2[i]->p_type.get())) return false;
+		}
+
+		return true;
+	}
+
+	/** same_global     The node of a new compile standing for a global
+	 *                  of the previous one.
+	 *
+	 * @param p_node    : global of the previous compile.
+	 * @param p_symtab  : global table of the new compile.
+	 * @return the new node, nullptr if it is gone or changed.
+	 */
+	static symbol_table_node *same_global(const symbol_table_node *p_node, symbol_table *p_symtab) {
+		if (p_node->defined.defined_how == DC_FUNCTION) {
+			local::range functions = p_symtab->find_functions(p_node->name);
+
+			for (auto function = functions.first; function != functions.second; ++function) {
+				symbol_table_node *p_function = function->second.get();
+
+				if ((p_function->defined.defined_how == DC_FUNCTION) &&
+					(p_function->defined.routine.function_type == p_node->defined.routine.function_type) &&
+					same_signature(p_node, p_function)) return p_function;
+			}
+
+			return nullptr;
+		}
+
+		symbol_table_node_ptr p_same = p_symtab->search(p_node->name);
+
+		if ((p_same == nullptr) || (p_node->defined.defined_how == DC_PROGRAM) ||
+			(p_same->defined.defined_how != p_node->defined.defined_how) ||
+			!same_type(p_same->p_type.get(), p_node->p_type.get())) return nullptr;
+
+		return p_same.get();
+	}
+
+	/** remap_code      Point a function's code kept from the previous
+	 *                  compile at the globals of the new one.  Its own
+	 *                  parameters and locals come along with it.
+	 *
+	 * @param code        : copy of the function's code.
+	 * @param old_globals : globals of the previous compile.
+	 * @param p_symtab    : global table of the new compile.
+	 * @return false if the code uses something that changed.
+	 */
+	static bool remap_code(program &code, const std::set<const symbol_table_node *> &old_globals,
+		symbol_table *p_symtab) {
+
+		for (auto &instruction : code) {
+			switch (arg0_kind(instruction.op)) {
+			case OPERAND_NODE: {
+				symbol_table_node *p_node = static_cast<symbol_table_node *>(instruction.arg0.a_);
+				if (p_node == nullptr) break;
+
+				if (old_globals.count(p_node) > 0) {
+					symbol_table_node *p_same = same_global(p_node, p_symtab);
+					if (p_same == nullptr) return false;
+
+					instruction.arg0.a_ = p_same;
+				}
+				else if ((p_node->defined.defined_how != DC_FUNCTION) && !plain_type(p_node->p_type.get())) {
+					return false;
+				}
+			} break;
+			case OPERAND_TYPE:
+				if (!plain_type(static_cast<const cx_type *>(instruction.arg0.a_))) return false;
+				break;
+			default:
+				break;
+			}
+		}
+
+		return true;
+	}
+
+	/** same_constant   True if two constants hold the same value.
+	 */
+	static bool same_constant(const symbol_table_node *p_constant1, const symbol_table_node *p_constant2) {
+		const value &value1 = p_constant1->defined.constant_value;
+		const value &value2 = p_constant2->defined.constant_value;
+
+		switch (p_constant1->p_type->typecode) {
+		case T_BOOLEAN:	return value1.z_ == value2.z_;
+		case T_BYTE:	return value1.b_ == value2.b_;
+		case T_INT:		return value1.i_ == value2.i_;
+		case T_CHAR:	return value1.c_ == value2.c_;
+		case T_DOUBLE:	return value1.d_ == value2.d_;
+		default:		return false;
+		}
+	}
+
+	/** remap_dependencies  Find the constants and inlined callees a
+	 *                      function's code was built from in the new
+	 *                      compile.  Constants of the function's own
+	 *                      scope come with its unchanged body.
+	 *
+	 * @param p_old       : function of the previous compile.
+	 * @param previous    : the previous compile.
+	 * @param file        : the new compile.
+	 * @param old_globals : globals of the previous compile.
+	 * @param ids         : the dependencies in the new compile.
+	 * @return false if one changed or can't be told.
+	 */
+	static bool remap_dependencies(const symbol_table_node *p_old, const compiled_file &previous,
+		const compiled_file &file, const std::set<const symbol_table_node *> &old_globals,
+		std::vector<const symbol_table_node *> &ids) {
+
+		const symbol_table_ptr &p_scope = p_old->defined.routine.p_symtab;
+
+		for (auto p_node : p_old->defined.routine.p_dependency_ids) {
+			if (p_node->defined.defined_how == DC_CONSTANT) {
+				if ((p_scope != nullptr) && (p_scope->search(p_node->name).get() == p_node)) {
+					ids.push_back(p_node);
+					continue;
+				}
+
+				if (old_globals.count(p_node) == 0) return false;
+
+				const symbol_table_node *p_same = same_global(p_node, file.p_globals.get());
+				if ((p_same == nullptr) || !same_constant(p_node, p_same)) return false;
+
+				ids.push_back(p_same);
+			}
+			else {
+				// an inlined callee, its code must be the same too
+				if (old_globals.count(p_node) == 0) return false;
+
+				const symbol_table_node *p_same = same_global(p_node, file.p_globals.get());
+				if (p_same == nullptr) return false;
+
+				auto old_body = previous.body_hashes.find(p_node);
+				auto new_body = file.body_hashes.find(p_same);
+				if ((old_body == previous.body_hashes.end()) || (new_body == file.body_hashes.end()) ||
+					(old_body->second != new_body->second)) return false;
+
+				ids.push_back(p_same);
+			}
+		}
+
+		return true;
+	}
+
+	/** adopt_unchanged_functions   Give the functions of a new compile
+	 *                              that are still waiting for their
+	 *                              first call the code compiled for
+	 *                              them by the previous compile, when
+	 *                              neither their body, their signature
+	 *                              nor the constants and callees built
+	 *                              into the code changed.
+	 *
+	 * @param previous : the previous compile of the file.
+	 * @param file     : the new compile.
+	 */
+	static void adopt_unchanged_functions(const compiled_file &previous, compiled_file &file) {
+		std::set<const symbol_table_node *> old_globals;
+		for (auto &entry : previous.p_globals->symbols) old_globals.insert(entry.second.get());
+
+		for (auto &body : previous.body_hashes) {
+			const symbol_table_node *p_old = body.first;
+			if (p_old->defined.routine.p_lazy_body != nullptr) continue;	// never called
+
+			symbol_table_node *p_new = same_global(p_old, file.p_globals.get());
+			if ((p_new == nullptr) || (p_new == p_old) ||
+				(p_new->defined.routine.p_lazy_body == nullptr)) continue;
+
+			auto new_body = file.body_hashes.find(p_new);
+			if ((new_body == file.body_hashes.end()) || (new_body->second != body.second)) continue;
+
+			bool plain_locals = true;
+			for (auto &p_id : p_old->defined.routine.p_parameter_ids) plain_locals &= plain_type(p_id->p_type.get());
+			for (auto &p_id : p_old->defined.routine.p_variable_ids) plain_locals &= plain_type(p_id->p_type.get());
+			if (!plain_locals) continue;
+
+			program code = p_old->defined.routine.program_code;
+			if (!remap_code(code, old_globals, file.p_globals.get())) continue;
+
+			std::vector<const symbol_table_node *> dependency_ids;
+			if (!remap_dependencies(p_old, previous, file, old_globals, dependency_ids)) continue;
+
+			auto &routine = p_new->defined.routine;
+			routine.p_parameter_ids = p_old->defined.routine.p_parameter_ids;
+			routine.p_variable_ids = p_old->defined.routine.p_variable_ids;
+			routine.p_type_ids = p_old->defined.routine.p_type_ids;
+			routine.p_function_ids = p_old->defined.routine.p_function_ids;
+			routine.p_constant_ids = p_old->defined.routine.p_constant_ids;
+			routine.p_dependency_ids.swap(dependency_ids);
+			routine.p_symtab = p_old->defined.routine.p_symtab;
+			routine.program_code.swap(code);
+			routine.p_lazy_body = nullptr;
+		}
+	}
+
+	/** compile_file    Bring the server's compile of a file up to date.
+	 *
+	 * @param file_name : full path of the file.
+	 * @param file      : the server's compile of it, replaced if stale.
+	 */
+	static void compile_file(const std::wstring &file_name, compiled_file &file) {
+		uint64_t source_hash = 0;
+		if (!hash_file(file_name, source_hash)) abort_translation(ABORT_SOURCE_FILE_OPEN_FAILED);
+
+		const bool modules_changed = forget_changed_modules();
+		if ((file.p_program_id != nullptr) && (file.source_hash == source_hash) && !modules_changed) return;
+
+		compiled_file previous;
+		std::swap(previous, file);
+
+		p_global_symbol_table = new_symtab();
+
+		symbol_table_node_ptr p_program_id;
+		{
+			parser program_parser(new source_buffer(file_name));
+			p_program_id = program_parser.parse();
+			if (program_parser.error_count() > 0) throw translation_stopped{ ABORT_TOO_MANY_SYNTAX_ERRORS };
+		}
+
+		for (auto &entry : p_global_symbol_table->symbols) {
+			auto &p_lazy_body = entry.second->defined.routine.p_lazy_body;
+			if (p_lazy_body != nullptr) file.body_hashes[entry.second.get()] = p_lazy_body->body_hash;
+		}
+
+		file.source_hash = source_hash;
+		file.p_globals = p_global_symbol_table;
+		file.p_program_id = p_program_id;
+
+		if (previous.p_program_id != nullptr) adopt_unchanged_functions(previous, file);
+	}
+
+	/** run_file        Compile a file as needed and run it, as main
+	 *                  would.
+	 *
+	 * @param file_name : full path of the file.
+	 * @param files     : the server's compiled files.
+	 * @return the program's exit status.
+	 */
+	static int run_file(const std::wstring &file_name, std::map<std::wstring, compiled_file> &files) {
+		compiled_file &file = files[file_name];
+
+		try {
+			compile_file(file_name, file);
+			p_global_symbol_table = file.p_globals;
+
+			symbol_table_node_ptr &p_program_id = file.p_program_id;
+			// as in main, verified code runs without the VM's guards
+			std::string reason;
+			verifier::verify_program(p_program_id.get(), reason);
+
+			std::shared_ptr<cxvm> cx = std::make_shared<cxvm>();
+
+			p_program_id->runstack_item = cx->push();
+			cx->enter_function(p_program_id.get());
+			cx->go();
+
+			std::wcout << p_program_id->node_name << " returned " << p_program_id->runstack_item->i_ << std::endl;
+
+			return static_cast<int>(p_program_id->runstack_item->i_);
+		}
+		catch (translation_stopped stop) {
+			// a body may be half compiled, start over next time
+			files.erase(file_name);
+			return stop.exit_code;
+		}
+		catch (std::exception ex) {
+			// bounds and VM guard failures end the run, as they end main
+			std::cerr << "\nFatal: " << ex.what() << std::endl;
+			files.erase(file_name);
+			return ABORT_RUNTIME_ERROR;
+		}
+	}
+
+	static bool send_all(socket_handle s, const std::string &text) {
+		for (size_t sent = 0; sent < text.size();) {
+			int count = send(s, text.data() + sent, static_cast<int>(text.size() - sent), 0);
+			if (count <= 0) return false;
+			sent += count;
+		}
+
+		return true;
+	}
+
+	static bool receive_line(socket_handle s, std::string &line) {
+		line.clear();
+
+		for (char c; recv(s, &c, 1, 0) == 1;) {
+			if (c == '\n') return true;
+			line += c;
+		}
+
+		return false;
+	}
+
+	/** server_address   The server's socket, "server<port>" in a
+	 *                  directory only its user can open: the server
+	 *                  runs any file it is sent, and compile errors
+	 *                  quote the source, so no one else may connect.
+	 *                  On Windows the directory is under the user's
+	 *                  local application data and inherits its ACL.
+	 *
+	 * @param address : set to the socket's path.
+	 * @return false if there is no private directory for it.
+	 */
+	static bool server_address(sockaddr_un &address) {
+		std::string path;
+
+#if defined _WIN32
+		const wchar_t *p_base = _wgetenv(L"LOCALAPPDATA");
+		if (p_base == nullptr) return false;
+
+		std::wstring directory = std::wstring(p_base) + L"\\cx";
+		if (!CreateDirectoryW(directory.c_str(), nullptr) && (GetLastError() != ERROR_ALREADY_EXISTS)) return false;
+
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		path = converter.to_bytes(directory) + "\\server" + std::to_string(server_settings::port);
+#else
+		const char *p_base = getenv("XDG_RUNTIME_DIR");
+		std::string directory = std::string((p_base != nullptr) ? p_base : "/tmp") + "/cx-" + std::to_string(getuid());
+		mkdir(directory.c_str(), 0700);
+
+		// made by someone else, or opened up since: don't use it
+		struct stat status;
+		if ((lstat(directory.c_str(), &status) != 0) || !S_ISDIR(status.st_mode) ||
+			(status.st_uid != getuid()) || ((status.st_mode & 077) != 0)) return false;
+
+		path = directory + "/server" + std::to_string(server_settings::port);
+#endif
+
+		if (path.size() >= sizeof(address.sun_path)) return false;
+
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+		return true;
+	}
+
+	static bool connect_to(socket_handle s, const sockaddr_un &address) {
+		return connect(s, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+	}
+
+	int serve(void) {
+		sockaddr_un address;
+		if (!start_sockets() || !server_address(address)) {
+			std::cerr << "cx: no private directory for the compile server's socket" << std::endl;
+			return ABORT_INVALID_COMMANDLINE_ARGS;
+		}
+
+		// a socket no server answers on is left from one that was killed
+		socket_handle probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (probe != INVALID_SOCKET) {
+			const bool running = connect_to(probe, address);
+			close_socket(probe);
+
+			if (running) {
+				std::cerr << "cx: a compile server is already on " << address.sun_path << std::endl;
+				return ABORT_INVALID_COMMANDLINE_ARGS;
+			}
+		}
+		remove(address.sun_path);
+
+		socket_handle listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if ((listener == INVALID_SOCKET) ||
+			(bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) ||
+			(listen(listener, SOMAXCONN) != 0)) {
+			std::cerr << "cx: could not listen on " << address.sun_path << std::endl;
+			return ABORT_INVALID_COMMANDLINE_ARGS;
+		}
+
+		// a bad file ends its request, not the server
+		error::throw_on_abort = true;
+		parse_settings::lazy_functions = true;
+
+		std::cout << "cx: compile server on " << address.sun_path << std::endl;
+
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		std::map<std::wstring, compiled_file> files;
+
+		for (;;) {
+			socket_handle client = accept(listener, nullptr, nullptr);
+			if (client == INVALID_SOCKET) continue;
+
+			std::string request;
+
+			if (receive_line(client, request) && (request.compare(0, 4, "RUN ") == 0)) {
+				std::string output;
+				int exit_code = 0;
+
+				{
+					output_capture capture(output);
+					exit_code = run_file(converter.from_bytes(request.substr(4)), files);
+				}
+
+				send_all(client, std::to_string(exit_code) + "\n" + output);
+			}
+
+			close_socket(client);
+		}
+	}
+
+	int run_on_server(const std::wstring &source_file_name) {
+		std::wstring full_path = existing_full_path(source_file_name);
+
+		if (full_path.empty()) {
+			std::wcerr << source_file_name << L": file not found" << std::endl;
+			return ABORT_SOURCE_FILE_OPEN_FAILED;
+		}
+
+		sockaddr_un address;
+		socket_handle server = (start_sockets() && server_address(address)) ? socket(AF_UNIX, SOCK_STREAM, 0) : INVALID_SOCKET;
+
+		if ((server == INVALID_SOCKET) || !connect_to(server, address)) {
+			if (server != INVALID_SOCKET) close_socket(server);
+			std::cerr << "cx: no compile server " << server_settings::port << " running" << std::endl;
+			return ABORT_INVALID_COMMANDLINE_ARGS;
+		}
+
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		std::string status;
+
+		if (!send_all(server, "RUN " + converter.to_bytes(full_path) + "\n") ||
+			!receive_line(server, status)) {
+			close_socket(server);
+			std::cerr << "cx: the compile server did not answer" << std::endl;
+			return ABORT_INVALID_COMMANDLINE_ARGS;
+		}
+
+		char buffer[4096];
+		for (int count; (count = recv(server, buffer, sizeof(buffer), 0)) > 0;) {
+			std::cout.write(buffer, count);
+		}
+
+		close_socket(server);
+
+		return atoi(status.c_str());
+	}
+}
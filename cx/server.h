@@ -0,0 +1,62 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+
+namespace cx {
+	namespace server_settings {
+		extern bool serve;			// -serve: run as the compile server
+		extern bool remote;			// -remote: have the server run the file
+		extern unsigned short port;	// -port<n>: which of the user's servers, names its socket
+	}
+
+	/** serve           Run the compile server on a local socket only
+	 *                  its user can connect to, until the process is
+	 *                  killed.
+	 *
+	 *                  The server keeps the compiled form of every
+	 *                  file it was asked to run.  A file that did not
+	 *                  change, nor any module it includes, is run
+	 *                  again without being compiled.  An edited file
+	 *                  is parsed again with lazy bodies, and functions
+	 *                  whose body and signature did not change keep
+	 *                  the code compiled for them last time.
+	 *
+	 * @return exit status.
+	 */
+	int serve(void);
+
+	/** run_on_server   Have the compile server run a file, and
+	 *                  print what the program printed.
+	 *
+	 * @param source_file_name : file to run.
+	 * @return the program's exit status.
+	 */
+	int run_on_server(const std::wstring &source_file_name);
+}
+
+#endif
@@ -0,0 +1,582 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "cxvm.h"
+#include "optimizer.h"
+#include "simd.h"
+
+#if defined _M_X64 || defined _M_IX86 || defined __x86_64__ || defined __i386__
+#define CX_SIMD_X86
+#if defined _MSC_VER
+#include <intrin.h>
+#define _TARGET_SSE2
+#define _TARGET_AVX2
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define _TARGET_SSE2 __attribute__((target("sse2")))
+#define _TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+// the double kernels run cx_real arrays when it is a double, or a
+// long double no wider than one, as MSVC's is
+#if defined __CX_REAL_DOUBLE__ || defined _MSC_VER
+#define CX_SIMD_REAL
+#endif
+#endif
+
+namespace cx {
+	namespace simd_settings {
+		bool vectorize = true;
+	}
+
+	// elements a kernel instruction works on at a time
+	const cx_int kernel_width = 256;
+
+	enum kernel_opcode {
+		VK_LOAD,		// elements of an array
+		VK_INDEX,		// the loop index itself
+		VK_CONST,
+		VK_SCALAR,		// a variable the loop doesn't change
+		VK_ADD,
+		VK_SUB,
+		VK_MUL,
+		VK_DIV
+	};
+
+	enum element_type {
+		E_INT, E_REAL, E_BYTE
+	};
+
+	struct kernel_op {
+		kernel_opcode op;
+		element_type type;				// of the array or the variable
+		const symbol_table_node *p_node;
+		value constant;
+	};
+
+	/** kernel_statement    One array store of the loop body.  Its ops
+	 *                      are the stored expression in postfix, run
+	 *                      on buffers of the stored element type.
+	 */
+	struct kernel_statement {
+		const symbol_table_node *p_array;
+		element_type type;
+		std::vector<kernel_op> ops;
+		int depth;						// buffers the ops need
+	};
+
+	/** vector_kernel   A counted loop whose body only stores to
+	 *                  arrays at its index, as emitted by parse_FOR:
+	 *
+	 *          header:  iload i
+	 *                   iconst <n> | iload n
+	 *                   ilt | ilt_eq
+	 *                   if_false <exit>
+	 *                   iinc i 1
+	 *                   <stores of a[i] = expression>
+	 *                   goto header
+	 *
+	 *                  Every element is only touched by the iteration
+	 *                  of its index, so the statements can run a
+	 *                  block of elements at a time in any grouping.
+	 */
+	struct vector_kernel {
+		const symbol_table_node *p_index;
+		const symbol_table_node *p_limit;	// nullptr for a constant limit
+		cx_int limit;
+		bool inclusive;						// ilt_eq
+		cx_int exit;						// location the header leaves to
+		std::vector<const symbol_table_node *> checked;	// arrays accessed with a bounds check
+		std::vector<kernel_statement> statements;
+	};
+
+	/******************
+	 *                *
+	 *    Compiler    *
+	 *                *
+	 ******************/
+
+	// Operand stack entry while a loop body is compiled.
+	struct kernel_entry {
+		enum { INDEX, ARRAY, VALUE } kind;
+		element_type type;			// E_INT or E_REAL for a VALUE
+		bool low_byte;				// only its low byte is defined (BALOAD)
+		const symbol_table_node *p_node;
+		std::vector<kernel_op> ops;
+	};
+
+	static const symbol_table_node *node_of(const inst &instruction) {
+		return static_cast<const symbol_table_node *>(instruction.arg0.a_);
+	}
+
+	/** compile_loop    Compile the loop with its header at header.
+	 *
+	 * @param code   : function code.
+	 * @param header : index of the loop header.
+	 * @param kernel : filled in on success.
+	 * @return true if the loop has the shape of a vector_kernel.
+	 */
+	static bool compile_loop(const program &code, int header, vector_kernel &kernel) {
+		const int size = static_cast<int>(code.size());
+		if ((header < 0) || (header + 5 >= size)) return false;
+
+		const inst *p_header = &code[header];
+		if ((p_header[0].op != ILOAD) ||
+			((p_header[2].op != ILT) && (p_header[2].op != ILT_EQ)) ||
+			(p_header[3].op != IF_FALSE) ||
+			(p_header[4].op != IINC) || (p_header[4].arg0.a_ != p_header[0].arg0.a_) || (p_header[4].arg1.i_ != 1)) return false;
+
+		kernel.p_index = node_of(p_header[0]);
+		kernel.p_limit = nullptr;
+		kernel.limit = 0;
+		kernel.inclusive = (p_header[2].op == ILT_EQ);
+		kernel.exit = p_header[3].arg0.i_;
+
+		if (p_header[1].op == ICONST) kernel.limit = p_header[1].arg0.i_;
+		else if ((p_header[1].op == ILOAD) && (node_of(p_header[1]) != kernel.p_index)) kernel.p_limit = node_of(p_header[1]);
+		else return false;
+
+		std::vector<kernel_entry> stack;
+
+		auto pop = [&stack](kernel_entry &entry) {
+			if (stack.empty()) return false;
+			entry = std::move(stack.back());
+			stack.pop_back();
+			return true;
+		};
+
+		// i used as a number rather than an index
+		auto pop_value = [&pop](kernel_entry &entry) {
+			if (!pop(entry) || (entry.kind == kernel_entry::ARRAY)) return false;
+
+			if (entry.kind == kernel_entry::INDEX) {
+				entry.kind = kernel_entry::VALUE;
+				entry.type = E_INT;
+				entry.ops = { { VK_INDEX, E_INT, nullptr, value() } };
+			}
+			return true;
+		};
+
+		auto leaf = [&stack](kernel_opcode op, element_type type, const symbol_table_node *p_node, const value &constant) {
+			stack.push_back({ kernel_entry::VALUE, (type == E_REAL) ? E_REAL : E_INT, type == E_BYTE, p_node,
+				{ { op, type, p_node, constant } } });
+		};
+
+		int pc = header + 5;
+		for (; (pc < size) && (code[pc].op != GOTO); ++pc) {
+			const inst &instruction = code[pc];
+
+			switch (instruction.op) {
+			case ILOAD:
+				if (node_of(instruction) == kernel.p_index) {
+					stack.push_back({ kernel_entry::INDEX, E_INT, false, kernel.p_index, {} });
+				}
+				else leaf(VK_SCALAR, E_INT, node_of(instruction), value());
+				continue;
+			case DLOAD: leaf(VK_SCALAR, E_REAL, node_of(instruction), value()); continue;
+			case ICONST: leaf(VK_CONST, E_INT, nullptr, instruction.arg0); continue;
+			case DCONST: leaf(VK_CONST, E_REAL, nullptr, instruction.arg0); continue;
+			case ALOAD:
+				stack.push_back({ kernel_entry::ARRAY, E_INT, false, node_of(instruction), {} });
+				continue;
+			case BALOAD: case BALOAD_U:
+			case DALOAD: case DALOAD_U:
+			case IALOAD: case IALOAD_U: {
+				kernel_entry index, array;
+				if (!pop(index) || !pop(array) || (index.kind != kernel_entry::INDEX) ||
+					(array.kind != kernel_entry::ARRAY) || (array.p_node != node_of(instruction))) return false;
+
+				if ((instruction.op == BALOAD) || (instruction.op == DALOAD) || (instruction.op == IALOAD)) {
+					kernel.checked.push_back(array.p_node);
+				}
+
+				const element_type type = ((instruction.op == BALOAD) || (instruction.op == BALOAD_U)) ? E_BYTE :
+					((instruction.op == DALOAD) || (instruction.op == DALOAD_U)) ? E_REAL : E_INT;
+				leaf(VK_LOAD, type, array.p_node, value());
+			} continue;
+			case IADD: case ISUB: case IMUL:
+			case DADD: case DSUB: case DMUL: case DDIV: {
+				const bool real = (instruction.op == DADD) || (instruction.op == DSUB) ||
+					(instruction.op == DMUL) || (instruction.op == DDIV);
+
+				kernel_entry b, a;
+				if (!pop_value(b) || !pop_value(a)) return false;
+				if ((a.type != (real ? E_REAL : E_INT)) || (b.type != a.type)) return false;
+
+				kernel_opcode op = VK_DIV;
+				switch (instruction.op) {
+				case IADD: case DADD: op = VK_ADD; break;
+				case ISUB: case DSUB: op = VK_SUB; break;
+				case IMUL: case DMUL: op = VK_MUL; break;
+				default: break;
+				}
+
+				a.ops.insert(a.ops.end(), b.ops.begin(), b.ops.end());
+				a.ops.push_back({ op, a.type, nullptr, value() });
+				a.low_byte = a.low_byte || b.low_byte;
+				stack.push_back(std::move(a));
+			} continue;
+			case BASTORE: case BASTORE_U:
+			case DASTORE: case DASTORE_U:
+			case IASTORE: case IASTORE_U: {
+				kernel_entry stored, index;
+				if (!pop_value(stored) || !pop(index) || (index.kind != kernel_entry::INDEX) || !stack.empty()) return false;
+
+				kernel_statement statement;
+				statement.p_array = node_of(instruction);
+
+				switch (instruction.op) {
+				case BASTORE: case BASTORE_U:
+					// add, sub and mul keep the low byte of their operands' low bytes
+					if (stored.type != E_INT) return false;
+					statement.type = E_BYTE;
+					break;
+				case DASTORE: case DASTORE_U:
+					if (stored.type != E_REAL) return false;
+					statement.type = E_REAL;
+					break;
+				default:
+					if ((stored.type != E_INT) || stored.low_byte) return false;
+					statement.type = E_INT;
+					break;
+				}
+
+				if ((instruction.op == BASTORE) || (instruction.op == DASTORE) || (instruction.op == IASTORE)) {
+					kernel.checked.push_back(statement.p_array);
+				}
+
+				int depth = 0;
+				statement.depth = 0;
+				for (auto &op : stored.ops) {
+					depth += (op.op <= VK_SCALAR) ? 1 : -1;
+					statement.depth = std::max(statement.depth, depth);
+				}
+
+				statement.ops = std::move(stored.ops);
+				kernel.statements.push_back(std::move(statement));
+			} continue;
+			default:
+				return false;
+			}
+		}
+
+		if ((pc >= size) || (optimizer::jump_target(code[pc]) != header) || !stack.empty()) return false;
+		if (optimizer::jump_target(p_header[3]) <= pc) return false;
+
+		return !kernel.statements.empty();
+	}
+
+	/******************
+	 *                *
+	 *   Operations   *
+	 *                *
+	 ******************/
+
+	// a[k] = a[k] op b[k], one by one
+	template <typename T> static void add(T *a, const T *b, size_t n) { for (size_t k = 0; k < n; ++k) a[k] = static_cast<T>(a[k] + b[k]); }
+	template <typename T> static void subtract(T *a, const T *b, size_t n) { for (size_t k = 0; k < n; ++k) a[k] = static_cast<T>(a[k] - b[k]); }
+	template <typename T> static void multiply(T *a, const T *b, size_t n) { for (size_t k = 0; k < n; ++k) a[k] = static_cast<T>(a[k] * b[k]); }
+	template <typename T> static void divide(T *a, const T *b, size_t n) { for (size_t k = 0; k < n; ++k) a[k] = static_cast<T>(a[k] / b[k]); }
+
+#if defined CX_SIMD_X86
+	enum isa_level {
+		ISA_SCALAR, ISA_SSE2, ISA_AVX2
+	};
+
+	static void cpu_id(int info[4], int leaf, int subleaf) {
+#if defined _MSC_VER
+		__cpuidex(info, leaf, subleaf);
+#else
+		__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+	}
+
+	// state the OS saves on a context switch
+	static uint64_t extended_control(void) {
+#if defined _MSC_VER
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+	}
+
+	/** detect_isa      Best instruction set of this CPU: AVX2 needs
+	 *                  the OS to save the YMM registers too.
+	 *
+	 * @return level.
+	 */
+	static isa_level detect_isa(void) {
+		int info[4] = { 0, 0, 0, 0 };
+
+		cpu_id(info, 0, 0);
+		const int max_leaf = info[0];
+
+		cpu_id(info, 1, 0);
+		if (!(info[3] & (1 << 26))) return ISA_SCALAR;
+
+		const bool os_saves_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+			((extended_control() & 6) == 6);
+
+		if (os_saves_avx && (max_leaf >= 7)) {
+			cpu_id(info, 7, 0);
+			if (info[1] & (1 << 5)) return ISA_AVX2;
+		}
+
+		return ISA_SSE2;
+	}
+
+	static const isa_level isa = detect_isa();
+
+#define _LOAD_128(p) _mm_loadu_si128((const __m128i *)(p))
+#define _STORE_128(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define _LOAD_256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define _STORE_256(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+
+	// a[k] = a[k] op b[k], lanes at a time, then one by one
+#define _SIMD_OP(name, target, type, lanes, load, store, vector_op, op) \
+	target static void name(type *a, const type *b, size_t n) { \
+		size_t k = 0; \
+		for (; k + lanes <= n; k += lanes) store(a + k, vector_op(load(a + k), load(b + k))); \
+		for (; k < n; ++k) a[k] = static_cast<type>(a[k] op b[k]); \
+	}
+
+	_SIMD_OP(add_sse2, _TARGET_SSE2, cx_int, 2, _LOAD_128, _STORE_128, _mm_add_epi64, +)
+	_SIMD_OP(subtract_sse2, _TARGET_SSE2, cx_int, 2, _LOAD_128, _STORE_128, _mm_sub_epi64, -)
+	_SIMD_OP(add_sse2, _TARGET_SSE2, cx_byte, 16, _LOAD_128, _STORE_128, _mm_add_epi8, +)
+	_SIMD_OP(subtract_sse2, _TARGET_SSE2, cx_byte, 16, _LOAD_128, _STORE_128, _mm_sub_epi8, -)
+#if defined CX_SIMD_REAL
+	_SIMD_OP(add_sse2, _TARGET_SSE2, double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, +)
+	_SIMD_OP(subtract_sse2, _TARGET_SSE2, double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, -)
+	_SIMD_OP(multiply_sse2, _TARGET_SSE2, double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_mul_pd, *)
+	_SIMD_OP(divide_sse2, _TARGET_SSE2, double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_div_pd, /)
+#endif
+
+	_SIMD_OP(add_avx2, _TARGET_AVX2, cx_int, 4, _LOAD_256, _STORE_256, _mm256_add_epi64, +)
+	_SIMD_OP(subtract_avx2, _TARGET_AVX2, cx_int, 4, _LOAD_256, _STORE_256, _mm256_sub_epi64, -)
+	_SIMD_OP(add_avx2, _TARGET_AVX2, cx_byte, 32, _LOAD_256, _STORE_256, _mm256_add_epi8, +)
+	_SIMD_OP(subtract_avx2, _TARGET_AVX2, cx_byte, 32, _LOAD_256, _STORE_256, _mm256_sub_epi8, -)
+#if defined CX_SIMD_REAL
+	_SIMD_OP(add_avx2, _TARGET_AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, +)
+	_SIMD_OP(subtract_avx2, _TARGET_AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_sub_pd, -)
+	_SIMD_OP(multiply_avx2, _TARGET_AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_mul_pd, *)
+	_SIMD_OP(divide_avx2, _TARGET_AVX2, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_div_pd, /)
+#endif
+
+	// pick the widest the CPU has; these beat the templates above
+#define _DISPATCH(name, type) \
+	static void name(type *a, const type *b, size_t n) { \
+		if (isa == ISA_AVX2) name##_avx2(a, b, n); \
+		else if (isa == ISA_SSE2) name##_sse2(a, b, n); \
+		else name<type>(a, b, n); \
+	}
+
+	_DISPATCH(add, cx_int)
+	_DISPATCH(subtract, cx_int)
+	_DISPATCH(add, cx_byte)
+	_DISPATCH(subtract, cx_byte)
+
+#if defined CX_SIMD_REAL
+	static_assert(sizeof(cx_real) == sizeof(double), "the double kernels need cx_real to be a double");
+
+	// kernels take cx_real arrays, which may be long double
+#define _DISPATCH_REAL(name) \
+	static void name(cx_real *a, const cx_real *b, size_t n) { \
+		if (isa == ISA_AVX2) name##_avx2(reinterpret_cast<double *>(a), reinterpret_cast<const double *>(b), n); \
+		else if (isa == ISA_SSE2) name##_sse2(reinterpret_cast<double *>(a), reinterpret_cast<const double *>(b), n); \
+		else name<cx_real>(a, b, n); \
+	}
+
+	_DISPATCH_REAL(add)
+	_DISPATCH_REAL(subtract)
+	_DISPATCH_REAL(multiply)
+	_DISPATCH_REAL(divide)
+#endif
+#endif
+
+	/** fill_leaf       Set a buffer to elements first... of a leaf.
+	 *
+	 * @param p_buffer : buffer.
+	 * @param op       : leaf op.
+	 * @param first    : index of the first element.
+	 * @param count    : number of elements.
+	 */
+	template <typename T>
+	static void fill_leaf(T *p_buffer, const kernel_op &op, cx_int first, cx_int count) {
+		switch (op.op) {
+		case VK_LOAD: {
+			const void *p_elements = op.p_node->runstack_item->a_;
+
+			switch (op.type) {
+			case E_INT: std::copy_n(static_cast<const cx_int *>(p_elements) + first, count, p_buffer); break;
+			case E_REAL: std::copy_n(static_cast<const cx_real *>(p_elements) + first, count, p_buffer); break;
+			case E_BYTE: std::copy_n(static_cast<const cx_byte *>(p_elements) + first, count, p_buffer); break;
+			}
+		} break;
+		case VK_INDEX:
+			for (cx_int k = 0; k < count; ++k) p_buffer[k] = static_cast<T>(first + k);
+			break;
+		case VK_CONST:
+			std::fill_n(p_buffer, count, (op.type == E_REAL) ? static_cast<T>(op.constant.d_) : static_cast<T>(op.constant.i_));
+			break;
+		case VK_SCALAR: {
+			const value *p_value = op.p_node->runstack_item;
+			std::fill_n(p_buffer, count, (op.type == E_REAL) ? static_cast<T>(p_value->d_) : static_cast<T>(p_value->i_));
+		} break;
+		default:
+			break;
+		}
+	}
+
+	/** run_statement   Run a statement over elements first... .
+	 *
+	 * @param statement : statement.
+	 * @param first     : index of the first element.
+	 * @param count     : number of elements, at most kernel_width.
+	 * @param p_buffers : statement.depth buffers of kernel_width.
+	 */
+	template <typename T>
+	static void run_statement(const kernel_statement &statement, cx_int first, cx_int count, T *p_buffers) {
+		const size_t n = static_cast<size_t>(count);
+		T *p_top = p_buffers;
+
+		for (auto &op : statement.ops) {
+			switch (op.op) {
+			case VK_ADD: p_top -= kernel_width; add(p_top - kernel_width, p_top, n); break;
+			case VK_SUB: p_top -= kernel_width; subtract(p_top - kernel_width, p_top, n); break;
+			case VK_MUL: p_top -= kernel_width; multiply(p_top - kernel_width, p_top, n); break;
+			case VK_DIV: p_top -= kernel_width; divide(p_top - kernel_width, p_top, n); break;
+			default:
+				fill_leaf(p_top, op, first, count);
+				p_top += kernel_width;
+				break;
+			}
+		}
+
+		T *p_elements = static_cast<T *>(statement.p_array->runstack_item->a_);
+		std::copy_n(p_buffers, n, p_elements + first);
+	}
+
+	namespace simd {
+		/** compile         Compile the loop with its header at header.
+		 *
+		 * @param code   : function code.
+		 * @param header : index of the loop header.
+		 * @return its kernel, nullptr if it doesn't have the shape of one.
+		 */
+		std::shared_ptr<vector_kernel> compile(const program &code, int header) {
+			std::shared_ptr<vector_kernel> p_kernel = std::make_shared<vector_kernel>();
+			if (!compile_loop(code, header, *p_kernel)) p_kernel.reset();
+
+			return p_kernel;
+		}
+
+		/** run             Run a loop as its kernel.  Bounds are checked
+		 *                  for the whole range up front: a loop that
+		 *                  would fail one runs as it is, to fail at the
+		 *                  same element.
+		 *
+		 * @param kernel : kernel of the loop.
+		 * @return location to go on at, or -1 to run the loop.
+		 */
+		int run(const vector_kernel &kernel) {
+			// the body runs for i + 1 ... n, or n + 1 for <=
+			const cx_int start = kernel.p_index->runstack_item->i_;
+			cx_int last = (kernel.p_limit != nullptr) ? kernel.p_limit->runstack_item->i_ : kernel.limit;
+
+			if (kernel.inclusive) {
+				if (last == std::numeric_limits<cx_int>::max()) return -1;
+				++last;
+			}
+
+			if (start >= last) return static_cast<int>(kernel.exit);
+			const cx_int first = start + 1;
+
+			for (auto p_array : kernel.checked) {
+				if ((first < 0) || (static_cast<size_t>(last) > p_array->p_type->array.max_index)) return -1;
+			}
+
+			std::vector<cx_int> int_buffers;
+			std::vector<cx_real> real_buffers;
+			std::vector<cx_byte> byte_buffers;
+
+			for (auto &statement : kernel.statements) {
+				const size_t size = static_cast<size_t>(statement.depth * kernel_width);
+
+				switch (statement.type) {
+				case E_INT: if (int_buffers.size() < size) int_buffers.resize(size); break;
+				case E_REAL: if (real_buffers.size() < size) real_buffers.resize(size); break;
+				case E_BYTE: if (byte_buffers.size() < size) byte_buffers.resize(size); break;
+				}
+			}
+
+			for (cx_int at = first; at <= last; at += kernel_width) {
+				const cx_int count = std::min(kernel_width, last - at + 1);
+
+				for (auto &statement : kernel.statements) {
+					switch (statement.type) {
+					case E_INT: run_statement(statement, at, count, int_buffers.data()); break;
+					case E_REAL: run_statement(statement, at, count, real_buffers.data()); break;
+					case E_BYTE: run_statement(statement, at, count, byte_buffers.data()); break;
+					}
+				}
+			}
+
+			kernel.p_index->runstack_item->i_ = last;
+			return static_cast<int>(kernel.exit);
+		}
+
+		/** run             Run a loop of a running function as its
+		 *                  kernel, compiling it the first time.
+		 *
+		 * @param p_function_id : function running.
+		 * @param header        : index of the loop header.
+		 * @return location to go on at, or -1 to run the loop.
+		 */
+		int run(symbol_table_node *p_function_id, int header) {
+			auto &routine = p_function_id->defined.routine;
+
+			if (routine.p_kernel_cache == nullptr) routine.p_kernel_cache = std::make_shared<kernel_cache>();
+			kernel_cache &cache = *routine.p_kernel_cache;
+
+			if (cache.p_code != routine.program_code.data()) {
+				cache.kernels.clear();
+				cache.p_code = routine.program_code.data();
+			}
+
+			auto found = cache.kernels.find(header);
+			if (found == cache.kernels.end()) {
+				found = cache.kernels.emplace(header, compile(routine.program_code, header)).first;
+			}
+
+			return (found->second != nullptr) ? run(*found->second) : -1;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <memory>
+#include <unordered_map>
+#include "symtab.h"
+
+namespace cx {
+	struct vector_kernel;
+
+	namespace simd_settings {
+		extern bool vectorize;		// mark vectorizable loops with VLOOP (-novector clears it)
+	}
+
+	/** kernel_cache    A function's loop kernels, by header location,
+	 *                  nullptr for a loop that can't run as one.  It
+	 *                  starts over when -tier installs new code.
+	 */
+	struct kernel_cache {
+		const inst *p_code = nullptr;
+		std::unordered_map<int, std::shared_ptr<vector_kernel>> kernels;
+	};
+
+	namespace simd {
+		// Kernel of the loop with its header at header, nullptr if it has none
+		std::shared_ptr<vector_kernel> compile(const program &code, int header);
+		/* Run a loop as its kernel, from the current value of its index
+		 * to the end.  The location to go on at is returned, or -1 to
+		 * run the loop as it is. */
+		int run(const vector_kernel &kernel);
+		// Run the loop with its header at header of a running function
+		int run(symbol_table_node *p_function_id, int header);
+	}
+}
+
+#endif
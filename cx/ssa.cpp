@@ -0,0 +1,1629 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <sstream>
+#include "ssa.h"
+#include "optimizer.h"
+
+namespace cx {
+	namespace ssa {
+
+		instruction *basic_block::terminator(void) const {
+			if (body.empty()) return nullptr;
+
+			instruction *p_last = body.back();
+			switch (p_last->op) {
+			case GOTO:
+			case IF_FALSE:
+			case RETURN:
+				return p_last;
+			default:
+				return nullptr;
+			}
+		}
+
+		instruction *function::create(opcode op, type_code type, value arg0, value arg1) {
+			values.emplace_back(new instruction(static_cast<int>(values.size()), op, type));
+
+			instruction *p_new = values.back().get();
+			p_new->arg0 = arg0;
+			p_new->arg1 = arg1;
+
+			return p_new;
+		}
+
+		void function::replace_all_uses(instruction *p_old, instruction *p_new) {
+			for (auto &p_block : blocks) {
+				for (auto p_phi : p_block->phis) {
+					std::replace(p_phi->operands.begin(), p_phi->operands.end(), p_old, p_new);
+				}
+
+				for (auto p_inst : p_block->body) {
+					std::replace(p_inst->operands.begin(), p_inst->operands.end(), p_old, p_new);
+				}
+			}
+		}
+
+		std::map<const instruction *, int> function::use_counts(void) const {
+			std::map<const instruction *, int> counts;
+
+			for (auto &p_block : blocks) {
+				for (auto p_phi : p_block->phis) {
+					for (auto p_operand : p_phi->operands) ++counts[p_operand];
+				}
+
+				for (auto p_inst : p_block->body) {
+					for (auto p_operand : p_inst->operands) ++counts[p_operand];
+				}
+			}
+
+			return counts;
+		}
+
+		void function::print(std::wostream &out) const {
+			out << L"function: " << p_function_id->node_name << std::endl;
+
+			for (auto &p_block : blocks) {
+				out << L"bb" << p_block->id << L":";
+				if (!p_block->preds.empty()) {
+					out << L"\t\t; preds";
+					for (auto p_pred : p_block->preds) out << L" bb" << p_pred->id;
+				}
+				out << std::endl;
+
+				for (auto p_phi : p_block->phis) {
+					out << L"\t%" << p_phi->id << L" = phi";
+					for (size_t i = 0; i < p_phi->operands.size(); ++i) {
+						out << (i ? L", " : L" ") << L"[%" << p_phi->operands[i]->id
+							<< L", bb" << p_block->preds[i]->id << L"]";
+					}
+					if (p_phi->p_variable != nullptr) out << L"\t; " << p_phi->p_variable->node_name;
+					out << std::endl;
+				}
+
+				for (auto p_inst : p_block->body) {
+					out << L"\t";
+					if (p_inst->type != T_VOID) out << L"%" << p_inst->id << L" = ";
+					out << opcode_string[p_inst->op];
+
+					for (size_t i = 0; i < p_inst->operands.size(); ++i) {
+						out << (i ? L", %" : L" %") << p_inst->operands[i]->id;
+					}
+
+					switch (p_inst->op) {
+					case ICONST: out << L" " << p_inst->arg0.i_; break;
+					case DCONST: out << L" " << p_inst->arg0.d_; break;
+					case GOTO: out << L" bb" << p_block->p_jump->id; break;
+					case IF_FALSE: out << L" bb" << p_block->p_jump->id; break;
+					default: break;
+					}
+					out << std::endl;
+				}
+
+				if ((p_block->terminator() == nullptr) && (p_block->p_fall != nullptr)) {
+					out << L"\t; fall through to bb" << p_block->p_fall->id << std::endl;
+				}
+			}
+		}
+
+		/** has_side_effects     Instructions that write memory, transfer
+		 *                      control, call out or can throw. Everything
+		 *                      else only computes its result and can be
+		 *                      dropped when nothing reads it.
+		 *
+		 * @param op : opcode.
+		 * @return true unless op is pure.
+		 */
+		bool has_side_effects(opcode op) {
+			switch (op) {
+			case AALOAD:
+			case ACONST_NULL:
+			case ALOAD:
+			case B2I:
+			case BALOAD_P:
+			case BALOAD_U:
+			case BEQ:
+			case C2I:
+			case CALOAD_P:
+			case CALOAD_U:
+			case D2I:
+			case DADD:
+			case DALOAD_P:
+			case DALOAD_U:
+			case DCONST:
+			case DDIV:
+			case DEQ:
+			case DGT:
+			case DGT_EQ:
+			case DLOAD:
+			case DLT:
+			case DLT_EQ:
+			case DMUL:
+			case DNEG:
+			case DNOT_EQ:
+			case DPOS:
+			case DREM:
+			case DSUB:
+			case I2B:
+			case I2C:
+			case I2D:
+			case IADD:
+			case IALOAD_P:
+			case IALOAD_U:
+			case IAND:
+			case ICONST:
+			case IEQ:
+			case IGT:
+			case IGT_EQ:
+			case ILOAD:
+			case ILT:
+			case ILT_EQ:
+			case IMUL:
+			case INEG:
+			case INOT:
+			case INOT_EQ:
+			case IOR:
+			case IPOS:
+			case ISHL:
+			case ISHR:
+			case ISUB:
+			case IXOR:
+			case LOGIC_AND:
+			case LOGIC_NOT:
+			case LOGIC_OR:
+			case NOP:
+			case PLOAD:
+			case ZEQ:
+				return false;
+			default:
+				return true;
+			}
+		}
+
+		/** result_type      Type of the value an instruction pushes.
+		 *
+		 * @param instruction : bytecode instruction.
+		 * @return type code, T_VOID if nothing is pushed.
+		 */
+		type_code result_type(const inst &instruction) {
+			switch (instruction.op) {
+			case AALOAD:
+			case ACONST_NULL:
+			case ALOAD:
+			case NEWARRAY:
+			case PLOAD:
+				return T_REFERENCE;
+			case BALOAD:
+			case BALOAD_P:
+			case BALOAD_U:
+			case I2B:
+				return T_BYTE;
+			case CALOAD:
+			case CALOAD_P:
+			case CALOAD_U:
+			case I2C:
+				return T_CHAR;
+			case DADD:
+			case DALOAD:
+			case DALOAD_P:
+			case DALOAD_U:
+			case DCONST:
+			case DDIV:
+			case DLOAD:
+			case DMUL:
+			case DNEG:
+			case DPOS:
+			case DREM:
+			case DSUB:
+			case I2D:
+				return T_DOUBLE;
+			case BEQ:
+			case DEQ:
+			case DGT:
+			case DGT_EQ:
+			case DLT:
+			case DLT_EQ:
+			case DNOT_EQ:
+			case IEQ:
+			case IGT:
+			case IGT_EQ:
+			case ILT:
+			case ILT_EQ:
+			case INOT_EQ:
+			case LOGIC_AND:
+			case LOGIC_NOT:
+			case LOGIC_OR:
+			case ZEQ:
+				return T_BOOLEAN;
+			case CALL:
+				return ((const symbol_table_node *)instruction.arg0.a_)->p_type->typecode;
+			default:
+				return T_INT;
+			}
+		}
+
+		static bool is_constant(const instruction *p_inst) {
+			if (p_inst->is_phi) return false;
+
+			switch (p_inst->op) {
+			case ACONST_NULL:
+			case DCONST:
+			case ICONST:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		// Bytecode stack state at the end of a block while building.
+		struct build_state {
+			bool done;
+			std::vector<instruction *> stack;
+			std::vector<instruction *> locals;
+		};
+
+		/** build            Translate program_code into SSA form:
+		 *
+		 *                  1. split the code into basic blocks at jump
+		 *                     targets and after jumps/returns,
+		 *                  2. check that every block is entered with the
+		 *                     same operand stack height from all sides,
+		 *                  3. symbolically execute each block in reverse
+		 *                     post order, giving blocks with several
+		 *                     predecessors a phi per promoted local and
+		 *                     per stack slot,
+		 *                  4. fill in the phis and fold away the trivial
+		 *                     ones.
+		 *
+		 * @param fn : function to fill, fn.p_function_id names the code.
+		 * @return false if the code uses something the IR can't express.
+		 */
+		bool build(function &fn) {
+			const program &code = fn.p_function_id->defined.routine.program_code;
+			const int size = static_cast<int>(code.size());
+
+			if (size == 0) return false;
+
+			std::vector<int> pops(size, 0);
+			std::vector<int> pushes(size, 0);
+			std::vector<bool> is_leader(size + 1, false);
+			is_leader[0] = true;
+
+			for (int pc = 0; pc < size; ++pc) {
+				const inst &instruction = code[pc];
+
+				if (instruction.op == CALL) {
+					const symbol_table_node *p_callee = (const symbol_table_node *)instruction.arg0.a_;
+					if (p_callee->p_type == nullptr) return false;
+
+					pops[pc] = static_cast<int>(p_callee->defined.routine.p_parameter_ids.size());
+					pushes[pc] = (p_callee->p_type->typecode == T_VOID) ? 0 : 1;
+				}
+				else if (!optimizer::stack_effect(instruction, pops[pc], pushes[pc])) {
+					return false;
+				}
+
+				if (optimizer::is_jump(instruction.op)) {
+					const cx_int location = instruction.arg0.i_;
+					if ((location <= 0) || (location > size)) return false;
+
+					is_leader[static_cast<int>(location)] = true;
+					is_leader[pc + 1] = true;
+				}
+				else if (instruction.op == RETURN) {
+					is_leader[pc + 1] = true;
+				}
+			}
+
+			// Blocks in layout order, plus an empty exit block at the end.
+			std::vector<basic_block *> block_at(size + 1, nullptr);
+			std::vector<int> block_start;
+			std::vector<std::unique_ptr<basic_block>> blocks;
+
+			for (int pc = 0; pc < size; ++pc) {
+				if (is_leader[pc]) {
+					blocks.emplace_back(new basic_block(static_cast<int>(blocks.size())));
+					block_start.push_back(pc);
+				}
+				block_at[pc] = blocks.back().get();
+			}
+
+			blocks.emplace_back(new basic_block(static_cast<int>(blocks.size())));
+			block_start.push_back(size);
+			block_at[size] = blocks.back().get();
+
+			const size_t block_count = blocks.size();
+			basic_block *p_exit = blocks.back().get();
+
+			for (size_t b = 0; b + 1 < block_count; ++b) {
+				basic_block *p_block = blocks[b].get();
+				const inst &last = code[block_start[b + 1] - 1];
+				p_block->last_location = block_start[b + 1] - 1;
+
+				switch (last.op) {
+				case GOTO:
+					p_block->p_jump = block_at[static_cast<int>(last.arg0.i_)];
+					break;
+				case IF_FALSE:
+					p_block->p_jump = block_at[static_cast<int>(last.arg0.i_)];
+					p_block->p_fall = blocks[b + 1].get();
+					break;
+				case RETURN:
+					break;
+				default:
+					p_block->p_fall = blocks[b + 1].get();
+					break;
+				}
+			}
+
+			// Reverse post order from the entry.
+			std::vector<basic_block *> rpo;
+			{
+				std::vector<bool> seen(block_count, false);
+				std::vector<std::pair<basic_block *, int>> work;
+				work.push_back(std::make_pair(blocks[0].get(), 0));
+				seen[0] = true;
+
+				while (!work.empty()) {
+					basic_block *p_block = work.back().first;
+					const int next = work.back().second++;
+					basic_block *p_succ = (next == 0) ? p_block->p_fall : (next == 1) ? p_block->p_jump : nullptr;
+
+					if (next > 1) {
+						rpo.push_back(p_block);
+						work.pop_back();
+					}
+					else if ((p_succ != nullptr) && !seen[p_succ->id]) {
+						seen[p_succ->id] = true;
+						work.push_back(std::make_pair(p_succ, 0));
+					}
+				}
+
+				std::reverse(rpo.begin(), rpo.end());
+			}
+
+			std::vector<bool> reachable(block_count, false);
+			for (auto p_block : rpo) reachable[p_block->id] = true;
+
+			for (auto p_block : rpo) {
+				if (p_block->p_fall != nullptr) p_block->p_fall->preds.push_back(p_block);
+				if (p_block->p_jump != nullptr) p_block->p_jump->preds.push_back(p_block);
+			}
+
+			if (!blocks[0]->preds.empty()) return false;
+
+			// Operand stack height on entry to each block.
+			std::vector<int> height(block_count, -1);
+			height[0] = 0;
+
+			for (auto p_block : rpo) {
+				if (p_block == p_exit) continue;
+
+				int h = height[p_block->id];
+				if (h < 0) return false;
+
+				for (int pc = block_start[p_block->id]; pc < block_start[p_block->id + 1]; ++pc) {
+					h -= pops[pc];
+					if (h < 0) return false;
+					h += pushes[pc];
+				}
+
+				basic_block *succs[] = { p_block->p_fall, p_block->p_jump };
+				for (auto p_succ : succs) {
+					// Whatever is left on the stack at the end is dropped.
+					if ((p_succ == nullptr) || (p_succ == p_exit)) continue;
+
+					if (height[p_succ->id] < 0) height[p_succ->id] = h;
+					else if (height[p_succ->id] != h) return false;
+				}
+			}
+
+			/* Scalar locals only touched by their own load/store/inc can
+			 * live in SSA values. A nested function could reach them, so
+			 * promotion is skipped when the function has any. */
+			std::map<const void *, size_t> local_index;
+
+			if (fn.p_function_id->defined.routine.p_function_ids.empty()) {
+				for (auto &p_local : fn.p_function_id->defined.routine.p_variable_ids) {
+					if (p_local->p_type == nullptr) continue;
+
+					const type_code typecode = p_local->p_type->typecode;
+					const bool is_real = (typecode == T_DOUBLE);
+					const bool is_integer = (typecode == T_BOOLEAN) || (typecode == T_BYTE) ||
+						(typecode == T_CHAR) || (typecode == T_INT);
+
+					if (!is_real && !is_integer) continue;
+
+					bool promote = true;
+					for (auto &instruction : code) {
+						if (instruction.arg0.a_ != p_local.get()) continue;
+
+						switch (instruction.op) {
+						case ILOAD:
+						case ISTORE:
+						case IINC:
+							promote = promote && is_integer;
+							break;
+						case DLOAD:
+						case DSTORE:
+						case DINC:
+							promote = promote && is_real;
+							break;
+						default:
+							promote = false;
+							break;
+						}
+					}
+
+					if (promote) {
+						local_index[p_local.get()] = fn.promoted.size();
+						fn.promoted.push_back(p_local.get());
+					}
+				}
+			}
+
+			const size_t local_count = fn.promoted.size();
+			std::vector<build_state> states(block_count);
+
+			for (auto p_block : rpo) {
+				if (p_block == p_exit) continue;
+
+				build_state &state = states[p_block->id];
+				state.done = true;
+
+				if (p_block->id == 0) {
+					// Entry: locals start out as whatever their slot holds.
+					for (auto p_local : fn.promoted) {
+						const bool is_real = (p_local->p_type->typecode == T_DOUBLE);
+						instruction *p_load = fn.create(is_real ? DLOAD : ILOAD,
+							is_real ? T_DOUBLE : T_INT, p_local);
+						p_load->p_block = p_block;
+						p_load->p_variable = p_local;
+						p_block->body.push_back(p_load);
+						state.locals.push_back(p_load);
+					}
+				}
+				else if ((p_block->preds.size() == 1) && states[p_block->preds[0]->id].done) {
+					state.stack = states[p_block->preds[0]->id].stack;
+					state.locals = states[p_block->preds[0]->id].locals;
+				}
+				else {
+					for (auto p_local : fn.promoted) {
+						instruction *p_phi = fn.create(NOP,
+							p_local->p_type->typecode == T_DOUBLE ? T_DOUBLE : T_INT);
+						p_phi->is_phi = true;
+						p_phi->p_block = p_block;
+						p_phi->p_variable = p_local;
+						p_block->phis.push_back(p_phi);
+						state.locals.push_back(p_phi);
+					}
+
+					for (int slot = 0; slot < height[p_block->id]; ++slot) {
+						instruction *p_phi = fn.create(NOP, T_INT);
+						p_phi->is_phi = true;
+						p_phi->p_block = p_block;
+						p_block->phis.push_back(p_phi);
+						state.stack.push_back(p_phi);
+					}
+				}
+
+				std::vector<instruction *> &stack = state.stack;
+
+				for (int pc = block_start[p_block->id]; pc < block_start[p_block->id + 1]; ++pc) {
+					const inst &source = code[pc];
+					auto local = local_index.find(source.arg0.a_);
+					const bool is_promoted = (local != local_index.end());
+
+					switch (source.op) {
+					case ILOAD:
+					case DLOAD:
+						if (!is_promoted) break;
+						stack.push_back(state.locals[local->second]);
+						continue;
+					case ISTORE:
+					case DSTORE:
+						if (!is_promoted) break;
+						state.locals[local->second] = stack.back();
+						if (stack.back()->p_variable == nullptr) {
+							stack.back()->p_variable = fn.promoted[local->second];
+						}
+						stack.pop_back();
+						continue;
+					case IINC:
+					case DINC: {
+						if (!is_promoted) break;
+
+						const bool is_real = (source.op == DINC);
+						instruction *p_step = fn.create(is_real ? DCONST : ICONST,
+							is_real ? T_DOUBLE : T_INT, source.arg1);
+						instruction *p_sum = fn.create(is_real ? DADD : IADD,
+							is_real ? T_DOUBLE : T_INT);
+
+						p_sum->operands.push_back(state.locals[local->second]);
+						p_sum->operands.push_back(p_step);
+						p_sum->p_variable = fn.promoted[local->second];
+						p_step->p_block = p_block;
+						p_sum->p_block = p_block;
+						p_block->body.push_back(p_step);
+						p_block->body.push_back(p_sum);
+						state.locals[local->second] = p_sum;
+					} continue;
+					case POP:
+						stack.pop_back();
+						continue;
+					case POP2:
+						stack.pop_back();
+						stack.pop_back();
+						continue;
+					case NOP:
+						continue;
+					default:
+						break;
+					}
+
+					instruction *p_inst = fn.create(source.op,
+						pushes[pc] ? result_type(source) : T_VOID, source.arg0, source.arg1);
+					p_inst->p_block = p_block;
+					p_inst->operands.assign(stack.end() - pops[pc], stack.end());
+					stack.resize(stack.size() - pops[pc]);
+					p_block->body.push_back(p_inst);
+
+					if (pushes[pc]) stack.push_back(p_inst);
+				}
+			}
+
+			// Phi operands, one per predecessor.
+			for (auto p_block : rpo) {
+				if (p_block->phis.empty()) continue;
+
+				for (auto p_pred : p_block->preds) {
+					const build_state &state = states[p_pred->id];
+
+					for (size_t i = 0; i < p_block->phis.size(); ++i) {
+						p_block->phis[i]->operands.push_back(i < local_count
+							? state.locals[i] : state.stack[i - local_count]);
+					}
+				}
+
+				for (size_t i = local_count; i < p_block->phis.size(); ++i) {
+					p_block->phis[i]->type = p_block->phis[i]->operands[0]->type;
+				}
+			}
+
+			// Drop unreachable blocks, keeping the exit last.
+			for (auto &p_block : blocks) {
+				if (reachable[p_block->id] || (p_block.get() == p_exit)) {
+					fn.blocks.push_back(std::move(p_block));
+				}
+			}
+
+			// A phi whose operands are all one value (or itself) is that value.
+			bool changed = true;
+			while (changed) {
+				changed = false;
+
+				for (auto &p_block : fn.blocks) {
+					for (size_t i = 0; i < p_block->phis.size(); ++i) {
+						instruction *p_phi = p_block->phis[i];
+						instruction *p_same = nullptr;
+						bool trivial = true;
+
+						for (auto p_operand : p_phi->operands) {
+							if ((p_operand == p_phi) || (p_operand == p_same)) continue;
+							if (p_same != nullptr) {
+								trivial = false;
+								break;
+							}
+							p_same = p_operand;
+						}
+
+						if (!trivial || (p_same == nullptr)) continue;
+
+						p_block->phis.erase(p_block->phis.begin() + i);
+						fn.replace_all_uses(p_phi, p_same);
+						changed = true;
+						break;
+					}
+				}
+			}
+
+			return true;
+		}
+
+		/** run (constant_folding)   Evaluate integer and real arithmetic
+		 *                          and comparisons on two constants the
+		 *                          way cxvm::go would, and put the result
+		 *                          in place of the instruction.
+		 *
+		 * @param fn : function.
+		 * @return true if anything was folded.
+		 */
+		bool constant_folding::run(function &fn) {
+			bool changed = false;
+
+			for (auto &p_block : fn.blocks) {
+				for (auto &p_inst : p_block->body) {
+					if (p_inst->operands.size() != 2) continue;
+
+					const instruction *p_a = p_inst->operands[0];
+					const instruction *p_b = p_inst->operands[1];
+					instruction *p_folded = nullptr;
+
+					if ((p_a->op == ICONST) && (p_b->op == ICONST) && !p_a->is_phi && !p_b->is_phi) {
+						const cx_int a = p_a->arg0.i_;
+						const cx_int b = p_b->arg0.i_;
+						// Wrap around like the VM does on overflow
+						const uint64_t ua = static_cast<uint64_t>(a);
+						const uint64_t ub = static_cast<uint64_t>(b);
+						bool folds = true;
+						cx_int result = 0;
+
+						switch (p_inst->op) {
+						case IADD: result = static_cast<cx_int>(ua + ub); break;
+						case ISUB: result = static_cast<cx_int>(ua - ub); break;
+						case IMUL: result = static_cast<cx_int>(ua * ub); break;
+						case IAND: result = a & b; break;
+						case IOR: result = a | b; break;
+						case IXOR: result = a ^ b; break;
+						case IDIV:
+						case IREM:
+							folds = (b != 0) && !((a == INT64_MIN) && (b == -1));
+							if (folds) result = (p_inst->op == IDIV) ? a / b : a % b;
+							break;
+						case ISHL:
+							folds = (b >= 0) && (b < 64);
+							if (folds) result = static_cast<cx_int>(ua << b);
+							break;
+						case ISHR:
+							folds = (a >= 0) && (b >= 0) && (b < 64);
+							if (folds) result = a >> b;
+							break;
+						case IEQ: result = (a == b); break;
+						case INOT_EQ: result = (a != b); break;
+						case ILT: result = (a < b); break;
+						case ILT_EQ: result = (a <= b); break;
+						case IGT: result = (a > b); break;
+						case IGT_EQ: result = (a >= b); break;
+						default: folds = false; break;
+						}
+
+						if (folds) p_folded = fn.create(ICONST, p_inst->type, result);
+					}
+					else if ((p_a->op == DCONST) && (p_b->op == DCONST) && !p_a->is_phi && !p_b->is_phi) {
+						const cx_real a = p_a->arg0.d_;
+						const cx_real b = p_b->arg0.d_;
+
+						switch (p_inst->op) {
+						case DADD: p_folded = fn.create(DCONST, T_DOUBLE, a + b); break;
+						case DSUB: p_folded = fn.create(DCONST, T_DOUBLE, a - b); break;
+						case DMUL: p_folded = fn.create(DCONST, T_DOUBLE, a * b); break;
+						case DEQ: p_folded = fn.create(ICONST, T_BOOLEAN, static_cast<cx_int>(a == b)); break;
+						case DNOT_EQ: p_folded = fn.create(ICONST, T_BOOLEAN, static_cast<cx_int>(a != b)); break;
+						case DLT: p_folded = fn.create(ICONST, T_BOOLEAN, static_cast<cx_int>(a < b)); break;
+						case DLT_EQ: p_folded = fn.create(ICONST, T_BOOLEAN, static_cast<cx_int>(a <= b)); break;
+						case DGT: p_folded = fn.create(ICONST, T_BOOLEAN, static_cast<cx_int>(a > b)); break;
+						case DGT_EQ: p_folded = fn.create(ICONST, T_BOOLEAN, static_cast<cx_int>(a >= b)); break;
+						default: break;
+						}
+					}
+
+					if (p_folded == nullptr) continue;
+
+					instruction *p_old = p_inst;
+					p_folded->p_block = p_old->p_block;
+					p_folded->p_variable = p_old->p_variable;
+					p_inst = p_folded;
+					fn.replace_all_uses(p_old, p_folded);
+					changed = true;
+				}
+			}
+
+			return changed;
+		}
+
+		/** run (dead_code_elimination)  Mark everything the side effects
+		 *                              of the function depend on and drop
+		 *                              the rest, phis included.
+		 *
+		 * @param fn : function.
+		 * @return true if anything was removed.
+		 */
+		bool dead_code_elimination::run(function &fn) {
+			std::set<const instruction *> live;
+			std::vector<const instruction *> work;
+
+			for (auto &p_block : fn.blocks) {
+				for (auto p_inst : p_block->body) {
+					if (has_side_effects(p_inst->op)) {
+						live.insert(p_inst);
+						work.push_back(p_inst);
+					}
+				}
+			}
+
+			while (!work.empty()) {
+				const instruction *p_inst = work.back();
+				work.pop_back();
+
+				for (auto p_operand : p_inst->operands) {
+					if (live.insert(p_operand).second) work.push_back(p_operand);
+				}
+			}
+
+			bool changed = false;
+			auto is_dead = [&live](const instruction *p_inst) { return live.count(p_inst) == 0; };
+
+			for (auto &p_block : fn.blocks) {
+				const size_t before = p_block->phis.size() + p_block->body.size();
+
+				p_block->phis.erase(std::remove_if(p_block->phis.begin(), p_block->phis.end(), is_dead),
+					p_block->phis.end());
+				p_block->body.erase(std::remove_if(p_block->body.begin(), p_block->body.end(), is_dead),
+					p_block->body.end());
+
+				changed = changed || (before != p_block->phis.size() + p_block->body.size());
+			}
+
+			return changed;
+		}
+
+		// Temporaries are picked by how the VM copies the value.
+		enum storage_class { SC_INTEGER, SC_REAL, SC_REFERENCE };
+
+		static storage_class storage_of(type_code type) {
+			switch (type) {
+			case T_DOUBLE: return SC_REAL;
+			case T_REFERENCE: return SC_REFERENCE;
+			default: return SC_INTEGER;
+			}
+		}
+
+		/** lowering         Out of SSA translation for one function.
+		 *
+		 *                  Values used once, by the next consumer in the
+		 *                  same block, stay on the operand stack: each
+		 *                  root instruction is emitted as an expression
+		 *                  tree in post order, which reproduces the code
+		 *                  the parser wrote. Constants are re-emitted at
+		 *                  every use. Everything else (phis included) is
+		 *                  spilled to a local: stored after its definition
+		 *                  and loaded at each use. Spilled values that
+		 *                  never live at the same time share a local,
+		 *                  phis are coalesced with their operands, and
+		 *                  x = x + c sharing a local becomes IINC/DINC.
+		 */
+		class lowering {
+		private:
+			function &fn;
+			program &code;
+
+			std::map<const instruction *, std::vector<instruction *>> users;
+			std::set<const instruction *> phi_used;
+			std::set<const instruction *> stackable;
+			std::vector<instruction *> spilled;
+			std::map<const instruction *, int> spill_index;
+
+			std::vector<std::set<int>> interference;
+			std::vector<int> group;		// union-find parent per spilled value
+			std::map<int, symbol_table_node *> temp_of_group;
+
+			struct edge_move {
+				const instruction *p_source;
+				const instruction *p_target;
+			};
+
+			struct fixup {
+				size_t at;
+				const basic_block *p_target;	// nullptr for a trampoline
+				size_t trampoline;
+			};
+
+			struct trampoline {
+				const basic_block *p_from;
+				const basic_block *p_to;
+			};
+
+			std::vector<fixup> fixups;
+			std::vector<trampoline> trampolines;
+
+			bool is_spilled(const instruction *p_inst) const {
+				return spill_index.count(p_inst) != 0;
+			}
+
+			int find(int i) {
+				while (group[i] != i) i = group[i] = group[group[i]];
+				return i;
+			}
+
+			symbol_table_node *temp(const instruction *p_inst) {
+				return temp_of_group[find(spill_index.at(p_inst))];
+			}
+
+			void find_users(void);
+			void choose_stackable(void);
+			void emit_order(const basic_block *p_block, std::vector<const instruction *> &order) const;
+			void tree_order(const instruction *p_inst, std::vector<const instruction *> &order) const;
+			void build_interference(void);
+			bool try_coalesce(const instruction *p_a, const instruction *p_b);
+			void assign_temps(void);
+			bool fold_increment(const instruction *p_inst, inst &increment);
+
+			void emit_load(const instruction *p_inst);
+			void emit_store(const instruction *p_inst);
+			void emit_tree(const instruction *p_inst);
+			void emit_operands(const instruction *p_inst);
+			void emit_root(const instruction *p_inst);
+			std::vector<edge_move> moves(const basic_block *p_from, const basic_block *p_to);
+			void emit_moves(const basic_block *p_from, const basic_block *p_to);
+			void emit_jump(opcode op, const basic_block *p_target);
+
+		public:
+			lowering(function &fn_, program &code_) : fn(fn_), code(code_) {}
+			void run(void);
+		};
+
+		void lowering::find_users(void) {
+			users.clear();
+			phi_used.clear();
+
+			for (auto &p_block : fn.blocks) {
+				for (auto p_phi : p_block->phis) {
+					for (auto p_operand : p_phi->operands) phi_used.insert(p_operand);
+				}
+
+				for (auto p_inst : p_block->body) {
+					for (auto p_operand : p_inst->operands) users[p_operand].push_back(p_inst);
+				}
+			}
+		}
+
+		void lowering::tree_order(const instruction *p_inst, std::vector<const instruction *> &order) const {
+			for (auto p_operand : p_inst->operands) {
+				if (stackable.count(p_operand)) tree_order(p_operand, order);
+			}
+
+			order.push_back(p_inst);
+		}
+
+		void lowering::emit_order(const basic_block *p_block, std::vector<const instruction *> &order) const {
+			for (auto p_inst : p_block->body) {
+				if (is_constant(p_inst) || stackable.count(p_inst)) continue;
+				tree_order(p_inst, order);
+			}
+		}
+
+		/** choose_stackable     Start with every single use value whose
+		 *                      user is in the same block, then spill the
+		 *                      ones that tree emission would move past
+		 *                      another instruction until the emitted order
+		 *                      matches the IR order.
+		 */
+		void lowering::choose_stackable(void) {
+			stackable.clear();
+
+			for (auto &p_block : fn.blocks) {
+				for (auto p_inst : p_block->body) {
+					if ((p_inst->type == T_VOID) || is_constant(p_inst) || phi_used.count(p_inst)) continue;
+
+					auto found = users.find(p_inst);
+					if ((found == users.end()) || (found->second.size() != 1)) continue;
+					if (found->second[0]->p_block != p_inst->p_block) continue;
+
+					stackable.insert(p_inst);
+				}
+			}
+
+			for (auto &p_block : fn.blocks) {
+				for (;;) {
+					std::vector<const instruction *> expected;
+					std::vector<const instruction *> order;
+
+					for (auto p_inst : p_block->body) {
+						if (!is_constant(p_inst)) expected.push_back(p_inst);
+					}
+					emit_order(p_block.get(), order);
+
+					size_t i = 0;
+					while ((i < expected.size()) && (i < order.size()) && (expected[i] == order[i])) ++i;
+					if ((i == expected.size()) && (i == order.size())) break;
+
+					if ((i < expected.size()) && stackable.count(expected[i])) {
+						stackable.erase(expected[i]);
+					}
+					else if ((i < order.size()) && stackable.count(order[i])) {
+						stackable.erase(order[i]);
+					}
+					else {
+						for (auto p_inst : p_block->body) stackable.erase(p_inst);
+					}
+				}
+			}
+
+			spilled.clear();
+			spill_index.clear();
+
+			for (auto &p_block : fn.blocks) {
+				for (auto p_phi : p_block->phis) {
+					spill_index[p_phi] = static_cast<int>(spilled.size());
+					spilled.push_back(p_phi);
+				}
+
+				for (auto p_inst : p_block->body) {
+					if ((p_inst->type == T_VOID) || is_constant(p_inst) || stackable.count(p_inst)) continue;
+					if ((users.count(p_inst) == 0) && (phi_used.count(p_inst) == 0)) continue;
+
+					spill_index[p_inst] = static_cast<int>(spilled.size());
+					spilled.push_back(p_inst);
+				}
+			}
+		}
+
+		/** build_interference   Liveness over spilled values, then two
+		 *                      values interfere when one is live where the
+		 *                      other is defined. Phi operands are used at
+		 *                      the end of the matching predecessor;
+		 *                      constants are re-emitted instead of loaded.
+		 */
+		void lowering::build_interference(void) {
+			const size_t block_count = fn.blocks.size();
+			std::map<const basic_block *, size_t> index;
+			for (size_t b = 0; b < block_count; ++b) index[fn.blocks[b].get()] = b;
+
+			auto is_loaded = [this](const instruction *p_operand) {
+				return is_spilled(p_operand);
+			};
+
+			// Values read at the end of a block by the phis of a successor.
+			std::vector<std::set<const instruction *>> phi_uses(block_count);
+			std::vector<std::set<const instruction *>> gen(block_count);
+			std::vector<std::set<const instruction *>> kill(block_count);
+
+			for (size_t b = 0; b < block_count; ++b) {
+				const basic_block *p_block = fn.blocks[b].get();
+
+				for (auto p_phi : p_block->phis) {
+					kill[b].insert(p_phi);
+
+					for (size_t i = 0; i < p_phi->operands.size(); ++i) {
+						if (is_loaded(p_phi->operands[i])) phi_uses[index[p_block->preds[i]]].insert(p_phi->operands[i]);
+					}
+				}
+
+				for (auto p_inst : p_block->body) {
+					for (auto p_operand : p_inst->operands) {
+						if (is_loaded(p_operand) && !kill[b].count(p_operand)) gen[b].insert(p_operand);
+					}
+					if (is_spilled(p_inst)) kill[b].insert(p_inst);
+				}
+			}
+
+			std::vector<std::set<const instruction *>> live_in(block_count);
+			std::vector<std::set<const instruction *>> live_out(block_count);
+
+			bool changed = true;
+			while (changed) {
+				changed = false;
+
+				for (size_t b = block_count; b-- > 0;) {
+					const basic_block *p_block = fn.blocks[b].get();
+					std::set<const instruction *> out = phi_uses[b];
+
+					const basic_block *succs[] = { p_block->p_fall, p_block->p_jump };
+					for (auto p_succ : succs) {
+						if (p_succ == nullptr) continue;
+
+						const size_t s = index[p_succ];
+						for (auto p_value : live_in[s]) out.insert(p_value);
+					}
+
+					std::set<const instruction *> in = gen[b];
+					for (auto p_value : out) {
+						if (!kill[b].count(p_value)) in.insert(p_value);
+					}
+
+					if ((out != live_out[b]) || (in != live_in[b])) {
+						live_out[b].swap(out);
+						live_in[b].swap(in);
+						changed = true;
+					}
+				}
+			}
+
+			interference.assign(spilled.size(), std::set<int>());
+
+			auto interfere = [this](const instruction *p_a, const instruction *p_b) {
+				const int a = spill_index.at(p_a);
+				const int b = spill_index.at(p_b);
+				if (a == b) return;
+				interference[a].insert(b);
+				interference[b].insert(a);
+			};
+
+			for (size_t b = 0; b < block_count; ++b) {
+				const basic_block *p_block = fn.blocks[b].get();
+				std::set<const instruction *> live = live_out[b];
+
+				for (auto p_inst = p_block->body.rbegin(); p_inst != p_block->body.rend(); ++p_inst) {
+					if (is_spilled(*p_inst)) {
+						for (auto p_value : live) interfere(*p_inst, p_value);
+						live.erase(*p_inst);
+					}
+
+					for (auto p_operand : (*p_inst)->operands) {
+						if (is_loaded(p_operand)) live.insert(p_operand);
+					}
+				}
+
+				for (auto p_phi : p_block->phis) {
+					for (auto p_value : live) interfere(p_phi, p_value);
+					for (auto p_other : p_block->phis) interfere(p_phi, p_other);
+				}
+			}
+		}
+
+		bool lowering::try_coalesce(const instruction *p_a, const instruction *p_b) {
+			if (!is_spilled(p_a) || !is_spilled(p_b)) return false;
+			if (storage_of(p_a->type) != storage_of(p_b->type)) return false;
+
+			const int a = find(spill_index.at(p_a));
+			const int b = find(spill_index.at(p_b));
+			if (a == b) return true;
+
+			for (size_t i = 0; i < spilled.size(); ++i) {
+				if (find(static_cast<int>(i)) != a) continue;
+
+				for (auto other : interference[i]) {
+					if (find(other) == b) return false;
+				}
+			}
+
+			group[b] = a;
+			return true;
+		}
+
+		/** assign_temps     Coalesce, then give each group of spilled
+		 *                  values a local. Groups that don't interfere
+		 *                  share one; the promoted locals are reused
+		 *                  first since nothing else refers to them now.
+		 */
+		void lowering::assign_temps(void) {
+			group.resize(spilled.size());
+			for (size_t i = 0; i < spilled.size(); ++i) group[i] = static_cast<int>(i);
+
+			for (auto &p_block : fn.blocks) {
+				for (auto p_phi : p_block->phis) {
+					for (auto p_operand : p_phi->operands) try_coalesce(p_phi, p_operand);
+				}
+			}
+
+			for (auto p_inst : spilled) {
+				if (!p_inst->is_phi && (p_inst->operands.size() == 2)) {
+					const instruction *p_base = is_constant(p_inst->operands[1]) ? p_inst->operands[0] : p_inst->operands[1];
+					if (!is_constant(p_base)) {
+						switch (p_inst->op) {
+						case IADD:
+						case DADD:
+							try_coalesce(p_inst, p_base);
+							break;
+						case ISUB:
+						case DSUB:
+							if (p_base == p_inst->operands[0]) try_coalesce(p_inst, p_base);
+							break;
+						default:
+							break;
+						}
+					}
+				}
+			}
+
+			// Locals free for reuse, by storage class.
+			std::vector<symbol_table_node *> pool[3];
+			for (auto p_local : fn.promoted) {
+				pool[storage_of(p_local->p_type->typecode)].push_back(p_local);
+			}
+
+			std::map<const symbol_table_node *, std::vector<int>> groups_in;
+			int temp_count = 0;
+
+			for (size_t i = 0; i < spilled.size(); ++i) {
+				const int root = find(static_cast<int>(i));
+				if (temp_of_group.count(root)) continue;
+
+				const storage_class sc = storage_of(spilled[i]->type);
+				std::set<int> conflicts;
+				std::vector<symbol_table_node *> candidates;
+
+				for (size_t j = 0; j < spilled.size(); ++j) {
+					if (find(static_cast<int>(j)) != root) continue;
+
+					for (auto other : interference[j]) conflicts.insert(find(other));
+					if ((spilled[j]->p_variable != nullptr) &&
+						(storage_of(spilled[j]->p_variable->p_type->typecode) == sc)) {
+						candidates.push_back(spilled[j]->p_variable);
+					}
+				}
+
+				for (auto p_local : pool[sc]) candidates.push_back(p_local);
+
+				symbol_table_node *p_temp = nullptr;
+				for (auto p_candidate : candidates) {
+					if (std::find(pool[sc].begin(), pool[sc].end(), p_candidate) == pool[sc].end()) continue;
+
+					bool is_free = true;
+					for (auto other : groups_in[p_candidate]) {
+						if (conflicts.count(other)) {
+							is_free = false;
+							break;
+						}
+					}
+
+					if (is_free) {
+						p_temp = p_candidate;
+						break;
+					}
+				}
+
+				if (p_temp == nullptr) {
+					static const type_ptr *p_types[] = { &p_integer_type, &p_double_type, &p_reference_type };
+					p_temp = optimizer::new_hidden_local(fn.p_function_id,
+						L"$t" + std::to_wstring(temp_count++), *p_types[sc]);
+					pool[sc].push_back(p_temp);
+				}
+
+				temp_of_group[root] = p_temp;
+				groups_in[p_temp].push_back(root);
+			}
+		}
+
+		/** fold_increment   x' = x + c where x and x' share a local is a
+		 *                  single IINC/DINC on that local.
+		 *
+		 * @param p_inst    : spilled IADD/ISUB/DADD/DSUB.
+		 * @param increment : the replacement instruction.
+		 * @return true if it applies.
+		 */
+		bool lowering::fold_increment(const instruction *p_inst, inst &increment) {
+			if (p_inst->is_phi || (p_inst->operands.size() != 2) || !is_spilled(p_inst)) return false;
+
+			const instruction *p_left = p_inst->operands[0];
+			const instruction *p_right = p_inst->operands[1];
+
+			switch (p_inst->op) {
+			case IADD:
+			case ISUB:
+			case DADD:
+			case DSUB:
+				break;
+			default:
+				return false;
+			}
+
+			const bool is_real = (p_inst->op == DADD) || (p_inst->op == DSUB);
+			const opcode constant = is_real ? DCONST : ICONST;
+			const bool is_add = (p_inst->op == IADD) || (p_inst->op == DADD);
+
+			const instruction *p_base = nullptr;
+			const instruction *p_step = nullptr;
+
+			if ((p_right->op == constant) && is_constant(p_right)) {
+				p_base = p_left;
+				p_step = p_right;
+			}
+			else if (is_add && (p_left->op == constant) && is_constant(p_left)) {
+				p_base = p_right;
+				p_step = p_left;
+			}
+
+			if ((p_base == nullptr) || is_constant(p_base) || !is_spilled(p_base)) return false;
+			if (temp(p_base) != temp(p_inst)) return false;
+
+			increment.op = is_real ? DINC : IINC;
+			increment.arg0 = temp(p_inst);
+
+			if (is_real) increment.arg1 = is_add ? p_step->arg0.d_ : -p_step->arg0.d_;
+			else increment.arg1 = is_add ? p_step->arg0.i_ : static_cast<cx_int>(0 - static_cast<uint64_t>(p_step->arg0.i_));
+
+			return true;
+		}
+
+		void lowering::emit_load(const instruction *p_inst) {
+			if (is_constant(p_inst)) {
+				code.push_back({ p_inst->op, p_inst->arg0, p_inst->arg1 });
+				return;
+			}
+
+			static const opcode loads[] = { ILOAD, DLOAD, AALOAD };
+			code.push_back({ loads[storage_of(p_inst->type)], temp(p_inst) });
+		}
+
+		void lowering::emit_store(const instruction *p_inst) {
+			static const opcode stores[] = { ISTORE, DSTORE, AASTORE };
+			code.push_back({ stores[storage_of(p_inst->type)], temp(p_inst) });
+		}
+
+		void lowering::emit_operands(const instruction *p_inst) {
+			for (auto p_operand : p_inst->operands) {
+				if (stackable.count(p_operand)) emit_tree(p_operand);
+				else emit_load(p_operand);
+			}
+		}
+
+		void lowering::emit_tree(const instruction *p_inst) {
+			emit_operands(p_inst);
+			code.push_back({ p_inst->op, p_inst->arg0, p_inst->arg1 });
+		}
+
+		void lowering::emit_root(const instruction *p_inst) {
+			if (is_constant(p_inst) || stackable.count(p_inst)) return;
+
+			inst increment(NOP);
+			if (fold_increment(p_inst, increment)) {
+				code.push_back(increment);
+				return;
+			}
+
+			// Reloading a local into itself
+			if (((p_inst->op == ILOAD) || (p_inst->op == DLOAD)) && is_spilled(p_inst) &&
+				(p_inst->arg0.a_ == temp(p_inst))) return;
+
+			emit_tree(p_inst);
+
+			if (p_inst->type == T_VOID) return;
+
+			if (is_spilled(p_inst)) emit_store(p_inst);
+			else code.push_back({ POP });
+		}
+
+		/** moves            Phi copies needed on the edge p_from -> p_to,
+		 *                  leaving out the ones coalescing made free.
+		 */
+		std::vector<lowering::edge_move> lowering::moves(const basic_block *p_from, const basic_block *p_to) {
+			std::vector<edge_move> result;
+			if (p_to == nullptr) return result;
+
+			const size_t pred = std::find(p_to->preds.begin(), p_to->preds.end(), p_from) - p_to->preds.begin();
+
+			for (auto p_phi : p_to->phis) {
+				const instruction *p_source = p_phi->operands[pred];
+
+				if (is_constant(p_source) || (temp(p_source) != temp(p_phi))) {
+					result.push_back({ p_source, p_phi });
+				}
+			}
+
+			return result;
+		}
+
+		/** emit_moves       Copy phi operands into the phis' locals on
+		 *                  the edge p_from -> p_to. When a target local
+		 *                  is also a source the copies go through the
+		 *                  operand stack so they happen in parallel.
+		 */
+		void lowering::emit_moves(const basic_block *p_from, const basic_block *p_to) {
+			const std::vector<edge_move> pending = moves(p_from, p_to);
+
+			bool overlap = false;
+			for (auto &a : pending) {
+				for (auto &b : pending) {
+					if (!is_constant(a.p_source) && (&a != &b) && (temp(a.p_source) == temp(b.p_target))) overlap = true;
+				}
+			}
+
+			if (!overlap) {
+				for (auto &move : pending) {
+					emit_load(move.p_source);
+					emit_store(move.p_target);
+				}
+				return;
+			}
+
+			for (auto &move : pending) emit_load(move.p_source);
+			for (auto move = pending.rbegin(); move != pending.rend(); ++move) emit_store(move->p_target);
+		}
+
+		void lowering::emit_jump(opcode op, const basic_block *p_target) {
+			fixups.push_back({ code.size(), p_target, 0 });
+			code.push_back({ op, static_cast<cx_int>(0) });
+		}
+
+		void lowering::run(void) {
+			dead_code_elimination().run(fn);
+
+			find_users();
+			choose_stackable();
+			build_interference();
+			assign_temps();
+
+			code.clear();
+
+			const basic_block *p_exit = fn.exit_block();
+			std::map<const basic_block *, size_t> offset;
+
+			// A taken branch that needs phi copies jumps to a trampoline.
+			bool has_trampolines = false;
+			for (auto &p_block : fn.blocks) {
+				const instruction *p_term = p_block->terminator();
+				if ((p_term != nullptr) && (p_term->op == IF_FALSE) && !moves(p_block.get(), p_block->p_jump).empty()) {
+					has_trampolines = true;
+				}
+			}
+
+			for (size_t b = 0; b + 1 < fn.blocks.size(); ++b) {
+				const basic_block *p_block = fn.blocks[b].get();
+				const basic_block *p_next = fn.blocks[b + 1].get();
+				const instruction *p_term = p_block->terminator();
+
+				offset[p_block] = code.size();
+
+				for (auto p_inst : p_block->body) {
+					if (p_inst != p_term) emit_root(p_inst);
+				}
+
+				if (p_term != nullptr) {
+					emit_operands(p_term);
+
+					switch (p_term->op) {
+					case RETURN:
+						code.push_back({ RETURN });
+						continue;
+					case GOTO:
+						emit_moves(p_block, p_block->p_jump);
+						if ((p_block->p_jump != p_next) || ((p_next == p_exit) && has_trampolines)) {
+							emit_jump(GOTO, p_block->p_jump);
+						}
+						continue;
+					case IF_FALSE:
+						if (!moves(p_block, p_block->p_jump).empty()) {
+							fixups.push_back({ code.size(), nullptr, trampolines.size() });
+							trampolines.push_back({ p_block, p_block->p_jump });
+							code.push_back({ IF_FALSE, static_cast<cx_int>(0) });
+						}
+						else {
+							emit_jump(IF_FALSE, p_block->p_jump);
+						}
+						break;
+					default:
+						break;
+					}
+				}
+
+				// Fall through, or jump when the successor isn't next.
+				const basic_block *p_fall = p_block->p_fall;
+				if (p_fall == nullptr) continue;
+
+				emit_moves(p_block, p_fall);
+				if ((p_fall != p_next) || ((p_fall == p_exit) && has_trampolines)) {
+					emit_jump(GOTO, p_fall);
+				}
+			}
+
+			std::vector<size_t> trampoline_offset;
+			for (auto &edge : trampolines) {
+				trampoline_offset.push_back(code.size());
+				emit_moves(edge.p_from, edge.p_to);
+				emit_jump(GOTO, edge.p_to);
+			}
+
+			offset[p_exit] = code.size();
+
+			for (auto &patch : fixups) {
+				const size_t target = (patch.p_target != nullptr)
+					? offset.at(patch.p_target) : trampoline_offset[patch.trampoline];
+				code[patch.at].arg0 = static_cast<cx_int>(target);
+			}
+		}
+
+		void lower(function &fn, program &code) {
+			lowering(fn, code).run();
+		}
+
+		/** run              Count each block from the profile, then
+		 *                  chain blocks from the entry, always taking
+		 *                  the heavier successor not placed yet.  A
+		 *                  chain ends at a successor that never ran;
+		 *                  the next one starts at the first hot block
+		 *                  left, and the cold ones follow in their old
+		 *                  order.
+		 *
+		 * @param fn : function.
+		 * @return true if the order changed.
+		 */
+		bool block_layout::run(function &fn) {
+			const size_t block_count = fn.blocks.size();
+			if (block_count < 3) return false;
+
+			auto counter = [this](int location) -> const profile_counter * {
+				if ((location < 0) || (location >= static_cast<int>(profile_.counters.size()))) return nullptr;
+				return &profile_.counters[location];
+			};
+
+			std::map<const basic_block *, uint64_t> count;
+
+			// Runs of the edge p_block -> p_succ.
+			auto edge = [&](const basic_block *p_block, const basic_block *p_succ) -> uint64_t {
+				const instruction *p_term = p_block->terminator();
+				const profile_counter *p_counter = counter(p_block->last_location);
+
+				if ((p_term != nullptr) && (p_counter != nullptr)) {
+					if (p_term->op == IF_FALSE) {
+						return (p_succ == p_block->p_jump) ? p_counter->taken : p_counter->count - p_counter->taken;
+					}
+					if (p_term->op == GOTO) return p_counter->count;
+				}
+
+				return count[p_block];
+			};
+
+			// A block ending in a counted jump knows its count, the others add up their edges in.
+			for (size_t round = 0; round < block_count; ++round) {
+				bool changed = false;
+
+				for (auto &p_block : fn.blocks) {
+					const instruction *p_term = p_block->terminator();
+					const profile_counter *p_counter = counter(p_block->last_location);
+					uint64_t runs = 0;
+
+					if ((p_term != nullptr) && (p_counter != nullptr) &&
+						((p_term->op == IF_FALSE) || (p_term->op == GOTO))) {
+						runs = p_counter->count;
+					}
+					else if (p_block == fn.blocks.front()) {
+						runs = profile_.entries;
+					}
+					else {
+						for (auto p_pred : p_block->preds) runs += edge(p_pred, p_block.get());
+					}
+
+					if (count[p_block.get()] != runs) {
+						count[p_block.get()] = runs;
+						changed = true;
+					}
+				}
+
+				if (!changed) break;
+			}
+
+			const basic_block *p_exit = fn.exit_block();
+			std::set<const basic_block *> placed = { p_exit };
+			std::vector<basic_block *> layout;
+
+			auto first_left = [&](bool hot) -> basic_block * {
+				for (auto &p_block : fn.blocks) {
+					if (!placed.count(p_block.get()) && ((count[p_block.get()] > 0) == hot)) return p_block.get();
+				}
+				return nullptr;
+			};
+
+			basic_block *p_block = fn.blocks.front().get();
+			while (p_block != nullptr) {
+				placed.insert(p_block);
+				layout.push_back(p_block);
+
+				basic_block *p_next = nullptr;
+				uint64_t heaviest = 0;
+
+				basic_block *succs[] = { p_block->p_fall, p_block->p_jump };
+				for (auto p_succ : succs) {
+					if ((p_succ == nullptr) || placed.count(p_succ)) continue;
+
+					const uint64_t runs = edge(p_block, p_succ);
+					if ((p_next == nullptr) || (runs > heaviest)) {
+						p_next = p_succ;
+						heaviest = runs;
+					}
+				}
+
+				if ((p_next != nullptr) && (heaviest == 0) && (count[p_block] > 0)) p_next = nullptr;
+				if (p_next == nullptr) p_next = first_left(true);
+				if (p_next == nullptr) p_next = first_left(false);
+
+				p_block = p_next;
+			}
+
+			bool same = true;
+			for (size_t b = 0; b < layout.size(); ++b) {
+				if (layout[b] != fn.blocks[b].get()) same = false;
+			}
+			if (same) return false;
+
+			std::map<const basic_block *, size_t> index;
+			for (size_t b = 0; b < block_count; ++b) index[fn.blocks[b].get()] = b;
+
+			std::vector<std::unique_ptr<basic_block>> blocks;
+			for (auto p_placed : layout) blocks.push_back(std::move(fn.blocks[index[p_placed]]));
+			blocks.push_back(std::move(fn.blocks.back()));
+
+			fn.blocks.swap(blocks);
+			return true;
+		}
+
+		/** run              Optimize one function through SSA. Hidden
+		 *                  locals made by a lowering that is thrown
+		 *                  away are removed again.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 * @return true if the function's code was replaced.
+		 */
+		bool pass_manager::run(symbol_table_node *p_function_id) {
+			function fn(p_function_id);
+			if (!build(fn)) return false;
+
+			bool may_grow = false;
+			for (auto &p_pass : passes_) {
+				const auto start = std::chrono::steady_clock::now();
+				if (p_pass->run(fn) && p_pass->trades_size()) may_grow = true;
+				optimizer::record_pass_time(p_pass->name(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+				// SSA passes dump the SSA form, not bytecode
+				if (optimizer::print_after(p_pass->name())) {
+					std::wostringstream dump;
+					fn.print(dump);
+					optimizer::write_dump(p_pass->name(), dump.str());
+				}
+			}
+
+			auto &routine = p_function_id->defined.routine;
+			const size_t local_count = routine.p_variable_ids.size();
+			program lowered;
+
+			lower(fn, lowered);
+
+			if (!may_grow && (lowered.size() > routine.program_code.size())) {
+				routine.p_variable_ids.erase(routine.p_variable_ids.begin() + local_count, routine.p_variable_ids.end());
+				return false;
+			}
+
+			routine.program_code.swap(lowered);
+			return true;
+		}
+
+		/** optimize         Default SSA pipeline, run on every function
+		 *                  once its body has been parsed, from -O1 up.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 */
+		void optimize(symbol_table_node *p_function_id) {
+			if (p_function_id->defined.defined_how != DC_FUNCTION) return;
+
+			pass_manager passes;
+			passes.add(new constant_folding);
+			passes.add(new dead_code_elimination);
+			passes.run(p_function_id);
+		}
+
+		/** pass_names       Names of the SSA passes, whether the default
+		 *                  pipeline or -profile-in runs them.
+		 *
+		 * @return names, in the order they run.
+		 */
+		std::vector<const char *> pass_names(void) {
+			const code_profile no_profile;
+
+			return { constant_folding().name(), dead_code_elimination().name(), block_layout(no_profile).name() };
+		}
+	}
+}
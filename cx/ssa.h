@@ -0,0 +1,179 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SSA_H
+#define SSA_H
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "cxvm.h"
+#include "profile.h"
+#include "symtab.h"
+
+namespace cx {
+	namespace ssa {
+
+		struct basic_block;
+
+		/** instruction     One SSA value. Body instructions keep the
+		 *                  opcode and arguments of the bytecode they
+		 *                  came from, with their stack operands turned
+		 *                  into explicit operands (bottom of the stack
+		 *                  first). Phis sit at the top of a block and
+		 *                  have one operand per predecessor.
+		 */
+		struct instruction {
+			int id;
+			bool is_phi;
+			opcode op;
+			value arg0;
+			value arg1;
+			type_code type;		// T_VOID when nothing is pushed
+			std::vector<instruction *> operands;
+			basic_block *p_block;
+			symbol_table_node *p_variable;	// local this value is a version of
+
+			instruction(int id_, opcode op_, type_code type_)
+				: id(id_), is_phi(false), op(op_), type(type_),
+				p_block(nullptr), p_variable(nullptr) {}
+		};
+
+		/** basic_block     Straight line run of instructions. The last
+		 *                  body instruction is the terminator (GOTO,
+		 *                  IF_FALSE or RETURN) when there is one.
+		 */
+		struct basic_block {
+			int id;
+			std::vector<instruction *> phis;
+			std::vector<instruction *> body;
+			basic_block *p_fall;	// successor when falling through
+			basic_block *p_jump;	// successor of GOTO or a taken IF_FALSE
+			std::vector<basic_block *> preds;
+			int last_location;		// its last instruction in the code built from, -1 for the exit
+
+			explicit basic_block(int id_) : id(id_), p_fall(nullptr), p_jump(nullptr), last_location(-1) {}
+
+			instruction *terminator(void) const;
+		};
+
+		/** function        SSA form of one routine. Scalar locals that
+		 *                  are only read and written by ILOAD/ISTORE/IINC
+		 *                  (or the D forms) are held in SSA values;
+		 *                  everything else stays a memory operation.
+		 */
+		class function {
+		public:
+			symbol_table_node *p_function_id;
+			std::vector<std::unique_ptr<basic_block>> blocks;	// layout order, entry first, exit last
+			std::vector<std::unique_ptr<instruction>> values;	// owns every instruction
+			std::vector<symbol_table_node *> promoted;			// locals held in SSA values
+
+			explicit function(symbol_table_node *p_function_id_) : p_function_id(p_function_id_) {}
+
+			instruction *create(opcode op, type_code type, value arg0 = value(), value arg1 = value());
+			basic_block *exit_block(void) const { return blocks.back().get(); }
+
+			// Point every use of p_old at p_new.
+			void replace_all_uses(instruction *p_old, instruction *p_new);
+			// Number of operand slots (body and phi) referring to each value.
+			std::map<const instruction *, int> use_counts(void) const;
+			// Text form, one instruction per line.
+			void print(std::wostream &out) const;
+		};
+
+		// True if removing an unused instance could change behavior.
+		bool has_side_effects(opcode op);
+		// Type pushed by an opcode.
+		type_code result_type(const inst &instruction);
+
+		// Build SSA from the function's program_code, false if the code is not supported.
+		bool build(function &fn);
+		// Write the function back out as stack bytecode.
+		void lower(function &fn, program &code);
+
+		/** pass            An SSA transformation. run returns true when
+		 *                  it changed the function. A pass that trades
+		 *                  size for speed may leave the code longer.
+		 */
+		class pass {
+		public:
+			virtual ~pass() {}
+			virtual const char *name(void) const = 0;
+			virtual bool run(function &fn) = 0;
+			virtual bool trades_size(void) const { return false; }
+		};
+
+		class constant_folding : public pass {
+		public:
+			const char *name(void) const { return "constant-folding"; }
+			bool run(function &fn);
+		};
+
+		class dead_code_elimination : public pass {
+		public:
+			const char *name(void) const { return "dce"; }
+			bool run(function &fn);
+		};
+
+		/** block_layout    Orders the blocks by the counts of a profiled
+		 *                  run: each block is followed by its likeliest
+		 *                  successor, and blocks that never ran go last.
+		 */
+		class block_layout : public pass {
+		public:
+			explicit block_layout(const code_profile &profile) : profile_(profile) {}
+			const char *name(void) const { return "block-layout"; }
+			bool run(function &fn);
+			bool trades_size(void) const { return true; }
+
+		private:
+			const code_profile &profile_;
+		};
+
+		/** pass_manager    Builds the SSA form of a function, runs the
+		 *                  registered passes in order and lowers the
+		 *                  result. The new code only replaces the old
+		 *                  one when it is not longer, unless a pass
+		 *                  that trades size changed it.  Each pass is
+		 *                  timed for -time-passes and can be dumped
+		 *                  with -print-after.
+		 */
+		class pass_manager {
+		private:
+			std::vector<std::unique_ptr<pass>> passes_;
+		public:
+			void add(pass *p_pass) { passes_.emplace_back(p_pass); }
+			bool run(symbol_table_node *p_function_id);
+		};
+
+		// Default pipeline for a finished function.
+		void optimize(symbol_table_node *p_function_id);
+		// Names of the SSA passes, which -print-after also takes.
+		std::vector<const char *> pass_names(void);
+	}
+}
+
+#endif
@@ -38,23 +38,23 @@ namespace cx {
 		symtab_stack.enter_scope();
 		get_token();
 
-		int do_start = current_location(p_function_id);//put_location_marker(p_function_id);
+		label do_start;
+		label do_end;
+		place_label(p_function_id, do_start);
 
+		break_labels.push_back(&do_end);
 		parse_statement(p_function_id);
+		break_labels.pop_back();
 
 		conditional_get_token(TC_WHILE, ERR_MISSING_WHILE);
 		conditional_get_token(TC_LEFT_PAREN, ERR_MISSING_LEFT_PAREN);
 		check_boolean(parse_expression(p_function_id), nullptr);
 		conditional_get_token(TC_RIGHT_PAREN, ERR_MISSING_RIGHT_PAREN);
 
-		this->emit(p_function_id, opcode::IF_FALSE, 0); // Push 0 for now, come back and fix location jump.
-		int break_marker = put_location_marker(p_function_id);
-
-		this->emit(p_function_id, opcode::GOTO, { do_start });
+		emit_jump(p_function_id, opcode::IF_FALSE, do_end);
+		emit_jump(p_function_id, opcode::GOTO, do_start);
 		this->emit(p_function_id, opcode::NOP);
-
-		fixup_location_marker(p_function_id, break_marker);
-		set_break_jump(p_function_id, do_start);
+		place_label(p_function_id, do_end);
 
 		symtab_stack.exit_scope();
 	}
@@ -71,21 +71,23 @@ namespace cx {
 		symtab_stack.enter_scope();
 		get_token();
 
-		int while_start = current_location(p_function_id);
+		label while_start;
+		label while_end;
+		place_label(p_function_id, while_start);
 
 		conditional_get_token(TC_LEFT_PAREN, ERR_MISSING_LEFT_PAREN);
 		check_boolean(parse_expression(p_function_id), nullptr);
 		conditional_get_token(TC_RIGHT_PAREN, ERR_MISSING_RIGHT_PAREN);
 
-		this->emit(p_function_id, opcode::IF_FALSE, 0); // Push 0 for now, come back and fix location jump.
-		int break_marker = put_location_marker(p_function_id);
+		emit_jump(p_function_id, opcode::IF_FALSE, while_end);
 
+		break_labels.push_back(&while_end);
 		parse_statement(p_function_id);
+		break_labels.pop_back();
 
-		this->emit(p_function_id, opcode::GOTO, { while_start });
+		emit_jump(p_function_id, opcode::GOTO, while_start);
 		this->emit(p_function_id, opcode::NOP);
-		fixup_location_marker(p_function_id, break_marker);
-		set_break_jump(p_function_id, while_start);
+		place_label(p_function_id, while_end);
 		symtab_stack.exit_scope();
 	}
 
@@ -109,34 +111,36 @@ namespace cx {
 		check_boolean(parse_expression(p_function_id), nullptr);
 		conditional_get_token(TC_RIGHT_PAREN, ERR_MISSING_RIGHT_PAREN);
 
-		// Append a placeholder location marker for where to go to if
-		// <expr> is false.  Remember the location of this placeholder
-		// so it can be fixed up below.
-		this->emit(p_function_id, opcode::IF_FALSE, 0); // Push 0 for now, come back and fix location jump.
-		int at_false_location_marker = put_location_marker(p_function_id);
+		// Where to go to if <expr> is false, placed once the
+		// statement has been parsed.
+		label if_false;
+		emit_jump(p_function_id, opcode::IF_FALSE, if_false);
 
 		parse_statement(p_function_id);
 
-
-		int if_end = current_location(p_function_id);
-		this->emit(p_function_id, opcode::NOP);
-		fixup_location_marker(p_function_id, at_false_location_marker);
-
 		if (token == TC_SEMICOLON) get_token();
 		symtab_stack.exit_scope();
 		if (token == TC_ELSE) {
+			// The true branch skips over the else statement.
+			label if_end;
+			emit_jump(p_function_id, opcode::GOTO, if_end);
+			place_label(p_function_id, if_false);
+			this->emit(p_function_id, opcode::NOP);
+
 			// Enter new scoped block
 			symtab_stack.enter_scope();
 			get_token();
 			parse_statement(p_function_id);
 
+			place_label(p_function_id, if_end);
 			this->emit(p_function_id, opcode::NOP);
-			p_function_id->defined.routine.program_code.insert(
-				p_function_id->defined.routine.program_code.begin() + if_end,
-				{ opcode::GOTO, current_location(p_function_id) });
 
 			symtab_stack.exit_scope();
 		}
+		else {
+			this->emit(p_function_id, opcode::NOP);
+			place_label(p_function_id, if_false);
+		}
 	}
 
 	/** parse_FOR            parse for statements.
@@ -159,15 +163,15 @@ namespace cx {
 
 		conditional_get_token(TC_SEMICOLON, ERR_MISSING_SEMICOLON);
 
-		int for_start = current_location(p_function_id);
-		int break_marker = 0;
+		label for_start;
+		label for_end;
+		place_label(p_function_id, for_start);
 
 		if (token != TC_SEMICOLON) {
 			// Condition
 			check_boolean(parse_expression(p_function_id), nullptr);
 			// IF_FALSE emit GOTO end of loop
-			this->emit(p_function_id, opcode::IF_FALSE, 0); // Push 0 for now, come back and fix location jump.
-			break_marker = put_location_marker(p_function_id);
+			emit_jump(p_function_id, opcode::IF_FALSE, for_end);
 		}
 
 		conditional_get_token(TC_SEMICOLON, ERR_MISSING_SEMICOLON);
@@ -178,12 +182,14 @@ namespace cx {
 		}
 
 		conditional_get_token(TC_RIGHT_PAREN, ERR_MISSING_RIGHT_PAREN);
+
+		break_labels.push_back(&for_end);
 		parse_statement(p_function_id);
-		this->emit(p_function_id, opcode::GOTO, for_start);
-		this->emit(p_function_id, opcode::NOP);
+		break_labels.pop_back();
 
-		fixup_location_marker(p_function_id, break_marker);
-		set_break_jump(p_function_id, for_start);
+		emit_jump(p_function_id, opcode::GOTO, for_start);
+		this->emit(p_function_id, opcode::NOP);
+		place_label(p_function_id, for_end);
 		symtab_stack.exit_scope();
 	}
 
@@ -214,4 +220,23 @@ namespace cx {
 		this->emit_store(p_function_id, p_function_id);
 		this->emit(p_function_id, RETURN);
 	}
-}
\ No newline at end of file
+
+	/** parse_BREAK          parse break statements.
+	*
+	*      break;
+	*
+	* Jumps past the end of the innermost enclosing loop.
+	*
+	* @param p_function_id : ptr to this statements function Id.
+	*/
+	void parser::parse_BREAK(symbol_table_node_ptr &p_function_id) {
+		get_token();
+
+		if (break_labels.empty()) {
+			cx_error(ERR_INVALID_STATEMENT);
+			return;
+		}
+
+		emit_jump(p_function_id, opcode::GOTO, *break_labels.back());
+	}
+}
@@ -22,6 +22,8 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <cstdint>
 #include <utility>
 #include <memory>
 #include "error.h"
@@ -30,7 +32,6 @@ THE SOFTWARE.
 
 namespace cx{
 	namespace scoping {
-		int current_nesting_level = 0;
 		const int MAX_NESTING_LEVEL = 512;
 	}
 
@@ -47,6 +48,97 @@ namespace cx{
 		return std::make_shared<symbol_table>();
 	}
 
+	/** find_slot   Probe for the slot holding name, or the empty
+	 *              slot where it would go. Atoms are small dense
+	 *              integers, so they are spread with a Fibonacci hash.
+	 *
+	 * @param name : atom of the symbol name.
+	 * @return slot index, -1 if the index is empty.
+	 */
+	int symbol_map::find_slot(atom_id name) const {
+		if (slots.empty()) return -1;
+
+		const size_t mask = slots.size() - 1;
+
+		for (size_t i = (name * 2654435761u) & mask;; i = (i + 1) & mask) {
+			const int entry = slots[i];
+
+			if ((entry < 0) || (entries[entry].first == name)) {
+				return static_cast<int>(i);
+			}
+		}
+	}
+
+	/** grow        Double the index and reinsert the first entry of
+	 *              every name. Chains are unaffected.
+	 */
+	void symbol_map::grow(void) {
+		std::vector<int> old_slots;
+		old_slots.swap(slots);
+		slots.assign(old_slots.empty() ? 16 : old_slots.size() * 2, -1);
+
+		const size_t mask = slots.size() - 1;
+
+		for (int entry : old_slots) {
+			if (entry < 0) continue;
+
+			size_t i = (entries[entry].first * 2654435761u) & mask;
+			while (slots[i] >= 0) i = (i + 1) & mask;
+			slots[i] = entry;
+		}
+	}
+
+	/** find        First entry entered with a name.
+	 *
+	 * @param name : atom of the symbol name.
+	 * @return iterator to the entry, end() if there is none.
+	 */
+	symbol_map::iterator symbol_map::find(atom_id name) {
+		const int slot = find_slot(name);
+
+		if ((slot < 0) || (slots[slot] < 0)) return entries.end();
+
+		return entries.begin() + slots[slot];
+	}
+
+	/** equal_range All entries with a name, in the order they were
+	 *              entered.
+	 *
+	 * @param name : atom of the symbol name.
+	 * @return [first, last) over the name's chain.
+	 */
+	symbol_map::range symbol_map::equal_range(atom_id name) {
+		const int slot = find_slot(name);
+		const int first = ((slot < 0) ? -1 : slots[slot]);
+
+		return std::make_pair(chain_iterator(this, first), chain_iterator(this, -1));
+	}
+
+	/** insert      Add an entry. A name already present gets the
+	 *              entry appended to its chain.
+	 *
+	 * @param entry : name and node.
+	 */
+	void symbol_map::insert(const value_type &entry) {
+		// Keep the index at most half full.
+		if ((entries.size() + 1) * 2 > slots.size()) grow();
+
+		const int index = static_cast<int>(entries.size());
+		const int slot = find_slot(entry.first);
+
+		entries.push_back(entry);
+		next.push_back(-1);
+
+		if (slots[slot] < 0) {
+			slots[slot] = index;
+			return;
+		}
+
+		int last = slots[slot];
+		while (next[last] >= 0) last = next[last];
+		next[last] = index;
+	}
+
 	/** Destructor      Delete the local symbol table and icode of a
 	 *                  program, procedure or function definition.
 	 *                  Note that the parameter and local identifier
@@ -63,9 +155,8 @@ namespace cx{
 	 * @param p_str : ptr to the symbol string.
 	 * @param dc    : definition code.
 	 */
-	symbol_table_node::symbol_table_node(std::wstring name, define_code dc)
-		: node_name(name) {
-		this->level = scoping::current_nesting_level;
+	symbol_table_node::symbol_table_node(atom_id name_, define_code dc)
+		: name(name_), node_name(cx_atoms.name(name_)) {
 		this->defined.defined_how = dc;
 		this->runstack_item = nullptr;
 	}
@@ -77,22 +168,30 @@ namespace cx{
 	 */
 	symbol_table_node::~symbol_table_node(void) {}
 
+	/** add_dependency  Note a constant whose value a function's code
+	 *                  holds, or a callee copied into it, so -serve
+	 *                  can tell when the code went stale.
+	 *
+	 * @param p_function_id : function whose code it went into.
+	 * @param p_node        : the constant or callee.
+	 */
+	void add_dependency(symbol_table_node *p_function_id, const symbol_table_node *p_node) {
+		auto &ids = p_function_id->defined.routine.p_dependency_ids;
+		if (std::find(ids.begin(), ids.end(), p_node) == ids.end()) ids.push_back(p_node);
+	}
+
 	/** search      search the symbol table for the node with a
 	 *              given name string.
 	 *
-	 * @param p_string : ptr to the name string to search for.
+	 * @param name : atom of the name to search for.
 	 * @return ptr to the node if found, else nullptr.
 	 */
 	//symbol_table_node_ptr return_null;
-	symbol_table_node_ptr symbol_table::search(std::wstring name) {
-		for (auto &node : this->symbols){
-			if (node.first == name) return node.second;
-		}
-
-		//auto p_node = this->symbols.find(name);
-		//if (p_node == this->symbols.end()) return nullptr;
+	symbol_table_node_ptr symbol_table::search(atom_id name) {
+		auto p_node = this->symbols.find(name);
+		if (p_node == this->symbols.end()) return nullptr;
 
-		return nullptr;
+		return p_node->second;
 	}
 
 	/** enter       search the symbol table for the node with a
@@ -101,15 +200,16 @@ namespace cx{
 	 *              node with the name string, and return a pointer
 	 *              to the new node.
 	 *
-	 * @param p_string : ptr to the name string to enter.
+	 * @param name : atom of the name to enter.
 	 * @param dc      : definition code.
 	 * @return ptr to the node, whether existing or newly-entered.
 	 */
-	symbol_table_node_ptr symbol_table::enter(std::wstring name, define_code dc) {
+	symbol_table_node_ptr symbol_table::enter(atom_id name, define_code dc) {
 		auto p_node = symbols.find(name);
 
 		if (p_node == symbols.end()) {
-			return (symbols.insert(std::make_pair(name, std::make_shared<symbol_table_node>(name, dc))))->second;
+			symbols.insert(std::make_pair(name, std::make_shared<symbol_table_node>(name, dc)));
+			return symbols.find(name)->second;
 		}
 
 		return p_node->second; // return a ptr to it
@@ -120,11 +220,11 @@ namespace cx{
 	 *              enter it.  Otherwise, flag the redefined
 	 *              identifier error.
 	 *
-	 * @param p_string : ptr to name string to enter.
+	 * @param name : atom of the name to enter.
 	 * @param dc      : definition code.
 	 * @return ptr to symbol table node.
 	 */
-	symbol_table_node_ptr symbol_table::enter_new(std::wstring name, define_code dc) {
+	symbol_table_node_ptr symbol_table::enter_new(atom_id name, define_code dc) {
 		auto p_node = symbols.find(name);
 
 		if (p_node == symbols.end()) return enter(name, dc);
@@ -134,7 +234,7 @@ namespace cx{
 	}
 
 	void symbol_table::enter_new(symbol_table_node_ptr &p_new_id) {
-		auto p_node = symbols.find(p_new_id->node_name);
+		auto p_node = symbols.find(p_new_id->name);
 
 		if (p_node == symbols.end()) enter(p_new_id);
 		else cx_error(ERR_REDEFINED_IDENTIFIER);
@@ -144,7 +244,7 @@ namespace cx{
 		enter(p_new_id);
 	}
 
-	std::pair<local::iterator, local::iterator> symbol_table::find_functions(std::wstring name) {
+	local::range symbol_table::find_functions(atom_id name) {
 		return symbols.equal_range(name);
 	}
 
@@ -153,7 +253,7 @@ namespace cx{
 	}
 
 	void symbol_table::enter(symbol_table_node_ptr &p_new_id) {
-		this->symbols.insert(std::make_pair(p_new_id->node_name, p_new_id));
+		this->symbols.insert(std::make_pair(p_new_id->name, p_new_id));
 	}
 
 	void symbol_table::enter(local &params){
@@ -164,21 +264,23 @@ namespace cx{
 	/** Constructor	    Initialize the global (level 0) symbol
 	 *		    table, and set the others to nullptr.
 	 *
+	 * @param p_global_symtab : the program's global table, or a
+	 *                          module's own.
 	 */
-	symbol_table_stack::symbol_table_stack(void) {
+	symbol_table_stack::symbol_table_stack(symbol_table_ptr &p_global_symtab)
+		: current_nesting_level(0) {
 
 		void initialize_std_functions(symbol_table *p_symtab);
 
-		scoping::current_nesting_level = 0;
 		//for (int i = 1; i < MAX_NESTING_LEVEL; ++i) p_symtabs[i] = nullptr;
 
 		// Initialize the global nesting level.
-		p_symtabs[0] = p_global_symbol_table.get();//emplace_back(p_global_symbol_table);
+		p_symtabs[0] = p_global_symtab.get();//emplace_back(p_global_symbol_table);
 
 //		if (p_main_function_id == nullptr) {
 
 			// TODO: initialize_builtin_types move this to another file.
-			initialize_builtin_types(p_global_symbol_table);
+			initialize_builtin_types(p_global_symtab);
 	//	}
 	}
 
@@ -190,14 +292,14 @@ namespace cx{
 	/** search_all   search the symbol table stack for the given
 	 *              name string.
 	 *
-	 * @param p_string : ptr to name string to find.
+	 * @param name : atom of the name to find.
 	 * @return ptr to symbol table node if found, else nullptr.
 	 */
-	symbol_table_node_ptr symbol_table_stack::search_all(std::wstring name) {
+	symbol_table_node_ptr symbol_table_stack::search_all(atom_id name) {
 		
 		symbol_table_node_ptr p_node;
 
-		for (int i = scoping::current_nesting_level; i >= 0; --i) {
+		for (int i = current_nesting_level; i >= 0; --i) {
 			p_node = p_symtabs[i]->search(name);
 			if (p_node != nullptr) return p_node;
 		}
@@ -211,10 +313,10 @@ namespace cx{
 	 *		and then enter the name into the local symbol
 	 *		table.
 	 *
-	 * @param p_string : ptr to name string to find.
+	 * @param name : atom of the name to find.
 	 * @return ptr to symbol table node.
 	 */
-	symbol_table_node_ptr symbol_table_stack::find(std::wstring name) {
+	symbol_table_node_ptr symbol_table_stack::find(atom_id name) {
 
 		symbol_table_node_ptr p_node = search_all(name);
 
@@ -232,7 +334,7 @@ namespace cx{
 	 */
 	void symbol_table_stack::enter_scope(void) {
 
-		if (++scoping::current_nesting_level >= scoping::MAX_NESTING_LEVEL) {
+		if (++current_nesting_level >= scoping::MAX_NESTING_LEVEL) {
 			cx_error(ERR_NESTING_TOO_DEEP);
 			abort_translation(ABORT_NESTING_TOO_DEEP);
 		}
@@ -249,6 +351,6 @@ namespace cx{
 	 * @return ptr to closed scope's symbol table.
 	 */
 	symbol_table_ptr symbol_table_stack::exit_scope(void) {
-		return std::make_shared<symbol_table>(*p_symtabs[scoping::current_nesting_level--]);
+		return std::make_shared<symbol_table>(*p_symtabs[current_nesting_level--]);
 	}
 }
@@ -30,21 +30,74 @@ THE SOFTWARE.
 #include <string>
 #include <memory>
 #include <vector>
+#include "atom.h"
 #include "token.h"
 #include "types.h"
 #include "cxvm.h"
 
 namespace cx{
 	namespace scoping {
-		extern int current_nesting_level;
 		extern const int MAX_NESTING_LEVEL;
 	}
 
 	class symbol_table_node;
 	class symbol_table;
 
-	//typedef std::map<std::wstring, std::shared_ptr<symbol_table_node>> local;
-	typedef std::multimap<std::wstring, std::shared_ptr<symbol_table_node>> local;
+	/** symbol_map      Open addressing hash table of named symbols,
+	 *                  keyed by the atom of the name.
+	 *
+	 *                  Entries are kept in insertion order. Each slot
+	 *                  of the (power of two sized, linearly probed)
+	 *                  index holds the first entry with a given name;
+	 *                  later entries with the same name, such as
+	 *                  function overloads, are chained behind it.
+	 */
+	class symbol_map {
+	public:
+		typedef std::pair<atom_id, std::shared_ptr<symbol_table_node>> value_type;
+		typedef std::vector<value_type>::iterator iterator;
+
+		// Walks the chain of entries sharing one name.
+		class chain_iterator {
+			symbol_map *p_map;
+			int entry;
+		public:
+			chain_iterator(symbol_map *p_map_, int entry_) : p_map(p_map_), entry(entry_) {}
+
+			value_type &operator*(void) const { return p_map->entries[entry]; }
+			value_type *operator->(void) const { return &p_map->entries[entry]; }
+			chain_iterator &operator++(void) { entry = p_map->next[entry]; return *this; }
+			bool operator==(const chain_iterator &other) const { return entry == other.entry; }
+			bool operator!=(const chain_iterator &other) const { return entry != other.entry; }
+		};
+
+		typedef std::pair<chain_iterator, chain_iterator> range;
+
+		symbol_map() {}
+
+		iterator begin(void) { return entries.begin(); }
+		iterator end(void) { return entries.end(); }
+		size_t size(void) const { return entries.size(); }
+
+		iterator find(atom_id name);
+		range equal_range(atom_id name);
+		void insert(const value_type &entry);
+
+		template <typename input_iterator>
+		void insert(input_iterator first, input_iterator last) {
+			for (; first != last; ++first) insert(*first);
+		}
+
+	private:
+		std::vector<value_type> entries;
+		std::vector<int> next;		// next entry with the same name, -1 at the end
+		std::vector<int> slots;		// first entry per name, -1 if empty
+
+		int find_slot(atom_id name) const;
+		void grow(void);
+	};
+
+	typedef symbol_map local;
 	typedef std::shared_ptr<symbol_table> symbol_table_ptr;
 	typedef std::shared_ptr<symbol_table_node> symbol_table_node_ptr;
 
@@ -80,10 +133,10 @@ namespace cx{
 		//void enter(symbol_table_node *p_node);
 		void enter(symbol_table_node_ptr &p_new_id);
 		void enter(local &params);
-		symbol_table_node_ptr search(std::wstring);
-		symbol_table_node_ptr enter(std::wstring, define_code dc = DC_UNDEFINED);
-		symbol_table_node_ptr enter_new(std::wstring, define_code dc = DC_UNDEFINED);
-		std::pair<local::iterator, local::iterator> find_functions(std::wstring name);
+		symbol_table_node_ptr search(atom_id name);
+		symbol_table_node_ptr enter(atom_id name, define_code dc = DC_UNDEFINED);
+		symbol_table_node_ptr enter_new(atom_id name, define_code dc = DC_UNDEFINED);
+		local::range find_functions(atom_id name);
 		void enter_new(symbol_table_node_ptr &p_new_id);
 		void enter_new_function(symbol_table_node_ptr &p_new_id);
 
@@ -93,6 +146,17 @@ namespace cx{
 	union value;
 	class cxvm;
 	struct inst;
+	struct lazy_body;
+	struct native_code;
+	struct tiered_code;
+	struct trace_cache;
+	struct code_profile;
+	struct kernel_cache;
+
+	// Parse and emit a function body left for its first call.
+	void compile_function_body(symbol_table_node *p_function_id);
+	// Note a node whose value or code went into a function's code.
+	void add_dependency(symbol_table_node *p_function_id, const symbol_table_node *p_node);
 
 	// Program instructions
 	typedef std::vector<inst> program;
@@ -126,6 +190,7 @@ namespace cx{
 		struct {
 			function_code function_type;
 			int return_marker; // used for globals return location
+			std::wstring qualified_name; // <file>:<enclosing>.<name>(<parameter types>)
 
 			struct {
 				int loop_start; // icode positions
@@ -142,9 +207,25 @@ namespace cx{
 			std::vector<std::shared_ptr<symbol_table_node>> p_type_ids;
 			std::vector<std::shared_ptr<symbol_table_node>> p_function_ids;
 			std::vector<std::shared_ptr<symbol_table_node>> p_constant_ids;
+			std::vector<const symbol_table_node *> p_dependency_ids; // constants folded into the code, callees inlined into it
 
 			symbol_table_ptr p_symtab;
 			program program_code;
+			std::shared_ptr<lazy_body> p_lazy_body; // body not compiled yet
+			mutable std::shared_ptr<native_code> p_native_code; // -jit translation, once tried
+
+			// -tier hotness and the optimized code built once it's hot
+			unsigned call_count = 0;
+			unsigned loop_count = 0;	// back edges taken
+			unsigned active_calls = 0;	// activations running program_code
+			uint8_t tier = 0;
+			std::shared_ptr<tiered_code> p_tier_code;
+
+			std::shared_ptr<trace_cache> p_trace_cache; // -trace loop heads
+			std::shared_ptr<code_profile> p_profile; // -profile-out counts, or the -profile-in ones
+			std::shared_ptr<kernel_cache> p_kernel_cache; // VLOOP kernels
+			const inst *p_verified_code = nullptr; // code the verifier last checked
+			bool trusted = false;	// it passed, so it runs without the VM's guards
 		} routine;
 
 		struct {
@@ -155,18 +236,17 @@ namespace cx{
 	class symbol_table_node {
 
 		friend class symbol_table;
-	private:
-		int level;
 	public:
 
 		type_ptr p_type;
-		std::wstring node_name;
+		atom_id name;
+		const std::wstring &node_name;	// interned text of name
 		define defined;
 
 		// pointer to runstack item
 		value *runstack_item;
 		symbol_table_node() = delete;
-		symbol_table_node(std::wstring name, define_code dc = DC_UNDEFINED);
+		symbol_table_node(atom_id name_, define_code dc = DC_UNDEFINED);
 		~symbol_table_node();
 	};
 
@@ -175,58 +255,63 @@ namespace cx{
 	class symbol_table_stack {
 
 		symbol_table *p_symtabs[512];
+		int current_nesting_level;	// of this parser, nested parsers have their own
 
 	public:
-		symbol_table_stack(void);
+		symbol_table_stack(symbol_table_ptr &p_global_symtab);
 		~symbol_table_stack(void);
 
-		std::pair<local::iterator, local::iterator> find_functions(std::wstring name) {
+		local::range find_functions(atom_id name) {
 			return p_symtabs[0]->find_functions(name);
 		}
 
-		symbol_table_node_ptr search_local(std::wstring name) {
-			return p_symtabs[scoping::current_nesting_level]->search(name);
+		symbol_table_node_ptr search_local(atom_id name) {
+			return p_symtabs[current_nesting_level]->search(name);
 		}
 
-		symbol_table_node_ptr enter_local(std::wstring name,
+		symbol_table_node_ptr enter_local(atom_id name,
 			define_code dc = DC_UNDEFINED) {
-			return p_symtabs[scoping::current_nesting_level]->enter(name, dc);
+			return p_symtabs[current_nesting_level]->enter(name, dc);
 		}
 
-		symbol_table_node_ptr enter_new_local(std::wstring name,
+		symbol_table_node_ptr enter_new_local(atom_id name,
 			define_code dc = DC_UNDEFINED) {
-			return p_symtabs[scoping::current_nesting_level]->enter_new(name, dc);
+			return p_symtabs[current_nesting_level]->enter_new(name, dc);
 		}
 
 		void enter_new_local(symbol_table_node_ptr &p_new_id) {
-			p_symtabs[scoping::current_nesting_level]->enter_new(p_new_id);
+			p_symtabs[current_nesting_level]->enter_new(p_new_id);
 		}
 
 		void enter_new_function(symbol_table_node_ptr &p_new_id) {
-			p_symtabs[scoping::current_nesting_level]->enter_new_function(p_new_id);
+			p_symtabs[current_nesting_level]->enter_new_function(p_new_id);
 		}
 
 		symbol_table *get_current_symtab(void) const {
-			return p_symtabs[scoping::current_nesting_level];
+			return p_symtabs[current_nesting_level];
 		}
 
 		void set_current_symtab(symbol_table *p_symtab) {
-			p_symtabs[scoping::current_nesting_level] = p_symtab;
+			p_symtabs[current_nesting_level] = p_symtab;
 		}
 
 		void set_scope(int scopeLevel) {
-			scoping::current_nesting_level = scopeLevel;
+			current_nesting_level = scopeLevel;
+		}
+
+		int nesting_level(void) const {
+			return current_nesting_level;
 		}
 
-		symbol_table_node_ptr search_available_scopes(std::wstring name);
-		symbol_table_node_ptr search_all(std::wstring name);
-		symbol_table_node_ptr find(std::wstring name);
+		symbol_table_node_ptr search_available_scopes(atom_id name);
+		symbol_table_node_ptr search_all(atom_id name);
+		symbol_table_node_ptr find(atom_id name);
 		void enter_scope(void);
 		symbol_table_ptr exit_scope(void);
 	};
 
 	// mains scope level on the symtab stack
-#define __MAIN_ENTRY__ symtab_stack.find(L"__main__")
+#define __MAIN_ENTRY__ symtab_stack.find(cx_atoms.intern(L"__main__"))
 }
 #endif	/* SYMTABLE_H */
 
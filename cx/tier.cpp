@@ -0,0 +1,282 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "jit.h"
+#include "optimizer.h"
+#include "tier.h"
+
+namespace cx {
+	namespace tier_settings {
+		bool tiered = false;
+		unsigned call_threshold = 1000;
+		unsigned loop_threshold = 10000;
+	}
+
+	namespace tier {
+		/** tier_job        A hot function to optimize: a copy of its
+		 *                  node, so the passes never touch what the
+		 *                  interpreter is running, and where the
+		 *                  result goes.  The copy has its own
+		 *                  parameters and locals, the interpreter
+		 *                  retypes the live ones (ASTORE, reference
+		 *                  arguments) while the passes read theirs.
+		 */
+		struct tier_job {
+			symbol_table_node_ptr p_copy;
+			std::shared_ptr<tiered_code> p_code;
+			std::map<const symbol_table_node *, symbol_table_node *> clone_of;	// live parameter/local -> its clone
+			std::map<const symbol_table_node *, symbol_table_node_ptr> live_of;	// and back
+		};
+
+		/** tier_scheduler  Queue of the tier thread.
+		 */
+		struct tier_scheduler {
+			std::mutex lock;
+			std::condition_variable queued;
+			std::condition_variable idle;
+			std::deque<tier_job> jobs;
+			bool started = false;
+			bool busy = false;
+		};
+
+		/** scheduler       The one scheduler.  Like the module
+		 *                  scheduler it is never destroyed, the tier
+		 *                  thread waits on it until the process exits.
+		 */
+		static tier_scheduler &scheduler(void) {
+			static tier_scheduler *p_scheduler = new tier_scheduler();
+			return *p_scheduler;
+		}
+
+		/** clone_slots     Give the copy clones of the parameters and
+		 *                  locals, typed as they are now.  Runs on the
+		 *                  interpreter's thread.
+		 *
+		 * @param job : job being queued.
+		 */
+		static void clone_slots(tier_job &job) {
+			auto &routine = job.p_copy->defined.routine;
+
+			for (auto *p_ids : { &routine.p_parameter_ids, &routine.p_variable_ids }) {
+				for (auto &p_id : *p_ids) {
+					symbol_table_node_ptr p_clone = std::make_shared<symbol_table_node>(p_id->name, p_id->defined.defined_how);
+					p_clone->p_type = p_id->p_type;
+
+					job.clone_of[p_id.get()] = p_clone.get();
+					job.live_of[p_clone.get()] = p_id;
+					p_id = p_clone;
+				}
+			}
+		}
+
+		/** remap_nodes     Point the node operands of code at other
+		 *                  nodes.
+		 *
+		 * @param code : code to change.
+		 * @param to   : node -> node to use instead, others are kept.
+		 */
+		template <typename node_ref>
+		static void remap_nodes(program &code, const std::map<const symbol_table_node *, node_ref> &to) {
+			for (auto &instruction : code) {
+				if (optimizer::arg0_kind(instruction.op) != optimizer::OPERAND_NODE) continue;
+
+				auto it = to.find(static_cast<const symbol_table_node *>(instruction.arg0.a_));
+				if (it != to.end()) instruction.arg0.a_ = &*it->second;
+			}
+		}
+
+		/** optimize        Run the optimizing passes over the copy,
+		 *                  and translate the result with -jit.  Code
+		 *                  the passes fail on stays unoptimized, the
+		 *                  result is left empty.  The program is only
+		 *                  ever entered once, so it gets nothing but
+		 *                  the translation for on stack replacement.
+		 *
+		 *                  The passes work on the clones; the code
+		 *                  goes back to the live nodes before it is
+		 *                  translated, since native code addresses
+		 *                  their runstack items.
+		 *
+		 * @param job : job taken off the queue.
+		 */
+		static void optimize(tier_job &job) {
+			symbol_table_node *p_copy = job.p_copy.get();
+			auto &routine = p_copy->defined.routine;
+
+			try {
+				if (vm_settings::jit_flag) job.p_code->p_osr_code = jit::translate(p_copy);
+				if (p_copy->defined.defined_how != DC_FUNCTION) return;
+
+				remap_nodes(routine.program_code, job.clone_of);
+
+				// -O3 inlining reads callees the interpreter may be changing
+				optimizer::optimize_function(p_copy, true);
+
+				remap_nodes(routine.program_code, job.live_of);
+				for (auto &p_id : routine.p_variable_ids) {
+					auto it = job.live_of.find(p_id.get());
+					if (it != job.live_of.end()) p_id = it->second;
+				}
+
+				if (vm_settings::jit_flag) job.p_code->p_native_code = jit::translate(p_copy);
+			}
+			catch (...) {
+				return;
+			}
+
+			job.p_code->program_code.swap(routine.program_code);
+			job.p_code->p_variable_ids.swap(routine.p_variable_ids);
+		}
+
+		/** tier_thread     Body of the tier thread: optimize queued
+		 *                  functions until the process exits.
+		 */
+		static void tier_thread(void) {
+			tier_scheduler &s = scheduler();
+			std::unique_lock<std::mutex> guard(s.lock);
+
+			for (;;) {
+				s.queued.wait(guard, [&s] { return !s.jobs.empty(); });
+
+				tier_job job = s.jobs.front();
+				s.jobs.pop_front();
+				s.busy = true;
+				guard.unlock();
+
+				optimize(job);
+
+				job.p_code->ready = true;
+
+				guard.lock();
+				s.busy = false;
+				s.idle.notify_all();
+			}
+		}
+
+		/** queue           Hand a hot function to the tier thread,
+		 *                  starting it the first time.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 */
+		static void queue(symbol_table_node *p_function_id) {
+			auto &routine = p_function_id->defined.routine;
+
+			tier_job job;
+			job.p_copy = std::make_shared<symbol_table_node>(p_function_id->name, p_function_id->defined.defined_how);
+			job.p_copy->p_type = p_function_id->p_type;
+			job.p_copy->defined.routine = routine;
+			job.p_code = std::make_shared<tiered_code>();
+
+			// the caches stay with the live routine
+			auto &copy = job.p_copy->defined.routine;
+			copy.p_trace_cache = nullptr;
+			copy.p_profile = nullptr;
+			copy.p_kernel_cache = nullptr;
+			copy.p_native_code = nullptr;
+			clone_slots(job);
+
+			routine.p_tier_code = job.p_code;
+			routine.tier = QUEUED;
+
+			tier_scheduler &s = scheduler();
+			std::lock_guard<std::mutex> guard(s.lock);
+
+			if (!s.started) {
+				s.started = true;
+				std::thread(tier_thread).detach();
+			}
+
+			s.jobs.push_back(job);
+			s.queued.notify_one();
+		}
+
+		/** install         Switch a function to its optimized code
+		 *                  if the tier thread is done with it.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 */
+		static void install(symbol_table_node *p_function_id) {
+			auto &routine = p_function_id->defined.routine;
+			if (!routine.p_tier_code->ready) return;
+
+			std::shared_ptr<tiered_code> p_code;
+			p_code.swap(routine.p_tier_code);
+			routine.tier = OPTIMIZED;
+
+			if (p_code->program_code.empty()) return;
+
+			routine.program_code.swap(p_code->program_code);
+			routine.p_variable_ids.swap(p_code->p_variable_ids);
+			routine.p_native_code = p_code->p_native_code;
+
+			if (vm_settings::dev_debug_flag) {
+				std::wcout << p_function_id->node_name << L" optimized after " << routine.call_count
+					<< L" calls, " << routine.loop_count << L" back edges" << std::endl;
+			}
+		}
+
+		void enter(symbol_table_node *p_function_id) {
+			auto &routine = p_function_id->defined.routine;
+
+			switch (routine.tier) {
+			case INTERPRETED:
+				if (++routine.call_count >= tier_settings::call_threshold) queue(p_function_id);
+				break;
+			case QUEUED:
+				// an activation further up is still running the old code
+				if (routine.active_calls == 0) install(p_function_id);
+				break;
+			}
+		}
+
+		const native_code *back_edge(symbol_table_node *p_function_id) {
+			auto &routine = p_function_id->defined.routine;
+
+			switch (routine.tier) {
+			case INTERPRETED:
+				if (++routine.loop_count >= tier_settings::loop_threshold) queue(p_function_id);
+				break;
+			case QUEUED:
+				if (routine.p_tier_code->ready) return routine.p_tier_code->p_osr_code.get();
+				break;
+			}
+
+			return nullptr;
+		}
+
+		void shutdown(void) {
+			tier_scheduler &s = scheduler();
+			std::unique_lock<std::mutex> guard(s.lock);
+
+			s.jobs.clear();
+			s.idle.wait(guard, [&s] { return !s.busy; });
+		}
+	}
+}
@@ -0,0 +1,90 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef TIER_H
+#define TIER_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "symtab.h"
+
+namespace cx {
+	namespace tier_settings {
+		extern bool tiered;				// -tier: optimize hot functions only
+		extern unsigned call_threshold;	// calls before a function is hot
+		extern unsigned loop_threshold;	// back edges before a function is hot
+	}
+
+	/** tiered_code     Optimized copy of a function's code, built on
+	 *                  the tier thread.  The interpreter installs it
+	 *                  on a call that finds it ready and the function
+	 *                  not running.
+	 *
+	 *                  With -jit it also holds a translation of the
+	 *                  code as it was queued, which an activation
+	 *                  still running that code enters at the head of
+	 *                  a hot loop (on stack replacement).
+	 */
+	struct tiered_code {
+		std::atomic<bool> ready{ false };
+		program program_code;
+		std::vector<symbol_table_node_ptr> p_variable_ids;
+		std::shared_ptr<native_code> p_native_code;
+		std::shared_ptr<native_code> p_osr_code;
+	};
+
+	namespace tier {
+		enum : uint8_t {
+			INTERPRETED,	// plain bytecode, counting
+			QUEUED,			// hot, being optimized
+			OPTIMIZED		// running the optimized code
+		};
+
+		// Count a call of a function, installing its optimized code if ready
+		void enter(symbol_table_node *p_function_id);
+		// Count a back edge taken in a function, the code to continue in if any
+		const native_code *back_edge(symbol_table_node *p_function_id);
+		// Drop queued work and wait for the tier thread to go idle
+		void shutdown(void);
+
+		/** active_call     Marks a function as running while it lives,
+		 *                  so its code is not replaced under it.
+		 */
+		class active_call {
+		public:
+			explicit active_call(symbol_table_node *p_function_id)
+				: p_function_id_(p_function_id) {
+				++p_function_id_->defined.routine.active_calls;
+			}
+
+			~active_call() { --p_function_id_->defined.routine.active_calls; }
+
+		private:
+			symbol_table_node *p_function_id_;
+		};
+	}
+}
+
+#endif
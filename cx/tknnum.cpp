@@ -163,7 +163,7 @@ namespace cx{
 			cx_error(ERR_REAL_OUT_OF_RANGE);
 			return;
 		}
-		if (exponent != 0) number_value *= pow(10.0L, exponent);
+		if (exponent != 0) number_value *= pow(static_cast<cx_real>(10.0), exponent);
 
 		// Check and set the numeric value.
 		if (type__ == T_INT) {
@@ -200,7 +200,7 @@ namespace cx{
 
 		/* cx_error if the first character is not a digit
 		 * and radix base is not hex */
-		if ((char_map[ch] != CC_DIGIT) && (!isxdigit(static_cast<int>(ch)))) {
+		if ((char_code_of(ch) != CC_DIGIT) && (!isxdigit(static_cast<int>(ch)))) {
 			cx_error(ec);
 			return false; // failure
 		}
@@ -218,7 +218,7 @@ namespace cx{
 
 			ch = buffer.get_char();
 
-		} while ((char_map[ch] == CC_DIGIT) || isxdigit(ch));
+		} while ((char_code_of(ch) == CC_DIGIT) || isxdigit(ch));
 
 		return true; // success
 	}
@@ -81,6 +81,9 @@ namespace cx{
 	
 		ch = buffer.get_char(); // first char after opening quote
 		
+		// room for the closing quote and terminator
+		const wchar_t *p_string_end = &string[MAX_INPUT_BUFFER_SIZE - 2];
+
 		while (ch != buffer::EOF_CHAR) {
 			if (ch == L'\"') { // look for another quote
 
@@ -94,13 +97,12 @@ namespace cx{
 			else if (ch == L'\0') ch = L' ';
 
 			if (ch == L'\\') {
-				*ps++ = get_escape_char(buffer.get_char());
-			}
-			else {
-				// Append current char to string, then get the next__ char.
-				*ps++ = ch;
+				ch = get_escape_char(buffer.get_char());
 			}
 
+			// Append current char to string, then get the next__ char.
+			if (ps < p_string_end) *ps++ = ch;
+
 			ch = buffer.get_char();
 		}
 
@@ -24,6 +24,7 @@ THE SOFTWARE.
 
 #include <utility>
 #include <cstring>
+#include <cwchar>
 #include <cstdio>
 #include "token.h"
 #include "scanner.h"
@@ -37,59 +38,155 @@ THE SOFTWARE.
 namespace cx{
 
 	///  Reserved word lists
-	std::pair<std::wstring, token_code> map_data[] = {
-		std::make_pair(L"if", TC_IF),
-		std::make_pair(L"return", TC_RETURN),
-		std::make_pair(L"continue", TC_CONTINUE),
-		std::make_pair(L"friend", TC_FRIEND),
-		std::make_pair(L"goto", TC_GOTO),
-		std::make_pair(L"try", TC_TRY),
-		std::make_pair(L"delete", TC_DELETE),
-		std::make_pair(L"typeid", TC_TYPEID),
-		std::make_pair(L"do", TC_DO),
-		std::make_pair(L"signed", TC_SIGNED),
-		std::make_pair(L"typename", TC_TYPENAME),
-		std::make_pair(L"break", TC_BREAK),
-		std::make_pair(L"sizeof", TC_SIZEOF),
-		std::make_pair(L"case", TC_CASE),
-		std::make_pair(L"static", TC_STATIC),
-		std::make_pair(L"unsigned", TC_UNSIGNED),
-		std::make_pair(L"catch", TC_CATCH),
-		std::make_pair(L"else", TC_ELSE),
-		std::make_pair(L"namespace", TC_NAMESPACE),
-		std::make_pair(L"using", TC_USING),
-		std::make_pair(L"new", TC_NEW),
-		std::make_pair(L"virtual", TC_VIRTUAL),
-		std::make_pair(L"explicit", TC_EXPLICIT),
-		std::make_pair(L"noexcept", TC_NOEXCEPT),
-		std::make_pair(L"export", TC_EXPORT),
-		std::make_pair(L"enum", TC_ENUM),
-		std::make_pair(L"switch", TC_SWITCH),
-		std::make_pair(L"extern", TC_EXTERN),
-		std::make_pair(L"operator", TC_OPERATOR),
-		std::make_pair(L"template", TC_TEMPLATE),
-		std::make_pair(L"const", TC_CONST),
-		std::make_pair(L"private", TC_PRIVATE),
-		std::make_pair(L"this", TC_THIS),
-		std::make_pair(L"while", TC_WHILE),
-		std::make_pair(L"protected", TC_PROTECTED),
-		std::make_pair(L"thread_local", TC_THREADLOCAL),
-		std::make_pair(L"for", TC_FOR),
-		std::make_pair(L"public", TC_PUBLIC),
-		std::make_pair(L"throw", TC_THROW),
-		std::make_pair(L"default", TC_DEFAULT),
-		std::make_pair(L"typedef", TC_TYPEDEF),
-		std::make_pair(L"mutable", TC_MUTABLE),
-		std::make_pair(L"include", TC_INCLUDE),
-		std::make_pair(L"warn", TC_WARN),
-		std::make_pair(L"import", TC_IMPORT),
-		std::make_pair(L"asm", TC_ASM),
-		std::make_pair(L"init", TC_INIT),
-		std::make_pair(L"dispose", TC_DISPOSE),
-		std::make_pair(L"class", TC_CLASS)
+
+	struct reserved_word {
+		const wchar_t *string;
+		size_t length;
+		token_code code;
 	};
 
-	token_map cx_reserved_words(map_data, map_data + sizeof map_data / sizeof map_data[0]);
+	/** reserved_word_hash      Perfect hash of the reserved words.
+	 *                          The multipliers were searched for so
+	 *                          that no two reserved words share a slot.
+	 *
+	 * @param string : word to hash, at least two characters long.
+	 * @param length : number of characters in the word.
+	 * @return slot in reserved_words.
+	 */
+	constexpr size_t reserved_word_hash(const wchar_t *string, size_t length) {
+		return (string[0] * 3u + string[1] * 11u + string[length - 1] * 27u + length) & 127u;
+	}
+
+	constexpr reserved_word reserved_words[128] = {
+		{ L"for", 3, TC_FOR }, // 0
+		{ nullptr, 0, TC_DUMMY }, // 1
+		{ nullptr, 0, TC_DUMMY }, // 2
+		{ nullptr, 0, TC_DUMMY }, // 3
+		{ nullptr, 0, TC_DUMMY }, // 4
+		{ nullptr, 0, TC_DUMMY }, // 5
+		{ nullptr, 0, TC_DUMMY }, // 6
+		{ nullptr, 0, TC_DUMMY }, // 7
+		{ L"try", 3, TC_TRY }, // 8
+		{ L"while", 5, TC_WHILE }, // 9
+		{ nullptr, 0, TC_DUMMY }, // 10
+		{ nullptr, 0, TC_DUMMY }, // 11
+		{ nullptr, 0, TC_DUMMY }, // 12
+		{ nullptr, 0, TC_DUMMY }, // 13
+		{ nullptr, 0, TC_DUMMY }, // 14
+		{ nullptr, 0, TC_DUMMY }, // 15
+		{ nullptr, 0, TC_DUMMY }, // 16
+		{ nullptr, 0, TC_DUMMY }, // 17
+		{ nullptr, 0, TC_DUMMY }, // 18
+		{ nullptr, 0, TC_DUMMY }, // 19
+		{ nullptr, 0, TC_DUMMY }, // 20
+		{ nullptr, 0, TC_DUMMY }, // 21
+		{ L"asm", 3, TC_ASM }, // 22
+		{ nullptr, 0, TC_DUMMY }, // 23
+		{ nullptr, 0, TC_DUMMY }, // 24
+		{ L"export", 6, TC_EXPORT }, // 25
+		{ nullptr, 0, TC_DUMMY }, // 26
+		{ L"explicit", 8, TC_EXPLICIT }, // 27
+		{ nullptr, 0, TC_DUMMY }, // 28
+		{ L"continue", 8, TC_CONTINUE }, // 29
+		{ nullptr, 0, TC_DUMMY }, // 30
+		{ nullptr, 0, TC_DUMMY }, // 31
+		{ nullptr, 0, TC_DUMMY }, // 32
+		{ L"typeid", 6, TC_TYPEID }, // 33
+		{ nullptr, 0, TC_DUMMY }, // 34
+		{ L"include", 7, TC_INCLUDE }, // 35
+		{ L"sizeof", 6, TC_SIZEOF }, // 36
+		{ L"namespace", 9, TC_NAMESPACE }, // 37
+		{ nullptr, 0, TC_DUMMY }, // 38
+		{ nullptr, 0, TC_DUMMY }, // 39
+		{ L"do", 2, TC_DO }, // 40
+		{ nullptr, 0, TC_DUMMY }, // 41
+		{ L"friend", 6, TC_FRIEND }, // 42
+		{ L"operator", 8, TC_OPERATOR }, // 43
+		{ L"import", 6, TC_IMPORT }, // 44
+		{ L"unsigned", 8, TC_UNSIGNED }, // 45
+		{ L"warn", 4, TC_WARN }, // 46
+		{ L"const", 5, TC_CONST }, // 47
+		{ L"delete", 6, TC_DELETE }, // 48
+		{ L"new", 3, TC_NEW }, // 49
+		{ L"using", 5, TC_USING }, // 50
+		{ L"goto", 4, TC_GOTO }, // 51
+		{ nullptr, 0, TC_DUMMY }, // 52
+		{ L"init", 4, TC_INIT }, // 53
+		{ nullptr, 0, TC_DUMMY }, // 54
+		{ nullptr, 0, TC_DUMMY }, // 55
+		{ nullptr, 0, TC_DUMMY }, // 56
+		{ nullptr, 0, TC_DUMMY }, // 57
+		{ nullptr, 0, TC_DUMMY }, // 58
+		{ nullptr, 0, TC_DUMMY }, // 59
+		{ nullptr, 0, TC_DUMMY }, // 60
+		{ nullptr, 0, TC_DUMMY }, // 61
+		{ L"typename", 8, TC_TYPENAME }, // 62
+		{ nullptr, 0, TC_DUMMY }, // 63
+		{ nullptr, 0, TC_DUMMY }, // 64
+		{ nullptr, 0, TC_DUMMY }, // 65
+		{ nullptr, 0, TC_DUMMY }, // 66
+		{ nullptr, 0, TC_DUMMY }, // 67
+		{ L"thread_local", 12, TC_THREADLOCAL }, // 68
+		{ nullptr, 0, TC_DUMMY }, // 69
+		{ L"default", 7, TC_DEFAULT }, // 70
+		{ nullptr, 0, TC_DUMMY }, // 71
+		{ nullptr, 0, TC_DUMMY }, // 72
+		{ nullptr, 0, TC_DUMMY }, // 73
+		{ nullptr, 0, TC_DUMMY }, // 74
+		{ L"protected", 9, TC_PROTECTED }, // 75
+		{ L"static", 6, TC_STATIC }, // 76
+		{ L"return", 6, TC_RETURN }, // 77
+		{ L"public", 6, TC_PUBLIC }, // 78
+		{ nullptr, 0, TC_DUMMY }, // 79
+		{ L"virtual", 7, TC_VIRTUAL }, // 80
+		{ L"catch", 5, TC_CATCH }, // 81
+		{ nullptr, 0, TC_DUMMY }, // 82
+		{ L"noexcept", 8, TC_NOEXCEPT }, // 83
+		{ nullptr, 0, TC_DUMMY }, // 84
+		{ nullptr, 0, TC_DUMMY }, // 85
+		{ nullptr, 0, TC_DUMMY }, // 86
+		{ nullptr, 0, TC_DUMMY }, // 87
+		{ L"typedef", 7, TC_TYPEDEF }, // 88
+		{ nullptr, 0, TC_DUMMY }, // 89
+		{ L"break", 5, TC_BREAK }, // 90
+		{ nullptr, 0, TC_DUMMY }, // 91
+		{ nullptr, 0, TC_DUMMY }, // 92
+		{ L"dispose", 7, TC_DISPOSE }, // 93
+		{ nullptr, 0, TC_DUMMY }, // 94
+		{ nullptr, 0, TC_DUMMY }, // 95
+		{ nullptr, 0, TC_DUMMY }, // 96
+		{ L"if", 2, TC_IF }, // 97
+		{ L"template", 8, TC_TEMPLATE }, // 98
+		{ nullptr, 0, TC_DUMMY }, // 99
+		{ L"private", 7, TC_PRIVATE }, // 100
+		{ nullptr, 0, TC_DUMMY }, // 101
+		{ L"throw", 5, TC_THROW }, // 102
+		{ nullptr, 0, TC_DUMMY }, // 103
+		{ nullptr, 0, TC_DUMMY }, // 104
+		{ nullptr, 0, TC_DUMMY }, // 105
+		{ nullptr, 0, TC_DUMMY }, // 106
+		{ nullptr, 0, TC_DUMMY }, // 107
+		{ L"enum", 4, TC_ENUM }, // 108
+		{ nullptr, 0, TC_DUMMY }, // 109
+		{ L"signed", 6, TC_SIGNED }, // 110
+		{ nullptr, 0, TC_DUMMY }, // 111
+		{ nullptr, 0, TC_DUMMY }, // 112
+		{ nullptr, 0, TC_DUMMY }, // 113
+		{ nullptr, 0, TC_DUMMY }, // 114
+		{ L"class", 5, TC_CLASS }, // 115
+		{ L"switch", 6, TC_SWITCH }, // 116
+		{ nullptr, 0, TC_DUMMY }, // 117
+		{ nullptr, 0, TC_DUMMY }, // 118
+		{ L"extern", 6, TC_EXTERN }, // 119
+		{ nullptr, 0, TC_DUMMY }, // 120
+		{ L"this", 4, TC_THIS }, // 121
+		{ nullptr, 0, TC_DUMMY }, // 122
+		{ nullptr, 0, TC_DUMMY }, // 123
+		{ L"mutable", 7, TC_MUTABLE }, // 124
+		{ nullptr, 0, TC_DUMMY }, // 125
+		{ L"else", 4, TC_ELSE }, // 126
+		{ L"case", 4, TC_CASE }, // 127
+	};
 
 	// tokens that start a declaration
 	const token_code tokenlist_declaration_start[] = {
@@ -279,41 +376,48 @@ namespace cx{
 	 *****************/
 
 	/** get     Extract a word token from the source and downshift
-	 *          its characters.  Check if it's a reserved word.
+	 *          its characters.  Check if it's a reserved word,
+	 *          and intern it if it's an identifier.
 	 *
 	 * @param buffer : ptr to text input buffer.
 	 */
 	void word_token::get(text_in_buffer &buffer) {
-		extern cx::char_code_map char_map;
-
 		wchar_t ch = buffer.current_char(); // char fetched from input
 		wchar_t *ps = this->string;
 
 		// get the word.
 		do {
-			*ps++ = ch;
+			if (ps < &this->string[MAX_INPUT_BUFFER_SIZE - 1]) *ps++ = ch;
 			ch = buffer.get_char();
-		} while ((char_map[ch] == CC_LETTER)
-			|| (char_map[ch] == CC_DIGIT));
+		} while ((char_code_of(ch) == CC_LETTER)
+			|| (char_code_of(ch) == CC_DIGIT));
 
 		*ps = L'\0';
 
-		check_for_reserved_word();
+		check_for_reserved_word(ps - this->string);
+
+		atom__ = (code__ == TC_IDENTIFIER) ? cx_atoms.intern(this->string, ps - this->string) : NO_ATOM;
 	}
 
 	/** check_for_reserved_word    Is the word token a reserved word?
 	 *                          If yes, set the its token code to
 	 *                          the appropriate code.  If not, set
 	 *                          the token code to tc_identifier.
+	 *
+	 * @param length : number of characters in the word.
 	 */
-	void word_token::check_for_reserved_word(void) {
+	void word_token::check_for_reserved_word(size_t length) {
 
 		code__ = TC_IDENTIFIER; // first assume it's an identifier
 
-		/* from the reserved word table, check to see if the word
-		 * is in there. */
-		token_code c_ = cx_reserved_words[this->string];
-		if (c_ > 0) code__ = c_;
+		if (length < 2) return;
 
+		/* a single probe into the reserved word table; the slot
+		 * holds the only reserved word that can hash there. */
+		const reserved_word &word = reserved_words[reserved_word_hash(this->string, length)];
+		if ((word.length == length)
+			&& (wmemcmp(word.string, this->string, length) == 0)) {
+			code__ = word.code;
+		}
 	}
 }
\ No newline at end of file
@@ -25,6 +25,7 @@ THE SOFTWARE.
 #ifndef TOKEN_H
 #define TOKEN_H
 #include <cstdint>
+#include "atom.h"
 #include "error.h"
 #include "buffer.h"
 #include "types.h"
@@ -128,8 +129,6 @@ namespace cx{
 		TC_CLASS
 	};
 
-	typedef std::map<std::wstring, token_code> token_map;
-
 	// tokens that can start a statement
 	extern const token_code tokenlist_statement_start[];
 	// tokens that can follow a statement
@@ -167,14 +166,46 @@ namespace cx{
 
 	bool token_in(token_code tc, const token_code *p_list);
 
-	typedef std::map<wchar_t, char_code> char_code_map;
-	extern char_code_map char_map;
+	/** ascii_char_codes      Character code of every 7-bit character,
+	 *                      indexed by the character itself.  Unlisted
+	 *                      characters scan as letters.
+	 */
+	constexpr char_code ascii_char_codes[128] = {
+		CC_WHITE_SPACE, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x00
+		CC_LETTER, CC_WHITE_SPACE, CC_WHITE_SPACE, CC_LETTER, CC_WHITE_SPACE, CC_WHITE_SPACE, CC_LETTER, CC_LETTER, // 0x08
+		CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x10
+		CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x18
+		CC_WHITE_SPACE, CC_SPECIAL, CC_DOUBLE_QUOTE, CC_SPECIAL, CC_LETTER, CC_SPECIAL, CC_SPECIAL, CC_QUOTE, // 0x20
+		CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, // 0x28
+		CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT, CC_DIGIT, // 0x30
+		CC_DIGIT, CC_DIGIT, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, // 0x38
+		CC_ERROR, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x40
+		CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x48
+		CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x50
+		CC_LETTER, CC_LETTER, CC_LETTER, CC_SPECIAL, CC_WHITE_SPACE, CC_SPECIAL, CC_SPECIAL, CC_LETTER, // 0x58
+		CC_ERROR, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x60
+		CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x68
+		CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, CC_LETTER, // 0x70
+		CC_LETTER, CC_LETTER, CC_LETTER, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_SPECIAL, CC_END_OF_FILE, // 0x78
+	};
+
+	/** char_code_of        Classify a source character.  7-bit
+	 *                      characters come straight from the table,
+	 *                      anything wider scans as a letter.
+	 *
+	 * @param ch : character to classify.
+	 * @return its character code.
+	 */
+	inline char_code char_code_of(wchar_t ch) {
+		return (static_cast<uint32_t>(ch) < 128) ? ascii_char_codes[ch] : CC_LETTER;
+	}
 
 	class token {
 	protected:
 		token_code code__;
 		type_code type__;
 		value value__;
+		atom_id atom__;
 		
 	public:
 		wchar_t string[MAX_INPUT_BUFFER_SIZE];
@@ -182,6 +213,7 @@ namespace cx{
 		token(void) {
 			code__ = TC_DUMMY;
 			type__ = T_DUMMY;;
+			atom__ = NO_ATOM;
 			memset(&value__, 0, sizeof value__);
 			memset(&string, 0, sizeof string);
 		}
@@ -189,6 +221,7 @@ namespace cx{
 		token_code code() const { return code__; }
 		type_code type() const { return type__; }
 		value value() const { return value__; }
+		atom_id atom() const { return atom__; } // identifiers only
 
 		wchar_t get_escape_char(const wchar_t &c);
 		virtual void get(text_in_buffer &buffer) = 0;
@@ -198,7 +231,7 @@ namespace cx{
 	///  word_token          Word token subclass of token.
 
 	class word_token : public token {
-		void check_for_reserved_word(void);
+		void check_for_reserved_word(size_t length);
 
 	public:
 		virtual void get(text_in_buffer &buffer);
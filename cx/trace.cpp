@@ -0,0 +1,754 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "cxvm.h"
+#include "optimizer.h"
+#include "tier.h"
+#include "trace.h"
+
+namespace cx {
+	namespace trace_settings {
+		bool tracing = false;
+		unsigned threshold = 50;
+	}
+
+	// Instructions only traces have, numbered after the VM's
+	enum trace_opcode {
+		GUARD_TRUE = ZEQ + 1,	// the recording found the condition true
+		GUARD_FALSE,			// ... and false
+		ENTER,					// bind an inlined call's parameters
+		LEAVE					// push an inlined call's result
+	};
+
+	/** trace_op        One instruction of a trace.  A guard pops its
+	 *                  condition, or the operands of the compare in
+	 *                  arg0 that was folded into it, and leaves the
+	 *                  trace at location when it differs from the
+	 *                  recording.  Anything else that leaves the
+	 *                  trace does so before it runs, at the
+	 *                  instruction it was recorded from.
+	 */
+	struct trace_op {
+		int op;
+		value arg0;
+		value arg1;
+		int location;
+		int frame;		// inlined call it runs in, -1 the loop's function
+	};
+
+	/** inline_frame    A call the recording went into.  Its result,
+	 *                  parameters and variables are bound to slots
+	 *                  of the trace instead of a VM of its own.
+	 */
+	struct inline_frame {
+		symbol_table_node *p_function_id;
+		const inst *p_code;		// the callee's code when recorded
+		int parent;				// frame of the caller
+		int return_location;	// instruction after the CALL
+		std::vector<value> slots;
+	};
+
+	/** loop_trace      The path one iteration of a hot loop took,
+	 *                  as straight line code from its head back to
+	 *                  its head.
+	 */
+	struct loop_trace {
+		std::vector<trace_op> ops;
+		std::vector<inline_frame> frames;
+		bool running = false;	// an activation is inside it
+		bool stale = false;		// a callee's code changed since recording
+		unsigned early_exits = 0;	// entries in a row that left in the first iteration
+	};
+
+	namespace trace {
+		const size_t max_length = 1000;	// instructions recorded before giving up
+		const int max_depth = 64;		// operand stack of a trace
+		const int max_frames = 16;		// calls inlined in one trace
+		const unsigned max_aborts = 3;	// recordings tried at one head
+		const unsigned max_early_exits = 16;	// before the loop is recorded again
+
+		enum step_result {
+			STEPPED,
+			UNSUPPORTED,
+			OUT_OF_BOUNDS
+		};
+
+		/** trace_state     Operands of the loop's function and of the
+		 *                  calls inlined in it, one stack with the
+		 *                  depth each inlined call starts at.
+		 */
+		struct trace_state {
+			value stack[max_depth];
+			value *sp;
+			size_t bases[max_frames];
+		};
+
+		/** trace_exit      Where a trace hands the activation back.
+		 */
+		struct trace_exit {
+			int frame;
+			int location;
+		};
+
+		/** running_trace   Marks a trace as entered while it lives.
+		 */
+		class running_trace {
+		public:
+			explicit running_trace(loop_trace &trace) : trace_(trace) { trace_.running = true; }
+			~running_trace() { trace_.running = false; }
+
+		private:
+			loop_trace &trace_;
+		};
+
+		// Stack ops
+#define _TPOP (--sp)
+#define _TPUSH (sp++)
+
+		// Value of the instruction's node
+#define _TVALUE ((symbol_table_node *)instruction.arg0.a_)->runstack_item
+
+		// The same test as the VM's _BOUNDS_CHECK, without the throw
+#define _TIN_BOUNDS(index) \
+	(!(((index) > ((symbol_table_node *)instruction.arg0.a_)->p_type->array.max_index) || ((index) < 0)))
+
+		/* Checked array access leaves the trace before it touches the
+		 * stack, the interpreter then throws for it. */
+#define _TALOAD(t_, type) { \
+	if (!_TIN_BOUNDS(sp[-1].i_)) return OUT_OF_BOUNDS; \
+	cx_int index = _TPOP->i_; \
+	void *mem = _TPOP->a_; \
+	_TPUSH->t_ = ((type *)mem)[index]; \
+}
+
+#define _TASTORE(t_, type) { \
+	if (!_TIN_BOUNDS(sp[-2].i_)) return OUT_OF_BOUNDS; \
+	type v_ = _TPOP->t_; \
+	cx_int index = _TPOP->i_; \
+	((type *)_TVALUE->a_)[index] = v_; \
+}
+
+#define _TALOAD_U(t_, type) { \
+	cx_int index = _TPOP->i_; \
+	void *mem = _TPOP->a_; \
+	_TPUSH->t_ = ((type *)mem)[index]; \
+}
+
+#define _TASTORE_U(t_, type) { \
+	type v_ = _TPOP->t_; \
+	cx_int index = _TPOP->i_; \
+	((type *)_TVALUE->a_)[index] = v_; \
+}
+
+#define _TALOAD_P(t_, type) { _TPUSH->t_ = *((type *)_TVALUE->a_); }
+#define _TASTORE_P(t_, type) { *((type *)_TVALUE->a_) = _TPOP->t_; }
+
+#define _TBIN_OP(t_, type, op) { \
+	type b = _TPOP->t_; \
+	type a = _TPOP->t_; \
+	_TPUSH->t_ = (a op b); \
+}
+
+#define _TREL_OP(t_, type, op) { \
+	type b = _TPOP->t_; \
+	type a = _TPOP->t_; \
+	_TPUSH->i_ = (a op b); \
+}
+
+#define _TCOMPARE(t_, type, op) { \
+	type b = _TPOP->t_; \
+	type a = _TPOP->t_; \
+	return a op b; \
+}
+
+		/** step        Run an instruction that has the same meaning in a
+		 *              trace as in cxvm::go.
+		 *
+		 * @param instruction : recorded, or from the function's code.
+		 * @param sp          : trace's stack pointer.
+		 * @return UNSUPPORTED for an instruction only the interpreter
+		 *         runs, OUT_OF_BOUNDS for a failed bounds check; the
+		 *         stack is untouched then.
+		 */
+		template <typename instruction_type>
+		static inline step_result step(const instruction_type &instruction, value *&sp) {
+			switch (static_cast<int>(instruction.op)) {
+			case AALOAD: _TPUSH->a_ = _TVALUE->a_; break;
+			case AASTORE: _TVALUE->a_ = _TPOP->a_; break;
+			case ACONST_NULL: _TPUSH->a_ = nullptr; break;
+			case AINC: _TVALUE->a_ = (char *)_TVALUE->a_ + instruction.arg1.i_; break;
+			case ALOAD: _TPUSH->a_ = _TVALUE->a_; break;
+			case APTR: _TVALUE->a_ = (char *)_TPOP->a_ + instruction.arg1.i_; break;
+			case B2I: _TPUSH->i_ = static_cast<cx_int> (_TPOP->b_); break;
+			case BALOAD: _TALOAD(b_, cx_byte); break;
+			case BALOAD_U: _TALOAD_U(b_, cx_byte); break;
+			case BALOAD_P: _TALOAD_P(b_, cx_byte); break;
+			case BASTORE: _TASTORE(b_, cx_byte); break;
+			case BASTORE_U: _TASTORE_U(b_, cx_byte); break;
+			case BASTORE_P: _TASTORE_P(b_, cx_byte); break;
+			case BEQ: _TREL_OP(b_, cx_byte, == ); break;
+			case C2I: _TPUSH->i_ = static_cast<cx_int> (_TPOP->c_); break;
+			case CALOAD: _TALOAD(c_, cx_char); break;
+			case CALOAD_U: _TALOAD_U(c_, cx_char); break;
+			case CALOAD_P: _TALOAD_P(c_, cx_char); break;
+			case CASTORE: _TASTORE(c_, cx_char); break;
+			case CASTORE_U: _TASTORE_U(c_, cx_char); break;
+			case CASTORE_P: _TASTORE_P(c_, cx_char); break;
+			case CHECKCAST: break;
+			case D2I: _TPUSH->i_ = static_cast<cx_int> (_TPOP->d_); break;
+			case DADD: _TBIN_OP(d_, cx_real, +); break;
+			case DALOAD: _TALOAD(d_, cx_real); break;
+			case DALOAD_U: _TALOAD_U(d_, cx_real); break;
+			case DALOAD_P: _TALOAD_P(d_, cx_real); break;
+			case DASTORE: _TASTORE(d_, cx_real); break;
+			case DASTORE_U: _TASTORE_U(d_, cx_real); break;
+			case DASTORE_P: _TASTORE_P(d_, cx_real); break;
+			case DCONST: _TPUSH->d_ = instruction.arg0.d_; break;
+			case DDIV: _TBIN_OP(d_, cx_real, / ); break;
+			case DEQ: _TREL_OP(d_, cx_real, == ); break;
+			case DGT: _TREL_OP(d_, cx_real, > ); break;
+			case DGT_EQ: _TREL_OP(d_, cx_real, >= ); break;
+			case DINC: _TVALUE->d_ += instruction.arg1.d_; break;
+			case DLOAD: _TPUSH->d_ = _TVALUE->d_; break;
+			case DLT: _TREL_OP(d_, cx_real, < ); break;
+			case DLT_EQ: _TREL_OP(d_, cx_real, <= ); break;
+			case DMUL: _TBIN_OP(d_, cx_real, *); break;
+			case DNEG: _TPUSH->d_ = -abs(_TPOP->d_); break;
+			case DNOT_EQ: _TREL_OP(d_, cx_real, != ); break;
+			case DPOS: _TPUSH->d_ = abs(_TPOP->d_); break;
+			case DREM: {
+				cx_real b = _TPOP->d_;
+				cx_real a = _TPOP->d_;
+				_TPUSH->d_ = fmod(a, b);
+			} break;
+			case DSTORE: _TVALUE->d_ = _TPOP->d_; break;
+			case DSUB: _TBIN_OP(d_, cx_real, -); break;
+			case I2B: _TPUSH->b_ = static_cast<cx_byte> (_TPOP->i_); break;
+			case I2C: _TPUSH->c_ = static_cast<cx_char> (_TPOP->i_); break;
+			case I2D: _TPUSH->d_ = static_cast<cx_real> (_TPOP->i_); break;
+			case IADD: _TBIN_OP(i_, cx_int, +); break;
+			case IALOAD: _TALOAD(i_, cx_int); break;
+			case IALOAD_U: _TALOAD_U(i_, cx_int); break;
+			case IALOAD_P: _TALOAD_P(i_, cx_int); break;
+			case IAND: _TBIN_OP(i_, cx_int, &); break;
+			case IASTORE: _TASTORE(i_, cx_int); break;
+			case IASTORE_U: _TASTORE_U(i_, cx_int); break;
+			case IASTORE_P: _TASTORE_P(i_, cx_int); break;
+			case ICONST: _TPUSH->i_ = instruction.arg0.i_; break;
+			case IDIV: _TBIN_OP(i_, cx_int, / ); break;
+			case IEQ: _TREL_OP(i_, cx_int, == ); break;
+			case IGT: _TREL_OP(i_, cx_int, > ); break;
+			case IGT_EQ: _TREL_OP(i_, cx_int, >= ); break;
+			case IINC: _TVALUE->i_ += instruction.arg1.i_; break;
+			case ILOAD: _TPUSH->i_ = _TVALUE->i_; break;
+			case ILT: _TREL_OP(i_, cx_int, < ); break;
+			case ILT_EQ: _TREL_OP(i_, cx_int, <= ); break;
+			case IMUL: _TBIN_OP(i_, cx_int, *); break;
+			case INEG: _TPUSH->i_ = -abs(_TPOP->i_); break;
+			case INOT: { cx_int a = _TPOP->i_; _TPUSH->i_ = ~a; } break;
+			case INOT_EQ: _TREL_OP(i_, cx_int, != ); break;
+			case IOR: _TBIN_OP(i_, cx_int, | ); break;
+			case IPOS: _TPUSH->i_ = abs(_TPOP->i_); break;
+			case IREM: _TBIN_OP(i_, cx_int, %); break;
+			case ISHL: _TBIN_OP(i_, cx_int, << ); break;
+			case ISHR: _TBIN_OP(i_, cx_int, >> ); break;
+			case ISTORE: _TVALUE->i_ = _TPOP->i_; break;
+			case ISUB: _TBIN_OP(i_, cx_int, -); break;
+			case IXOR: _TBIN_OP(i_, cx_int, ^); break;
+			case LOGIC_OR: _TBIN_OP(z_, cx_bool, || ); break;
+			case LOGIC_AND: _TBIN_OP(z_, cx_bool, &&); break;
+			case LOGIC_NOT: _TPUSH->z_ = !_TPOP->i_; break;
+			case NOP: break;
+			case PLOAD: _TPUSH->a_ = _TVALUE->a_; break;
+			case POP: _TPOP; break;
+			case POP2: _TPOP; _TPOP; break;
+			case ZEQ: _TREL_OP(z_, cx_bool, == ); break;
+			default: return UNSUPPORTED;
+			}
+
+			return STEPPED;
+		}
+
+		/** is_compare      A compare a guard can take in.
+		 *
+		 * @param op : opcode.
+		 * @return true if it is one.
+		 */
+		static bool is_compare(int op) {
+			switch (op) {
+			case DEQ: case DGT: case DGT_EQ: case DLT: case DLT_EQ: case DNOT_EQ:
+			case IEQ: case IGT: case IGT_EQ: case ILT: case ILT_EQ: case INOT_EQ:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/** condition       Pop what a guard tests.
+		 *
+		 * @param guard : GUARD_TRUE or GUARD_FALSE.
+		 * @param sp    : trace's stack pointer.
+		 * @return the condition.
+		 */
+		static inline bool condition(const trace_op &guard, value *&sp) {
+			switch (guard.arg0.i_) {
+			case DEQ: _TCOMPARE(d_, cx_real, == );
+			case DGT: _TCOMPARE(d_, cx_real, > );
+			case DGT_EQ: _TCOMPARE(d_, cx_real, >= );
+			case DLT: _TCOMPARE(d_, cx_real, < );
+			case DLT_EQ: _TCOMPARE(d_, cx_real, <= );
+			case DNOT_EQ: _TCOMPARE(d_, cx_real, != );
+			case IEQ: _TCOMPARE(i_, cx_int, == );
+			case IGT: _TCOMPARE(i_, cx_int, > );
+			case IGT_EQ: _TCOMPARE(i_, cx_int, >= );
+			case ILT: _TCOMPARE(i_, cx_int, < );
+			case ILT_EQ: _TCOMPARE(i_, cx_int, <= );
+			case INOT_EQ: _TCOMPARE(i_, cx_int, != );
+			default: return _TPOP->z_;
+			}
+		}
+
+		/** passes_value    True for a type cxvm::call copies by value.
+		 *
+		 * @param p_type : type of a parameter or result.
+		 * @return true if it is a scalar.
+		 */
+		static bool passes_value(const type_ptr &p_type) {
+			if (!p_type->is_scalar_type()) return false;
+
+			switch (p_type->typecode) {
+			case T_BOOLEAN: case T_BYTE: case T_CHAR: case T_DOUBLE: case T_INT:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/** returns_value   True if cxvm::call pushes a result for the
+		 *                  function.
+		 *
+		 * @param p_function_id : ptr to the function id's symbol table node.
+		 * @return true if it does.
+		 */
+		static bool returns_value(const symbol_table_node *p_function_id) {
+			switch (p_function_id->p_type->typecode) {
+			case T_BOOLEAN: case T_BYTE: case T_CHAR: case T_DOUBLE: case T_INT: case T_REFERENCE:
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/** inlinable       Can the recording go into a call.  The
+		 *                  callee needs compiled code that takes and
+		 *                  returns plain values, and must not be
+		 *                  running in the trace already.
+		 *
+		 * @param trace         : trace being recorded.
+		 * @param frame         : frame of the CALL.
+		 * @param p_function_id : the loop's function.
+		 * @param p_callee      : function called.
+		 * @return true if it can be inlined.
+		 */
+		static bool inlinable(const loop_trace &trace, int frame,
+			const symbol_table_node *p_function_id, const symbol_table_node *p_callee) {
+			auto &routine = p_callee->defined.routine;
+
+			if ((p_callee->defined.defined_how != DC_FUNCTION) || (routine.p_lazy_body != nullptr)) return false;
+			if (static_cast<int>(trace.frames.size()) >= max_frames) return false;
+			if ((p_callee->p_type->typecode != T_VOID) && !passes_value(p_callee->p_type)) return false;
+
+			for (auto &p_parameter : routine.p_parameter_ids) {
+				if (!passes_value(p_parameter->p_type)) return false;
+			}
+
+			if (p_callee == p_function_id) return false;
+			for (; frame >= 0; frame = trace.frames[frame].parent) {
+				if (trace.frames[frame].p_function_id == p_callee) return false;
+			}
+
+			return true;
+		}
+
+		/** enter       Bind an inlined call the way cxvm::call and
+		 *              enter_function do, popping its arguments.
+		 *
+		 * @param trace : trace.
+		 * @param op    : ENTER.
+		 * @param state : trace's stacks.
+		 */
+		static void enter(loop_trace &trace, const trace_op &op, trace_state &state) {
+			inline_frame &callee = trace.frames[op.arg1.i_];
+			auto &routine = callee.p_function_id->defined.routine;
+			value *p_slot = callee.slots.data();
+
+			callee.p_function_id->runstack_item = p_slot;
+			(p_slot++)->a_ = nullptr;
+
+			for (auto parameter = routine.p_parameter_ids.rbegin(); parameter != routine.p_parameter_ids.rend(); ++parameter) {
+				(*parameter)->runstack_item = p_slot;
+				*(p_slot++) = *(--state.sp);
+			}
+
+			for (auto &local : routine.p_variable_ids) local->runstack_item = p_slot++;
+
+			state.bases[op.arg1.i_] = state.sp - state.stack;
+		}
+
+		/** leave       Drop an inlined call's operands and push its
+		 *              result.
+		 *
+		 * @param trace : trace.
+		 * @param op    : LEAVE.
+		 * @param state : trace's stacks.
+		 */
+		static void leave(const loop_trace &trace, const trace_op &op, trace_state &state) {
+			const symbol_table_node *p_callee = trace.frames[op.arg1.i_].p_function_id;
+
+			state.sp = state.stack + state.bases[op.arg1.i_];
+			if (returns_value(p_callee)) *(state.sp++) = *p_callee->runstack_item;
+		}
+
+		/** call        Call a function the trace does not go into,
+		 *              on the VM of the loop's function.
+		 *
+		 * @param vm       : VM of the loop's function.
+		 * @param p_callee : function called.
+		 * @param state    : trace's stacks.
+		 */
+		static void call(cxvm *vm, symbol_table_node *p_callee, trace_state &state) {
+			const size_t count = p_callee->defined.routine.p_parameter_ids.size();
+
+			state.sp -= count;
+			for (size_t i = 0; i < count; ++i) *vm->push() = state.sp[i];
+
+			vm->call(p_callee);
+
+			if (returns_value(p_callee)) *(state.sp++) = *vm->pop();
+		}
+
+		/** code_of     Code a frame of the trace runs.
+		 *
+		 * @param trace         : trace.
+		 * @param p_function_id : the loop's function.
+		 * @param frame         : frame.
+		 * @return its program.
+		 */
+		static const program &code_of(const loop_trace &trace, const symbol_table_node *p_function_id, int frame) {
+			if (frame < 0) return p_function_id->defined.routine.program_code;
+			return trace.frames[frame].p_function_id->defined.routine.program_code;
+		}
+
+		/** record      Run one iteration of the loop at head on the
+		 *              trace's stack, appending what it runs to the
+		 *              trace.  Jumps are dropped and each branch
+		 *              becomes a guard on the way it went; calls that
+		 *              can be are run inline.
+		 *
+		 * @param vm            : VM of the loop's function.
+		 * @param p_function_id : the loop's function.
+		 * @param head          : location of the loop's head.
+		 * @param trace         : trace to record.
+		 * @param state         : trace's stacks.
+		 * @param stop          : where the recording stopped.
+		 * @return true if it came back to head, false if it gave up
+		 *         at stop, which has not run.
+		 */
+		static bool record(cxvm *vm, symbol_table_node *p_function_id, int head,
+			loop_trace &trace, trace_state &state, trace_exit &stop) {
+			value *&sp = state.sp;
+			int frame = -1;
+			int location = head;
+
+			for (;;) {
+				const program &code = code_of(trace, p_function_id, frame);
+				stop = { frame, location };
+
+				if ((trace.ops.size() >= max_length) || (sp - state.stack > max_depth - 4)) return false;
+
+				const bool returning = (location >= static_cast<int>(code.size())) || (code[location].op == RETURN);
+				if (returning) {
+					if (frame < 0) return false;
+
+					const inline_frame &callee = trace.frames[frame];
+					trace_op op = { LEAVE, value(), value(frame), location, frame };
+					trace.ops.push_back(op);
+					leave(trace, op, state);
+
+					location = callee.return_location;
+					frame = callee.parent;
+					continue;
+				}
+
+				const inst &instruction = code[location];
+				trace_op op = { instruction.op, instruction.arg0, instruction.arg1, location, frame };
+
+				switch (instruction.op) {
+				case NOP:
+					++location;
+					break;
+				case GOTO: {
+					const int target = optimizer::jump_target(instruction);
+					if (target > location) {
+						location = target;
+						break;
+					}
+
+					// only the loop's own back edge closes the trace
+					return (frame < 0) && (target == head) && (sp == state.stack) && !trace.ops.empty();
+				}
+				case IF_FALSE: {
+					const int target = optimizer::jump_target(instruction);
+					if (target <= location) return false;
+
+					const bool taken = !_TPOP->z_;
+					op.op = taken ? GUARD_FALSE : GUARD_TRUE;
+					op.arg0.i_ = NOP;
+					op.location = taken ? location + 1 : target;
+					trace.ops.push_back(op);
+
+					location = taken ? target : location + 1;
+				} break;
+				case CALL: {
+					symbol_table_node *p_callee = (symbol_table_node *)instruction.arg0.a_;
+
+					if (inlinable(trace, frame, p_function_id, p_callee)) {
+						auto &routine = p_callee->defined.routine;
+
+						inline_frame callee;
+						callee.p_function_id = p_callee;
+						callee.p_code = routine.program_code.data();
+						callee.parent = frame;
+						callee.return_location = location + 1;
+						callee.slots.resize(1 + routine.p_parameter_ids.size() + routine.p_variable_ids.size());
+						trace.frames.push_back(callee);
+
+						op.op = ENTER;
+						op.arg1.i_ = static_cast<cx_int>(trace.frames.size() - 1);
+						trace.ops.push_back(op);
+						enter(trace, op, state);
+
+						frame = op.arg1.i_;
+						location = 0;
+						break;
+					}
+
+					// a call out of an inlined one would run on the wrong VM
+					if (frame >= 0) return false;
+
+					trace.ops.push_back(op);
+					call(vm, p_callee, state);
+					++location;
+				} break;
+				default:
+					if (step(instruction, sp) != STEPPED) return false;
+
+					trace.ops.push_back(op);
+					++location;
+				}
+			}
+		}
+
+		/** optimize    Clean up a recorded trace, now that it is
+		 *              straight line code: a compare only a guard
+		 *              reads is folded into the guard, and a guard on
+		 *              a constant, which can't fail, goes with it.
+		 *
+		 * @param trace : trace.
+		 */
+		static void optimize(loop_trace &trace) {
+			std::vector<trace_op> ops;
+			ops.reserve(trace.ops.size());
+
+			for (const trace_op &op : trace.ops) {
+				const bool guard = (op.op == GUARD_TRUE) || (op.op == GUARD_FALSE);
+
+				if (guard && !ops.empty() && (ops.back().frame == op.frame)) {
+					if (ops.back().op == ICONST) {
+						ops.pop_back();
+						continue;
+					}
+
+					if (is_compare(ops.back().op)) {
+						const int compare = ops.back().op;
+						ops.back() = op;
+						ops.back().arg0.i_ = compare;
+						continue;
+					}
+				}
+
+				ops.push_back(op);
+			}
+
+			trace.ops.swap(ops);
+		}
+
+		/** run         Run a trace over and over until something in
+		 *              it has to leave.  Leaving before the first
+		 *              iteration is done is counted: the loop may have
+		 *              gone another way for good.
+		 *
+		 * @param vm    : VM of the loop's function.
+		 * @param trace : trace.
+		 * @param state : trace's stacks.
+		 * @return where it left.
+		 */
+		static trace_exit run(cxvm *vm, loop_trace &trace, trace_state &state) {
+			value *&sp = state.sp;
+
+			for (bool looped = false;; looped = true) {
+				for (const trace_op &op : trace.ops) {
+					bool leaving = false;
+
+					switch (op.op) {
+					case GUARD_TRUE:
+					case GUARD_FALSE:
+						leaving = condition(op, sp) != (op.op == GUARD_TRUE);
+						break;
+					case ENTER: {
+						const inline_frame &callee = trace.frames[op.arg1.i_];
+
+						// -tier installed other code in the callee, call it instead
+						if (callee.p_code != callee.p_function_id->defined.routine.program_code.data()) {
+							trace.stale = true;
+							leaving = true;
+						}
+						else {
+							enter(trace, op, state);
+						}
+					} break;
+					case LEAVE:
+						leave(trace, op, state);
+						break;
+					case CALL:
+						call(vm, (symbol_table_node *)op.arg0.a_, state);
+						break;
+					default:
+						leaving = step(op, sp) != STEPPED;
+					}
+
+					if (leaving) {
+						trace.early_exits = looped ? 0 : trace.early_exits + 1;
+						return{ op.frame, op.location };
+					}
+				}
+			}
+		}
+
+		/** side_exit   Hand the activation back to the interpreter.
+		 *              Inlined calls still running go on on VMs of
+		 *              their own, innermost first, each result pushed
+		 *              for its caller; then the operands left are
+		 *              pushed for the loop's function.
+		 *
+		 * @param vm    : VM of the loop's function.
+		 * @param trace : trace.
+		 * @param state : trace's stacks.
+		 * @param stop  : where the trace left.
+		 * @return location the loop's function goes on at.
+		 */
+		static int side_exit(cxvm *vm, const loop_trace &trace, trace_state &state, trace_exit stop) {
+			value *sp = state.sp;
+
+			while (stop.frame >= 0) {
+				const inline_frame &callee = trace.frames[stop.frame];
+				value *base = state.stack + state.bases[stop.frame];
+
+				std::shared_ptr<cxvm> cx = std::make_shared<cxvm>();
+				for (value *p = base; p < sp; ++p) *cx->push() = *p;
+				cx->resume(callee.p_function_id, stop.location);
+
+				sp = base;
+				if (returns_value(callee.p_function_id)) *(sp++) = *callee.p_function_id->runstack_item;
+
+				stop = { callee.parent, callee.return_location };
+			}
+
+			for (value *p = state.stack; p < sp; ++p) *vm->push() = *p;
+
+			return stop.location;
+		}
+
+		int back_edge(cxvm *vm, symbol_table_node *p_function_id, int head) {
+			auto &routine = p_function_id->defined.routine;
+			if (routine.p_trace_cache == nullptr) routine.p_trace_cache = std::make_shared<trace_cache>();
+
+			std::shared_ptr<trace_cache> p_cache = routine.p_trace_cache;
+
+			// -tier installed new code, the heads were for the old
+			if (p_cache->p_code != routine.program_code.data()) {
+				p_cache->heads.clear();
+				p_cache->p_code = routine.program_code.data();
+			}
+
+			loop_head &loop = p_cache->heads[head];
+			std::shared_ptr<loop_trace> p_trace = loop.p_trace;
+
+			if ((p_trace != nullptr) && !p_trace->running &&
+				(p_trace->stale || (p_trace->early_exits >= max_early_exits))) {
+				loop.p_trace.reset();
+				loop.back_edges = 0;
+				return -1;
+			}
+
+			if (p_trace == nullptr) {
+				if ((loop.aborts >= max_aborts) || (++loop.back_edges < trace_settings::threshold)) return -1;
+				p_trace = std::make_shared<loop_trace>();
+			}
+			else if (p_trace->running) {
+				// recursion came back into the loop, it runs interpreted
+				return -1;
+			}
+
+			running_trace running(*p_trace);
+			trace_state state;
+			state.sp = state.stack;
+
+			if (loop.p_trace == nullptr) {
+				trace_exit stop;
+
+				if (!record(vm, p_function_id, head, *p_trace, state, stop)) {
+					++loop.aborts;
+					loop.back_edges = 0;
+					return side_exit(vm, *p_trace, state, stop);
+				}
+
+				optimize(*p_trace);
+				loop.p_trace = p_trace;
+
+				if (vm_settings::dev_debug_flag) {
+					std::wcout << p_function_id->node_name << L" loop at " << head << L" traced: "
+						<< p_trace->ops.size() << L" instructions, " << p_trace->frames.size()
+						<< L" calls inlined" << std::endl;
+				}
+			}
+
+			return side_exit(vm, *p_trace, state, run(vm, *p_trace, state));
+		}
+	}
+}
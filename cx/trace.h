@@ -0,0 +1,69 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <memory>
+#include <unordered_map>
+#include "symtab.h"
+
+namespace cx {
+	class cxvm;
+	struct loop_trace;
+
+	namespace trace_settings {
+		extern bool tracing;		// -trace: record hot loop paths
+		extern unsigned threshold;	// back edges before a loop is hot
+	}
+
+	/** loop_head       Back edges seen at the head of a loop, and
+	 *                  the trace recorded through it once it's hot.
+	 */
+	struct loop_head {
+		unsigned back_edges = 0;
+		unsigned aborts = 0;		// recordings that did not close the loop
+		std::shared_ptr<loop_trace> p_trace;
+	};
+
+	/** trace_cache     A function's loop heads, by location.  It is
+	 *                  kept for one program: when -tier installs new
+	 *                  code in the function it starts over.
+	 */
+	struct trace_cache {
+		const inst *p_code = nullptr;
+		std::unordered_map<int, loop_head> heads;
+	};
+
+	namespace trace {
+		/* Count a back edge to head in an activation running on vm.  A
+		 * hot loop is recorded and then run as its trace until a guard
+		 * fails; the location to go on interpreting at is returned, or
+		 * -1 to take the back edge as usual. */
+		int back_edge(cxvm *vm, symbol_table_node *p_function_id, int head);
+	}
+}
+
+#endif
@@ -105,62 +105,65 @@ namespace cx{
 	 */
 	void initialize_builtin_types(symbol_table_ptr &p_symtab) {
 
-		symbol_table_node_ptr p_integer_id = p_symtab->enter(L"int", DC_TYPE);
-		symbol_table_node_ptr p_byte_id = p_symtab->enter(L"byte", DC_TYPE);
-		symbol_table_node_ptr p_double_id = p_symtab->enter(L"real", DC_TYPE);
-		symbol_table_node_ptr p_reference_id = p_symtab->enter(L"object", DC_TYPE);
-		symbol_table_node_ptr p_boolean_id = p_symtab->enter(L"bool", DC_TYPE);
-		symbol_table_node_ptr p_char_id = p_symtab->enter(L"char", DC_TYPE);
-		symbol_table_node_ptr p_false_id = p_symtab->enter(L"false", DC_CONSTANT);
-		symbol_table_node_ptr p_true_id = p_symtab->enter(L"true", DC_CONSTANT);
-		symbol_table_node_ptr p_void_id = p_symtab->enter(L"void", DC_TYPE);
+		symbol_table_node_ptr p_integer_id = p_symtab->enter(cx_atoms.intern(L"int"), DC_TYPE);
+		symbol_table_node_ptr p_byte_id = p_symtab->enter(cx_atoms.intern(L"byte"), DC_TYPE);
+		symbol_table_node_ptr p_double_id = p_symtab->enter(cx_atoms.intern(L"real"), DC_TYPE);
+		symbol_table_node_ptr p_reference_id = p_symtab->enter(cx_atoms.intern(L"object"), DC_TYPE);
+		symbol_table_node_ptr p_boolean_id = p_symtab->enter(cx_atoms.intern(L"bool"), DC_TYPE);
+		symbol_table_node_ptr p_char_id = p_symtab->enter(cx_atoms.intern(L"char"), DC_TYPE);
+		symbol_table_node_ptr p_false_id = p_symtab->enter(cx_atoms.intern(L"false"), DC_CONSTANT);
+		symbol_table_node_ptr p_true_id = p_symtab->enter(cx_atoms.intern(L"true"), DC_CONSTANT);
+		symbol_table_node_ptr p_void_id = p_symtab->enter(cx_atoms.intern(L"void"), DC_TYPE);
 
 		// Only used for functions with no return value.
 		if (p_void_type == nullptr) {
 			p_void_type = std::make_shared<cx_type>(F_SCALAR, T_VOID, 0, p_void_id, p_std_type_members);
 			p_void_type->p_type_id = p_void_id;
-			p_void_id->p_type = p_void_type;
 		}
 
 		if (p_integer_type == nullptr) {
 			p_integer_type = std::make_shared<cx_type>(F_SCALAR, T_INT, sizeof(cx_int), p_integer_id, p_std_type_members);
 			p_integer_type->p_type_id = p_integer_id;
-			p_integer_id->p_type = p_integer_type;
 		}
 
 		if (p_byte_type == nullptr) {
 			p_byte_type = std::make_shared<cx_type>(F_SCALAR, T_BYTE, sizeof(uint8_t), p_byte_id, p_std_type_members);
 			p_byte_type->p_type_id = p_byte_id;
-			p_byte_id->p_type = p_byte_type;
 		}
 
 		if (p_double_type == nullptr) {
 			p_double_type = std::make_shared<cx_type>(F_SCALAR, T_DOUBLE, sizeof(cx_real), p_double_id, p_std_type_members);
 			p_double_type->p_type_id = p_double_id;
-			p_double_id->p_type = p_double_type;
 		}
 
 		if (p_boolean_type == nullptr) {
 			p_boolean_type = std::make_shared<cx_type>(F_SCALAR, T_BOOLEAN, sizeof(bool), p_boolean_id, p_std_type_members);
 			p_boolean_type->p_type_id = p_boolean_id;
-			p_boolean_id->p_type = p_boolean_type;
-			p_false_id->p_type = p_boolean_type;
-			p_true_id->p_type = p_boolean_type;
-			p_false_id->defined.constant_value.z_ = false;
-			p_true_id->defined.constant_value.z_ = true;
 		}
 
 		if (p_char_type == nullptr) {
 			p_char_type = std::make_shared<cx_type>(F_SCALAR, T_CHAR, sizeof(wchar_t), p_char_id, p_std_type_members);
 			p_char_type->p_type_id = p_char_id;
-			p_char_id->p_type = p_char_type;
 		}
 
 		if (p_reference_type == nullptr) {
 			p_reference_type = std::make_shared<cx_type>(F_REFERENCE, T_REFERENCE, sizeof(uintptr_t), p_reference_id, p_std_type_members);
-			p_reference_id->p_type = p_reference_type;
 		}
 
+		/* The types are made once and shared, every global table
+		 * (a module has its own) binds its identifiers to them. */
+		p_void_id->p_type = p_void_type;
+		p_integer_id->p_type = p_integer_type;
+		p_byte_id->p_type = p_byte_type;
+		p_double_id->p_type = p_double_type;
+		p_boolean_id->p_type = p_boolean_type;
+		p_char_id->p_type = p_char_type;
+		p_reference_id->p_type = p_reference_type;
+		p_false_id->p_type = p_boolean_type;
+		p_true_id->p_type = p_boolean_type;
+		p_false_id->defined.constant_value.z_ = false;
+		p_true_id->defined.constant_value.z_ = true;
+
 		//init_std_members();
 
 		if (p_dummy_type == nullptr){
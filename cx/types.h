@@ -36,7 +36,11 @@ THE SOFTWARE.
 namespace cx {
 
 	typedef long long cx_int;
+#ifdef __CX_REAL_DOUBLE__
+	typedef double cx_real;		// Fast mode: IEEE double, SSE friendly
+#else
 	typedef long double cx_real;
+#endif
 	typedef bool cx_bool;
 	typedef wchar_t cx_char;
 	typedef uint8_t cx_byte;
@@ -0,0 +1,363 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <iostream>
+#include <set>
+#include <vector>
+#include "cxvm.h"
+#include "optimizer.h"
+#include "verify.h"
+
+namespace cx {
+	/** slot_kind       What an operand stack entry holds.  The
+	 *                  numbers (z_, b_, c_, i_ and d_) are one kind:
+	 *                  the compiler mixes them in places, an int
+	 *                  added with dadd, which gives wrong arithmetic
+	 *                  but can't hurt the VM.  An address is only
+	 *                  ever made by an address instruction.
+	 */
+	enum slot_kind : uint8_t {
+		K_NUMBER,
+		K_ADDRESS,
+		K_ANY		// paths disagree, only a pop takes it
+	};
+
+	typedef std::vector<slot_kind> stack_state;
+
+	// the program whose variables are the globals functions may use
+	static const symbol_table_node *p_globals_program = nullptr;
+
+	/** kind_of         Operand kind of a value of a type, as call
+	 *                  passes it.
+	 *
+	 * @param p_type : type.
+	 * @return its kind.
+	 */
+	static slot_kind kind_of(const cx_type *p_type) {
+		return ((p_type->typecode == T_REFERENCE) || !p_type->is_scalar_type()) ? K_ADDRESS : K_NUMBER;
+	}
+
+	/** slot_kind_for   Kind of value an instruction loads from or
+	 *                  stores to its slot.  The array instructions
+	 *                  index, bound or step through the address the
+	 *                  slot holds.
+	 *
+	 * @param op : opcode with a node operand, not CALL.
+	 * @return the kind.
+	 */
+	static slot_kind slot_kind_for(opcode op) {
+		switch (op) {
+		case DINC: case DLOAD: case DSTORE: case IINC: case ILOAD: case ISTORE:
+			return K_NUMBER;
+		default:
+			return K_ADDRESS;
+		}
+	}
+
+	/** operand_kinds   What an instruction pops and pushes.
+	 *
+	 * @param instruction : instruction, its operands checked already.
+	 * @param pops        : kinds popped, the top of the stack last.
+	 * @param pushes      : kinds pushed.
+	 * @return false for opcodes the VM doesn't run.
+	 */
+	static bool operand_kinds(const inst &instruction, stack_state &pops, stack_state &pushes) {
+		pops.clear();
+		pushes.clear();
+
+		switch (instruction.op) {
+		case AALOAD: case ACONST_NULL: case ALOAD: case PLOAD:
+			pushes = { K_ADDRESS }; return true;
+		case DCONST: case DLOAD: case ICONST: case ILOAD:
+		case BALOAD_P: case CALOAD_P: case DALOAD_P: case IALOAD_P:
+			pushes = { K_NUMBER }; return true;
+		case AASTORE: case APTR: case ASTORE:
+			pops = { K_ADDRESS }; return true;
+		case DSTORE: case ISTORE: case IF_FALSE:
+		case BASTORE_P: case CASTORE_P: case DASTORE_P: case IASTORE_P:
+			pops = { K_NUMBER }; return true;
+		case POP:
+			pops = { K_ANY }; return true;
+		case POP2:
+			pops = { K_ANY, K_ANY }; return true;
+		case BASTORE: case BASTORE_U: case CASTORE: case CASTORE_U:
+		case DASTORE: case DASTORE_U: case IASTORE: case IASTORE_U:
+			pops = { K_NUMBER, K_NUMBER }; return true;
+		case BALOAD: case BALOAD_U: case CALOAD: case CALOAD_U:
+		case DALOAD: case DALOAD_U: case IALOAD: case IALOAD_U:
+			pops = { K_ADDRESS, K_NUMBER }; pushes = { K_NUMBER }; return true;
+		case B2I: case C2I: case D2I: case I2B: case I2C: case I2D:
+		case DNEG: case DPOS: case INEG: case IPOS: case INOT: case LOGIC_NOT:
+			pops = { K_NUMBER }; pushes = { K_NUMBER }; return true;
+		case NEWARRAY:
+			pops = { K_NUMBER }; pushes = { K_ADDRESS }; return true;
+		case BEQ: case DADD: case DDIV: case DEQ: case DGT: case DGT_EQ: case DLT:
+		case DLT_EQ: case DMUL: case DNOT_EQ: case DREM: case DSUB:
+		case IADD: case IAND: case IDIV: case IEQ: case IGT: case IGT_EQ:
+		case ILT: case ILT_EQ: case IMUL: case INOT_EQ: case IOR: case IREM: case ISHL:
+		case ISHR: case ISUB: case IXOR: case LOGIC_OR: case LOGIC_AND: case ZEQ:
+			pops = { K_NUMBER, K_NUMBER }; pushes = { K_NUMBER }; return true;
+		case CALL: {
+			const symbol_table_node *p_callee = static_cast<const symbol_table_node *>(instruction.arg0.a_);
+
+			for (auto &p_parameter : p_callee->defined.routine.p_parameter_ids) pops.push_back(kind_of(p_parameter->p_type.get()));
+			if (p_callee->p_type->typecode != T_VOID) pushes = { kind_of(p_callee->p_type.get()) };
+		} return true;
+		case AINC: case CHECKCAST: case DEL: case DINC: case GOTO: case IINC: case NOP: case RETURN: case VLOOP:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	/** check_operand   Check what arg0 of an instruction points to,
+	 *                  and that its slot holds what the instruction
+	 *                  loads or stores.
+	 *
+	 * @param instruction : instruction.
+	 * @param slots       : nodes the function may load and store.
+	 * @return nullptr, or why it is bad.
+	 */
+	static const char *check_operand(const inst &instruction, const std::set<const symbol_table_node *> &slots) {
+		if (instruction.op == NEWARRAY) return (instruction.arg0.a_ == nullptr) ? "missing array type" : nullptr;
+		if (optimizer::arg0_kind(instruction.op) != optimizer::OPERAND_NODE) return nullptr;
+
+		const symbol_table_node *p_node = static_cast<const symbol_table_node *>(instruction.arg0.a_);
+		if (p_node == nullptr) return "missing operand";
+
+		if (instruction.op == CALL) {
+			if ((p_node->defined.defined_how != DC_FUNCTION) || (p_node->p_type == nullptr)) return "call of something not a function";
+
+			for (auto &p_parameter : p_node->defined.routine.p_parameter_ids) {
+				if ((p_parameter == nullptr) || (p_parameter->p_type == nullptr)) return "call of a function with a bad parameter";
+			}
+			return nullptr;
+		}
+
+		if (slots.count(p_node) == 0) return "slot outside the function";
+		if (p_node->p_type == nullptr) return "slot without a type";
+
+		// an address is only ever made from a slot declared to hold one
+		return (kind_of(p_node->p_type.get()) == slot_kind_for(instruction.op)) ? nullptr : "slot of the wrong kind";
+	}
+
+	/** merge           Join the stack a path brings to an instruction
+	 *                  with the one already there.
+	 *
+	 * @param at      : stack at the instruction, empty if unreached.
+	 * @param reached : whether it was reached before.
+	 * @param stack   : stack coming in.
+	 * @return -1 if the depths differ, 1 if at changed, else 0.
+	 */
+	static int merge(stack_state &at, bool &reached, const stack_state &stack) {
+		if (!reached) {
+			reached = true;
+			at = stack;
+			return 1;
+		}
+
+		if (at.size() != stack.size()) return -1;
+
+		int changed = 0;
+		for (size_t i = 0; i < at.size(); ++i) {
+			if ((at[i] != stack[i]) && (at[i] != K_ANY)) {
+				at[i] = K_ANY;
+				changed = 1;
+			}
+		}
+
+		return changed;
+	}
+
+	/** failure         Why a function failed, by instruction.
+	 *
+	 * @param code : function's code.
+	 * @param pc   : instruction at fault.
+	 * @param what : what is wrong with it.
+	 * @return reason text.
+	 */
+	static std::string failure(const program &code, int pc, const char *what) {
+		std::wstring name = (static_cast<unsigned>(code[pc].op) <= ZEQ) ? opcode_string[code[pc].op] : L"?";
+		return std::string(name.begin(), name.end()) + " at " + std::to_string(pc) + ": " + what;
+	}
+
+	namespace verifier {
+		bool verify(const symbol_table_node *p_function_id, std::string &reason) {
+			const auto &routine = p_function_id->defined.routine;
+			const program &code = routine.program_code;
+			const int size = static_cast<int>(code.size());
+
+			// its result, parameters and variables, then the globals
+			std::set<const symbol_table_node *> slots = { p_function_id };
+			for (auto &p_parameter : routine.p_parameter_ids) slots.insert(p_parameter.get());
+			for (auto &p_variable : routine.p_variable_ids) slots.insert(p_variable.get());
+
+			if (p_globals_program != nullptr) {
+				slots.insert(p_globals_program);
+				for (auto &p_variable : p_globals_program->defined.routine.p_variable_ids) slots.insert(p_variable.get());
+			}
+
+			std::vector<stack_state> state(size + 1);
+			std::vector<bool> reached(size + 1, false);
+			std::vector<int> work;
+			stack_state pops, pushes;
+			size_t max_depth = 0;
+
+			auto reach = [&](int index, const stack_state &stack) -> bool {
+				bool was_reached = reached[index];
+				const int changed = merge(state[index], was_reached, stack);
+				reached[index] = was_reached;
+
+				if (changed > 0) work.push_back(index);
+				return changed >= 0;
+			};
+
+			if (size > 0) reach(0, stack_state());
+
+			while (!work.empty()) {
+				const int pc = work.back();
+				work.pop_back();
+
+				// falling off the end returns
+				if (pc == size) continue;
+
+				const inst &instruction = code[pc];
+				if (static_cast<unsigned>(instruction.op) > ZEQ) {
+					reason = failure(code, pc, "unknown opcode");
+					return false;
+				}
+
+				const char *p_bad = check_operand(instruction, slots);
+				if (p_bad != nullptr) {
+					reason = failure(code, pc, p_bad);
+					return false;
+				}
+
+				if (!operand_kinds(instruction, pops, pushes)) {
+					reason = failure(code, pc, "opcode the VM doesn't run");
+					return false;
+				}
+
+				stack_state stack = state[pc];
+				if (stack.size() < pops.size()) {
+					reason = failure(code, pc, "stack underflow");
+					return false;
+				}
+
+				for (size_t i = pops.size(); i-- > 0;) {
+					const slot_kind kind = stack.back();
+					stack.pop_back();
+
+					if ((pops[i] != K_ANY) && (kind != pops[i])) {
+						reason = failure(code, pc, "operand of the wrong kind");
+						return false;
+					}
+				}
+
+				stack.insert(stack.end(), pushes.begin(), pushes.end());
+				if (stack.size() > max_depth) max_depth = stack.size();
+
+				if (optimizer::is_jump(instruction.op)) {
+					const cx_int location = instruction.arg0.i_;
+
+					// only GOTO takes a location <= 0, to the start
+					if ((location > size) || ((instruction.op != GOTO) && (location < 1))) {
+						reason = failure(code, pc, "jump outside the code");
+						return false;
+					}
+
+					if (!reach(optimizer::jump_target(instruction), stack)) {
+						reason = failure(code, pc, "stack depth differs where paths join");
+						return false;
+					}
+				}
+
+				if ((instruction.op != GOTO) && (instruction.op != RETURN) && !reach(pc + 1, stack)) {
+					reason = failure(code, pc, "stack depth differs where paths join");
+					return false;
+				}
+			}
+
+			// cxvm keeps the result, parameters, variables and operands on one stack
+			const size_t frame_size = 1 + routine.p_parameter_ids.size() + routine.p_variable_ids.size() + max_depth;
+			if (frame_size > _STACK_SIZE) {
+				reason = "frame of " + std::to_string(frame_size) + " values overflows the stack";
+				return false;
+			}
+
+			return true;
+		}
+
+		bool verify_program(symbol_table_node *p_program_id, std::string &reason) {
+			p_globals_program = p_program_id;
+
+			std::vector<symbol_table_node *> routines = { p_program_id };
+			std::set<symbol_table_node *> seen = { p_program_id };
+			bool all_trusted = true;
+
+			for (size_t i = 0; i < routines.size(); ++i) {
+				auto &routine = routines[i]->defined.routine;
+				std::string why;
+
+				routine.p_verified_code = routine.program_code.data();
+				routine.trusted = verify(routines[i], why);
+
+				if (!routine.trusted && all_trusted) {
+					reason = std::string(routines[i]->node_name.begin(), routines[i]->node_name.end()) + ": " + why;
+					all_trusted = false;
+				}
+
+				for (auto &instruction : routine.program_code) {
+					if (instruction.op != CALL) continue;
+
+					symbol_table_node *p_callee = static_cast<symbol_table_node *>(instruction.arg0.a_);
+					if ((p_callee != nullptr) && (p_callee->defined.defined_how == DC_FUNCTION) &&
+						seen.insert(p_callee).second) routines.push_back(p_callee);
+				}
+			}
+
+			return all_trusted;
+		}
+
+		bool trusted(symbol_table_node *p_function_id) {
+			auto &routine = p_function_id->defined.routine;
+
+			// lazy bodies and -tier/-profile-in rewrites bring new code
+			if (routine.p_verified_code != routine.program_code.data()) {
+				std::string reason;
+
+				routine.p_verified_code = routine.program_code.data();
+				routine.trusted = verify(p_function_id, reason);
+
+				if (!routine.trusted && vm_settings::dev_debug_flag) {
+					std::wcerr << L"[ verifier  ]--> " << p_function_id->node_name << L": "
+						<< std::wstring(reason.begin(), reason.end()) << std::endl;
+				}
+			}
+
+			return routine.trusted;
+		}
+	}
+}
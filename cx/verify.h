@@ -0,0 +1,46 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Aaron Hebert <aaron.hebert@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <string>
+#include "symtab.h"
+
+namespace cx {
+	namespace verifier {
+		/* Check a function's code: every opcode runs in the VM, the
+		 * operand stack has one depth and kind of value at each
+		 * instruction, jumps land inside the code and slots belong to
+		 * the function or the program.  Why it failed is put in reason. */
+		bool verify(const symbol_table_node *p_function_id, std::string &reason);
+		// Verify the program and every function it calls, false if any failed
+		bool verify_program(symbol_table_node *p_program_id, std::string &reason);
+		// True if a function's code passed, verifying it first if it changed
+		bool trusted(symbol_table_node *p_function_id);
+	}
+}
+
+#endif